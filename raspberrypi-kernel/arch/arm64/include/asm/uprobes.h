@@ -28,6 +28,8 @@ struct arch_uprobe {
 	};
 	struct arch_probe_insn api;
 	bool simulate;
+	/* returns false to fall back to stepping out of line */
+	bool (*emulate)(u32 insn, struct pt_regs *regs);
 };
 
 #endif
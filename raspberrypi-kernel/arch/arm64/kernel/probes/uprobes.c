@@ -4,6 +4,7 @@
  */
 #include <linux/highmem.h>
 #include <linux/ptrace.h>
+#include <linux/uaccess.h>
 #include <linux/uprobes.h>
 #include <asm/cacheflush.h>
 
@@ -31,6 +32,101 @@ unsigned long uprobe_get_swbp_addr(struct pt_regs *regs)
 	return instruction_pointer(regs);
 }
 
+#define UPROBE_STP_X_PRE_MASK	0xffc003e0	/* stp xt, xt2, [sp, #imm]! */
+#define UPROBE_STP_X_PRE_VAL	0xa98003e0
+#define UPROBE_STP_X_OFF_MASK	0xffc003e0	/* stp xt, xt2, [sp, #imm] */
+#define UPROBE_STP_X_OFF_VAL	0xa90003e0
+#define UPROBE_ADD_X_IMM_MASK	0xbf800000	/* add/sub xd|sp, xn|sp, #imm */
+#define UPROBE_ADD_X_IMM_VAL	0x91000000
+#define UPROBE_MOV_X_MASK	0xffe0ffe0	/* mov xd, xm */
+#define UPROBE_MOV_X_VAL	0xaa0003e0
+
+/* Register 31 is sp here, unlike pt_regs_read_reg() */
+static unsigned long uprobe_read_reg_sp(struct pt_regs *regs, int r)
+{
+	return r == 31 ? regs->sp : regs->regs[r];
+}
+
+static bool uprobe_emulate_nop(u32 insn, struct pt_regs *regs)
+{
+	instruction_pointer_set(regs, instruction_pointer(regs) + 4);
+	return true;
+}
+
+static bool uprobe_emulate_mov(u32 insn, struct pt_regs *regs)
+{
+	int xd = insn & 0x1f, xm = (insn >> 16) & 0x1f;
+
+	pt_regs_write_reg(regs, xd, pt_regs_read_reg(regs, xm));
+	instruction_pointer_set(regs, instruction_pointer(regs) + 4);
+	return true;
+}
+
+static bool uprobe_emulate_add_sub_imm(u32 insn, struct pt_regs *regs)
+{
+	int xd = insn & 0x1f, xn = (insn >> 5) & 0x1f;
+	unsigned long imm = (insn >> 10) & 0xfff;
+	unsigned long val;
+
+	if (insn & BIT(22))
+		imm <<= 12;
+
+	val = uprobe_read_reg_sp(regs, xn);
+	val = (insn & BIT(30)) ? val - imm : val + imm;
+
+	if (xd == 31)
+		regs->sp = val;
+	else
+		regs->regs[xd] = val;
+	instruction_pointer_set(regs, instruction_pointer(regs) + 4);
+	return true;
+}
+
+static bool uprobe_emulate_stp(u32 insn, struct pt_regs *regs)
+{
+	int xt = insn & 0x1f, xt2 = (insn >> 10) & 0x1f;
+	long offset = sign_extend64((insn >> 15) & 0x7f, 6) * 8;
+	unsigned long addr = regs->sp + offset;
+	u64 pair[2];
+
+	/*
+	 * A misaligned sp or an unmapped stack is left for the stepped
+	 * instruction to fault on, so that the task gets the right signal.
+	 */
+	if (!IS_ALIGNED(regs->sp, 16))
+		return false;
+
+	pair[0] = pt_regs_read_reg(regs, xt);
+	pair[1] = pt_regs_read_reg(regs, xt2);
+	if (copy_to_user((void __user *)addr, pair, sizeof(pair)))
+		return false;
+
+	if ((insn & UPROBE_STP_X_PRE_MASK) == UPROBE_STP_X_PRE_VAL)
+		regs->sp = addr;
+	instruction_pointer_set(regs, instruction_pointer(regs) + 4);
+	return true;
+}
+
+/*
+ * The instructions that open most functions, and the nops of USDT probe
+ * sites, are emulated so that a hit costs only the breakpoint trap and
+ * not another one for stepping the instruction out of line.
+ */
+static bool (*uprobe_decode_emulate(u32 insn))(u32, struct pt_regs *)
+{
+	if (insn == aarch64_insn_gen_nop())
+		return uprobe_emulate_nop;
+	if ((insn & UPROBE_STP_X_PRE_MASK) == UPROBE_STP_X_PRE_VAL ||
+	    (insn & UPROBE_STP_X_OFF_MASK) == UPROBE_STP_X_OFF_VAL)
+		return uprobe_emulate_stp;
+	if ((insn & UPROBE_ADD_X_IMM_MASK) == UPROBE_ADD_X_IMM_VAL)
+		return uprobe_emulate_add_sub_imm;
+	if ((insn & UPROBE_MOV_X_MASK) == UPROBE_MOV_X_VAL)
+		return uprobe_emulate_mov;
+
+	return NULL;
+}
+
 int arch_uprobe_analyze_insn(struct arch_uprobe *auprobe, struct mm_struct *mm,
 		unsigned long addr)
 {
@@ -53,6 +149,7 @@ int arch_uprobe_analyze_insn(struct arch_uprobe *auprobe, struct mm_struct *mm,
 		break;
 
 	default:
+		auprobe->emulate = uprobe_decode_emulate(insn);
 		break;
 	}
 
@@ -105,10 +202,14 @@ bool arch_uprobe_skip_sstep(struct arch_uprobe *auprobe, struct pt_regs *regs)
 	probe_opcode_t insn;
 	unsigned long addr;
 
+	insn = *(probe_opcode_t *)(&auprobe->insn[0]);
+
+	if (auprobe->emulate)
+		return auprobe->emulate(insn, regs);
+
 	if (!auprobe->simulate)
 		return false;
 
-	insn = *(probe_opcode_t *)(&auprobe->insn[0]);
 	addr = instruction_pointer(regs);
 
 	if (auprobe->api.handler)
@@ -44,6 +44,12 @@ struct arch_uprobe {
 			u8	reg_offset;	/* to the start of pt_regs */
 			u8	ilen;
 		}			push;
+		struct {
+			u8	src_offset;	/* to the start of pt_regs */
+			u8	dst_offset;
+			u8	ilen;
+			u8	size;		/* 0 for a nop */
+		}			mov;
 	};
 };
 
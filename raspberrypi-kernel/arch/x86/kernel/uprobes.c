@@ -670,6 +670,20 @@ static bool push_emulate_op(struct arch_uprobe *auprobe, struct pt_regs *regs)
 	return true;
 }
 
+static bool mov_emulate_op(struct arch_uprobe *auprobe, struct pt_regs *regs)
+{
+	unsigned long *src_ptr = (void *)regs + auprobe->mov.src_offset;
+	unsigned long *dst_ptr = (void *)regs + auprobe->mov.dst_offset;
+
+	/* a 32-bit destination is zero extended, as the cpu would do */
+	if (auprobe->mov.size == 4)
+		*dst_ptr = (u32)*src_ptr;
+	else if (auprobe->mov.size)
+		*dst_ptr = *src_ptr;
+	regs->ip += auprobe->mov.ilen;
+	return true;
+}
+
 static int branch_post_xol_op(struct arch_uprobe *auprobe, struct pt_regs *regs)
 {
 	BUG_ON(!branch_is_call(auprobe));
@@ -712,6 +726,10 @@ static const struct uprobe_xol_ops push_xol_ops = {
 	.emulate  = push_emulate_op,
 };
 
+static const struct uprobe_xol_ops mov_xol_ops = {
+	.emulate  = mov_emulate_op,
+};
+
 /* Returns -ENOSYS if branch_xol_ops doesn't handle this insn */
 static int branch_setup_xol_ops(struct arch_uprobe *auprobe, struct insn *insn)
 {
@@ -842,6 +860,84 @@ static int push_setup_xol_ops(struct arch_uprobe *auprobe, struct insn *insn)
 	return 0;
 }
 
+static const u8 mov_reg_offsets[] = {
+	offsetof(struct pt_regs, ax),
+	offsetof(struct pt_regs, cx),
+	offsetof(struct pt_regs, dx),
+	offsetof(struct pt_regs, bx),
+	offsetof(struct pt_regs, sp),
+	offsetof(struct pt_regs, bp),
+	offsetof(struct pt_regs, si),
+	offsetof(struct pt_regs, di),
+#ifdef CONFIG_X86_64
+	offsetof(struct pt_regs, r8),
+	offsetof(struct pt_regs, r9),
+	offsetof(struct pt_regs, r10),
+	offsetof(struct pt_regs, r11),
+	offsetof(struct pt_regs, r12),
+	offsetof(struct pt_regs, r13),
+	offsetof(struct pt_regs, r14),
+	offsetof(struct pt_regs, r15),
+#endif
+};
+
+/*
+ * Returns -ENOSYS if mov_xol_ops doesn't handle this insn. Besides the
+ * register to register moves of function prologues like "mov %rsp,%rbp",
+ * this covers the multi-byte nops and endbr that compilers pad with.
+ */
+static int mov_setup_xol_ops(struct arch_uprobe *auprobe, struct insn *insn)
+{
+	u8 opc1 = OPCODE1(insn), modrm = insn->modrm.value, rex = 0;
+	unsigned int reg, rm;
+
+	if (opc1 == 0x0f && insn->opcode.nbytes == 2) {
+		switch (OPCODE2(insn)) {
+		case 0x1f:	/* nopw/nopl */
+			if (MODRM_REG(insn) != 0)
+				return -ENOSYS;
+			break;
+		case 0x1e:	/* endbr32/endbr64, nops without user IBT */
+			if (modrm != 0xfa && modrm != 0xfb)
+				return -ENOSYS;
+			break;
+		default:
+			return -ENOSYS;
+		}
+		auprobe->mov.size = 0;
+		goto out;
+	}
+
+	if (opc1 != 0x89 && opc1 != 0x8b)
+		return -ENOSYS;
+
+	/* only register operands, and no operand size or segment prefix */
+	if (X86_MODRM_MOD(modrm) != 3 || insn->prefixes.nbytes)
+		return -ENOSYS;
+
+	if (insn->rex_prefix.nbytes)
+		rex = insn->rex_prefix.bytes[0];
+
+	reg = X86_MODRM_REG(modrm) + (X86_REX_R(rex) ? 8 : 0);
+	rm = X86_MODRM_RM(modrm) + (X86_REX_B(rex) ? 8 : 0);
+	if (reg >= ARRAY_SIZE(mov_reg_offsets) ||
+	    rm >= ARRAY_SIZE(mov_reg_offsets))
+		return -ENOSYS;
+
+	if (opc1 == 0x89) {	/* mov reg, r/m */
+		auprobe->mov.src_offset = mov_reg_offsets[reg];
+		auprobe->mov.dst_offset = mov_reg_offsets[rm];
+	} else {		/* mov r/m, reg */
+		auprobe->mov.src_offset = mov_reg_offsets[rm];
+		auprobe->mov.dst_offset = mov_reg_offsets[reg];
+	}
+	auprobe->mov.size = X86_REX_W(rex) ? 8 : 4;
+out:
+	auprobe->mov.ilen = insn->length;
+	auprobe->ops = &mov_xol_ops;
+	return 0;
+}
+
 /**
  * arch_uprobe_analyze_insn - instruction analysis including validity and fixups.
  * @auprobe: the probepoint information.
@@ -867,6 +963,10 @@ int arch_uprobe_analyze_insn(struct arch_uprobe *auprobe, struct mm_struct *mm,
 	if (ret != -ENOSYS)
 		return ret;
 
+	ret = mov_setup_xol_ops(auprobe, &insn);
+	if (ret != -ENOSYS)
+		return ret;
+
 	/*
 	 * Figure out which fixups default_post_xol_op() will need to perform,
 	 * and annotate defparam->fixups accordingly.
@@ -68,6 +68,7 @@ void blk_free_queue_stats(struct blk_queue_stats *);
 void blk_stat_add(struct request *rq, u64 now);
 
 /* record time/size info in request but not add a callback */
+void blk_stat_disable_accounting(struct request_queue *q);
 void blk_stat_enable_accounting(struct request_queue *q);
 
 /**
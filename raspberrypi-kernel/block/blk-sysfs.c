@@ -788,6 +788,9 @@ static void blk_release_queue(struct kobject *kobj)
 		blk_stat_remove_callback(q, q->poll_cb);
 	blk_stat_free_callback(q->poll_cb);
 
+	/* the latency histograms use q->stats */
+	blk_trace_shutdown(q);
+
 	blk_free_queue_stats(q->stats);
 
 	if (queue_is_mq(q)) {
@@ -807,7 +810,6 @@ static void blk_release_queue(struct kobject *kobj)
 	if (queue_is_mq(q))
 		blk_mq_release(q);
 
-	blk_trace_shutdown(q);
 	mutex_lock(&q->debugfs_mutex);
 	debugfs_remove_recursive(q->debugfs_dir);
 	mutex_unlock(&q->debugfs_mutex);
@@ -887,6 +889,7 @@ int blk_register_queue(struct gendisk *disk)
 	mutex_lock(&q->debugfs_mutex);
 	q->debugfs_dir = debugfs_create_dir(kobject_name(q->kobj.parent),
 					    blk_debugfs_root);
+	blk_trace_register_latency(q);
 	mutex_unlock(&q->debugfs_mutex);
 
 	if (queue_is_mq(q)) {
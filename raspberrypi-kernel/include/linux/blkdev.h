@@ -33,6 +33,7 @@ struct scsi_ioctl_command;
 struct request_queue;
 struct elevator_queue;
 struct blk_trace;
+struct blk_lat_hist;
 struct request;
 struct sg_io_hdr;
 struct bsg_job;
@@ -533,6 +534,7 @@ struct request_queue {
 	struct mutex		debugfs_mutex;
 #ifdef CONFIG_BLK_DEV_IO_TRACE
 	struct blk_trace __rcu	*blk_trace;
+	struct blk_lat_hist __rcu *blk_lat;
 #endif
 	/*
 	 * for flush operations
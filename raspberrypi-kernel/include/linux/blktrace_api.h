@@ -33,6 +33,7 @@ struct blkcg;
 
 extern int blk_trace_ioctl(struct block_device *, unsigned, char __user *);
 extern void blk_trace_shutdown(struct request_queue *);
+extern void blk_trace_register_latency(struct request_queue *);
 extern __printf(3, 4)
 void __trace_note_message(struct blk_trace *, struct blkcg *blkcg, const char *fmt, ...);
 
@@ -90,6 +91,7 @@ extern struct attribute_group blk_trace_attr_group;
 #else /* !CONFIG_BLK_DEV_IO_TRACE */
 # define blk_trace_ioctl(bdev, cmd, arg)		(-ENOTTY)
 # define blk_trace_shutdown(q)				do { } while (0)
+# define blk_trace_register_latency(q)			do { } while (0)
 # define blk_add_driver_data(q, rq, data, len)		do {} while (0)
 # define blk_trace_setup(q, name, dev, bdev, arg)	(-ENOTTY)
 # define blk_trace_startstop(q, start)			(-ENOTTY)
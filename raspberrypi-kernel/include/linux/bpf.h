@@ -36,6 +36,7 @@ struct seq_operations;
 struct bpf_iter_aux_info;
 struct bpf_local_storage;
 struct bpf_local_storage_map;
+struct ctl_table;
 
 extern struct idr btf_idr;
 extern spinlock_t btf_idr_lock;
@@ -86,6 +87,7 @@ struct bpf_map_ops {
 	u32 (*map_fd_sys_lookup_elem)(void *ptr);
 	void (*map_seq_show_elem)(struct bpf_map *map, void *key,
 				  struct seq_file *m);
+	void (*map_show_fdinfo)(const struct bpf_map *map, struct seq_file *m);
 	int (*map_check_btf)(const struct bpf_map *map,
 			     const struct btf *btf,
 			     const struct btf_type *key_type,
@@ -159,11 +161,12 @@ struct bpf_map {
 	u32 btf_value_type_id;
 	struct btf *btf;
 	struct bpf_map_memory memory;
+	u64 map_extra; /* any per-map-type extra fields */
 	char name[BPF_OBJ_NAME_LEN];
 	u32 btf_vmlinux_value_type_id;
 	bool bypass_spec_v1;
 	bool frozen; /* write-once; write-protected by freeze_mutex */
-	/* 22 bytes hole */
+	/* 10 bytes hole */
 
 	/* The 3rd and 4th cacheline with misc members to avoid false sharing
 	 * particularly with refcounting.
@@ -536,6 +539,11 @@ struct bpf_tramp_progs {
 	int nr_progs;
 };
 
+/* BPF_F_MULTI_FUNC programs see this many u64 arguments, fexit programs
+ * find the return value right after them.
+ */
+#define BPF_MULTI_FUNC_ARGS 6
+
 /* Different use cases for BPF trampoline:
  * 1. replace nop at the function entry (kprobe equivalent)
  *    flags = BPF_TRAMP_F_RESTORE_REGS
@@ -604,12 +612,23 @@ struct bpf_trampoline {
 	struct hlist_head progs_hlist[BPF_TRAMP_MAX];
 	/* Number of attached programs. A counter per kind. */
 	int progs_cnt[BPF_TRAMP_MAX];
+	/* BPF_F_MULTI_FUNC programs, linked through bpf_tramp_node */
+	struct hlist_head multi_hlist[BPF_TRAMP_MAX];
+	int multi_cnt[BPF_TRAMP_MAX];
 	/* Executable image of trampoline */
 	void *image;
 	u64 selector;
 	struct bpf_ksym ksym;
 };
 
+/* A BPF_F_MULTI_FUNC program is attached to many trampolines at once, so it
+ * is linked into each of them with one of these instead of aux->tramp_hlist.
+ */
+struct bpf_tramp_node {
+	struct hlist_node hlist;
+	struct bpf_prog *prog;
+};
+
 struct bpf_attach_target_info {
 	struct btf_func_model fmodel;
 	long tgt_addr;
@@ -649,6 +668,12 @@ int bpf_trampoline_unlink_prog(struct bpf_prog *prog, struct bpf_trampoline *tr)
 struct bpf_trampoline *bpf_trampoline_get(u64 key,
 					  struct bpf_attach_target_info *tgt_info);
 void bpf_trampoline_put(struct bpf_trampoline *tr);
+int bpf_trampoline_multi_link(struct bpf_prog *prog,
+			      struct bpf_trampoline **trs,
+			      struct bpf_tramp_node *nodes, u32 cnt);
+void bpf_trampoline_multi_unlink(struct bpf_trampoline **trs,
+				 struct bpf_tramp_node *nodes, u32 cnt);
+void bpf_trampoline_put_many(struct bpf_trampoline **trs, u32 cnt);
 #define BPF_DISPATCHER_INIT(_name) {				\
 	.mutex = __MUTEX_INITIALIZER(_name.mutex),		\
 	.func = &_name##_func,					\
@@ -687,6 +712,8 @@ void bpf_dispatcher_change_prog(struct bpf_dispatcher *d, struct bpf_prog *from,
 				struct bpf_prog *to);
 /* Called only from JIT-enabled code, so there's no need for stubs. */
 void *bpf_jit_alloc_exec_page(void);
+int bpf_jit_charge_modmem(u32 pages);
+void bpf_jit_uncharge_modmem(u32 pages);
 void bpf_image_ksym_add(void *data, struct bpf_ksym *ksym);
 void bpf_image_ksym_del(struct bpf_ksym *ksym);
 void bpf_ksym_add(struct bpf_ksym *ksym);
@@ -708,6 +735,18 @@ static inline struct bpf_trampoline *bpf_trampoline_get(u64 key,
 	return ERR_PTR(-EOPNOTSUPP);
 }
 static inline void bpf_trampoline_put(struct bpf_trampoline *tr) {}
+static inline int bpf_trampoline_multi_link(struct bpf_prog *prog,
+					    struct bpf_trampoline **trs,
+					    struct bpf_tramp_node *nodes,
+					    u32 cnt)
+{
+	return -ENOTSUPP;
+}
+static inline void bpf_trampoline_multi_unlink(struct bpf_trampoline **trs,
+					       struct bpf_tramp_node *nodes,
+					       u32 cnt) {}
+static inline void bpf_trampoline_put_many(struct bpf_trampoline **trs,
+					   u32 cnt) {}
 #define DEFINE_BPF_DISPATCHER(name)
 #define DECLARE_BPF_DISPATCHER(name)
 #define BPF_DISPATCHER_FUNC(name) bpf_dispatcher_nop_func
@@ -768,6 +807,7 @@ struct bpf_prog_aux {
 	u32 ctx_arg_info_size;
 	u32 max_rdonly_access;
 	u32 max_rdwr_access;
+	u32 verified_insns;
 	const struct bpf_ctx_arg_aux *ctx_arg_info;
 	struct mutex dst_mutex; /* protects dst_* pointers below, *after* prog becomes visible */
 	struct bpf_prog *dst_prog;
@@ -779,6 +819,7 @@ struct bpf_prog_aux {
 	bool attach_btf_trace; /* true if attaching to BTF-enabled raw tp */
 	bool func_proto_unreliable;
 	bool sleepable;
+	bool multi_func; /* BPF_F_MULTI_FUNC, attached through tracing_multi links */
 	bool tail_call_reachable;
 	enum bpf_tramp_prog_type trampoline_prog_type;
 	struct hlist_node tramp_hlist;
@@ -1239,6 +1280,12 @@ struct bpf_prog *bpf_prog_get_curr_or_next(u32 *id);
 
 extern int sysctl_unprivileged_bpf_disabled;
 
+#ifdef CONFIG_BPF_VERIFIER_CACHE
+extern int sysctl_bpf_verifier_cache_kb;
+int bpf_verifier_cache_handler(struct ctl_table *table, int write,
+			       void *buffer, size_t *lenp, loff_t *ppos);
+#endif
+
 static inline bool bpf_allow_ptr_leaks(void)
 {
 	return perfmon_capable();
@@ -328,10 +328,17 @@ struct bpf_insn_aux_data {
 	bool prune_point;
 };
 
+#define BPF_MAP_PTR_UNPRIV	1UL
+#define BPF_MAP_PTR_POISON	((void *)((0xeB9FUL << 1) +	\
+					  POISON_POINTER_DELTA))
+#define BPF_MAP_PTR(X)		((struct bpf_map *)((X) & ~BPF_MAP_PTR_UNPRIV))
+
 #define MAX_USED_MAPS 64 /* max number of maps accessed by one eBPF program */
 
 #define BPF_VERIFIER_TMP_LOG_SIZE	1024
 
+#define BPF_VCACHE_DIGEST_SIZE		32
+
 struct bpf_verifier_log {
 	u32 level;
 	char kbuf[BPF_VERIFIER_TMP_LOG_SIZE];
@@ -423,6 +430,11 @@ struct bpf_verifier_env {
 	u32 peak_states;
 	/* longest register parentage chain walked for liveness marking */
 	u32 longest_mark_read_walk;
+	/* verification result cache key, see verifier_cache.c */
+	u8 vcache_digest[BPF_VCACHE_DIGEST_SIZE];
+	/* used_maps whose frozen contents are part of the key */
+	u64 vcache_rdonly_maps;
+	bool vcache_usable;
 };
 
 __printf(2, 0) void bpf_verifier_vlog(struct bpf_verifier_log *log,
@@ -457,6 +469,25 @@ bpf_prog_offload_remove_insns(struct bpf_verifier_env *env, u32 off, u32 cnt);
 int check_ctx_reg(struct bpf_verifier_env *env,
 		  const struct bpf_reg_state *reg, int regno);
 
+#ifdef CONFIG_BPF_VERIFIER_CACHE
+void bpf_vcache_prepare(struct bpf_verifier_env *env);
+bool bpf_vcache_restore(struct bpf_verifier_env *env);
+void bpf_vcache_store(struct bpf_verifier_env *env);
+#else
+static inline void bpf_vcache_prepare(struct bpf_verifier_env *env)
+{
+}
+
+static inline bool bpf_vcache_restore(struct bpf_verifier_env *env)
+{
+	return false;
+}
+
+static inline void bpf_vcache_store(struct bpf_verifier_env *env)
+{
+}
+#endif
+
 /* this lives here instead of in bpf.h because it needs to dereference tgt_prog */
 static inline u64 bpf_trampoline_compute_key(const struct bpf_prog *tgt_prog,
 					     u32 btf_id)
@@ -469,5 +500,8 @@ int bpf_check_attach_target(struct bpf_verifier_log *log,
 			    const struct bpf_prog *tgt_prog,
 			    u32 btf_id,
 			    struct bpf_attach_target_info *tgt_info);
+int bpf_check_attach_multi(struct bpf_verifier_log *log,
+			   const u32 *btf_ids, u32 cnt,
+			   struct bpf_attach_target_info *tgt_info);
 
 #endif /* _LINUX_BPF_VERIFIER_H */
@@ -3,12 +3,34 @@
 
 #include <linux/mmdebug.h>
 
+#ifdef CONFIG_PER_VMA_LOCK
+#define MMAP_LOCK_INITIALIZER(name) \
+	.mmap_lock = __RWSEM_INITIALIZER((name).mmap_lock), \
+	.mm_lock_seq = 0,
+
+/*
+ * Releases the write locks of all the VMAs that were write-locked since
+ * mmap_lock was taken for write.
+ */
+static inline void vma_end_write_all(struct mm_struct *mm)
+{
+	lockdep_assert_held_write(&mm->mmap_lock);
+	/* Pairs with the READ_ONCE() in vma_start_read(). */
+	WRITE_ONCE(mm->mm_lock_seq, mm->mm_lock_seq + 1);
+}
+#else
 #define MMAP_LOCK_INITIALIZER(name) \
 	.mmap_lock = __RWSEM_INITIALIZER((name).mmap_lock),
 
+static inline void vma_end_write_all(struct mm_struct *mm) {}
+#endif
+
 static inline void mmap_init_lock(struct mm_struct *mm)
 {
 	init_rwsem(&mm->mmap_lock);
+#ifdef CONFIG_PER_VMA_LOCK
+	mm->mm_lock_seq = 0;
+#endif
 }
 
 static inline void mmap_write_lock(struct mm_struct *mm)
@@ -33,11 +55,13 @@ static inline bool mmap_write_trylock(struct mm_struct *mm)
 
 static inline void mmap_write_unlock(struct mm_struct *mm)
 {
+	vma_end_write_all(mm);
 	up_write(&mm->mmap_lock);
 }
 
 static inline void mmap_write_downgrade(struct mm_struct *mm)
 {
+	vma_end_write_all(mm);
 	downgrade_write(&mm->mmap_lock);
 }
 
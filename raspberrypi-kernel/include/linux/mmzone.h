@@ -274,6 +274,59 @@ enum lruvec_flags {
 					 */
 };
 
+#ifdef CONFIG_LRU_GEN
+
+/*
+ * The multi-gen LRU sorts the pages of an lruvec into generations by when
+ * they were last found accessed. A generation is identified by a sequence
+ * number: max_seq is the youngest generation and min_seq[] the oldest one
+ * of anon and file pages. A page on the multi-gen LRU stores seq %
+ * MAX_NR_GENS + 1 in page->flags (LRU_GEN_MASK).
+ *
+ * The aging walks the page tables of the processes of the lruvec's memcg,
+ * moves the pages that were accessed into max_seq and then opens a new
+ * generation. The eviction reclaims from min_seq and retires it once it
+ * is empty. Eviction needs more than MIN_NR_GENS generations so that the
+ * pages found accessed always have a younger generation to go to.
+ *
+ * The two youngest generations count as active, and the others as
+ * inactive, in the LRU sizes that the rest of mm looks at.
+ */
+#define MIN_NR_GENS		2U
+#define MAX_NR_GENS		4U
+
+enum {
+	LRU_GEN_ANON,
+	LRU_GEN_FILE,
+};
+
+struct lru_gen_struct {
+	/* the youngest generation */
+	unsigned long max_seq;
+	/* the oldest generation of anon and file pages */
+	unsigned long min_seq[ANON_AND_FILE];
+	/* when each generation was opened, in jiffies */
+	unsigned long timestamps[MAX_NR_GENS];
+	/* the pages of each generation, by type and zone */
+	struct list_head lists[MAX_NR_GENS][ANON_AND_FILE][MAX_NR_ZONES];
+	/* the number of pages on each of the lists above */
+	long nr_pages[MAX_NR_GENS][ANON_AND_FILE][MAX_NR_ZONES];
+	/* whether new pages of this lruvec go on the lists above */
+	bool enabled;
+	/* whether a page table walk is aging this lruvec */
+	bool aging;
+};
+
+void lru_gen_init_lruvec(struct lruvec *lruvec);
+
+#else /* !CONFIG_LRU_GEN */
+
+static inline void lru_gen_init_lruvec(struct lruvec *lruvec)
+{
+}
+
+#endif /* CONFIG_LRU_GEN */
+
 struct lruvec {
 	struct list_head		lists[NR_LRU_LISTS];
 	/*
@@ -289,6 +342,9 @@ struct lruvec {
 	unsigned long			refaults[ANON_AND_FILE];
 	/* Various lruvec state flags (enum lruvec_flags) */
 	unsigned long			flags;
+#ifdef CONFIG_LRU_GEN
+	struct lru_gen_struct		lrugen;
+#endif
 #ifdef CONFIG_MEMCG
 	struct pglist_data *pgdat;
 #endif
@@ -112,6 +112,13 @@
 #define SLAB_KASAN		0
 #endif
 
+/* Cache allocations and frees in per cpu sheaves */
+#ifdef CONFIG_SLUB_SHEAVES
+# define SLAB_SHEAVES		((slab_flags_t __force)0x20000000U)
+#else
+# define SLAB_SHEAVES		0
+#endif
+
 /* The following flags affect the page allocator grouping pages by mobility */
 /* Objects are reclaimable */
 #define SLAB_RECLAIM_ACCOUNT	((slab_flags_t __force)0x00020000U)
@@ -154,6 +161,9 @@ struct kmem_cache *kmem_cache_create_usercopy(const char *name,
 			void (*ctor)(void *));
 void kmem_cache_destroy(struct kmem_cache *);
 int kmem_cache_shrink(struct kmem_cache *);
+#ifdef CONFIG_SLUB_SHEAVES
+int kmem_cache_set_sheaf_capacity(struct kmem_cache *s, unsigned int capacity);
+#endif
 
 /*
  * Please use this macro to create slab caches. Simply specify the
@@ -37,6 +37,10 @@ enum stat_item {
 	CPU_PARTIAL_FREE,	/* Refill cpu partial on free */
 	CPU_PARTIAL_NODE,	/* Refill cpu partial from node partial */
 	CPU_PARTIAL_DRAIN,	/* Drain cpu partial to node partial */
+	SHEAF_ALLOC,		/* Allocation from cpu sheaf */
+	SHEAF_FREE,		/* Free to cpu sheaf */
+	SHEAF_REFILL,		/* Refill cpu sheaf from cpu slab freelist */
+	SHEAF_FLUSH,		/* Flush of a full cpu sheaf to the slabs */
 	NR_SLUB_STAT_ITEMS };
 
 struct kmem_cache_cpu {
@@ -68,6 +72,20 @@ struct kmem_cache_cpu {
 #define slub_percpu_partial_read_once(c)	NULL
 #endif // CONFIG_SLUB_CPU_PARTIAL
 
+#ifdef CONFIG_SLUB_SHEAVES
+#define SLUB_SHEAF_MAX	64
+
+/*
+ * Per cpu array of free objects in front of the slabs. Objects may come
+ * from any slab of the cache, which lets a cpu reuse objects that other
+ * cpus allocated without going back to their slabs.
+ */
+struct slub_sheaf {
+	unsigned int size;	/* Number of objects in the sheaf */
+	void *objects[SLUB_SHEAF_MAX];
+};
+#endif
+
 /*
  * Word size structure that can be atomically updated or read and that
  * contains both the order and the number of objects that a slab of the
@@ -92,6 +110,11 @@ struct kmem_cache {
 #ifdef CONFIG_SLUB_CPU_PARTIAL
 	/* Number of per cpu partial objects to keep around */
 	unsigned int cpu_partial;
+#endif
+#ifdef CONFIG_SLUB_SHEAVES
+	struct slub_sheaf __percpu *cpu_sheaf;
+	/* Objects a sheaf holds before it is flushed, 0 if disabled */
+	unsigned int sheaf_capacity;
 #endif
 	struct kmem_cache_order_objects oo;
 
@@ -352,6 +352,7 @@ trace_get_fields(struct trace_event_call *event_call)
 
 struct trace_array;
 struct trace_subsystem_dir;
+struct event_sample;
 
 enum {
 	EVENT_FILE_FL_ENABLED_BIT,
@@ -365,6 +366,7 @@ enum {
 	EVENT_FILE_FL_TRIGGER_COND_BIT,
 	EVENT_FILE_FL_PID_FILTER_BIT,
 	EVENT_FILE_FL_WAS_ENABLED_BIT,
+	EVENT_FILE_FL_SAMPLE_BIT,
 };
 
 extern struct trace_event_file *trace_get_event_file(const char *instance,
@@ -503,6 +505,8 @@ extern int __kprobe_event_add_fields(struct dynevent_cmd *cmd, ...);
  *  TRIGGER_COND  - When set, one or more triggers has an associated filter
  *  PID_FILTER    - When set, the event is filtered based on pid
  *  WAS_ENABLED   - Set when enabled to know to clear trace on module removal
+ *  SAMPLE        - When set, the event is sampled and/or rate limited
+ *                   before it is reserved in the ring buffer
  */
 enum {
 	EVENT_FILE_FL_ENABLED		= (1 << EVENT_FILE_FL_ENABLED_BIT),
@@ -516,12 +520,14 @@ enum {
 	EVENT_FILE_FL_TRIGGER_COND	= (1 << EVENT_FILE_FL_TRIGGER_COND_BIT),
 	EVENT_FILE_FL_PID_FILTER	= (1 << EVENT_FILE_FL_PID_FILTER_BIT),
 	EVENT_FILE_FL_WAS_ENABLED	= (1 << EVENT_FILE_FL_WAS_ENABLED_BIT),
+	EVENT_FILE_FL_SAMPLE		= (1 << EVENT_FILE_FL_SAMPLE_BIT),
 };
 
 struct trace_event_file {
 	struct list_head		list;
 	struct trace_event_call		*event_call;
 	struct event_filter __rcu	*filter;
+	struct event_sample __rcu	*sample;
 	struct dentry			*dir;
 	struct trace_array		*tr;
 	struct trace_subsystem_dir	*system;
@@ -157,6 +157,7 @@ enum bpf_map_type {
 	BPF_MAP_TYPE_STRUCT_OPS,
 	BPF_MAP_TYPE_RINGBUF,
 	BPF_MAP_TYPE_INODE_STORAGE,
+	BPF_MAP_TYPE_BLOOM_FILTER,
 };
 
 /* Note that tracing related programs such as
@@ -253,6 +254,7 @@ enum bpf_link_type {
 	BPF_LINK_TYPE_ITER = 4,
 	BPF_LINK_TYPE_NETNS = 5,
 	BPF_LINK_TYPE_XDP = 6,
+	BPF_LINK_TYPE_TRACING_MULTI = 7,
 
 	MAX_BPF_LINK_TYPE,
 };
@@ -355,6 +357,15 @@ enum bpf_link_type {
  */
 #define BPF_F_SLEEPABLE		(1U << 4)
 
+/* If BPF_F_MULTI_FUNC is used in BPF_PROG_LOAD command, the fentry or fexit
+ * program is not tied to the function given by attach_btf_id (which must be
+ * zero). It can be attached to many kernel functions at once with
+ * BPF_LINK_CREATE and link_create.multi. The program sees the first six
+ * arguments of the traced function as u64 values, fexit programs find the
+ * return value right after them.
+ */
+#define BPF_F_MULTI_FUNC	(1U << 5)
+
 /* When BPF ldimm64's insn[0].src_reg != 0 then this can have
  * the following extensions:
  *
@@ -438,6 +449,21 @@ enum {
 
 /* Create a map that is suitable to be an inner map with dynamic max entries */
 	BPF_F_INNER_MAP		= (1U << 12),
+
+/* Update and delete BPF_MAP_TYPE_HASH buckets with cmpxchg instead of
+ * taking the bucket lock. Only valid for preallocated maps.
+ */
+	BPF_F_LOCKLESS		= (1U << 13),
+
+/* Stage bpf_ringbuf_output() records per CPU and commit them to a
+ * BPF_MAP_TYPE_RINGBUF in bulk.
+ */
+	BPF_F_RB_BATCH		= (1U << 14),
+
+/* Keep a level-compressed lookup index next to a BPF_MAP_TYPE_LPM_TRIE.
+ * It is rebuilt in the background after updates.
+ */
+	BPF_F_LEVEL_COMPRESS	= (1U << 15),
 };
 
 /* Flags for BPF_PROG_QUERY. */
@@ -502,6 +528,13 @@ union bpf_attr {
 						   * struct stored as the
 						   * map value
 						   */
+		/* Any per-map-type extra fields
+		 *
+		 * BPF_MAP_TYPE_BLOOM_FILTER - the lowest 4 bits indicate the
+		 * number of hash functions (if 0, the bloom filter will default
+		 * to using 5 hash functions).
+		 */
+		__u64	map_extra;
 	};
 
 	struct { /* anonymous struct used by BPF_MAP_*_ELEM commands */
@@ -669,6 +702,11 @@ union bpf_attr {
 				__aligned_u64	iter_info;	/* extra bpf_iter_link_info */
 				__u32		iter_info_len;	/* iter_info length */
 			};
+			struct {
+				/* array of btf_ids of kernel functions */
+				__aligned_u64	btf_ids;
+				__u32		btf_ids_cnt;
+			} multi;
 		};
 	} link_create;
 
@@ -3310,6 +3348,13 @@ union bpf_attr {
  * 		of new data availability is sent.
  * 		If **BPF_RB_FORCE_WAKEUP** is specified in *flags*, notification
  * 		of new data availability is sent unconditionally.
+ *
+ * 		If *ringbuf* was created with **BPF_F_RB_BATCH**, small records
+ * 		are first collected in a per-CPU staging area and copied into
+ * 		the ring buffer together, at the latest on the next timer tick.
+ * 		**BPF_RB_FORCE_WAKEUP** commits the staged records immediately.
+ * 		Records of one CPU keep their order, but records of different
+ * 		CPUs may appear out of order in the ring buffer.
  * 	Return
  * 		0 on success, or a negative error in case of failure.
  *
@@ -3349,6 +3394,8 @@ union bpf_attr {
  *		* **BPF_RB_RING_SIZE**: The size of ring buffer.
  *		* **BPF_RB_CONS_POS**: Consumer position (can wrap around).
  *		* **BPF_RB_PROD_POS**: Producer(s) position (can wrap around).
+ *		* **BPF_RB_BATCH_LOST**: Number of staged records that did not
+ *		  fit into a **BPF_F_RB_BATCH** ring buffer when committed.
  *
  *		Data returned is just a momentary snapshot of actual values
  *		and could be inaccurate, so this facility should be used to
@@ -4037,6 +4084,7 @@ enum {
 	BPF_RB_RING_SIZE = 1,
 	BPF_RB_CONS_POS = 2,
 	BPF_RB_PROD_POS = 3,
+	BPF_RB_BATCH_LOST = 4,
 };
 
 /* BPF ring buffer constants */
@@ -4395,6 +4443,7 @@ struct bpf_prog_info {
 	__aligned_u64 prog_tags;
 	__u64 run_time_ns;
 	__u64 run_cnt;
+	__u32 verified_insns;
 } __attribute__((aligned(8)));
 
 struct bpf_map_info {
@@ -4412,6 +4461,8 @@ struct bpf_map_info {
 	__u32 btf_id;
 	__u32 btf_key_type_id;
 	__u32 btf_value_type_id;
+	__u32 :32;	/* alignment pad */
+	__u64 map_extra;
 } __attribute__((aligned(8)));
 
 struct bpf_btf_info {
@@ -4452,6 +4503,10 @@ struct bpf_link_info {
 		struct {
 			__u32 ifindex;
 		} xdp;
+		struct {
+			__u32 attach_type;
+			__u32 func_cnt;
+		} tracing_multi;
 	};
 } __attribute__((aligned(8)));
 
@@ -9,6 +9,15 @@
 #define MREMAP_FIXED		2
 #define MREMAP_DONTUNMAP	4
 
+/*
+ * Collapse the range into transparent huge pages synchronously. Defined
+ * here until the per-arch headers carry it; the value is the same on all
+ * architectures.
+ */
+#ifndef MADV_COLLAPSE
+#define MADV_COLLAPSE	25
+#endif
+
 #define OVERCOMMIT_GUESS		0
 #define OVERCOMMIT_ALWAYS		1
 #define OVERCOMMIT_NEVER		2
@@ -4438,6 +4438,19 @@ bool btf_ctx_access(int off, int size, enum bpf_access_type type,
 	u32 nr_args, arg;
 	int i, ret;
 
+	if (prog->aux->multi_func) {
+		/* Scalar arguments, then the return value for fexit */
+		nr_args = BPF_MULTI_FUNC_ARGS;
+		if (prog->expected_attach_type == BPF_TRACE_FEXIT)
+			nr_args++;
+		if (off % 8 || off / 8 >= nr_args) {
+			bpf_log(log, "multi function ctx offset %d is invalid\n",
+				off);
+			return false;
+		}
+		return true;
+	}
+
 	if (off % 8) {
 		bpf_log(log, "func '%s' offset %d is not multiple of 8\n",
 			tname, off);
@@ -5537,6 +5550,12 @@ u32 btf_id(const struct btf *btf)
 	return btf->id;
 }
 
+const void *btf_data(const struct btf *btf, u32 *size)
+{
+	*size = btf->data_size;
+	return btf->data;
+}
+
 static int btf_id_cmp_func(const void *a, const void *b)
 {
 	const int *pa = a, *pb = b;
@@ -10,13 +10,15 @@
 #include <linux/random.h>
 #include <uapi/linux/btf.h>
 #include <linux/rcupdate_trace.h>
+#include <linux/irq_work.h>
+#include <linux/llist.h>
 #include "percpu_freelist.h"
 #include "bpf_lru_list.h"
 #include "map_in_map.h"
 
 #define HTAB_CREATE_FLAG_MASK						\
 	(BPF_F_NO_PREALLOC | BPF_F_NO_COMMON_LRU | BPF_F_NUMA_NODE |	\
-	 BPF_F_ACCESS_MASK | BPF_F_ZERO_SEED)
+	 BPF_F_ACCESS_MASK | BPF_F_ZERO_SEED | BPF_F_LOCKLESS)
 
 #define BATCH_OPS(_name)			\
 	.map_lookup_batch =			\
@@ -95,6 +97,7 @@ struct bpf_htab {
 		struct bpf_lru lru;
 	};
 	struct htab_elem *__percpu *extra_elems;
+	struct htab_retire __percpu *retire;
 	atomic_t count;	/* number of elements in this hashtable */
 	u32 n_buckets;	/* number of hash buckets */
 	u32 elem_size;	/* size of each element in bytes */
@@ -117,16 +120,30 @@ struct htab_elem {
 	union {
 		struct rcu_head rcu;
 		struct bpf_lru_node lru_node;
+		struct llist_node llnode;
 	};
 	u32 hash;
 	char key[] __aligned(8);
 };
 
+/* Elements unlinked from a lockless map in NMI context, waiting for
+ * irq_work to hand them to call_rcu()
+ */
+struct htab_retire {
+	struct llist_head list;
+	struct irq_work work;
+};
+
 static inline bool htab_is_prealloc(const struct bpf_htab *htab)
 {
 	return !(htab->map.map_flags & BPF_F_NO_PREALLOC);
 }
 
+static inline bool htab_is_lockless(const struct bpf_htab *htab)
+{
+	return htab->map.map_flags & BPF_F_LOCKLESS;
+}
+
 static inline bool htab_use_raw_lock(const struct bpf_htab *htab)
 {
 	return (!IS_ENABLED(CONFIG_PREEMPT_RT) || htab_is_prealloc(htab));
@@ -137,7 +154,9 @@ static void htab_init_buckets(struct bpf_htab *htab)
 	unsigned i;
 
 	for (i = 0; i < htab->n_buckets; i++) {
-		INIT_HLIST_NULLS_HEAD(&htab->buckets[i].head, i);
+		/* lockless buckets never look at the nulls value */
+		INIT_HLIST_NULLS_HEAD(&htab->buckets[i].head,
+				      htab_is_lockless(htab) ? 0 : i);
 		if (htab_use_raw_lock(htab))
 			raw_spin_lock_init(&htab->buckets[i].raw_lock);
 		else
@@ -247,15 +266,28 @@ static struct htab_elem *prealloc_lru_pop(struct bpf_htab *htab, void *key,
 	return NULL;
 }
 
+/* Elements preallocated beyond max_entries. Lockless maps retire every
+ * replaced or deleted element through RCU, so they keep one spare per
+ * entry: every key can be replaced once per grace period before the
+ * freelist runs dry.
+ */
+static u32 htab_nr_spare_elems(const struct bpf_htab *htab)
+{
+	if (htab_is_lockless(htab))
+		return max_t(u32, htab->map.max_entries, num_possible_cpus());
+
+	return num_possible_cpus();
+}
+
 static int prealloc_init(struct bpf_htab *htab)
 {
 	u32 num_entries = htab->map.max_entries;
 	int err = -ENOMEM, i;
 
 	if (!htab_is_percpu(htab) && !htab_is_lru(htab))
-		num_entries += num_possible_cpus();
+		num_entries += htab_nr_spare_elems(htab);
 
-	htab->elems = bpf_map_area_alloc(htab->elem_size * num_entries,
+	htab->elems = bpf_map_area_alloc((u64)htab->elem_size * num_entries,
 					 htab->map.numa_node);
 	if (!htab->elems)
 		return -ENOMEM;
@@ -338,6 +370,43 @@ static int alloc_extra_elems(struct bpf_htab *htab)
 	return 0;
 }
 
+static void htab_ll_free_rcu(struct rcu_head *head)
+{
+	struct htab_elem *l = container_of(head, struct htab_elem, rcu);
+	struct bpf_htab *htab = l->htab;
+
+	/* l->htab shares storage with l->fnode, read it before the push */
+	pcpu_freelist_push(&htab->freelist, &l->fnode);
+}
+
+static void htab_ll_retire_work(struct irq_work *work)
+{
+	struct htab_retire *r = container_of(work, struct htab_retire, work);
+	struct htab_elem *l, *tmp;
+
+	llist_for_each_entry_safe(l, tmp, llist_del_all(&r->list), llnode)
+		call_rcu(&l->rcu, htab_ll_free_rcu);
+}
+
+static int alloc_retire_lists(struct bpf_htab *htab)
+{
+	struct htab_retire __percpu *pptr;
+	int cpu;
+
+	pptr = alloc_percpu_gfp(struct htab_retire, GFP_USER | __GFP_NOWARN);
+	if (!pptr)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct htab_retire *r = per_cpu_ptr(pptr, cpu);
+
+		init_llist_head(&r->list);
+		init_irq_work(&r->work, htab_ll_retire_work);
+	}
+	htab->retire = pptr;
+	return 0;
+}
+
 /* Called from syscall */
 static int htab_map_alloc_check(union bpf_attr *attr)
 {
@@ -353,6 +422,7 @@ static int htab_map_alloc_check(union bpf_attr *attr)
 	bool percpu_lru = (attr->map_flags & BPF_F_NO_COMMON_LRU);
 	bool prealloc = !(attr->map_flags & BPF_F_NO_PREALLOC);
 	bool zero_seed = (attr->map_flags & BPF_F_ZERO_SEED);
+	bool lockless = (attr->map_flags & BPF_F_LOCKLESS);
 	int numa_node = bpf_map_attr_numa_node(attr);
 
 	BUILD_BUG_ON(offsetof(struct htab_elem, htab) !=
@@ -380,6 +450,12 @@ static int htab_map_alloc_check(union bpf_attr *attr)
 	if (lru && !prealloc)
 		return -ENOTSUPP;
 
+	/* lockless buckets recycle preallocated elements through the
+	 * freelist, and only plain hash maps implement them
+	 */
+	if (lockless && (attr->map_type != BPF_MAP_TYPE_HASH || !prealloc))
+		return -EINVAL;
+
 	if (numa_node != NUMA_NO_NODE && (percpu || percpu_lru))
 		return -EINVAL;
 
@@ -421,6 +497,7 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 	 */
 	bool percpu_lru = (attr->map_flags & BPF_F_NO_COMMON_LRU);
 	bool prealloc = !(attr->map_flags & BPF_F_NO_PREALLOC);
+	bool lockless = (attr->map_flags & BPF_F_LOCKLESS);
 	struct bpf_htab *htab;
 	u64 cost;
 	int err;
@@ -466,7 +543,7 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 		cost += (u64) round_up(htab->map.value_size, 8) *
 			num_possible_cpus() * htab->map.max_entries;
 	else
-	       cost += (u64) htab->elem_size * num_possible_cpus();
+	       cost += (u64) htab->elem_size * htab_nr_spare_elems(htab);
 
 	/* if map size is larger than memlock limit, reject it */
 	err = bpf_map_charge_init(&htab->map.memory, cost);
@@ -492,7 +569,15 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 		if (err)
 			goto free_buckets;
 
-		if (!percpu && !lru) {
+		if (lockless) {
+			/* replaced elements go back to the freelist after a
+			 * grace period, extra elems are not used, the spare
+			 * elements take their place.
+			 */
+			err = alloc_retire_lists(htab);
+			if (err)
+				goto free_prealloc;
+		} else if (!percpu && !lru) {
 			/* lru itself can remove the least used element, so
 			 * there is no need for an extra elem during map_update.
 			 */
@@ -566,6 +651,65 @@ again:
 	return NULL;
 }
 
+/* Buckets of BPF_F_LOCKLESS maps are singly linked through
+ * hash_node.next and are never locked. An element is deleted in two
+ * steps: setting HTAB_LL_DELETED in its own next pointer takes it out
+ * of the map, and the first writer that swings the predecessor past it
+ * unlinks it and retires it. Retired elements are pushed back to the
+ * freelist only after an RCU grace period, so a node never changes
+ * bucket under a reader and a cmpxchg on a link never sees it reused.
+ */
+#define HTAB_LL_DELETED		2UL
+
+static inline bool ll_deleted(struct hlist_nulls_node *n)
+{
+	return (unsigned long)n & HTAB_LL_DELETED;
+}
+
+static inline struct hlist_nulls_node *ll_ptr(struct hlist_nulls_node *n)
+{
+	return (struct hlist_nulls_node *)((unsigned long)n & ~HTAB_LL_DELETED);
+}
+
+static inline struct hlist_nulls_node *ll_mark(struct hlist_nulls_node *n)
+{
+	return (struct hlist_nulls_node *)((unsigned long)n | HTAB_LL_DELETED);
+}
+
+/* can be called without holding anything but rcu_read_lock() */
+static struct htab_elem *htab_ll_lookup(struct hlist_nulls_head *head,
+					u32 hash, void *key, u32 key_size)
+{
+	struct hlist_nulls_node *n, *next;
+	struct htab_elem *l;
+
+	for (n = rcu_dereference_raw(head->first); !is_a_nulls(n);
+	     n = ll_ptr(next)) {
+		next = rcu_dereference_raw(n->next);
+		if (ll_deleted(next))
+			continue;
+		l = container_of(n, struct htab_elem, hash_node);
+		if (l->hash == hash && !memcmp(&l->key, key, key_size))
+			return l;
+	}
+
+	return NULL;
+}
+
+/* first element not marked deleted, starting at @n */
+static struct htab_elem *htab_ll_first(struct hlist_nulls_node *n)
+{
+	struct hlist_nulls_node *next;
+
+	for (n = ll_ptr(n); !is_a_nulls(n); n = ll_ptr(next)) {
+		next = rcu_dereference_raw(n->next);
+		if (!ll_deleted(next))
+			return container_of(n, struct htab_elem, hash_node);
+	}
+
+	return NULL;
+}
+
 /* Called from syscall or from eBPF program directly, so
  * arguments have to match bpf_map_lookup_elem() exactly.
  * The return value is adjusted by BPF instructions
@@ -586,6 +730,9 @@ static void *__htab_map_lookup_elem(struct bpf_map *map, void *key)
 
 	head = select_bucket(htab, hash);
 
+	if (htab_is_lockless(htab))
+		return htab_ll_lookup(head, hash, key, key_size);
+
 	l = lookup_nulls_elem_raw(head, hash, key, key_size, htab->n_buckets);
 
 	return l;
@@ -705,6 +852,36 @@ static bool htab_lru_map_delete_node(void *arg, struct bpf_lru_node *node)
 	return l == tgt_l;
 }
 
+static int htab_ll_get_next_key(struct bpf_htab *htab, void *key,
+				void *next_key)
+{
+	u32 key_size = htab->map.key_size;
+	struct htab_elem *l = NULL;
+	u32 hash = 0;
+	int i = 0;
+
+	if (key) {
+		hash = htab_map_hash(key, key_size, htab->hashrnd);
+		l = htab_ll_lookup(select_bucket(htab, hash), hash, key,
+				   key_size);
+	}
+
+	if (l) {
+		/* key was found, get next key in the same bucket */
+		l = htab_ll_first(rcu_dereference_raw(l->hash_node.next));
+		i = (hash & (htab->n_buckets - 1)) + 1;
+	}
+
+	for (; !l && i < htab->n_buckets; i++)
+		l = htab_ll_first(rcu_dereference_raw(select_bucket(htab, i)->first));
+
+	if (!l)
+		return -ENOENT;
+
+	memcpy(next_key, l->key, key_size);
+	return 0;
+}
+
 /* Called from syscall */
 static int htab_map_get_next_key(struct bpf_map *map, void *key, void *next_key)
 {
@@ -716,6 +893,9 @@ static int htab_map_get_next_key(struct bpf_map *map, void *key, void *next_key)
 
 	WARN_ON_ONCE(!rcu_read_lock_held());
 
+	if (htab_is_lockless(htab))
+		return htab_ll_get_next_key(htab, key, next_key);
+
 	key_size = map->key_size;
 
 	if (!key)
@@ -951,6 +1131,209 @@ static int check_flags(struct bpf_htab *htab, struct htab_elem *l_old,
 	return 0;
 }
 
+/* Called by whoever unlinked @l from its bucket */
+static void htab_ll_retire(struct bpf_htab *htab, struct htab_elem *l)
+{
+	struct htab_retire *r;
+
+	l->htab = htab;
+	if (likely(!in_nmi())) {
+		call_rcu(&l->rcu, htab_ll_free_rcu);
+		return;
+	}
+
+	/* call_rcu() is not NMI safe */
+	r = this_cpu_ptr(htab->retire);
+	llist_add(&l->llnode, &r->list);
+	irq_work_queue(&r->work);
+}
+
+/* Whoever marks @l deleted gives up the element's share of htab->count */
+static bool htab_ll_mark_deleted(struct bpf_htab *htab, struct htab_elem *l)
+{
+	struct hlist_nulls_node *next, *old;
+
+	next = READ_ONCE(l->hash_node.next);
+	while (!ll_deleted(next)) {
+		old = cmpxchg(&l->hash_node.next, next, ll_mark(next));
+		if (old == next) {
+			atomic_dec(&htab->count);
+			return true;
+		}
+		next = old;
+	}
+
+	return false;
+}
+
+/* Walk the list hanging off @start and return the first live element
+ * matching @key, unlinking and retiring deleted elements on the way.
+ * With a NULL @key the whole list is walked, which leaves it without
+ * any element that was marked deleted before the walk started. Returns
+ * NULL early if the element owning @start itself gets deleted.
+ */
+static struct htab_elem *htab_ll_find(struct bpf_htab *htab,
+				      struct hlist_nulls_node **start,
+				      u32 hash, void *key, u32 key_size)
+{
+	struct hlist_nulls_node **prev, *cur, *next;
+	struct htab_elem *l;
+
+again:
+	prev = start;
+	cur = READ_ONCE(*prev);
+	if (ll_deleted(cur))
+		return NULL;
+
+	while (!is_a_nulls(cur)) {
+		l = container_of(cur, struct htab_elem, hash_node);
+		next = READ_ONCE(cur->next);
+
+		if (ll_deleted(next)) {
+			if (cmpxchg(prev, cur, ll_ptr(next)) != cur)
+				goto again;
+			htab_ll_retire(htab, l);
+		} else {
+			/* cur is only known to be in the list while the
+			 * link to it is unchanged and unmarked
+			 */
+			if (READ_ONCE(*prev) != cur)
+				goto again;
+			if (key && l->hash == hash &&
+			    !memcmp(&l->key, key, key_size))
+				return l;
+			prev = &cur->next;
+		}
+		cur = ll_ptr(next);
+	}
+
+	return NULL;
+}
+
+static int htab_ll_update_elem(struct bpf_htab *htab, void *key, void *value,
+			       u64 map_flags)
+{
+	struct hlist_nulls_node *first, *old;
+	struct hlist_nulls_head *head;
+	struct htab_elem *l_new, *l_old;
+	bool replaced = false;
+	unsigned long flags;
+	u32 key_size, hash;
+	int ret;
+
+	key_size = htab->map.key_size;
+
+	hash = htab_map_hash(key, key_size, htab->hashrnd);
+
+	head = select_bucket(htab, hash);
+
+	if (unlikely(map_flags & BPF_F_LOCK) &&
+	    unlikely(!map_value_has_spin_lock(&htab->map)))
+		return -EINVAL;
+
+	l_old = htab_ll_lookup(head, hash, key, key_size);
+	ret = check_flags(htab, l_old, map_flags);
+	if (ret)
+		return ret;
+
+	/* As in htab_map_update_elem(), only BPF_F_LOCK updates the value
+	 * in place, under the element's lock. Lockless readers would see
+	 * a torn value otherwise, so other updates replace the element and
+	 * retire the old one.
+	 */
+	if (l_old && (map_flags & BPF_F_LOCK)) {
+		copy_map_value_locked(&htab->map,
+				      l_old->key + round_up(key_size, 8),
+				      value, false);
+		return 0;
+	}
+
+	/* Every element in a bucket holds a share of htab->count. The
+	 * replacement takes its share before the old element gives up its
+	 * own, so only new keys are held to max_entries.
+	 */
+	if (atomic_inc_return(&htab->count) > htab->map.max_entries &&
+	    !l_old) {
+		atomic_dec(&htab->count);
+		return -E2BIG;
+	}
+
+	local_irq_save(flags);
+	l_new = alloc_htab_elem(htab, key, value, key_size, hash, false, false,
+				NULL);
+	local_irq_restore(flags);
+	if (IS_ERR(l_new)) {
+		/* the spare elements are all waiting for a grace period,
+		 * bpf_map_update_value() waits for them and retries
+		 */
+		atomic_dec(&htab->count);
+		return -EBUSY;
+	}
+
+	/* add new element to the head of the list, so that
+	 * concurrent search will find it before old elem
+	 */
+	first = READ_ONCE(head->first);
+	for (;;) {
+		WRITE_ONCE(l_new->hash_node.next, first);
+		old = cmpxchg(&head->first, first, &l_new->hash_node);
+		if (old == first)
+			break;
+		first = old;
+	}
+
+	/* Now delete every older element with the same key. If the flags
+	 * did not allow the update after all, because a concurrent update
+	 * inserted or a concurrent delete removed the key after the check
+	 * above, back out instead.
+	 */
+	while ((l_old = htab_ll_find(htab, &l_new->hash_node.next, hash,
+				     key, key_size))) {
+		if ((map_flags & ~BPF_F_LOCK) == BPF_NOEXIST) {
+			ret = -EEXIST;
+			break;
+		}
+		if (htab_ll_mark_deleted(htab, l_old))
+			replaced = true;
+	}
+
+	if (!ret && !replaced && (map_flags & ~BPF_F_LOCK) == BPF_EXIST)
+		ret = -ENOENT;
+
+	if (!ret)
+		return 0;
+
+	/* If a concurrent delete got to l_new first, the update has been
+	 * visible and was removed again, which is as good as success.
+	 */
+	if (!htab_ll_mark_deleted(htab, l_new))
+		return 0;
+
+	htab_ll_find(htab, &head->first, hash, NULL, key_size);
+	return ret;
+}
+
+static int htab_ll_delete_elem(struct bpf_htab *htab, void *key)
+{
+	struct hlist_nulls_head *head;
+	struct htab_elem *l;
+	u32 hash, key_size;
+	int ret = -ENOENT;
+
+	key_size = htab->map.key_size;
+
+	hash = htab_map_hash(key, key_size, htab->hashrnd);
+
+	head = select_bucket(htab, hash);
+
+	/* the last, unsuccessful, search also unlinks what was marked */
+	while ((l = htab_ll_find(htab, &head->first, hash, key, key_size)))
+		if (htab_ll_mark_deleted(htab, l))
+			ret = 0;
+
+	return ret;
+}
+
 /* Called from syscall or from eBPF program */
 static int htab_map_update_elem(struct bpf_map *map, void *key, void *value,
 				u64 map_flags)
@@ -969,6 +1352,9 @@ static int htab_map_update_elem(struct bpf_map *map, void *key, void *value,
 
 	WARN_ON_ONCE(!rcu_read_lock_held() && !rcu_read_lock_trace_held());
 
+	if (htab_is_lockless(htab))
+		return htab_ll_update_elem(htab, key, value, map_flags);
+
 	key_size = map->key_size;
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
@@ -1248,6 +1634,9 @@ static int htab_map_delete_elem(struct bpf_map *map, void *key)
 
 	WARN_ON_ONCE(!rcu_read_lock_held() && !rcu_read_lock_trace_held());
 
+	if (htab_is_lockless(htab))
+		return htab_ll_delete_elem(htab, key);
+
 	key_size = map->key_size;
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
@@ -1321,12 +1710,18 @@ static void delete_all_elements(struct bpf_htab *htab)
 static void htab_map_free(struct bpf_map *map)
 {
 	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
+	int cpu;
 
 	/* bpf_free_used_maps() or close(map_fd) will trigger this map_free callback.
 	 * bpf_free_used_maps() is called after bpf prog is no longer executing.
 	 * There is no need to synchronize_rcu() here to protect map elements.
 	 */
 
+	/* elements retired from NMI reach call_rcu() via irq_work */
+	if (htab->retire)
+		for_each_possible_cpu(cpu)
+			irq_work_sync(&per_cpu_ptr(htab->retire, cpu)->work);
+
 	/* some of free_htab_elem() callbacks for elements of this map may
 	 * not have executed. Wait for them.
 	 */
@@ -1337,6 +1732,7 @@ static void htab_map_free(struct bpf_map *map)
 		prealloc_destroy(htab);
 
 	free_percpu(htab->extra_elems);
+	free_percpu(htab->retire);
 	bpf_map_area_free(htab->buckets);
 	kfree(htab);
 }
@@ -1386,6 +1782,10 @@ __htab_map_lookup_and_delete_batch(struct bpf_map *map,
 	struct bucket *b;
 	int ret = 0;
 
+	/* batches walk buckets under the bucket lock */
+	if (htab_is_lockless(htab))
+		return -EOPNOTSUPP;
+
 	elem_map_flags = attr->batch.elem_flags;
 	if ((elem_map_flags & ~BPF_F_LOCK) ||
 	    ((elem_map_flags & BPF_F_LOCK) && !map_value_has_spin_lock(map)))
@@ -1791,6 +2191,9 @@ static int bpf_iter_init_hash_map(void *priv_data,
 	void *value_buf;
 	u32 buf_size;
 
+	if (map->map_flags & BPF_F_LOCKLESS)
+		return -EOPNOTSUPP;
+
 	if (map->map_type == BPF_MAP_TYPE_PERCPU_HASH ||
 	    map->map_type == BPF_MAP_TYPE_LRU_PERCPU_HASH) {
 		buf_size = round_up(map->value_size, 8) * num_possible_cpus();
@@ -9,9 +9,14 @@
 #include <linux/bpf.h>
 #include <linux/btf.h>
 #include <linux/err.h>
+#include <linux/irq_work.h>
+#include <linux/llist.h>
+#include <linux/log2.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 #include <net/ipv6.h>
 #include <uapi/linux/btf.h>
 
@@ -19,6 +24,7 @@
 #define LPM_TREE_NODE_FLAG_IM BIT(0)
 
 struct lpm_trie_node;
+struct lpm_lc_index;
 
 struct lpm_trie_node {
 	struct rcu_head rcu;
@@ -31,10 +37,19 @@ struct lpm_trie_node {
 struct lpm_trie {
 	struct bpf_map			map;
 	struct lpm_trie_node __rcu	*root;
+	struct lpm_lc_index __rcu	*lc;
 	size_t				n_entries;
 	size_t				max_prefixlen;
 	size_t				data_size;
 	spinlock_t			lock;
+	/* Bumped under @lock before every change to the trie */
+	unsigned long			lc_gen;
+	/* Number of times an index was published */
+	unsigned long			lc_builds;
+	/* Unpublished indexes, freed and the rebuild scheduled from irq_work */
+	struct llist_head		lc_retired;
+	struct irq_work			lc_irq_work;
+	struct delayed_work		lc_work;
 };
 
 /* This trie implements a longest prefix match algorithm that can be used to
@@ -146,8 +161,58 @@ struct lpm_trie {
  * is a child that can be used to become more specific, the trie is traversed
  * downwards. The last node in the traversal that is a non-intermediate one is
  * returned.
+ *
+ * With BPF_F_LEVEL_COMPRESS, lookups additionally use an index that
+ * resolves several bits per step, in the spirit of the tnodes of
+ * net/ipv4/fib_trie.c. A table attached to node N is indexed by the
+ * bits of the key that follow N's prefix. Each entry records the
+ * longest non-intermediate node that the walk below N passes for those
+ * bits, and the node where the walk continues once the table's bits are
+ * used up, which may have a table of its own. With the example above, a
+ * 2 bit table at (1) indexed by bits 16 and 17 would send 192.168.0.x
+ * and 192.168.1.x to (4), 192.168.128.x to (3), and any other key to no
+ * node at all.
+ *
+ * Every table is sized after the number of nodes below it, so a trie
+ * that branches densely near the top is crossed in a few steps instead
+ * of one per level. The index is immutable: an update drops it and it
+ * is rebuilt from a workqueue once the trie has not changed for
+ * LPM_LC_REBUILD_DELAY, lookups walk the trie in the meantime. Lookups
+ * with a key shorter than max_prefixlen always walk the trie.
  */
 
+#define LPM_LC_MIN_BITS			2
+#define LPM_LC_MAX_BITS			16
+/* Upper bound of the index size, in entries per element of the trie */
+#define LPM_LC_ENTRIES_PER_PREFIX	4
+#define LPM_LC_REBUILD_DELAY		(HZ / 20)
+
+/* lpm_lc_entry::next points to a struct lpm_lc_table, not to a node */
+#define LPM_LC_TABLE			1UL
+
+struct lpm_lc_entry {
+	struct lpm_trie_node	*best;
+	unsigned long		next;
+};
+
+struct lpm_lc_table {
+	struct lpm_trie_node	*node;
+	u32			pos;	/* == node->prefixlen */
+	u32			bits;
+	struct lpm_lc_entry	entries[];
+};
+
+struct lpm_lc_index {
+	union {
+		struct rcu_head		rcu;
+		struct llist_node	llnode;
+	};
+	struct lpm_lc_table	*root;
+	size_t			size;
+	size_t			used;
+	u8			arena[] __aligned(sizeof(long));
+};
+
 static inline int extract_bit(const u8 *data, size_t index)
 {
 	return !!(data[index / 8] & (1 << (7 - (index % 8))));
@@ -223,16 +288,25 @@ static size_t longest_prefix_match(const struct lpm_trie *trie,
 	return prefixlen;
 }
 
-/* Called from syscall or from eBPF program */
-static void *trie_lookup_elem(struct bpf_map *map, void *_key)
+/* Return bits [pos, pos + nbits) of @data, nbits <= LPM_LC_MAX_BITS */
+static u32 lpm_lc_bits(const u8 *data, u32 pos, u32 nbits)
 {
-	struct lpm_trie *trie = container_of(map, struct lpm_trie, map);
-	struct lpm_trie_node *node, *found = NULL;
-	struct bpf_lpm_trie_key *key = _key;
+	u32 nbytes = DIV_ROUND_UP(pos % 8 + nbits, 8);
+	u32 i, v = 0;
 
-	/* Start walking the trie from the root node ... */
+	data += pos / 8;
+	for (i = 0; i < nbytes; i++)
+		v = (v << 8) | data[i];
 
-	for (node = rcu_dereference(trie->root); node;) {
+	return (v >> (nbytes * 8 - pos % 8 - nbits)) & ((1U << nbits) - 1);
+}
+
+static struct lpm_trie_node *trie_walk(const struct lpm_trie *trie,
+				       struct lpm_trie_node *node,
+				       const struct bpf_lpm_trie_key *key,
+				       struct lpm_trie_node *found)
+{
+	while (node) {
 		unsigned int next_bit;
 		size_t matchlen;
 
@@ -267,12 +341,326 @@ static void *trie_lookup_elem(struct bpf_map *map, void *_key)
 		node = rcu_dereference(node->child[next_bit]);
 	}
 
+	return found;
+}
+
+static struct lpm_trie_node *lpm_lc_lookup(const struct lpm_trie *trie,
+					   const struct lpm_lc_index *lc,
+					   const struct bpf_lpm_trie_key *key)
+{
+	const struct lpm_lc_table *t = lc->root;
+	struct lpm_trie_node *node = t->node, *found = NULL;
+	const struct lpm_lc_entry *e;
+	size_t matchlen;
+
+	for (;;) {
+		/* One step of trie_walk() ... */
+		matchlen = longest_prefix_match(trie, node, key);
+		if (matchlen == trie->max_prefixlen)
+			return node;
+		if (matchlen < node->prefixlen)
+			return found;
+		if (!(node->flags & LPM_TREE_NODE_FLAG_IM))
+			found = node;
+
+		if (!t)
+			break;
+
+		/* ... then skip the levels covered by the node's table */
+		e = &t->entries[lpm_lc_bits(key->data, t->pos, t->bits)];
+		if (e->best)
+			found = e->best;
+
+		if (e->next & LPM_LC_TABLE) {
+			t = (const struct lpm_lc_table *)(e->next & ~LPM_LC_TABLE);
+			node = t->node;
+		} else {
+			t = NULL;
+			node = (struct lpm_trie_node *)e->next;
+			if (!node)
+				return found;
+		}
+	}
+
+	node = rcu_dereference(node->child[extract_bit(key->data,
+						       node->prefixlen)]);
+	return trie_walk(trie, node, key, found);
+}
+
+/* Called from syscall or from eBPF program */
+static void *trie_lookup_elem(struct bpf_map *map, void *_key)
+{
+	struct lpm_trie *trie = container_of(map, struct lpm_trie, map);
+	struct bpf_lpm_trie_key *key = _key;
+	struct lpm_trie_node *found;
+	struct lpm_lc_index *lc;
+
+	lc = rcu_dereference(trie->lc);
+	if (lc && key->prefixlen == trie->max_prefixlen)
+		found = lpm_lc_lookup(trie, lc, key);
+	else
+		/* Start walking the trie from the root node ... */
+		found = trie_walk(trie, rcu_dereference(trie->root), key, NULL);
+
 	if (!found)
 		return NULL;
 
 	return found->data + trie->data_size;
 }
 
+static size_t lpm_lc_table_size(u32 bits)
+{
+	return sizeof(struct lpm_lc_table) +
+	       (sizeof(struct lpm_lc_entry) << bits);
+}
+
+static void lpm_lc_free_rcu(struct rcu_head *rcu)
+{
+	struct lpm_lc_index *lc = container_of(rcu, struct lpm_lc_index, rcu);
+
+	bpf_map_area_free(lc);
+}
+
+static void lpm_lc_irq_work(struct irq_work *work)
+{
+	struct lpm_trie *trie = container_of(work, struct lpm_trie,
+					     lc_irq_work);
+	struct lpm_lc_index *lc, *tmp;
+
+	llist_for_each_entry_safe(lc, tmp, llist_del_all(&trie->lc_retired),
+				  llnode)
+		call_rcu(&lc->rcu, lpm_lc_free_rcu);
+
+	/* A pending rebuild is not pushed back, so that a steady stream of
+	 * updates delays it by LPM_LC_REBUILD_DELAY at most.
+	 */
+	queue_delayed_work(system_unbound_wq, &trie->lc_work,
+			   LPM_LC_REBUILD_DELAY);
+}
+
+/* Called with trie->lock held, before the trie is modified. Programs
+ * update the trie from any context, so call_rcu() and the workqueue are
+ * left to irq_work.
+ */
+static void lpm_lc_invalidate(struct lpm_trie *trie)
+{
+	struct lpm_lc_index *lc;
+
+	if (!(trie->map.map_flags & BPF_F_LEVEL_COMPRESS))
+		return;
+
+	/* The index must be gone before any node it points to is freed */
+	lc = rcu_dereference_protected(trie->lc, lockdep_is_held(&trie->lock));
+	if (lc) {
+		RCU_INIT_POINTER(trie->lc, NULL);
+		llist_add(&lc->llnode, &trie->lc_retired);
+	}
+
+	WRITE_ONCE(trie->lc_gen, trie->lc_gen + 1);
+	irq_work_queue(&trie->lc_irq_work);
+}
+
+struct lpm_lc_builder {
+	struct lpm_trie		*trie;
+	struct lpm_lc_index	*lc;
+	/* Room for a depth first walk of the trie */
+	struct lpm_trie_node	**stack;
+};
+
+/* Count the nodes below @node, up to @limit */
+static u32 lpm_lc_count(struct lpm_lc_builder *b, struct lpm_trie_node *node,
+			u32 limit)
+{
+	struct lpm_trie_node *child;
+	int i, sp = 0;
+	u32 n = 0;
+
+	b->stack[sp++] = node;
+	while (sp && n < limit) {
+		node = b->stack[--sp];
+		for (i = 0; i < 2; i++) {
+			child = rcu_dereference(node->child[i]);
+			if (child) {
+				b->stack[sp++] = child;
+				n++;
+			}
+		}
+	}
+
+	return n;
+}
+
+static struct lpm_lc_table *lpm_lc_new_table(struct lpm_lc_builder *b,
+					     struct lpm_trie_node *node)
+{
+	size_t max_bits = b->trie->max_prefixlen - node->prefixlen;
+	struct lpm_lc_index *lc = b->lc;
+	struct lpm_lc_table *t;
+	u32 count, bits;
+
+	count = lpm_lc_count(b, node, 1U << LPM_LC_MAX_BITS);
+	if (count < (1U << LPM_LC_MIN_BITS) || max_bits < LPM_LC_MIN_BITS)
+		return NULL;
+
+	bits = min_t(u32, ilog2(count), max_bits);
+	if (lc->used + lpm_lc_table_size(bits) > lc->size)
+		return NULL;
+
+	t = (struct lpm_lc_table *)(lc->arena + lc->used);
+	lc->used += lpm_lc_table_size(bits);
+
+	t->node = node;
+	t->pos = node->prefixlen;
+	t->bits = bits;
+
+	return t;
+}
+
+static void lpm_lc_fill_range(struct lpm_lc_table *t, u32 first, u32 nr,
+			      struct lpm_trie_node *best)
+{
+	struct lpm_lc_entry *e = &t->entries[first];
+
+	while (nr--) {
+		e->best = best;
+		e->next = 0;
+		e++;
+	}
+}
+
+/* Fill the entries of @t for the keys whose bits [t->pos, t->pos + @d)
+ * are @idx, that reach @node with @best as their longest prefix so far.
+ * Recurses at most t->bits deep.
+ */
+static void lpm_lc_fill(struct lpm_lc_builder *b, struct lpm_lc_table *t,
+			struct lpm_trie_node *node, struct lpm_trie_node *best,
+			u32 idx, u32 d)
+{
+	u32 end = t->pos + t->bits;
+	u32 first, match, span, nbits;
+	struct lpm_lc_table *child;
+
+	if (!node) {
+		lpm_lc_fill_range(t, idx << (t->bits - d),
+				  1U << (t->bits - d), best);
+		return;
+	}
+
+	/* The part of @node's prefix within the table is compared against
+	 * the key, the entries that differ from it end the walk.
+	 */
+	nbits = min_t(u32, node->prefixlen, end) - t->pos;
+	if (nbits > d) {
+		first = idx << (t->bits - d);
+		span = 1U << (t->bits - d);
+		idx = (idx << (nbits - d)) |
+		      lpm_lc_bits(node->data, t->pos + d, nbits - d);
+		d = nbits;
+		match = idx << (t->bits - d);
+
+		lpm_lc_fill_range(t, first, match - first, best);
+		lpm_lc_fill_range(t, match + (1U << (t->bits - d)),
+				  first + span - match - (1U << (t->bits - d)),
+				  best);
+	}
+
+	if (node->prefixlen >= end) {
+		/* The walk continues at @node, possibly with its own table */
+		child = NULL;
+		if (node->prefixlen < b->trie->max_prefixlen)
+			child = lpm_lc_new_table(b, node);
+
+		t->entries[idx].best = best;
+		t->entries[idx].next = child ?
+				       (unsigned long)child | LPM_LC_TABLE :
+				       (unsigned long)node;
+		return;
+	}
+
+	if (!(node->flags & LPM_TREE_NODE_FLAG_IM))
+		best = node;
+
+	lpm_lc_fill(b, t, rcu_dereference(node->child[0]), best,
+		    idx << 1, d + 1);
+	lpm_lc_fill(b, t, rcu_dereference(node->child[1]), best,
+		    (idx << 1) | 1, d + 1);
+}
+
+static void lpm_lc_build(struct work_struct *work)
+{
+	struct lpm_trie *trie = container_of(to_delayed_work(work),
+					     struct lpm_trie, lc_work);
+	struct lpm_lc_builder b = { .trie = trie };
+	struct lpm_trie_node *root;
+	unsigned long gen, irq_flags;
+	struct lpm_lc_table *t;
+	size_t n_entries, off;
+
+	spin_lock_irqsave(&trie->lock, irq_flags);
+	gen = trie->lc_gen;
+	n_entries = trie->n_entries;
+	spin_unlock_irqrestore(&trie->lock, irq_flags);
+
+	if (n_entries < (1U << LPM_LC_MIN_BITS))
+		return;
+
+	b.stack = kmalloc_array(trie->max_prefixlen + 2, sizeof(*b.stack),
+				GFP_KERNEL);
+	b.lc = bpf_map_area_alloc(sizeof(*b.lc) + n_entries *
+				  LPM_LC_ENTRIES_PER_PREFIX *
+				  sizeof(struct lpm_lc_entry),
+				  trie->map.numa_node);
+	if (!b.stack || !b.lc)
+		goto out;
+
+	b.lc->root = NULL;
+	b.lc->size = n_entries * LPM_LC_ENTRIES_PER_PREFIX *
+		     sizeof(struct lpm_lc_entry);
+	b.lc->used = 0;
+
+	rcu_read_lock();
+	root = rcu_dereference(trie->root);
+	if (READ_ONCE(trie->lc_gen) == gen && root)
+		b.lc->root = lpm_lc_new_table(&b, root);
+	rcu_read_unlock();
+
+	if (!b.lc->root)
+		goto out;
+
+	/* Tables are appended as they are found, so this fills them breadth
+	 * first. The nodes they point to stay valid as long as the trie does
+	 * not change, which is checked at the start of every RCU section.
+	 */
+	for (off = 0; off < b.lc->used; off += lpm_lc_table_size(t->bits)) {
+		t = (struct lpm_lc_table *)(b.lc->arena + off);
+
+		rcu_read_lock();
+		if (READ_ONCE(trie->lc_gen) != gen) {
+			rcu_read_unlock();
+			goto out;
+		}
+		lpm_lc_fill(&b, t, rcu_dereference(t->node->child[0]), NULL,
+			    0, 1);
+		lpm_lc_fill(&b, t, rcu_dereference(t->node->child[1]), NULL,
+			    1, 1);
+		rcu_read_unlock();
+
+		cond_resched();
+	}
+
+	spin_lock_irqsave(&trie->lock, irq_flags);
+	if (trie->lc_gen == gen && !rcu_access_pointer(trie->lc)) {
+		rcu_assign_pointer(trie->lc, b.lc);
+		trie->lc_builds++;
+		b.lc = NULL;
+	}
+	spin_unlock_irqrestore(&trie->lock, irq_flags);
+
+out:
+	bpf_map_area_free(b.lc);
+	kfree(b.stack);
+}
+
 static struct lpm_trie_node *lpm_trie_node_alloc(const struct lpm_trie *trie,
 						 const void *value)
 {
@@ -337,6 +725,8 @@ static int trie_update_elem(struct bpf_map *map,
 	RCU_INIT_POINTER(new_node->child[1], NULL);
 	memcpy(new_node->data, key->data, trie->data_size);
 
+	lpm_lc_invalidate(trie);
+
 	/* Now find a slot to attach the new node. To do that, walk the tree
 	 * from the root and match as many bits as possible for each node until
 	 * we either find an empty slot or a slot that needs to be replaced by
@@ -474,6 +864,8 @@ static int trie_delete_elem(struct bpf_map *map, void *_key)
 		goto out;
 	}
 
+	lpm_lc_invalidate(trie);
+
 	trie->n_entries--;
 
 	/* If the node we are removing has two children, simply mark it
@@ -535,7 +927,7 @@ out:
 #define LPM_KEY_SIZE_MIN	LPM_KEY_SIZE(LPM_DATA_SIZE_MIN)
 
 #define LPM_CREATE_FLAG_MASK	(BPF_F_NO_PREALLOC | BPF_F_NUMA_NODE |	\
-				 BPF_F_ACCESS_MASK)
+				 BPF_F_ACCESS_MASK | BPF_F_LEVEL_COMPRESS)
 
 static struct bpf_map *trie_alloc(union bpf_attr *attr)
 {
@@ -569,6 +961,9 @@ static struct bpf_map *trie_alloc(union bpf_attr *attr)
 
 	cost_per_node = sizeof(struct lpm_trie_node) +
 			attr->value_size + trie->data_size;
+	if (attr->map_flags & BPF_F_LEVEL_COMPRESS)
+		cost_per_node += LPM_LC_ENTRIES_PER_PREFIX *
+				 sizeof(struct lpm_lc_entry);
 	cost += (u64) attr->max_entries * cost_per_node;
 
 	ret = bpf_map_charge_init(&trie->map.memory, cost);
@@ -576,6 +971,9 @@ static struct bpf_map *trie_alloc(union bpf_attr *attr)
 		goto out_err;
 
 	spin_lock_init(&trie->lock);
+	init_llist_head(&trie->lc_retired);
+	init_irq_work(&trie->lc_irq_work, lpm_lc_irq_work);
+	INIT_DELAYED_WORK(&trie->lc_work, lpm_lc_build);
 
 	return &trie->map;
 out_err:
@@ -587,8 +985,20 @@ static void trie_free(struct bpf_map *map)
 {
 	struct lpm_trie *trie = container_of(map, struct lpm_trie, map);
 	struct lpm_trie_node __rcu **slot;
+	struct lpm_lc_index *lc, *tmp;
 	struct lpm_trie_node *node;
 
+	if (map->map_flags & BPF_F_LEVEL_COMPRESS) {
+		irq_work_sync(&trie->lc_irq_work);
+		cancel_delayed_work_sync(&trie->lc_work);
+		/* no program or syscall can be looking at them anymore */
+		llist_for_each_entry_safe(lc, tmp,
+					  llist_del_all(&trie->lc_retired),
+					  llnode)
+			bpf_map_area_free(lc);
+	}
+	bpf_map_area_free(rcu_dereference_protected(trie->lc, 1));
+
 	/* Always start at the root and walk down to a node that has no
 	 * children. Then free that node, nullify its reference in the parent
 	 * and start over.
@@ -730,6 +1140,17 @@ static int trie_check_btf(const struct bpf_map *map,
 	       -EINVAL : 0;
 }
 
+static void trie_show_fdinfo(const struct bpf_map *map, struct seq_file *m)
+{
+	struct lpm_trie *trie = container_of(map, struct lpm_trie, map);
+
+	if (!(map->map_flags & BPF_F_LEVEL_COMPRESS))
+		return;
+
+	seq_printf(m, "lc_index:\t%u\n", !!rcu_access_pointer(trie->lc));
+	seq_printf(m, "lc_builds:\t%lu\n", READ_ONCE(trie->lc_builds));
+}
+
 static int trie_map_btf_id;
 const struct bpf_map_ops trie_map_ops = {
 	.map_meta_equal = bpf_map_meta_equal,
@@ -740,6 +1161,7 @@ const struct bpf_map_ops trie_map_ops = {
 	.map_update_elem = trie_update_elem,
 	.map_delete_elem = trie_delete_elem,
 	.map_check_btf = trie_check_btf,
+	.map_show_fdinfo = trie_show_fdinfo,
 	.map_btf_name = "lpm_trie",
 	.map_btf_id = &trie_map_btf_id,
 };
@@ -121,28 +121,71 @@ again:
 	}
 }
 
+/* Number of nodes taken from another CPU's list once the local list is
+ * empty, so that the next pops are served locally again instead of
+ * walking the other CPUs each time.
+ */
+#define PCPU_FREELIST_STEAL_BATCH	32
+
+/* Detach up to PCPU_FREELIST_STEAL_BATCH nodes, called with head->lock */
+static struct pcpu_freelist_node *
+pcpu_freelist_steal(struct pcpu_freelist_head *head,
+		    struct pcpu_freelist_node **last)
+{
+	struct pcpu_freelist_node *first, *node;
+	int n;
+
+	first = head->first;
+	if (!first)
+		return NULL;
+
+	node = first;
+	for (n = 1; n < PCPU_FREELIST_STEAL_BATCH && node->next; n++)
+		node = node->next;
+	head->first = node->next;
+	node->next = NULL;
+	*last = node;
+	return first;
+}
+
 static struct pcpu_freelist_node *___pcpu_freelist_pop(struct pcpu_freelist *s)
 {
-	struct pcpu_freelist_head *head;
-	struct pcpu_freelist_node *node;
+	struct pcpu_freelist_head *head, *local;
+	struct pcpu_freelist_node *node, *last;
 	int orig_cpu, cpu;
 
 	orig_cpu = cpu = raw_smp_processor_id();
+	local = per_cpu_ptr(s->freelist, cpu);
+	raw_spin_lock(&local->lock);
+	node = local->first;
+	if (node)
+		local->first = node->next;
+	raw_spin_unlock(&local->lock);
+	if (node)
+		return node;
+
 	while (1) {
-		head = per_cpu_ptr(s->freelist, cpu);
-		raw_spin_lock(&head->lock);
-		node = head->first;
-		if (node) {
-			head->first = node->next;
-			raw_spin_unlock(&head->lock);
-			return node;
-		}
-		raw_spin_unlock(&head->lock);
 		cpu = cpumask_next(cpu, cpu_possible_mask);
 		if (cpu >= nr_cpu_ids)
 			cpu = 0;
 		if (cpu == orig_cpu)
 			break;
+
+		head = per_cpu_ptr(s->freelist, cpu);
+		raw_spin_lock(&head->lock);
+		node = pcpu_freelist_steal(head, &last);
+		raw_spin_unlock(&head->lock);
+		if (!node)
+			continue;
+
+		/* keep the first node, move the rest to the local list */
+		if (node != last) {
+			raw_spin_lock(&local->lock);
+			last->next = local->first;
+			local->first = node->next;
+			raw_spin_unlock(&local->lock);
+		}
+		return node;
 	}
 
 	/* per cpu lists are all empty, try extralist */
@@ -10,7 +10,7 @@
 #include <linux/poll.h>
 #include <uapi/linux/btf.h>
 
-#define RINGBUF_CREATE_FLAG_MASK (BPF_F_NUMA_NODE)
+#define RINGBUF_CREATE_FLAG_MASK (BPF_F_NUMA_NODE | BPF_F_RB_BATCH)
 
 /* non-mmap()'able part of bpf_ringbuf (everything up to consumer page) */
 #define RINGBUF_PGOFF \
@@ -29,12 +29,38 @@
 #define RINGBUF_MAX_DATA_SZ \
 	(((1ULL << 24) - RINGBUF_POS_PAGES - RINGBUF_PGOFF) * PAGE_SIZE)
 
+/* Per CPU staging area of BPF_F_RB_BATCH ring buffers is at most a page,
+ * and at most a 1/(2 * nr_cpus) share of the ring itself.
+ */
+#define RINGBUF_STAGE_MAX_SZ PAGE_SIZE
+#define RINGBUF_STAGE_MIN_SZ 64
+
+struct bpf_ringbuf;
+
+/* Records written by bpf_ringbuf_output() into a BPF_F_RB_BATCH ring
+ * buffer are laid out in @data as they will be in the ring, and are
+ * copied into it under a single reservation when the area fills up,
+ * on the next tick, or when a producer asks for a forced wakeup.
+ */
+struct bpf_ringbuf_stage {
+	spinlock_t lock;
+	u32 len;
+	u32 cnt;
+	bool wakeup;
+	struct irq_work work;
+	struct bpf_ringbuf *rb;
+	void *data;
+};
+
 struct bpf_ringbuf {
 	wait_queue_head_t waitq;
 	struct irq_work work;
 	u64 mask;
 	struct page **pages;
 	int nr_pages;
+	struct bpf_ringbuf_stage __percpu *stage;
+	u32 stage_sz;
+	atomic_long_t stage_lost;
 	spinlock_t spinlock ____cacheline_aligned_in_smp;
 	/* Consumer and producer counters are put into separate pages to allow
 	 * mapping consumer page as r/w, but restrict producer page to r/o.
@@ -128,7 +154,61 @@ static void bpf_ringbuf_notify(struct irq_work *work)
 	wake_up_all(&rb->waitq);
 }
 
-static struct bpf_ringbuf *bpf_ringbuf_alloc(size_t data_sz, int numa_node)
+static void bpf_ringbuf_stage_work(struct irq_work *work);
+static void bpf_ringbuf_free(struct bpf_ringbuf *rb);
+
+static u32 bpf_ringbuf_stage_size(size_t data_sz)
+{
+	u64 sz = div_u64(data_sz, 2 * num_possible_cpus());
+
+	return round_down(min_t(u64, sz, RINGBUF_STAGE_MAX_SZ), 8);
+}
+
+static void bpf_ringbuf_free_stage(struct bpf_ringbuf *rb)
+{
+	int cpu;
+
+	if (!rb->stage)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct bpf_ringbuf_stage *stage = per_cpu_ptr(rb->stage, cpu);
+
+		irq_work_sync(&stage->work);
+		kfree(stage->data);
+	}
+	free_percpu(rb->stage);
+}
+
+static int bpf_ringbuf_alloc_stage(struct bpf_ringbuf *rb)
+{
+	int cpu;
+
+	rb->stage_sz = bpf_ringbuf_stage_size(rb->mask + 1);
+	rb->stage = alloc_percpu_gfp(struct bpf_ringbuf_stage,
+				     GFP_KERNEL | __GFP_NOWARN);
+	if (!rb->stage)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		struct bpf_ringbuf_stage *stage = per_cpu_ptr(rb->stage, cpu);
+
+		spin_lock_init(&stage->lock);
+		/* no IPI, the records can wait for the next tick */
+		stage->work = IRQ_WORK_INIT_LAZY(bpf_ringbuf_stage_work);
+		stage->rb = rb;
+		stage->data = kmalloc_node(rb->stage_sz,
+					   GFP_KERNEL | __GFP_NOWARN,
+					   cpu_to_node(cpu));
+		if (!stage->data)
+			return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static struct bpf_ringbuf *bpf_ringbuf_alloc(size_t data_sz, int numa_node,
+					     bool batch)
 {
 	struct bpf_ringbuf *rb;
 
@@ -144,6 +224,11 @@ static struct bpf_ringbuf *bpf_ringbuf_alloc(size_t data_sz, int numa_node)
 	rb->consumer_pos = 0;
 	rb->producer_pos = 0;
 
+	if (batch && bpf_ringbuf_alloc_stage(rb)) {
+		bpf_ringbuf_free(rb);
+		return ERR_PTR(-ENOMEM);
+	}
+
 	return rb;
 }
 
@@ -167,6 +252,11 @@ static struct bpf_map *ringbuf_map_alloc(union bpf_attr *attr)
 		return ERR_PTR(-E2BIG);
 #endif
 
+	/* too small to give every CPU a useful staging area */
+	if ((attr->map_flags & BPF_F_RB_BATCH) &&
+	    bpf_ringbuf_stage_size(attr->max_entries) < RINGBUF_STAGE_MIN_SZ)
+		return ERR_PTR(-EINVAL);
+
 	rb_map = kzalloc(sizeof(*rb_map), GFP_USER);
 	if (!rb_map)
 		return ERR_PTR(-ENOMEM);
@@ -176,11 +266,16 @@ static struct bpf_map *ringbuf_map_alloc(union bpf_attr *attr)
 	cost = sizeof(struct bpf_ringbuf_map) +
 	       sizeof(struct bpf_ringbuf) +
 	       attr->max_entries;
+	if (attr->map_flags & BPF_F_RB_BATCH)
+		cost += (u64)(sizeof(struct bpf_ringbuf_stage) +
+			      bpf_ringbuf_stage_size(attr->max_entries)) *
+			num_possible_cpus();
 	err = bpf_map_charge_init(&rb_map->map.memory, cost);
 	if (err)
 		goto err_free_map;
 
-	rb_map->rb = bpf_ringbuf_alloc(attr->max_entries, rb_map->map.numa_node);
+	rb_map->rb = bpf_ringbuf_alloc(attr->max_entries, rb_map->map.numa_node,
+				       attr->map_flags & BPF_F_RB_BATCH);
 	if (IS_ERR(rb_map->rb)) {
 		err = PTR_ERR(rb_map->rb);
 		goto err_uncharge;
@@ -203,6 +298,7 @@ static void bpf_ringbuf_free(struct bpf_ringbuf *rb)
 	struct page **pages = rb->pages;
 	int i, nr_pages = rb->nr_pages;
 
+	bpf_ringbuf_free_stage(rb);
 	vunmap(rb);
 	for (i = 0; i < nr_pages; i++)
 		__free_page(pages[i]);
@@ -367,6 +463,190 @@ static void *__bpf_ringbuf_reserve(struct bpf_ringbuf *rb, u64 size)
 	return (void *)hdr + BPF_RINGBUF_HDR_SZ;
 }
 
+/* Copy all staged records into the ring under one reservation. The
+ * first record stays busy until the others are in place, so the
+ * consumer never sees a partial batch. Called with irqs disabled and
+ * stage->lock held. Returns false if the records are still staged,
+ * because an NMI could not take the ring lock; the irq_work retries.
+ */
+static bool bpf_ringbuf_stage_flush(struct bpf_ringbuf *rb,
+				    struct bpf_ringbuf_stage *stage,
+				    bool force_wakeup)
+{
+	unsigned long cons_pos, prod_pos, rec_pos;
+	struct bpf_ringbuf_hdr *first, *hdr;
+	u32 off, first_len, len = stage->len;
+
+	if (!len)
+		return true;
+
+	cons_pos = smp_load_acquire(&rb->consumer_pos);
+
+	if (in_nmi()) {
+		if (!spin_trylock(&rb->spinlock)) {
+			if (force_wakeup)
+				stage->wakeup = true;
+			irq_work_queue(&stage->work);
+			return false;
+		}
+	} else {
+		spin_lock(&rb->spinlock);
+	}
+
+	prod_pos = rb->producer_pos;
+	if (prod_pos + len - cons_pos > rb->mask) {
+		spin_unlock(&rb->spinlock);
+		goto lost;
+	}
+
+	first = (void *)rb->data + (prod_pos & rb->mask);
+	first_len = ((struct bpf_ringbuf_hdr *)stage->data)->len;
+	first->len = first_len | BPF_RINGBUF_BUSY_BIT;
+	first->pg_off = bpf_ringbuf_rec_pg_off(rb, first);
+
+	/* pairs with consumer's smp_load_acquire() */
+	smp_store_release(&rb->producer_pos, prod_pos + len);
+
+	spin_unlock(&rb->spinlock);
+
+	/* data pages are mapped twice, so the batch can be copied in one go
+	 * even if it wraps around the end of the ring
+	 */
+	memcpy((void *)first + BPF_RINGBUF_HDR_SZ,
+	       stage->data + BPF_RINGBUF_HDR_SZ, len - BPF_RINGBUF_HDR_SZ);
+	off = round_up(first_len + BPF_RINGBUF_HDR_SZ, 8);
+	while (off < len) {
+		hdr = (void *)first + off;
+		hdr->pg_off = bpf_ringbuf_rec_pg_off(rb, hdr);
+		off += round_up(hdr->len + BPF_RINGBUF_HDR_SZ, 8);
+	}
+
+	/* publish the whole batch by committing its first record */
+	xchg(&first->len, first_len);
+
+	rec_pos = prod_pos & rb->mask;
+	cons_pos = smp_load_acquire(&rb->consumer_pos) & rb->mask;
+
+	if (force_wakeup || (stage->wakeup && cons_pos == rec_pos))
+		irq_work_queue(&rb->work);
+	goto out;
+
+lost:
+	atomic_long_add(stage->cnt, &rb->stage_lost);
+out:
+	stage->len = 0;
+	stage->cnt = 0;
+	stage->wakeup = false;
+	return true;
+}
+
+static void bpf_ringbuf_stage_work(struct irq_work *work)
+{
+	struct bpf_ringbuf_stage *stage;
+	unsigned long flags;
+
+	stage = container_of(work, struct bpf_ringbuf_stage, work);
+
+	spin_lock_irqsave(&stage->lock, flags);
+	bpf_ringbuf_stage_flush(stage->rb, stage, false);
+	spin_unlock_irqrestore(&stage->lock, flags);
+}
+
+/* Lock this CPU's staging area, with irqs disabled */
+static struct bpf_ringbuf_stage *
+bpf_ringbuf_stage_lock(struct bpf_ringbuf *rb, unsigned long *flags)
+{
+	struct bpf_ringbuf_stage *stage;
+
+	local_irq_save(*flags);
+	stage = this_cpu_ptr(rb->stage);
+
+	if (in_nmi()) {
+		if (!spin_trylock(&stage->lock)) {
+			local_irq_restore(*flags);
+			return NULL;
+		}
+	} else {
+		spin_lock(&stage->lock);
+	}
+
+	return stage;
+}
+
+static void bpf_ringbuf_stage_unlock(struct bpf_ringbuf_stage *stage,
+				     unsigned long flags)
+{
+	spin_unlock(&stage->lock);
+	local_irq_restore(flags);
+}
+
+/* Records that bypass the staging area must not overtake the ones
+ * already staged on this CPU. Returns false if some could not be
+ * flushed, in which case the caller has to fail its record, the same
+ * way a reservation from NMI fails when the ring lock is contended.
+ */
+static bool bpf_ringbuf_stage_flush_local(struct bpf_ringbuf *rb)
+{
+	struct bpf_ringbuf_stage *stage;
+	unsigned long flags;
+	bool flushed;
+
+	if (!rb->stage || !READ_ONCE(raw_cpu_ptr(rb->stage)->len))
+		return true;
+
+	stage = bpf_ringbuf_stage_lock(rb, &flags);
+	if (!stage)
+		return false;
+	flushed = bpf_ringbuf_stage_flush(rb, stage, false);
+	bpf_ringbuf_stage_unlock(stage, flags);
+	return flushed;
+}
+
+/* Returns -E2BIG if the record has to go to the ring directly */
+static int bpf_ringbuf_stage_output(struct bpf_ringbuf *rb, void *data,
+				    u64 size, u64 flags)
+{
+	struct bpf_ringbuf_stage *stage;
+	struct bpf_ringbuf_hdr *hdr;
+	unsigned long irq_flags;
+	u32 len;
+
+	if (size > rb->stage_sz - BPF_RINGBUF_HDR_SZ)
+		return -E2BIG;
+	len = round_up(size + BPF_RINGBUF_HDR_SZ, 8);
+
+	/* an NMI that interrupted this CPU's producer can neither stage
+	 * its record nor bypass the records staged so far
+	 */
+	stage = bpf_ringbuf_stage_lock(rb, &irq_flags);
+	if (!stage)
+		return -EAGAIN;
+
+	if (stage->len + len > rb->stage_sz &&
+	    !bpf_ringbuf_stage_flush(rb, stage, false)) {
+		bpf_ringbuf_stage_unlock(stage, irq_flags);
+		return -EAGAIN;
+	}
+
+	hdr = stage->data + stage->len;
+	hdr->len = size;
+	hdr->pg_off = 0;
+	memcpy((void *)hdr + BPF_RINGBUF_HDR_SZ, data, size);
+	stage->len += len;
+	stage->cnt++;
+	if (!(flags & BPF_RB_NO_WAKEUP))
+		stage->wakeup = true;
+
+	if (flags & BPF_RB_FORCE_WAKEUP)
+		bpf_ringbuf_stage_flush(rb, stage, true);
+	else if (stage->len == len)
+		/* first record of a batch, make sure it gets out */
+		irq_work_queue(&stage->work);
+
+	bpf_ringbuf_stage_unlock(stage, irq_flags);
+	return 0;
+}
+
 BPF_CALL_3(bpf_ringbuf_reserve, struct bpf_map *, map, u64, size, u64, flags)
 {
 	struct bpf_ringbuf_map *rb_map;
@@ -375,6 +655,8 @@ BPF_CALL_3(bpf_ringbuf_reserve, struct bpf_map *, map, u64, size, u64, flags)
 		return 0;
 
 	rb_map = container_of(map, struct bpf_ringbuf_map, map);
+	if (!bpf_ringbuf_stage_flush_local(rb_map->rb))
+		return 0;
 	return (unsigned long)__bpf_ringbuf_reserve(rb_map->rb, size);
 }
 
@@ -445,11 +727,20 @@ BPF_CALL_4(bpf_ringbuf_output, struct bpf_map *, map, void *, data, u64, size,
 {
 	struct bpf_ringbuf_map *rb_map;
 	void *rec;
+	int err;
 
 	if (unlikely(flags & ~(BPF_RB_NO_WAKEUP | BPF_RB_FORCE_WAKEUP)))
 		return -EINVAL;
 
 	rb_map = container_of(map, struct bpf_ringbuf_map, map);
+	if (rb_map->rb->stage) {
+		err = bpf_ringbuf_stage_output(rb_map->rb, data, size, flags);
+		if (err != -E2BIG)
+			return err;
+		if (!bpf_ringbuf_stage_flush_local(rb_map->rb))
+			return -EAGAIN;
+	}
+
 	rec = __bpf_ringbuf_reserve(rb_map->rb, size);
 	if (!rec)
 		return -EAGAIN;
@@ -483,6 +774,8 @@ BPF_CALL_2(bpf_ringbuf_query, struct bpf_map *, map, u64, flags)
 		return smp_load_acquire(&rb->consumer_pos);
 	case BPF_RB_PROD_POS:
 		return smp_load_acquire(&rb->producer_pos);
+	case BPF_RB_BATCH_LOST:
+		return atomic_long_read(&rb->stage_lost);
 	default:
 		return 0;
 	}
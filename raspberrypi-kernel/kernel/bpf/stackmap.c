@@ -11,6 +11,7 @@
 #include <linux/pagemap.h>
 #include <linux/irq_work.h>
 #include <linux/btf_ids.h>
+#include <linux/hash.h>
 #include "percpu_freelist.h"
 
 #define STACK_CREATE_FLAG_MASK					\
@@ -51,6 +52,82 @@ static void do_up_read(struct irq_work *entry)
 
 static DEFINE_PER_CPU(struct stack_map_irq_work, up_read_work);
 
+/* Build IDs of recently seen files, so that stack_map_get_build_id()
+ * does not look up and parse the first page of the same file for every
+ * frame of every sample. Entries are keyed by device, inode number and
+ * generation rather than by the inode pointer, which may be reused for
+ * another file once the inode is freed, and by mtime, so a rewritten
+ * file misses. The writer side of each entry's sequence count is a
+ * cmpxchg, so neither lookups nor updates ever wait, which keeps the
+ * cache usable from NMI.
+ */
+#define BUILD_ID_CACHE_BITS 8
+
+struct build_id_cache_entry {
+	unsigned int seq;
+	int err;
+	dev_t dev;
+	u32 generation;
+	unsigned long ino;
+	struct timespec64 mtime;
+	unsigned char build_id[BPF_BUILD_ID_SIZE];
+};
+
+static struct build_id_cache_entry build_id_cache[1 << BUILD_ID_CACHE_BITS];
+
+static struct build_id_cache_entry *build_id_cache_slot(struct inode *inode)
+{
+	u64 key = ((u64)inode->i_sb->s_dev << 32) ^ inode->i_ino;
+
+	return &build_id_cache[hash_64(key, BUILD_ID_CACHE_BITS)];
+}
+
+static bool build_id_cache_lookup(struct inode *inode,
+				  unsigned char *build_id, int *err)
+{
+	struct build_id_cache_entry *e = build_id_cache_slot(inode);
+	struct timespec64 mtime = inode->i_mtime;
+	unsigned int seq;
+	bool hit;
+
+	seq = smp_load_acquire(&e->seq);
+	if (seq & 1)
+		return false;
+
+	hit = e->ino == inode->i_ino && e->dev == inode->i_sb->s_dev &&
+	      e->generation == inode->i_generation &&
+	      timespec64_equal(&e->mtime, &mtime);
+	if (hit) {
+		*err = e->err;
+		memcpy(build_id, e->build_id, BPF_BUILD_ID_SIZE);
+	}
+
+	/* the entry must not have been rewritten while it was copied */
+	smp_rmb();
+	return hit && READ_ONCE(e->seq) == seq;
+}
+
+static void build_id_cache_update(struct inode *inode,
+				  const struct timespec64 *mtime,
+				  const unsigned char *build_id, int err)
+{
+	struct build_id_cache_entry *e = build_id_cache_slot(inode);
+	unsigned int seq = READ_ONCE(e->seq);
+
+	/* leave the slot to whoever is updating it already */
+	if ((seq & 1) || cmpxchg(&e->seq, seq, seq + 1) != seq)
+		return;
+
+	e->dev = inode->i_sb->s_dev;
+	e->generation = inode->i_generation;
+	e->ino = inode->i_ino;
+	e->mtime = *mtime;
+	e->err = err;
+	memcpy(e->build_id, build_id, BPF_BUILD_ID_SIZE);
+
+	smp_store_release(&e->seq, seq + 2);
+}
+
 static inline bool stack_map_use_build_id(struct bpf_map *map)
 {
 	return (map->map_flags & BPF_F_STACK_BUILD_ID);
@@ -252,6 +329,8 @@ static int stack_map_get_build_id_64(void *page_addr,
 static int stack_map_get_build_id(struct vm_area_struct *vma,
 				  unsigned char *build_id)
 {
+	struct timespec64 mtime;
+	struct inode *inode;
 	Elf32_Ehdr *ehdr;
 	struct page *page;
 	void *page_addr;
@@ -261,6 +340,13 @@ static int stack_map_get_build_id(struct vm_area_struct *vma,
 	if (!vma->vm_file)
 		return -EINVAL;
 
+	inode = file_inode(vma->vm_file);
+	if (build_id_cache_lookup(inode, build_id, &ret))
+		return ret;
+
+	/* read before the page, a concurrent rewrite then only misses */
+	mtime = inode->i_mtime;
+
 	page = find_get_page(vma->vm_file->f_mapping, 0);
 	if (!page)
 		return -EFAULT;	/* page not mapped */
@@ -284,6 +370,9 @@ static int stack_map_get_build_id(struct vm_area_struct *vma,
 out:
 	kunmap_atomic(page_addr);
 	put_page(page);
+
+	/* files without a build ID are remembered as well */
+	build_id_cache_update(inode, &mtime, build_id, ret);
 	return ret;
 }
 
@@ -291,7 +380,8 @@ static void stack_map_get_build_id_offset(struct bpf_stack_build_id *id_offs,
 					  u64 *ips, u32 trace_nr, bool user)
 {
 	int i;
-	struct vm_area_struct *vma;
+	struct vm_area_struct *vma, *prev_vma = NULL;
+	const unsigned char *prev_build_id = NULL;
 	bool irq_work_busy = false;
 	struct stack_map_irq_work *work = NULL;
 
@@ -333,6 +423,14 @@ static void stack_map_get_build_id_offset(struct bpf_stack_build_id *id_offs,
 	}
 
 	for (i = 0; i < trace_nr; i++) {
+		/* consecutive frames are often in the same mapping */
+		if (prev_vma && ips[i] >= prev_vma->vm_start &&
+		    ips[i] < prev_vma->vm_end) {
+			vma = prev_vma;
+			memcpy(id_offs[i].build_id, prev_build_id,
+			       BPF_BUILD_ID_SIZE);
+			goto build_id_valid;
+		}
 		vma = find_vma(current->mm, ips[i]);
 		if (!vma || stack_map_get_build_id(vma, id_offs[i].build_id)) {
 			/* per entry fall back to ips */
@@ -341,9 +439,12 @@ static void stack_map_get_build_id_offset(struct bpf_stack_build_id *id_offs,
 			memset(id_offs[i].build_id, 0, BPF_BUILD_ID_SIZE);
 			continue;
 		}
+build_id_valid:
 		id_offs[i].offset = (vma->vm_pgoff << PAGE_SHIFT) + ips[i]
 			- vma->vm_start;
 		id_offs[i].status = BPF_STACK_BUILD_ID_VALID;
+		prev_vma = vma;
+		prev_build_id = id_offs[i].build_id;
 	}
 
 	if (!work) {
@@ -31,6 +31,7 @@
 #include <linux/poll.h>
 #include <linux/bpf-netns.h>
 #include <linux/rcupdate_trace.h>
+#include <linux/sort.h>
 
 #define IS_FD_ARRAY(map) ((map)->map_type == BPF_MAP_TYPE_PERF_EVENT_ARRAY || \
 			  (map)->map_type == BPF_MAP_TYPE_CGROUP_ARRAY || \
@@ -170,6 +171,7 @@ static int bpf_map_update_value(struct bpf_map *map, struct fd f, void *key,
 						    flags);
 	}
 
+again:
 	bpf_disable_instrumentation();
 	if (map->map_type == BPF_MAP_TYPE_PERCPU_HASH ||
 	    map->map_type == BPF_MAP_TYPE_LRU_PERCPU_HASH) {
@@ -194,7 +196,8 @@ static int bpf_map_update_value(struct bpf_map *map, struct fd f, void *key,
 		err = bpf_fd_reuseport_array_update_elem(map, key, value,
 							 flags);
 	} else if (map->map_type == BPF_MAP_TYPE_QUEUE ||
-		   map->map_type == BPF_MAP_TYPE_STACK) {
+		   map->map_type == BPF_MAP_TYPE_STACK ||
+		   map->map_type == BPF_MAP_TYPE_BLOOM_FILTER) {
 		err = map->ops->map_push_elem(map, value, flags);
 	} else {
 		rcu_read_lock();
@@ -202,6 +205,16 @@ static int bpf_map_update_value(struct bpf_map *map, struct fd f, void *key,
 		rcu_read_unlock();
 	}
 	bpf_enable_instrumentation();
+
+	/* The spare elements of a lockless hash map are all waiting for a
+	 * grace period. Programs can't wait for them, syscalls can.
+	 */
+	if (err == -EBUSY && map->map_type == BPF_MAP_TYPE_HASH &&
+	    (map->map_flags & BPF_F_LOCKLESS) && !fatal_signal_pending(current)) {
+		rcu_barrier();
+		goto again;
+	}
+
 	maybe_wait_bpf_programs(map);
 
 	return err;
@@ -233,7 +246,8 @@ static int bpf_map_copy_value(struct bpf_map *map, void *key, void *value,
 	} else if (map->map_type == BPF_MAP_TYPE_REUSEPORT_SOCKARRAY) {
 		err = bpf_fd_reuseport_array_lookup_elem(map, key, value);
 	} else if (map->map_type == BPF_MAP_TYPE_QUEUE ||
-		   map->map_type == BPF_MAP_TYPE_STACK) {
+		   map->map_type == BPF_MAP_TYPE_STACK ||
+		   map->map_type == BPF_MAP_TYPE_BLOOM_FILTER) {
 		err = map->ops->map_peek_elem(map, value);
 	} else if (map->map_type == BPF_MAP_TYPE_STRUCT_OPS) {
 		/* struct_ops map requires directly updating "value" */
@@ -339,6 +353,7 @@ void bpf_map_init_from_attr(struct bpf_map *map, union bpf_attr *attr)
 	map->max_entries = attr->max_entries;
 	map->map_flags = bpf_map_flags_retain_permanent(attr->map_flags);
 	map->numa_node = bpf_map_attr_numa_node(attr);
+	map->map_extra = attr->map_extra;
 }
 
 static int bpf_charge_memlock(struct user_struct *user, u32 pages)
@@ -545,6 +560,7 @@ static void bpf_map_show_fdinfo(struct seq_file *m, struct file *filp)
 		   "value_size:\t%u\n"
 		   "max_entries:\t%u\n"
 		   "map_flags:\t%#x\n"
+		   "map_extra:\t%#llx\n"
 		   "memlock:\t%llu\n"
 		   "map_id:\t%u\n"
 		   "frozen:\t%u\n",
@@ -553,6 +569,7 @@ static void bpf_map_show_fdinfo(struct seq_file *m, struct file *filp)
 		   map->value_size,
 		   map->max_entries,
 		   map->map_flags,
+		   (unsigned long long)map->map_extra,
 		   map->memory.pages * 1ULL << PAGE_SHIFT,
 		   map->id,
 		   READ_ONCE(map->frozen));
@@ -560,6 +577,8 @@ static void bpf_map_show_fdinfo(struct seq_file *m, struct file *filp)
 		seq_printf(m, "owner_prog_type:\t%u\n", type);
 		seq_printf(m, "owner_jited:\t%u\n", jited);
 	}
+	if (map->ops->map_show_fdinfo)
+		map->ops->map_show_fdinfo(map, m);
 }
 #endif
 
@@ -790,7 +809,7 @@ static int map_check_btf(struct bpf_map *map, const struct btf *btf,
 	return ret;
 }
 
-#define BPF_MAP_CREATE_LAST_FIELD btf_vmlinux_value_type_id
+#define BPF_MAP_CREATE_LAST_FIELD map_extra
 /* called via syscall */
 static int map_create(union bpf_attr *attr)
 {
@@ -812,6 +831,10 @@ static int map_create(union bpf_attr *attr)
 		return -EINVAL;
 	}
 
+	if (attr->map_type != BPF_MAP_TYPE_BLOOM_FILTER &&
+	    attr->map_extra != 0)
+		return -EINVAL;
+
 	f_flags = bpf_get_file_flag(attr->map_flags);
 	if (f_flags < 0)
 		return f_flags;
@@ -1044,6 +1067,15 @@ static int map_lookup_elem(union bpf_attr *attr)
 	if (!value)
 		goto free_key;
 
+	if (map->map_type == BPF_MAP_TYPE_BLOOM_FILTER) {
+		/* The value is the element to test for membership */
+		if (copy_from_user(value, uvalue, value_size))
+			err = -EFAULT;
+		else
+			err = bpf_map_copy_value(map, key, value, attr->flags);
+		goto free_value;
+	}
+
 	err = bpf_map_copy_value(map, key, value, attr->flags);
 	if (err)
 		goto free_value;
@@ -1808,14 +1840,16 @@ static void bpf_prog_show_fdinfo(struct seq_file *m, struct file *filp)
 		   "memlock:\t%llu\n"
 		   "prog_id:\t%u\n"
 		   "run_time_ns:\t%llu\n"
-		   "run_cnt:\t%llu\n",
+		   "run_cnt:\t%llu\n"
+		   "verified_insns:\t%u\n",
 		   prog->type,
 		   prog->jited,
 		   prog_tag,
 		   prog->pages * 1ULL << PAGE_SHIFT,
 		   prog->aux->id,
 		   stats.nsecs,
-		   stats.cnt);
+		   stats.cnt,
+		   prog->aux->verified_insns);
 }
 #endif
 
@@ -2111,7 +2145,8 @@ static int bpf_prog_load(union bpf_attr *attr, union bpf_attr __user *uattr)
 				 BPF_F_ANY_ALIGNMENT |
 				 BPF_F_TEST_STATE_FREQ |
 				 BPF_F_SLEEPABLE |
-				 BPF_F_TEST_RND_HI32))
+				 BPF_F_TEST_RND_HI32 |
+				 BPF_F_MULTI_FUNC))
 		return -EINVAL;
 
 	if (!IS_ENABLED(CONFIG_HAVE_EFFICIENT_UNALIGNED_ACCESS) &&
@@ -2167,6 +2202,7 @@ static int bpf_prog_load(union bpf_attr *attr, union bpf_attr __user *uattr)
 
 	prog->aux->offload_requested = !!attr->prog_ifindex;
 	prog->aux->sleepable = attr->prog_flags & BPF_F_SLEEPABLE;
+	prog->aux->multi_func = attr->prog_flags & BPF_F_MULTI_FUNC;
 
 	err = security_bpf_prog_alloc(prog->aux);
 	if (err)
@@ -2574,6 +2610,11 @@ static int bpf_tracing_prog_attach(struct bpf_prog *prog,
 			err = -EINVAL;
 			goto out_put_prog;
 		}
+		/* Attached with BPF_LINK_CREATE and link_create.multi */
+		if (prog->aux->multi_func) {
+			err = -EINVAL;
+			goto out_put_prog;
+		}
 		break;
 	case BPF_PROG_TYPE_EXT:
 		if (prog->expected_attach_type != 0) {
@@ -2720,6 +2761,165 @@ out_put_prog:
 	return err;
 }
 
+/* Enough for every function in vmlinux BTF */
+#define BPF_TRACING_MULTI_MAX	(1U << 16)
+
+struct bpf_tracing_multi_link {
+	struct bpf_link link;
+	enum bpf_attach_type attach_type;
+	u32 cnt;
+	struct bpf_trampoline **trampolines;
+	struct bpf_tramp_node *nodes;
+};
+
+static void bpf_tracing_multi_link_release(struct bpf_link *link)
+{
+	struct bpf_tracing_multi_link *tr_link =
+		container_of(link, struct bpf_tracing_multi_link, link);
+
+	bpf_trampoline_multi_unlink(tr_link->trampolines, tr_link->nodes,
+				    tr_link->cnt);
+}
+
+static void bpf_tracing_multi_link_dealloc(struct bpf_link *link)
+{
+	struct bpf_tracing_multi_link *tr_link =
+		container_of(link, struct bpf_tracing_multi_link, link);
+
+	if (tr_link->trampolines)
+		bpf_trampoline_put_many(tr_link->trampolines, tr_link->cnt);
+	kvfree(tr_link->trampolines);
+	kvfree(tr_link->nodes);
+	kfree(tr_link);
+}
+
+static void bpf_tracing_multi_link_show_fdinfo(const struct bpf_link *link,
+					       struct seq_file *seq)
+{
+	struct bpf_tracing_multi_link *tr_link =
+		container_of(link, struct bpf_tracing_multi_link, link);
+
+	seq_printf(seq,
+		   "attach_type:\t%d\n"
+		   "func_cnt:\t%u\n",
+		   tr_link->attach_type,
+		   tr_link->cnt);
+}
+
+static int bpf_tracing_multi_link_fill_link_info(const struct bpf_link *link,
+						 struct bpf_link_info *info)
+{
+	struct bpf_tracing_multi_link *tr_link =
+		container_of(link, struct bpf_tracing_multi_link, link);
+
+	info->tracing_multi.attach_type = tr_link->attach_type;
+	info->tracing_multi.func_cnt = tr_link->cnt;
+
+	return 0;
+}
+
+static const struct bpf_link_ops bpf_tracing_multi_link_lops = {
+	.release = bpf_tracing_multi_link_release,
+	.dealloc = bpf_tracing_multi_link_dealloc,
+	.show_fdinfo = bpf_tracing_multi_link_show_fdinfo,
+	.fill_link_info = bpf_tracing_multi_link_fill_link_info,
+};
+
+static int btf_id_cmp(const void *a, const void *b)
+{
+	const u32 *x = a, *y = b;
+
+	return *x < *y ? -1 : *x > *y;
+}
+
+static int bpf_tracing_multi_attach(struct bpf_prog *prog,
+				    const union bpf_attr *attr)
+{
+	void __user *ubtf_ids = u64_to_user_ptr(attr->link_create.multi.btf_ids);
+	u32 cnt = attr->link_create.multi.btf_ids_cnt;
+	struct bpf_attach_target_info *tgt_info = NULL;
+	struct bpf_tracing_multi_link *link = NULL;
+	struct bpf_link_primer link_primer;
+	u32 *btf_ids;
+	int err;
+	u32 i;
+
+	if (!cnt || cnt > BPF_TRACING_MULTI_MAX ||
+	    attr->link_create.target_fd || attr->link_create.flags)
+		return -EINVAL;
+
+	btf_ids = kvmalloc_array(cnt, sizeof(*btf_ids), GFP_KERNEL);
+	if (!btf_ids)
+		return -ENOMEM;
+
+	err = -EFAULT;
+	if (copy_from_user(btf_ids, ubtf_ids, cnt * sizeof(*btf_ids)))
+		goto out_free;
+
+	/* A function can't be hooked twice by the same program */
+	sort(btf_ids, cnt, sizeof(*btf_ids), btf_id_cmp, NULL);
+	err = -EINVAL;
+	for (i = 1; i < cnt; i++)
+		if (btf_ids[i] == btf_ids[i - 1])
+			goto out_free;
+
+	err = -ENOMEM;
+	tgt_info = kvcalloc(cnt, sizeof(*tgt_info), GFP_KERNEL);
+	if (!tgt_info)
+		goto out_free;
+
+	err = bpf_check_attach_multi(NULL, btf_ids, cnt, tgt_info);
+	if (err)
+		goto out_free;
+
+	err = -ENOMEM;
+	link = kzalloc(sizeof(*link), GFP_USER);
+	if (!link)
+		goto out_free;
+	bpf_link_init(&link->link, BPF_LINK_TYPE_TRACING_MULTI,
+		      &bpf_tracing_multi_link_lops, prog);
+	link->attach_type = prog->expected_attach_type;
+	link->cnt = cnt;
+	/* these scale with cnt, charge them to the loader's memcg */
+	link->trampolines = kvcalloc(cnt, sizeof(*link->trampolines),
+				     GFP_USER | __GFP_ACCOUNT);
+	link->nodes = kvcalloc(cnt, sizeof(*link->nodes),
+			       GFP_USER | __GFP_ACCOUNT);
+	if (!link->trampolines || !link->nodes)
+		goto out_dealloc;
+
+	for (i = 0; i < cnt; i++) {
+		u64 key = bpf_trampoline_compute_key(NULL, btf_ids[i]);
+
+		link->trampolines[i] = bpf_trampoline_get(key, &tgt_info[i]);
+		if (!link->trampolines[i])
+			goto out_dealloc;
+	}
+
+	err = bpf_link_prime(&link->link, &link_primer);
+	if (err)
+		goto out_dealloc;
+
+	err = bpf_trampoline_multi_link(prog, link->trampolines, link->nodes,
+					cnt);
+	if (err) {
+		/* frees the link through bpf_tracing_multi_link_dealloc() */
+		bpf_link_cleanup(&link_primer);
+		goto out_free;
+	}
+
+	kvfree(tgt_info);
+	kvfree(btf_ids);
+	return bpf_link_settle(&link_primer);
+
+out_dealloc:
+	bpf_tracing_multi_link_dealloc(&link->link);
+out_free:
+	kvfree(tgt_info);
+	kvfree(btf_ids);
+	return err;
+}
+
 struct bpf_raw_tp_link {
 	struct bpf_link link;
 	struct bpf_raw_event_map *btp;
@@ -3443,6 +3643,7 @@ static int bpf_prog_get_info_by_fd(struct file *file,
 	bpf_prog_get_stats(prog, &stats);
 	info.run_time_ns = stats.nsecs;
 	info.run_cnt = stats.cnt;
+	info.verified_insns = prog->aux->verified_insns;
 
 	if (!bpf_capable()) {
 		info.jited_prog_len = 0;
@@ -3690,6 +3891,7 @@ static int bpf_map_get_info_by_fd(struct file *file,
 	info.value_size = map->value_size;
 	info.max_entries = map->max_entries;
 	info.map_flags = map->map_flags;
+	info.map_extra = map->map_extra;
 	memcpy(info.name, map->name, sizeof(map->name));
 
 	if (map->btf) {
@@ -4020,6 +4222,8 @@ static int tracing_bpf_link_attach(const union bpf_attr *attr, struct bpf_prog *
 
 	if (prog->expected_attach_type == BPF_TRACE_ITER)
 		return bpf_iter_link_attach(attr, prog);
+	else if (prog->aux->multi_func)
+		return bpf_tracing_multi_attach(prog, attr);
 	else if (prog->type == BPF_PROG_TYPE_EXT)
 		return bpf_tracing_prog_attach(prog,
 					       attr->link_create.target_fd,
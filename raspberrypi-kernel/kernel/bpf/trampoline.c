@@ -9,6 +9,7 @@
 #include <linux/btf.h>
 #include <linux/rcupdate_trace.h>
 #include <linux/rcupdate_wait.h>
+#include <linux/rwsem.h>
 
 /* dummy _ops. The verifier will operate on target program's ops. */
 const struct bpf_verifier_ops bpf_extension_verifier_ops = {
@@ -25,6 +26,21 @@ static struct hlist_head trampoline_table[TRAMPOLINE_TABLE_SIZE];
 /* serializes access to trampoline_table */
 static DEFINE_MUTEX(trampoline_mutex);
 
+/* Attaching one program to many trampolines would need as many trampoline
+ * mutexes. Instead, the batched operations take this for write and the
+ * single program ones take it for read, before the trampoline mutex.
+ */
+static DECLARE_RWSEM(trampoline_batch_sem);
+
+/* Layout of the trampoline stack for BPF_F_MULTI_FUNC programs: they can
+ * be attached to any function whose arguments fit in six registers.
+ */
+static const struct btf_func_model bpf_multi_func_model = {
+	.ret_size = 8,
+	.nr_args = BPF_MULTI_FUNC_ARGS,
+	.arg_size = { 8, 8, 8, 8, 8, 8 },
+};
+
 void *bpf_jit_alloc_exec_page(void)
 {
 	void *image;
@@ -84,9 +100,17 @@ static struct bpf_trampoline *bpf_trampoline_lookup(u64 key)
 	if (!tr)
 		goto out;
 
-	/* is_root was checked earlier. No need for bpf_jit_charge_modmem() */
+	/* A multi link may create one trampoline per target function, so
+	 * the images count against the JIT limit like programs do.
+	 */
+	if (bpf_jit_charge_modmem(1)) {
+		kfree(tr);
+		tr = NULL;
+		goto out;
+	}
 	image = bpf_jit_alloc_exec_page();
 	if (!image) {
+		bpf_jit_uncharge_modmem(1);
 		kfree(tr);
 		tr = NULL;
 		goto out;
@@ -97,8 +121,10 @@ static struct bpf_trampoline *bpf_trampoline_lookup(u64 key)
 	hlist_add_head(&tr->hlist, head);
 	refcount_set(&tr->refcnt, 1);
 	mutex_init(&tr->mutex);
-	for (i = 0; i < BPF_TRAMP_MAX; i++)
+	for (i = 0; i < BPF_TRAMP_MAX; i++) {
 		INIT_HLIST_HEAD(&tr->progs_hlist[i]);
+		INIT_HLIST_HEAD(&tr->multi_hlist[i]);
+	}
 	tr->image = image;
 	INIT_LIST_HEAD_RCU(&tr->ksym.lnode);
 	bpf_trampoline_ksym_add(tr);
@@ -165,6 +191,7 @@ static struct bpf_tramp_progs *
 bpf_trampoline_get_progs(const struct bpf_trampoline *tr, int *total)
 {
 	const struct bpf_prog_aux *aux;
+	const struct bpf_tramp_node *node;
 	struct bpf_tramp_progs *tprogs;
 	struct bpf_prog **progs;
 	int kind;
@@ -175,20 +202,37 @@ bpf_trampoline_get_progs(const struct bpf_trampoline *tr, int *total)
 		return ERR_PTR(-ENOMEM);
 
 	for (kind = 0; kind < BPF_TRAMP_MAX; kind++) {
-		tprogs[kind].nr_progs = tr->progs_cnt[kind];
-		*total += tr->progs_cnt[kind];
+		tprogs[kind].nr_progs = tr->progs_cnt[kind] + tr->multi_cnt[kind];
+		*total += tprogs[kind].nr_progs;
 		progs = tprogs[kind].progs;
 
 		hlist_for_each_entry(aux, &tr->progs_hlist[kind], tramp_hlist)
 			*progs++ = aux->prog;
+		hlist_for_each_entry(node, &tr->multi_hlist[kind], hlist)
+			*progs++ = node->prog;
 	}
 	return tprogs;
 }
 
-static int bpf_trampoline_update(struct bpf_trampoline *tr)
+static int bpf_trampoline_progs_cnt(const struct bpf_trampoline *tr)
+{
+	int kind, cnt = 0;
+
+	for (kind = 0; kind < BPF_TRAMP_MAX; kind++)
+		cnt += tr->progs_cnt[kind] + tr->multi_cnt[kind];
+	return cnt;
+}
+
+static bool bpf_trampoline_has_multi(const struct bpf_trampoline *tr)
+{
+	return tr->multi_cnt[BPF_TRAMP_FENTRY] || tr->multi_cnt[BPF_TRAMP_FEXIT];
+}
+
+/* Generate the code for the current progs into the unused half of the image */
+static int bpf_trampoline_prepare(struct bpf_trampoline *tr)
 {
-	void *old_image = tr->image + ((tr->selector + 1) & 1) * PAGE_SIZE/2;
 	void *new_image = tr->image + (tr->selector & 1) * PAGE_SIZE/2;
+	const struct btf_func_model *m = &tr->func.model;
 	struct bpf_tramp_progs *tprogs;
 	u32 flags = BPF_TRAMP_F_RESTORE_REGS;
 	int err, total;
@@ -197,33 +241,42 @@ static int bpf_trampoline_update(struct bpf_trampoline *tr)
 	if (IS_ERR(tprogs))
 		return PTR_ERR(tprogs);
 
-	if (total == 0) {
-		err = unregister_fentry(tr, old_image);
-		tr->selector = 0;
+	/* bpf_trampoline_switch() detaches the trampoline */
+	err = 0;
+	if (total == 0)
 		goto out;
-	}
 
 	if (tprogs[BPF_TRAMP_FEXIT].nr_progs ||
 	    tprogs[BPF_TRAMP_MODIFY_RETURN].nr_progs)
 		flags = BPF_TRAMP_F_CALL_ORIG | BPF_TRAMP_F_SKIP_FRAME;
 
-	/* Though the second half of trampoline page is unused a task could be
-	 * preempted in the middle of the first half of trampoline and two
-	 * updates to trampoline would change the code from underneath the
-	 * preempted task. Hence wait for tasks to voluntarily schedule or go
-	 * to userspace.
-	 * The same trampoline can hold both sleepable and non-sleepable progs.
-	 * synchronize_rcu_tasks_trace() is needed to make sure all sleepable
-	 * programs finish executing.
-	 * Wait for these two grace periods together.
+	/* The regular progs don't mind the wider model, see
+	 * bpf_trampoline_link_prog()
 	 */
-	synchronize_rcu_mult(call_rcu_tasks, call_rcu_tasks_trace);
+	if (bpf_trampoline_has_multi(tr))
+		m = &bpf_multi_func_model;
 
 	err = arch_prepare_bpf_trampoline(new_image, new_image + PAGE_SIZE / 2,
-					  &tr->func.model, flags, tprogs,
-					  tr->func.addr);
-	if (err < 0)
-		goto out;
+					  m, flags, tprogs, tr->func.addr);
+	if (err > 0)
+		err = 0;
+out:
+	kfree(tprogs);
+	return err;
+}
+
+/* Make the function call the code generated by bpf_trampoline_prepare() */
+static int bpf_trampoline_switch(struct bpf_trampoline *tr)
+{
+	void *old_image = tr->image + ((tr->selector + 1) & 1) * PAGE_SIZE/2;
+	void *new_image = tr->image + (tr->selector & 1) * PAGE_SIZE/2;
+	int err;
+
+	if (!bpf_trampoline_progs_cnt(tr)) {
+		err = unregister_fentry(tr, old_image);
+		tr->selector = 0;
+		return err;
+	}
 
 	if (tr->selector)
 		/* progs already running at this address */
@@ -232,11 +285,32 @@ static int bpf_trampoline_update(struct bpf_trampoline *tr)
 		/* first time registering */
 		err = register_fentry(tr, new_image);
 	if (err)
-		goto out;
+		return err;
 	tr->selector++;
-out:
-	kfree(tprogs);
-	return err;
+	return 0;
+}
+
+static int bpf_trampoline_update(struct bpf_trampoline *tr)
+{
+	int err;
+
+	/* Though the second half of trampoline page is unused a task could be
+	 * preempted in the middle of the first half of trampoline and two
+	 * updates to trampoline would change the code from underneath the
+	 * preempted task. Hence wait for tasks to voluntarily schedule or go
+	 * to userspace.
+	 * The same trampoline can hold both sleepable and non-sleepable progs.
+	 * synchronize_rcu_tasks_trace() is needed to make sure all sleepable
+	 * programs finish executing.
+	 * Wait for these two grace periods together.
+	 */
+	if (bpf_trampoline_progs_cnt(tr))
+		synchronize_rcu_mult(call_rcu_tasks, call_rcu_tasks_trace);
+
+	err = bpf_trampoline_prepare(tr);
+	if (err)
+		return err;
+	return bpf_trampoline_switch(tr);
 }
 
 static enum bpf_tramp_prog_type bpf_attach_type_to_tramp(struct bpf_prog *prog)
@@ -268,6 +342,7 @@ int bpf_trampoline_link_prog(struct bpf_prog *prog, struct bpf_trampoline *tr)
 	int cnt;
 
 	kind = bpf_attach_type_to_tramp(prog);
+	down_read(&trampoline_batch_sem);
 	mutex_lock(&tr->mutex);
 	if (tr->extension_prog) {
 		/* cannot attach fentry/fexit if extension prog is attached.
@@ -276,7 +351,16 @@ int bpf_trampoline_link_prog(struct bpf_prog *prog, struct bpf_trampoline *tr)
 		err = -EBUSY;
 		goto out;
 	}
-	cnt = tr->progs_cnt[BPF_TRAMP_FENTRY] + tr->progs_cnt[BPF_TRAMP_FEXIT];
+	if (bpf_trampoline_has_multi(tr) &&
+	    (kind == BPF_TRAMP_FEXIT || kind == BPF_TRAMP_MODIFY_RETURN)) {
+		/* The trampoline uses bpf_multi_func_model, which stores the
+		 * return value where this prog expects its argument count.
+		 */
+		err = -EBUSY;
+		goto out;
+	}
+	cnt = tr->progs_cnt[BPF_TRAMP_FENTRY] + tr->progs_cnt[BPF_TRAMP_FEXIT] +
+	      tr->multi_cnt[BPF_TRAMP_FENTRY] + tr->multi_cnt[BPF_TRAMP_FEXIT];
 	if (kind == BPF_TRAMP_REPLACE) {
 		/* Cannot attach extension if fentry/fexit are in use. */
 		if (cnt) {
@@ -306,6 +390,7 @@ int bpf_trampoline_link_prog(struct bpf_prog *prog, struct bpf_trampoline *tr)
 	}
 out:
 	mutex_unlock(&tr->mutex);
+	up_read(&trampoline_batch_sem);
 	return err;
 }
 
@@ -316,6 +401,7 @@ int bpf_trampoline_unlink_prog(struct bpf_prog *prog, struct bpf_trampoline *tr)
 	int err;
 
 	kind = bpf_attach_type_to_tramp(prog);
+	down_read(&trampoline_batch_sem);
 	mutex_lock(&tr->mutex);
 	if (kind == BPF_TRAMP_REPLACE) {
 		WARN_ON_ONCE(!tr->extension_prog);
@@ -329,9 +415,185 @@ int bpf_trampoline_unlink_prog(struct bpf_prog *prog, struct bpf_trampoline *tr)
 	err = bpf_trampoline_update(tr);
 out:
 	mutex_unlock(&tr->mutex);
+	up_read(&trampoline_batch_sem);
 	return err;
 }
 
+/* Undo bpf_trampoline_multi_link() for the first @cnt trampolines. The
+ * ones among the first @switched that already call the new code are
+ * updated again without @nodes.
+ */
+static void bpf_trampoline_multi_revert(struct bpf_trampoline **trs,
+					struct bpf_tramp_node *nodes,
+					enum bpf_tramp_prog_type kind,
+					u32 cnt, u32 switched)
+{
+	u32 i;
+
+	for (i = 0; i < cnt; i++) {
+		hlist_del_init(&nodes[i].hlist);
+		trs[i]->multi_cnt[kind]--;
+		if (i < switched && trs[i]->selector)
+			WARN_ON_ONCE(bpf_trampoline_update(trs[i]));
+	}
+}
+
+/* Attach @prog to all of @trs, linking it through @nodes[i] into @trs[i].
+ *
+ * Unlike @cnt calls to bpf_trampoline_link_prog(), this waits for a single
+ * RCU tasks grace period before rewriting the images, and the functions
+ * that are not hooked yet are all registered with one ftrace update
+ * instead of one text patching pass each. Either @prog is attached to
+ * all of @trs, or to none of them.
+ */
+int bpf_trampoline_multi_link(struct bpf_prog *prog,
+			      struct bpf_trampoline **trs,
+			      struct bpf_tramp_node *nodes, u32 cnt)
+{
+	enum bpf_tramp_prog_type kind = bpf_attach_type_to_tramp(prog);
+	unsigned long *ips, *addrs;
+	u32 i, added = 0, nr_ips = 0;
+	int err = -ENOMEM;
+
+	ips = kvcalloc(cnt, sizeof(*ips), GFP_KERNEL);
+	addrs = kvcalloc(cnt, sizeof(*addrs), GFP_KERNEL);
+	if (!ips || !addrs)
+		goto out_free;
+
+	down_write(&trampoline_batch_sem);
+	for (i = 0; i < cnt; i++) {
+		struct bpf_trampoline *tr = trs[i];
+
+		if (tr->extension_prog ||
+		    tr->progs_cnt[BPF_TRAMP_FEXIT] ||
+		    tr->progs_cnt[BPF_TRAMP_MODIFY_RETURN]) {
+			err = -EBUSY;
+			goto out_revert;
+		}
+		if (tr->progs_cnt[BPF_TRAMP_FENTRY] +
+		    tr->multi_cnt[BPF_TRAMP_FENTRY] +
+		    tr->multi_cnt[BPF_TRAMP_FEXIT] >= BPF_MAX_TRAMP_PROGS) {
+			err = -E2BIG;
+			goto out_revert;
+		}
+		nodes[i].prog = prog;
+		hlist_add_head(&nodes[i].hlist, &tr->multi_hlist[kind]);
+		tr->multi_cnt[kind]++;
+		added++;
+	}
+
+	/* One grace period for all the images, see bpf_trampoline_update() */
+	synchronize_rcu_mult(call_rcu_tasks, call_rcu_tasks_trace);
+
+	for (i = 0; i < cnt; i++) {
+		err = bpf_trampoline_prepare(trs[i]);
+		if (err)
+			goto out_revert;
+	}
+
+	/* Functions that are already hooked are switched one at a time, the
+	 * fresh ftrace managed ones are left for register_ftrace_direct_ips().
+	 */
+	for (i = 0; i < cnt; i++) {
+		struct bpf_trampoline *tr = trs[i];
+
+		if (!tr->selector) {
+			err = is_ftrace_location(tr->func.addr);
+			if (err < 0)
+				goto out_unswitch;
+			tr->func.ftrace_managed = err;
+			if (tr->func.ftrace_managed) {
+				ips[nr_ips] = (unsigned long)tr->func.addr;
+				addrs[nr_ips++] = (unsigned long)tr->image;
+				continue;
+			}
+		}
+		err = bpf_trampoline_switch(tr);
+		if (err)
+			goto out_unswitch;
+	}
+
+	err = register_ftrace_direct_ips(ips, addrs, nr_ips);
+	if (err) {
+		i = cnt;
+		goto out_unswitch;
+	}
+	/* The first half of the image was used, as selector was 0 */
+	for (i = 0; i < cnt; i++)
+		if (!trs[i]->selector)
+			trs[i]->selector++;
+	goto out_unlock;
+
+out_unswitch:
+	bpf_trampoline_multi_revert(trs, nodes, kind, added, i);
+	goto out_unlock;
+out_revert:
+	bpf_trampoline_multi_revert(trs, nodes, kind, added, 0);
+out_unlock:
+	up_write(&trampoline_batch_sem);
+out_free:
+	kvfree(ips);
+	kvfree(addrs);
+	return err;
+}
+
+/* Detach the program linked through @nodes from all of @trs, the
+ * counterpart of bpf_trampoline_multi_link(). It should never fail.
+ */
+void bpf_trampoline_multi_unlink(struct bpf_trampoline **trs,
+				 struct bpf_tramp_node *nodes, u32 cnt)
+{
+	enum bpf_tramp_prog_type kind;
+	unsigned long *ips, *addrs;
+	bool need_sync = false;
+	u32 i, nr_ips = 0;
+
+	if (!cnt)
+		return;
+
+	kind = bpf_attach_type_to_tramp(nodes[0].prog);
+	/* Without the arrays every trampoline is detached on its own */
+	ips = kvcalloc(cnt, sizeof(*ips), GFP_KERNEL);
+	addrs = kvcalloc(cnt, sizeof(*addrs), GFP_KERNEL);
+
+	down_write(&trampoline_batch_sem);
+	for (i = 0; i < cnt; i++) {
+		hlist_del_init(&nodes[i].hlist);
+		trs[i]->multi_cnt[kind]--;
+		if (bpf_trampoline_progs_cnt(trs[i]))
+			need_sync = true;
+	}
+
+	/* Only the images that keep other progs are rewritten */
+	if (need_sync)
+		synchronize_rcu_mult(call_rcu_tasks, call_rcu_tasks_trace);
+
+	for (i = 0; i < cnt; i++) {
+		struct bpf_trampoline *tr = trs[i];
+
+		if (ips && addrs && tr->func.ftrace_managed &&
+		    !bpf_trampoline_progs_cnt(tr)) {
+			ips[nr_ips] = (unsigned long)tr->func.addr;
+			addrs[nr_ips++] = (unsigned long)tr->image +
+				((tr->selector + 1) & 1) * PAGE_SIZE/2;
+			continue;
+		}
+		WARN_ON_ONCE(bpf_trampoline_prepare(tr) ||
+			     bpf_trampoline_switch(tr));
+	}
+
+	if (nr_ips) {
+		WARN_ON_ONCE(unregister_ftrace_direct_ips(ips, addrs, nr_ips));
+		for (i = 0; i < cnt; i++)
+			if (!bpf_trampoline_progs_cnt(trs[i]))
+				trs[i]->selector = 0;
+	}
+	up_write(&trampoline_batch_sem);
+
+	kvfree(ips);
+	kvfree(addrs);
+}
+
 struct bpf_trampoline *bpf_trampoline_get(u64 key,
 					  struct bpf_attach_target_info *tgt_info)
 {
@@ -352,6 +614,20 @@ out:
 	return tr;
 }
 
+static bool bpf_trampoline_unused(struct bpf_trampoline *tr)
+{
+	WARN_ON_ONCE(mutex_is_locked(&tr->mutex));
+	if (WARN_ON_ONCE(!hlist_empty(&tr->progs_hlist[BPF_TRAMP_FENTRY])))
+		return false;
+	if (WARN_ON_ONCE(!hlist_empty(&tr->progs_hlist[BPF_TRAMP_FEXIT])))
+		return false;
+	if (WARN_ON_ONCE(!hlist_empty(&tr->multi_hlist[BPF_TRAMP_FENTRY])))
+		return false;
+	if (WARN_ON_ONCE(!hlist_empty(&tr->multi_hlist[BPF_TRAMP_FEXIT])))
+		return false;
+	return true;
+}
+
 void bpf_trampoline_put(struct bpf_trampoline *tr)
 {
 	if (!tr)
@@ -359,10 +635,7 @@ void bpf_trampoline_put(struct bpf_trampoline *tr)
 	mutex_lock(&trampoline_mutex);
 	if (!refcount_dec_and_test(&tr->refcnt))
 		goto out;
-	WARN_ON_ONCE(mutex_is_locked(&tr->mutex));
-	if (WARN_ON_ONCE(!hlist_empty(&tr->progs_hlist[BPF_TRAMP_FENTRY])))
-		goto out;
-	if (WARN_ON_ONCE(!hlist_empty(&tr->progs_hlist[BPF_TRAMP_FEXIT])))
+	if (!bpf_trampoline_unused(tr))
 		goto out;
 	bpf_image_ksym_del(&tr->ksym);
 	/* This code will be executed when all bpf progs (both sleepable and
@@ -375,12 +648,50 @@ void bpf_trampoline_put(struct bpf_trampoline *tr)
 	 */
 	synchronize_rcu_tasks();
 	bpf_jit_free_exec(tr->image);
+	bpf_jit_uncharge_modmem(1);
 	hlist_del(&tr->hlist);
 	kfree(tr);
 out:
 	mutex_unlock(&trampoline_mutex);
 }
 
+/* bpf_trampoline_put() for all of @trs, with one synchronize_rcu_tasks()
+ * for all the images that are freed. The entries of @trs are cleared.
+ */
+void bpf_trampoline_put_many(struct bpf_trampoline **trs, u32 cnt)
+{
+	bool freed = false;
+	u32 i;
+
+	mutex_lock(&trampoline_mutex);
+	for (i = 0; i < cnt; i++) {
+		if (!trs[i])
+			continue;
+		if (!refcount_dec_and_test(&trs[i]->refcnt) ||
+		    !bpf_trampoline_unused(trs[i])) {
+			trs[i] = NULL;
+			continue;
+		}
+		bpf_image_ksym_del(&trs[i]->ksym);
+		freed = true;
+	}
+
+	/* See bpf_trampoline_put() */
+	if (freed)
+		synchronize_rcu_tasks();
+
+	for (i = 0; i < cnt; i++) {
+		if (!trs[i])
+			continue;
+		bpf_jit_free_exec(trs[i]->image);
+		bpf_jit_uncharge_modmem(1);
+		hlist_del(&trs[i]->hlist);
+		kfree(trs[i]);
+		trs[i] = NULL;
+	}
+	mutex_unlock(&trampoline_mutex);
+}
+
 /* The logic is similar to BPF_PROG_RUN, but with an explicit
  * rcu_read_lock() and migrate_disable() which are required
  * for the trampoline. The macro is split into
@@ -181,11 +181,6 @@ struct bpf_verifier_stack_elem {
 #define BPF_MAP_KEY_POISON	(1ULL << 63)
 #define BPF_MAP_KEY_SEEN	(1ULL << 62)
 
-#define BPF_MAP_PTR_UNPRIV	1UL
-#define BPF_MAP_PTR_POISON	((void *)((0xeB9FUL << 1) +	\
-					  POISON_POINTER_DELTA))
-#define BPF_MAP_PTR(X)		((struct bpf_map *)((X) & ~BPF_MAP_PTR_UNPRIV))
-
 static bool bpf_map_ptr_poisoned(const struct bpf_insn_aux_data *aux)
 {
 	return BPF_MAP_PTR(aux->map_ptr_state) == BPF_MAP_PTR_POISON;
@@ -3974,6 +3969,11 @@ static int resolve_map_arg_type(struct bpf_verifier_env *env,
 			return -EINVAL;
 		}
 		break;
+	case BPF_MAP_TYPE_BLOOM_FILTER:
+		/* bpf_map_peek_elem() reads the value to test for membership */
+		if (meta->func_id == BPF_FUNC_map_peek_elem)
+			*arg_type = ARG_PTR_TO_MAP_VALUE;
+		break;
 
 	default:
 		break;
@@ -4459,6 +4459,11 @@ static int check_map_func_compatibility(struct bpf_verifier_env *env,
 		    func_id != BPF_FUNC_map_push_elem)
 			goto error;
 		break;
+	case BPF_MAP_TYPE_BLOOM_FILTER:
+		if (func_id != BPF_FUNC_map_peek_elem &&
+		    func_id != BPF_FUNC_map_push_elem)
+			goto error;
+		break;
 	case BPF_MAP_TYPE_SK_STORAGE:
 		if (func_id != BPF_FUNC_sk_storage_get &&
 		    func_id != BPF_FUNC_sk_storage_delete)
@@ -4530,13 +4535,18 @@ static int check_map_func_compatibility(struct bpf_verifier_env *env,
 		    map->map_type != BPF_MAP_TYPE_SOCKHASH)
 			goto error;
 		break;
-	case BPF_FUNC_map_peek_elem:
 	case BPF_FUNC_map_pop_elem:
-	case BPF_FUNC_map_push_elem:
 		if (map->map_type != BPF_MAP_TYPE_QUEUE &&
 		    map->map_type != BPF_MAP_TYPE_STACK)
 			goto error;
 		break;
+	case BPF_FUNC_map_peek_elem:
+	case BPF_FUNC_map_push_elem:
+		if (map->map_type != BPF_MAP_TYPE_QUEUE &&
+		    map->map_type != BPF_MAP_TYPE_STACK &&
+		    map->map_type != BPF_MAP_TYPE_BLOOM_FILTER)
+			goto error;
+		break;
 	case BPF_FUNC_sk_storage_get:
 	case BPF_FUNC_sk_storage_delete:
 		if (map->map_type != BPF_MAP_TYPE_SK_STORAGE)
@@ -9765,6 +9775,14 @@ static int check_map_prog_compatibility(struct bpf_verifier_env *env,
 					"Sleepable programs can only use preallocated hash maps\n");
 				return -EINVAL;
 			}
+			/* lockless buckets recycle elements after a
+			 * normal RCU grace period only
+			 */
+			if (map->map_flags & BPF_F_LOCKLESS) {
+				verbose(env,
+					"Sleepable programs cannot use lockless hash maps\n");
+				return -EINVAL;
+			}
 			break;
 		default:
 			verbose(env,
@@ -11168,7 +11186,7 @@ patch_call_imm:
 		/* all functions that have prototype and verifier allowed
 		 * programs to call them, must be real in-kernel functions
 		 */
-		if (!fn->func) {
+		if (!fn || !fn->func) {
 			verbose(env,
 				"kernel subsystem misconfigured func %s#%d\n",
 				func_id_name(insn->imm), insn->imm);
@@ -11735,6 +11753,155 @@ int bpf_check_attach_target(struct bpf_verifier_log *log,
 	return 0;
 }
 
+/* The trampoline calls these around every program, so a program attached
+ * to all the functions it finds in BTF must not hook them.
+ */
+BTF_SET_START(btf_multi_func_deny)
+#ifdef CONFIG_SMP
+BTF_ID(func, migrate_disable)
+BTF_ID(func, migrate_enable)
+#endif
+#ifdef CONFIG_PREEMPT_RCU
+BTF_ID(func, __rcu_read_lock)
+BTF_ID(func, __rcu_read_unlock)
+#endif
+BTF_SET_END(btf_multi_func_deny)
+
+struct multi_func_sym {
+	const char *name;
+	struct bpf_attach_target_info *tgt_info;
+};
+
+static int multi_func_sym_cmp(const void *a, const void *b)
+{
+	const struct multi_func_sym *x = a, *y = b;
+
+	return strcmp(x->name, y->name);
+}
+
+struct multi_func_syms {
+	struct multi_func_sym *syms;
+	u32 cnt;
+	u32 found;
+};
+
+static int multi_func_resolve(void *data, const char *name,
+			      struct module *mod, unsigned long addr)
+{
+	struct multi_func_syms *ms = data;
+	struct multi_func_sym key = { .name = name }, *sym;
+
+	if (mod)
+		return 0;
+
+	sym = bsearch(&key, ms->syms, ms->cnt, sizeof(*sym),
+		      multi_func_sym_cmp);
+	if (!sym)
+		return 0;
+
+	/* Static functions may share a name, give each the first match like
+	 * kallsyms_lookup_name() would.
+	 */
+	while (sym > ms->syms && !strcmp(sym[-1].name, name))
+		sym--;
+	for (; sym < ms->syms + ms->cnt && !strcmp(sym->name, name); sym++) {
+		if (sym->tgt_info->tgt_addr)
+			continue;
+		sym->tgt_info->tgt_addr = addr;
+		ms->found++;
+	}
+
+	return ms->found == ms->cnt;
+}
+
+/* Check that the kernel functions in @btf_ids can be traced by a
+ * BPF_F_MULTI_FUNC program, and resolve their addresses. The addresses
+ * are found with one walk over kallsyms, rather than one lookup per
+ * function.
+ */
+int bpf_check_attach_multi(struct bpf_verifier_log *log,
+			   const u32 *btf_ids, u32 cnt,
+			   struct bpf_attach_target_info *tgt_info)
+{
+	struct multi_func_syms ms = { .cnt = cnt };
+	const struct btf_type *t;
+	const char *tname;
+	int ret = 0, j;
+	u32 i;
+
+	if (IS_ERR_OR_NULL(bpf_get_btf_vmlinux())) {
+		bpf_log(log, "Multi function programs need vmlinux BTF\n");
+		return -EINVAL;
+	}
+
+	ms.syms = kvcalloc(cnt, sizeof(*ms.syms), GFP_KERNEL);
+	if (!ms.syms)
+		return -ENOMEM;
+
+	for (i = 0; i < cnt; i++) {
+		struct btf_func_model *m = &tgt_info[i].fmodel;
+
+		ret = -EINVAL;
+		t = btf_type_by_id(btf_vmlinux, btf_ids[i]);
+		if (!t || !btf_type_is_func(t)) {
+			bpf_log(log, "attach_btf_id %u is not a function\n",
+				btf_ids[i]);
+			goto out;
+		}
+		tname = btf_name_by_offset(btf_vmlinux, t->name_off);
+		t = btf_type_by_id(btf_vmlinux, t->type);
+		if (!tname || !btf_type_is_func_proto(t))
+			goto out;
+		if (btf_id_set_contains(&btf_multi_func_deny, btf_ids[i])) {
+			bpf_log(log, "%s() can't be traced\n", tname);
+			goto out;
+		}
+
+		ret = btf_distill_func_proto(log, btf_vmlinux, t, tname, m);
+		if (ret < 0)
+			goto out;
+
+		ret = -EINVAL;
+		if (m->nr_args > BPF_MULTI_FUNC_ARGS || m->ret_size > 8) {
+			bpf_log(log, "%s() doesn't fit multi function programs\n",
+				tname);
+			goto out;
+		}
+		for (j = 0; j < m->nr_args; j++) {
+			if (m->arg_size[j] > 8) {
+				bpf_log(log, "%s() doesn't fit multi function programs\n",
+					tname);
+				goto out;
+			}
+		}
+
+		tgt_info[i].tgt_name = tname;
+		tgt_info[i].tgt_type = t;
+		tgt_info[i].tgt_addr = 0;
+		ms.syms[i].name = tname;
+		ms.syms[i].tgt_info = &tgt_info[i];
+	}
+
+	sort(ms.syms, cnt, sizeof(*ms.syms), multi_func_sym_cmp, NULL);
+	kallsyms_on_each_symbol(multi_func_resolve, &ms);
+
+	ret = 0;
+	if (ms.found == cnt)
+		goto out;
+
+	for (i = 0; i < cnt; i++) {
+		if (!tgt_info[i].tgt_addr) {
+			bpf_log(log, "The address of function %s cannot be found\n",
+				tgt_info[i].tgt_name);
+			break;
+		}
+	}
+	ret = -ENOENT;
+out:
+	kvfree(ms.syms);
+	return ret;
+}
+
 static int check_attach_btf_id(struct bpf_verifier_env *env)
 {
 	struct bpf_prog *prog = env->prog;
@@ -11751,6 +11918,21 @@ static int check_attach_btf_id(struct bpf_verifier_env *env)
 		return -EINVAL;
 	}
 
+	if (prog->aux->multi_func) {
+		if (prog->type != BPF_PROG_TYPE_TRACING ||
+		    (prog->expected_attach_type != BPF_TRACE_FENTRY &&
+		     prog->expected_attach_type != BPF_TRACE_FEXIT)) {
+			verbose(env, "Only fentry/fexit programs can attach to multiple functions\n");
+			return -EINVAL;
+		}
+		if (prog->aux->sleepable || btf_id || tgt_prog) {
+			verbose(env, "Multi function programs can't be sleepable or have an attach target\n");
+			return -EINVAL;
+		}
+		/* The functions are checked by bpf_check_attach_multi() */
+		return 0;
+	}
+
 	if (prog->type == BPF_PROG_TYPE_STRUCT_OPS)
 		return check_struct_ops_btf_id(env);
 
@@ -11925,9 +12107,16 @@ int bpf_check(struct bpf_prog **prog, union bpf_attr *attr,
 	if (ret < 0)
 		goto skip_full_check;
 
+	bpf_vcache_prepare(env);
+	if (bpf_vcache_restore(env))
+		goto skip_full_check;
+
 	ret = do_check_subprogs(env);
 	ret = ret ?: do_check_main(env);
 
+	if (ret == 0)
+		bpf_vcache_store(env);
+
 	if (ret == 0 && bpf_prog_is_dev_bound(env->prog->aux))
 		ret = bpf_prog_offload_finalize(env);
 
@@ -11971,6 +12160,7 @@ skip_full_check:
 
 	env->verification_time = ktime_get_ns() - start_time;
 	print_verification_stats(env);
+	env->prog->aux->verified_insns = env->insn_processed;
 
 	if (log->level && bpf_verifier_log_full(log))
 		ret = -ENOSPC;
@@ -0,0 +1,520 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/* Cache of BPF verification results
+ *
+ * Loading the same program again (a restarted agent, an object reloaded
+ * after a configuration change, the same program attached to many
+ * cgroups) repeats the whole state exploration of do_check(). The cache
+ * keys the outcome of a successful exploration by a SHA-256 digest of
+ * everything it depends on: the instructions with map references
+ * replaced by their index in used_maps, the shape of those maps, the
+ * contents of frozen read-only maps the verifier may have taken
+ * constants from, the program BTF and func_info, the program type and
+ * attach target, and the capabilities of the loader and lockdown state
+ * that decide which helpers it may call. A hit restores the
+ * per-instruction aux data and the few per-program results recorded by
+ * do_check(), and bpf_check() carries on with the instruction rewrites
+ * as usual.
+ *
+ * Programs bound to a device, programs attached to another BPF program
+ * and loads that ask for a verifier log always go through the full
+ * verification.
+ */
+#include <linux/bpf.h>
+#include <linux/bpf_verifier.h>
+#include <linux/btf.h>
+#include <linux/hashtable.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/perf_event.h>
+#include <linux/security.h>
+#include <linux/slab.h>
+#include <linux/sysctl.h>
+#include <linux/vmalloc.h>
+#include <crypto/sha.h>
+
+#define VCACHE_HASH_BITS	8
+
+int sysctl_bpf_verifier_cache_kb __read_mostly = 8192;
+
+struct bpf_vcache_entry {
+	struct hlist_node hnode;
+	struct list_head lru;
+	size_t size;
+	u8 digest[BPF_VCACHE_DIGEST_SIZE];
+	u32 len;
+	u32 subprog_cnt;
+
+	/* results of do_check() outside of insn_aux_data */
+	bool seen_direct_write;
+	bool has_callchain_buf;
+	bool call_get_stack;
+	bool enforce_expected_attach_type;
+	u32 max_ctx_offset;
+	u32 max_pkt_offset;
+	u32 max_tp_access;
+	u32 max_rdonly_access;
+	u32 max_rdwr_access;
+	u16 stack_depth[BPF_MAX_SUBPROGS + 1];
+	bool unreliable[BPF_MAX_SUBPROGS + 1];
+
+	/* statistics of the original verification */
+	u32 insn_processed;
+	u32 max_states_per_insn;
+	u32 total_states;
+	u32 peak_states;
+	u32 longest_mark_read_walk;
+
+	struct bpf_insn_aux_data aux[];
+};
+
+struct vcache_prog_key {
+	u32 prog_type;
+	u32 expected_attach_type;
+	u32 attach_btf_id;
+	u32 len;
+	u32 used_map_cnt;
+	u32 func_info_cnt;
+	u8 gpl_compatible;
+	u8 jit_requested;
+	u8 sleepable;
+	u8 multi_func;
+	u8 strict_alignment;
+	u8 test_state_freq;
+	u8 allow_ptr_leaks;
+	u8 allow_ptr_to_map_access;
+	u8 bpf_capable;
+	u8 bypass_spec_v1;
+	u8 bypass_spec_v4;
+	u8 cap_sys_admin;
+	u8 cap_perfmon;
+	u8 cap_net_admin;
+	u8 locked_down_bpf_read;
+	u8 locked_down_perf;
+};
+
+struct vcache_map_key {
+	u32 map_type;
+	u32 key_size;
+	u32 value_size;
+	u32 max_entries;
+	u32 map_flags;
+	s32 spin_lock_off;
+	u64 map_extra;
+	u32 rdonly;
+	u32 has_inner;
+};
+
+static DEFINE_MUTEX(vcache_lock);
+static DEFINE_HASHTABLE(vcache_table, VCACHE_HASH_BITS);
+static LIST_HEAD(vcache_lru);
+static size_t vcache_size;
+
+static bool vcache_map_rdonly(const struct bpf_map *map)
+{
+	return (map->map_flags & BPF_F_RDONLY_PROG) && READ_ONCE(map->frozen) &&
+	       map->ops->map_direct_value_addr;
+}
+
+static u64 vcache_rdonly_maps(const struct bpf_verifier_env *env)
+{
+	u64 mask = 0;
+	u32 i;
+
+	for (i = 0; i < env->used_map_cnt; i++)
+		if (vcache_map_rdonly(env->used_maps[i]))
+			mask |= 1ULL << i;
+	return mask;
+}
+
+static bool is_helper_call(const struct bpf_insn *insn)
+{
+	return insn->code == (BPF_JMP | BPF_CALL) && insn->src_reg == 0;
+}
+
+static bool is_map_ldimm64(const struct bpf_insn *insn)
+{
+	return insn->code == (BPF_LD | BPF_IMM | BPF_DW) &&
+	       (insn->src_reg == BPF_PSEUDO_MAP_FD ||
+		insn->src_reg == BPF_PSEUDO_MAP_VALUE);
+}
+
+static void vcache_hash_map(struct sha256_state *sctx,
+			    const struct bpf_map *map, bool rdonly)
+{
+	struct vcache_map_key key;
+
+	memset(&key, 0, sizeof(key));
+	key.map_type = map->map_type;
+	key.key_size = map->key_size;
+	key.value_size = map->value_size;
+	key.max_entries = map->max_entries;
+	key.map_flags = map->map_flags;
+	key.spin_lock_off = map->spin_lock_off;
+	key.map_extra = map->map_extra;
+	key.rdonly = rdonly;
+	key.has_inner = !!map->inner_map_meta;
+	sha256_update(sctx, (const u8 *)&key, sizeof(key));
+}
+
+static int vcache_hash_maps(struct bpf_verifier_env *env,
+			    struct sha256_state *sctx)
+{
+	struct bpf_map *map;
+	u64 addr;
+	u32 i;
+
+	env->vcache_rdonly_maps = vcache_rdonly_maps(env);
+
+	for (i = 0; i < env->used_map_cnt; i++) {
+		bool rdonly = env->vcache_rdonly_maps & (1ULL << i);
+
+		map = env->used_maps[i];
+		vcache_hash_map(sctx, map, rdonly);
+		if (map->inner_map_meta)
+			vcache_hash_map(sctx, map->inner_map_meta, false);
+		if (!rdonly)
+			continue;
+
+		/* The verifier turns loads from these into constants */
+		if (map->ops->map_direct_value_addr(map, &addr, 0))
+			return -EINVAL;
+		sha256_update(sctx, (const u8 *)(long)addr, map->value_size);
+	}
+
+	return 0;
+}
+
+static int vcache_hash_insns(struct bpf_verifier_env *env,
+			     struct sha256_state *sctx)
+{
+	struct bpf_prog *prog = env->prog;
+	struct bpf_insn *insns;
+	u32 i;
+
+	insns = kvmalloc_array(prog->len, sizeof(*insns), GFP_KERNEL);
+	if (!insns)
+		return -ENOMEM;
+	memcpy(insns, prog->insnsi, bpf_prog_insn_size(prog));
+
+	/* Map addresses differ from one load to the next */
+	for (i = 0; i < prog->len; i++) {
+		if (!is_map_ldimm64(&insns[i]))
+			continue;
+		insns[i].imm = env->insn_aux_data[i].map_index;
+		insns[i + 1].imm = env->insn_aux_data[i].map_off;
+		i++;
+	}
+
+	sha256_update(sctx, (const u8 *)insns, bpf_prog_insn_size(prog));
+	kvfree(insns);
+	return 0;
+}
+
+/* Called once resolve_pseudo_ldimm64() and check_cfg() are done */
+void bpf_vcache_prepare(struct bpf_verifier_env *env)
+{
+	struct bpf_prog *prog = env->prog;
+	struct vcache_prog_key key;
+	struct sha256_state sctx;
+	const void *data;
+	u32 size;
+
+	BUILD_BUG_ON(BPF_VCACHE_DIGEST_SIZE != SHA256_DIGEST_SIZE);
+	BUILD_BUG_ON(MAX_USED_MAPS > 64);
+
+	env->vcache_usable = false;
+	if (!READ_ONCE(sysctl_bpf_verifier_cache_kb) || env->log.level ||
+	    bpf_prog_is_dev_bound(prog->aux) || prog->aux->dst_prog)
+		return;
+
+	memset(&key, 0, sizeof(key));
+	key.prog_type = prog->type;
+	key.expected_attach_type = prog->expected_attach_type;
+	key.attach_btf_id = prog->aux->attach_btf_id;
+	key.len = prog->len;
+	key.used_map_cnt = env->used_map_cnt;
+	key.func_info_cnt = prog->aux->func_info_cnt;
+	key.gpl_compatible = prog->gpl_compatible;
+	key.jit_requested = prog->jit_requested;
+	key.sleepable = prog->aux->sleepable;
+	key.multi_func = prog->aux->multi_func;
+	key.strict_alignment = env->strict_alignment;
+	key.test_state_freq = env->test_state_freq;
+	key.allow_ptr_leaks = env->allow_ptr_leaks;
+	key.allow_ptr_to_map_access = env->allow_ptr_to_map_access;
+	key.bpf_capable = env->bpf_capable;
+	key.bypass_spec_v1 = env->bypass_spec_v1;
+	key.bypass_spec_v4 = env->bypass_spec_v4;
+	/* get_func_proto() decides on these which helpers may be called */
+	key.cap_sys_admin = ns_capable_noaudit(&init_user_ns, CAP_SYS_ADMIN);
+	key.cap_perfmon = key.cap_sys_admin ||
+			  ns_capable_noaudit(&init_user_ns, CAP_PERFMON);
+	key.cap_net_admin = ns_capable_noaudit(&init_user_ns, CAP_NET_ADMIN);
+	key.locked_down_bpf_read = security_locked_down(LOCKDOWN_BPF_READ) < 0;
+	key.locked_down_perf = security_locked_down(LOCKDOWN_PERF) < 0;
+
+	sha256_init(&sctx);
+	sha256_update(&sctx, (const u8 *)&key, sizeof(key));
+
+	if (vcache_hash_insns(env, &sctx) || vcache_hash_maps(env, &sctx))
+		return;
+
+	if (prog->aux->btf) {
+		data = btf_data(prog->aux->btf, &size);
+		sha256_update(&sctx, data, size);
+		sha256_update(&sctx, (const u8 *)prog->aux->func_info,
+			      prog->aux->func_info_cnt *
+			      sizeof(*prog->aux->func_info));
+	}
+
+	sha256_final(&sctx, env->vcache_digest);
+	env->vcache_usable = true;
+}
+
+static u32 vcache_hash(const u8 *digest)
+{
+	u32 h;
+
+	memcpy(&h, digest, sizeof(h));
+	return h;
+}
+
+static struct bpf_vcache_entry *vcache_find(const u8 *digest)
+{
+	struct bpf_vcache_entry *e;
+
+	hash_for_each_possible(vcache_table, e, hnode, vcache_hash(digest))
+		if (!memcmp(e->digest, digest, BPF_VCACHE_DIGEST_SIZE))
+			return e;
+	return NULL;
+}
+
+static void vcache_evict(size_t limit)
+{
+	struct bpf_vcache_entry *e;
+
+	lockdep_assert_held(&vcache_lock);
+
+	while (vcache_size > limit) {
+		e = list_last_entry(&vcache_lru, struct bpf_vcache_entry, lru);
+		hash_del(&e->hnode);
+		list_del(&e->lru);
+		vcache_size -= e->size;
+		kvfree(e);
+	}
+}
+
+/* map_ptr_state of helper calls holds a map pointer, which means nothing
+ * to the next load of the program. Store the index of the map in
+ * used_maps instead, or of the map-in-map whose inner map template it is.
+ */
+static int vcache_encode_map_ptr(const struct bpf_verifier_env *env,
+				 unsigned long *state)
+{
+	unsigned long unpriv = *state & BPF_MAP_PTR_UNPRIV;
+	struct bpf_map *map = BPF_MAP_PTR(*state);
+	u32 i;
+
+	if (!map || map == BPF_MAP_PTR_POISON)
+		return 0;
+
+	for (i = 0; i < env->used_map_cnt; i++) {
+		if (env->used_maps[i] == map) {
+			*state = (i + 1) << 1 | unpriv;
+			return 0;
+		}
+		if (env->used_maps[i]->inner_map_meta == map) {
+			*state = (i + 1 + MAX_USED_MAPS) << 1 | unpriv;
+			return 0;
+		}
+	}
+
+	return -ENOENT;
+}
+
+static void vcache_decode_map_ptr(const struct bpf_verifier_env *env,
+				  unsigned long *state)
+{
+	unsigned long unpriv = *state & BPF_MAP_PTR_UNPRIV;
+	unsigned long idx = *state >> 1;
+	struct bpf_map *map;
+
+	if (!idx || BPF_MAP_PTR(*state) == BPF_MAP_PTR_POISON)
+		return;
+
+	if (idx > MAX_USED_MAPS)
+		map = env->used_maps[idx - 1 - MAX_USED_MAPS]->inner_map_meta;
+	else
+		map = env->used_maps[idx - 1];
+	*state = (unsigned long)map | unpriv;
+}
+
+/* A hit skips check_helper_call(), so make sure again that this loader
+ * may call every helper the program uses. If not, the full verification
+ * rejects the program.
+ */
+static bool vcache_helpers_allowed(const struct bpf_verifier_env *env)
+{
+	const struct bpf_insn *insn = env->prog->insnsi;
+	u32 i;
+
+	for (i = 0; i < env->prog->len; i++, insn++) {
+		if (!is_helper_call(insn))
+			continue;
+		if (insn->imm < 0 || insn->imm >= __BPF_FUNC_MAX_ID ||
+		    !env->ops->get_func_proto ||
+		    !env->ops->get_func_proto(insn->imm, env->prog))
+			return false;
+	}
+
+	return true;
+}
+
+bool bpf_vcache_restore(struct bpf_verifier_env *env)
+{
+	struct bpf_func_info_aux *func_info_aux;
+	struct bpf_prog *prog = env->prog;
+	struct bpf_vcache_entry *e;
+	bool hit = false;
+	u32 i;
+
+	if (!env->vcache_usable || !vcache_helpers_allowed(env))
+		return false;
+
+	mutex_lock(&vcache_lock);
+	e = vcache_find(env->vcache_digest);
+	if (!e || e->len != prog->len || e->subprog_cnt != env->subprog_cnt)
+		goto out;
+
+#ifdef CONFIG_PERF_EVENTS
+	if (e->has_callchain_buf &&
+	    get_callchain_buffers(sysctl_perf_event_max_stack))
+		goto out;
+#endif
+
+	memcpy(env->insn_aux_data, e->aux, array_size(e->len, sizeof(e->aux[0])));
+	for (i = 0; i < prog->len; i++)
+		if (is_helper_call(&prog->insnsi[i]))
+			vcache_decode_map_ptr(env,
+					      &env->insn_aux_data[i].map_ptr_state);
+
+	func_info_aux = prog->aux->func_info_aux;
+	for (i = 0; i < env->subprog_cnt; i++) {
+		env->subprog_info[i].stack_depth = e->stack_depth[i];
+		if (func_info_aux)
+			func_info_aux[i].unreliable = e->unreliable[i];
+	}
+	prog->aux->stack_depth = e->stack_depth[0];
+
+	env->seen_direct_write = e->seen_direct_write;
+	prog->has_callchain_buf = e->has_callchain_buf;
+	prog->call_get_stack = e->call_get_stack;
+	prog->enforce_expected_attach_type = e->enforce_expected_attach_type;
+	prog->aux->max_ctx_offset = e->max_ctx_offset;
+	prog->aux->max_pkt_offset = e->max_pkt_offset;
+	prog->aux->max_tp_access = e->max_tp_access;
+	prog->aux->max_rdonly_access = e->max_rdonly_access;
+	prog->aux->max_rdwr_access = e->max_rdwr_access;
+
+	env->insn_processed = e->insn_processed;
+	env->max_states_per_insn = e->max_states_per_insn;
+	env->total_states = e->total_states;
+	env->peak_states = e->peak_states;
+	env->longest_mark_read_walk = e->longest_mark_read_walk;
+
+	list_move(&e->lru, &vcache_lru);
+	hit = true;
+out:
+	mutex_unlock(&vcache_lock);
+	return hit;
+}
+
+/* Called after a successful do_check(), before any instruction rewrite */
+void bpf_vcache_store(struct bpf_verifier_env *env)
+{
+	struct bpf_func_info_aux *func_info_aux;
+	struct bpf_prog *prog = env->prog;
+	struct bpf_vcache_entry *e;
+	size_t size, limit;
+	u32 i;
+
+	if (!env->vcache_usable)
+		return;
+
+	/* A map frozen while we were verifying may have been read from */
+	if (vcache_rdonly_maps(env) != env->vcache_rdonly_maps)
+		return;
+
+	size = struct_size(e, aux, prog->len);
+	limit = (size_t)READ_ONCE(sysctl_bpf_verifier_cache_kb) << 10;
+	if (size > limit)
+		return;
+
+	e = kvmalloc(size, GFP_KERNEL | __GFP_NOWARN);
+	if (!e)
+		return;
+
+	memcpy(e->aux, env->insn_aux_data, array_size(prog->len, sizeof(e->aux[0])));
+	for (i = 0; i < prog->len; i++) {
+		if (is_helper_call(&prog->insnsi[i]) &&
+		    vcache_encode_map_ptr(env, &e->aux[i].map_ptr_state)) {
+			kvfree(e);
+			return;
+		}
+	}
+
+	memcpy(e->digest, env->vcache_digest, BPF_VCACHE_DIGEST_SIZE);
+	e->size = size;
+	e->len = prog->len;
+	e->subprog_cnt = env->subprog_cnt;
+
+	func_info_aux = prog->aux->func_info_aux;
+	for (i = 0; i < env->subprog_cnt; i++) {
+		e->stack_depth[i] = env->subprog_info[i].stack_depth;
+		e->unreliable[i] = func_info_aux && func_info_aux[i].unreliable;
+	}
+
+	e->seen_direct_write = env->seen_direct_write;
+	e->has_callchain_buf = prog->has_callchain_buf;
+	e->call_get_stack = prog->call_get_stack;
+	e->enforce_expected_attach_type = prog->enforce_expected_attach_type;
+	e->max_ctx_offset = prog->aux->max_ctx_offset;
+	e->max_pkt_offset = prog->aux->max_pkt_offset;
+	e->max_tp_access = prog->aux->max_tp_access;
+	e->max_rdonly_access = prog->aux->max_rdonly_access;
+	e->max_rdwr_access = prog->aux->max_rdwr_access;
+
+	e->insn_processed = env->insn_processed;
+	e->max_states_per_insn = env->max_states_per_insn;
+	e->total_states = env->total_states;
+	e->peak_states = env->peak_states;
+	e->longest_mark_read_walk = env->longest_mark_read_walk;
+
+	mutex_lock(&vcache_lock);
+	if (vcache_find(e->digest)) {
+		/* raced with a load of the same program */
+		mutex_unlock(&vcache_lock);
+		kvfree(e);
+		return;
+	}
+	hash_add(vcache_table, &e->hnode, vcache_hash(e->digest));
+	list_add(&e->lru, &vcache_lru);
+	vcache_size += size;
+	vcache_evict(limit);
+	mutex_unlock(&vcache_lock);
+}
+
+int bpf_verifier_cache_handler(struct ctl_table *table, int write,
+			       void *buffer, size_t *lenp, loff_t *ppos)
+{
+	int ret;
+
+	ret = proc_dointvec_minmax(table, write, buffer, lenp, ppos);
+	if (!ret && write) {
+		mutex_lock(&vcache_lock);
+		vcache_evict((size_t)READ_ONCE(sysctl_bpf_verifier_cache_kb) << 10);
+		mutex_unlock(&vcache_lock);
+	}
+
+	return ret;
+}
@@ -0,0 +1,346 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Kernel-side aggregation of sampled callchains
+ *
+ * An event with attr::aggregate does not write its samples to the ring
+ * buffer. Its overflow handler, which may run in NMI, only copies the task
+ * ids, the period and the callchain into a small staging ring. An irq_work
+ * then counts the samples per (pid, tid, callchain) in an open addressed
+ * table, keeping each distinct callchain once in a store of fixed size.
+ * The table is written out as PERF_RECORD_STACK_COUNT records every
+ * aggregate_ms while samples come in, when the table or the store fills
+ * up, and when the event is disabled or closed. Both are empty again
+ * after that.
+ *
+ * Only CPU bound events are supported, inherited events aggregate into
+ * their parent. Everything then happens on that one CPU, the only
+ * concurrency being the overflow handler interrupting the irq_work.
+ */
+
+#include <linux/irq_work.h>
+#include <linux/jhash.h>
+#include <linux/perf_event.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/timer.h>
+
+#include "internal.h"
+
+#define PERF_AGGR_STAGE		16	/* samples waiting for the irq_work */
+#define PERF_AGGR_HASH_BITS	9
+#define PERF_AGGR_ENTRIES	(1 << PERF_AGGR_HASH_BITS)
+#define PERF_AGGR_DEFAULT_MS	1000
+/* callchain store, in u64 entries */
+#define PERF_AGGR_STORE		(PERF_AGGR_ENTRIES * 32)
+
+struct perf_aggr_sample {
+	u32			pid, tid;
+	u64			period;
+	u64			nr;
+	u64			ips[];
+};
+
+struct perf_aggr_entry {
+	u32			pid, tid;
+	u32			hash;		/* of the callchain */
+	u32			nr;
+	u32			off;		/* of the callchain in the store */
+	u64			count;		/* 0 for a free entry */
+	u64			period;
+};
+
+struct perf_aggr {
+	struct perf_event	*event;
+	struct irq_work		work;
+	struct timer_list	timer;
+	unsigned long		interval;	/* in jiffies */
+	bool			flush;
+
+	/* staging ring, head is only written by the overflow handler */
+	void			*stage;
+	size_t			sample_size;
+	u64			max_nr;
+	unsigned int		head;
+	unsigned int		tail;
+	local_t			dropped;
+
+	u64			*store;
+	unsigned int		store_used;
+
+	unsigned int		nr_entries;
+	struct perf_aggr_entry	entries[PERF_AGGR_ENTRIES];
+};
+
+static struct perf_aggr_sample *perf_aggr_slot(struct perf_aggr *aggr,
+					       unsigned int idx)
+{
+	idx &= PERF_AGGR_STAGE - 1;
+	return aggr->stage + idx * aggr->sample_size;
+}
+
+/*
+ * Called from the overflow handler of @event or of one of its inherited
+ * children, possibly in NMI.
+ */
+void perf_aggr_add(struct perf_event *event, u32 pid, u32 tid, u64 period,
+		   struct perf_callchain_entry *callchain)
+{
+	struct perf_aggr_sample *s;
+	struct perf_aggr *aggr;
+	unsigned int head;
+
+	if (event->parent)
+		event = event->parent;
+	aggr = event->aggr;
+
+	head = aggr->head;
+	if (head - READ_ONCE(aggr->tail) >= PERF_AGGR_STAGE) {
+		local_inc(&aggr->dropped);
+		goto out;
+	}
+
+	s = perf_aggr_slot(aggr, head);
+	s->pid = pid;
+	s->tid = tid;
+	s->period = period;
+	s->nr = min(callchain->nr, aggr->max_nr);
+	memcpy(s->ips, callchain->ip, s->nr * sizeof(u64));
+
+	/* the irq_work runs on this CPU, it only has to see the slot first */
+	barrier();
+	WRITE_ONCE(aggr->head, head + 1);
+out:
+	irq_work_queue(&aggr->work);
+}
+
+static void perf_aggr_output(struct perf_aggr *aggr)
+{
+	struct perf_event *event = aggr->event;
+	struct perf_output_handle handle;
+	struct perf_sample_data sample;
+	struct perf_aggr_entry *e;
+	u64 lost;
+	int i;
+
+	struct {
+		struct perf_event_header	header;
+		u32				pid, tid;
+		u64				count;
+		u64				period;
+		u64				nr;
+	} rec = {
+		.header = {
+			.type = PERF_RECORD_STACK_COUNT,
+			.misc = 0,
+		},
+	};
+
+	for (i = 0; i < PERF_AGGR_ENTRIES && aggr->nr_entries; i++) {
+		e = &aggr->entries[i];
+		if (!e->count)
+			continue;
+
+		rec.header.size = sizeof(rec) + e->nr * sizeof(u64);
+		rec.pid = e->pid;
+		rec.tid = e->tid;
+		rec.count = e->count;
+		rec.period = e->period;
+		rec.nr = e->nr;
+
+		perf_event_header__init_id(&rec.header, &sample, event);
+		if (!perf_output_begin(&handle, &sample, event,
+				       rec.header.size)) {
+			perf_output_put(&handle, rec);
+			perf_output_copy(&handle, aggr->store + e->off,
+					 e->nr * sizeof(u64));
+			perf_event__output_id_sample(event, &handle, &sample);
+			perf_output_end(&handle);
+		}
+
+		memset(e, 0, sizeof(*e));
+		aggr->nr_entries--;
+	}
+	aggr->store_used = 0;
+
+	lost = local_xchg(&aggr->dropped, 0);
+	if (lost)
+		perf_log_lost_samples(event, lost);
+}
+
+/*
+ * Returns the entry of the sample's task and callchain, adding it if
+ * there is room. NULL means the table has to be written out first.
+ */
+static struct perf_aggr_entry *perf_aggr_lookup(struct perf_aggr *aggr,
+						struct perf_aggr_sample *s,
+						u32 hash)
+{
+	unsigned int idx = jhash_3words(s->pid, s->tid, hash, 0);
+	struct perf_aggr_entry *e;
+	int i;
+
+	for (i = 0; i < PERF_AGGR_ENTRIES; i++) {
+		e = &aggr->entries[idx++ & (PERF_AGGR_ENTRIES - 1)];
+		if (!e->count)
+			break;
+		if (e->pid == s->pid && e->tid == s->tid && e->hash == hash &&
+		    e->nr == s->nr &&
+		    !memcmp(aggr->store + e->off, s->ips, s->nr * sizeof(u64)))
+			return e;
+	}
+
+	/* keep the probe sequences short */
+	if (aggr->nr_entries >= PERF_AGGR_ENTRIES - PERF_AGGR_ENTRIES / 4 ||
+	    aggr->store_used + s->nr > PERF_AGGR_STORE)
+		return NULL;
+
+	e->pid = s->pid;
+	e->tid = s->tid;
+	e->hash = hash;
+	e->nr = s->nr;
+	e->off = aggr->store_used;
+	memcpy(aggr->store + e->off, s->ips, s->nr * sizeof(u64));
+	aggr->store_used += s->nr;
+	aggr->nr_entries++;
+	return e;
+}
+
+static void perf_aggr_count(struct perf_aggr *aggr, struct perf_aggr_sample *s)
+{
+	u32 hash = jhash2((u32 *)s->ips, s->nr * 2, 0);
+	struct perf_aggr_entry *e;
+
+	e = perf_aggr_lookup(aggr, s, hash);
+	if (!e) {
+		perf_aggr_output(aggr);
+		/* a single callchain always fits into the empty store */
+		e = perf_aggr_lookup(aggr, s, hash);
+	}
+
+	e->count++;
+	e->period += s->period;
+}
+
+static void perf_aggr_work(struct irq_work *work)
+{
+	struct perf_aggr *aggr = container_of(work, struct perf_aggr, work);
+	unsigned int head = READ_ONCE(aggr->head);
+
+	/* pairs with the barrier() in perf_aggr_add() */
+	barrier();
+
+	if (aggr->tail != head) {
+		do {
+			perf_aggr_count(aggr, perf_aggr_slot(aggr, aggr->tail));
+			WRITE_ONCE(aggr->tail, aggr->tail + 1);
+		} while (aggr->tail != head);
+
+		/*
+		 * The timer is only armed while samples come in, so it does
+		 * not keep firing for a disabled or idle event.
+		 */
+		if (!timer_pending(&aggr->timer))
+			mod_timer(&aggr->timer, jiffies + aggr->interval);
+	}
+
+	if (READ_ONCE(aggr->flush)) {
+		WRITE_ONCE(aggr->flush, false);
+		perf_aggr_output(aggr);
+	}
+}
+
+static void perf_aggr_kick(struct perf_aggr *aggr)
+{
+	int cpu = aggr->event->cpu;
+
+	WRITE_ONCE(aggr->flush, true);
+	if (cpu_online(cpu))
+		irq_work_queue_on(&aggr->work, cpu);
+}
+
+static void perf_aggr_timer(struct timer_list *t)
+{
+	struct perf_aggr *aggr = from_timer(aggr, t, timer);
+
+	/* perf_aggr_work() rearms the timer if there are new samples */
+	perf_aggr_kick(aggr);
+}
+
+static void __perf_aggr_flush(struct perf_aggr *aggr)
+{
+	perf_aggr_kick(aggr);
+	irq_work_sync(&aggr->work);
+
+	/* no new samples, so neither of them can requeue the other */
+	del_timer_sync(&aggr->timer);
+	irq_work_sync(&aggr->work);
+}
+
+/* Writes out the counts so far and stops the timer, on disable */
+void perf_aggr_flush(struct perf_event *event)
+{
+	struct perf_aggr *aggr = event->aggr;
+
+	if (!aggr)
+		return;
+
+	__perf_aggr_flush(aggr);
+}
+
+int perf_aggr_alloc(struct perf_event *event)
+{
+	int node = cpu_to_node(event->cpu);
+	struct perf_aggr *aggr;
+	unsigned int ms;
+
+	if (event->cpu < 0 ||
+	    !(event->attr.sample_type & PERF_SAMPLE_CALLCHAIN))
+		return -EINVAL;
+
+	aggr = kzalloc_node(sizeof(*aggr), GFP_KERNEL, node);
+	if (!aggr)
+		return -ENOMEM;
+
+	aggr->max_nr = min_t(u64, event->attr.sample_max_stack +
+			     sysctl_perf_event_max_contexts_per_stack,
+			     PERF_AGGR_STORE);
+	aggr->sample_size = struct_size((struct perf_aggr_sample *)NULL, ips,
+					aggr->max_nr);
+	aggr->stage = kcalloc_node(PERF_AGGR_STAGE, aggr->sample_size,
+				   GFP_KERNEL, node);
+	aggr->store = kvmalloc_node(PERF_AGGR_STORE * sizeof(u64), GFP_KERNEL,
+				    node);
+	if (!aggr->stage || !aggr->store) {
+		kvfree(aggr->store);
+		kfree(aggr->stage);
+		kfree(aggr);
+		return -ENOMEM;
+	}
+
+	aggr->event = event;
+	local_set(&aggr->dropped, 0);
+	init_irq_work(&aggr->work, perf_aggr_work);
+
+	ms = event->attr.aggregate_ms ?: PERF_AGGR_DEFAULT_MS;
+	aggr->interval = max(msecs_to_jiffies(ms), 1UL);
+	timer_setup(&aggr->timer, perf_aggr_timer, TIMER_DEFERRABLE);
+
+	event->aggr = aggr;
+	return 0;
+}
+
+void perf_aggr_free(struct perf_event *event)
+{
+	struct perf_aggr *aggr = event->aggr;
+
+	if (!aggr)
+		return;
+
+	/* the ring buffer is still attached, write out what is left */
+	__perf_aggr_flush(aggr);
+
+	kvfree(aggr->store);
+	kfree(aggr->stage);
+	kfree(aggr);
+	event->aggr = NULL;
+}
@@ -4800,6 +4800,7 @@ static void perf_addr_filters_splice(struct perf_event *event,
 static void _free_event(struct perf_event *event)
 {
 	irq_work_sync(&event->pending);
+	perf_aggr_free(event);
 
 	unaccount_event(event);
 
@@ -5452,6 +5453,13 @@ static int perf_event_set_bpf_prog(struct perf_event *event, u32 prog_fd);
 static int perf_copy_attr(struct perf_event_attr __user *uattr,
 			  struct perf_event_attr *attr);
 
+/* Aggregated samples are written out when the event is disabled */
+static void _perf_event_disable_flush(struct perf_event *event)
+{
+	_perf_event_disable(event);
+	perf_aggr_flush(event);
+}
+
 static long _perf_ioctl(struct perf_event *event, unsigned int cmd, unsigned long arg)
 {
 	void (*func)(struct perf_event *);
@@ -5462,7 +5470,7 @@ static long _perf_ioctl(struct perf_event *event, unsigned int cmd, unsigned lon
 		func = _perf_event_enable;
 		break;
 	case PERF_EVENT_IOC_DISABLE:
-		func = _perf_event_disable;
+		func = _perf_event_disable_flush;
 		break;
 	case PERF_EVENT_IOC_RESET:
 		func = _perf_event_reset;
@@ -5664,6 +5672,8 @@ static void perf_event_init_userpage(struct perf_event *event)
 	userpg->size = offsetof(struct perf_event_mmap_page, __reserved);
 	userpg->data_offset = PAGE_SIZE;
 	userpg->data_size = perf_data_size(rb);
+	userpg->cap_user_rb_stats = 1;
+	userpg->wakeup_watermark = rb->watermark;
 
 unlock:
 	rcu_read_unlock();
@@ -6169,6 +6179,12 @@ accounting:
 	if (vma->vm_flags & VM_WRITE)
 		flags |= RING_BUFFER_WRITABLE;
 
+	if (event->attr.adaptive_wakeup)
+		flags |= RING_BUFFER_ADAPTIVE;
+
+	if (event->attr.overflow_reduce)
+		flags |= RING_BUFFER_REDUCE;
+
 	if (!rb) {
 		rb = rb_alloc(nr_pages,
 			      event->attr.watermark ? event->attr.wakeup_watermark : 0,
@@ -7208,6 +7224,9 @@ perf_event_output_forward(struct perf_event *event,
 			 struct perf_sample_data *data,
 			 struct pt_regs *regs)
 {
+	if (unlikely(perf_output_sample_reduced(event, data)))
+		return;
+
 	__perf_event_output(event, data, regs, perf_output_begin_forward);
 }
 
@@ -7216,9 +7235,29 @@ perf_event_output_backward(struct perf_event *event,
 			   struct perf_sample_data *data,
 			   struct pt_regs *regs)
 {
+	if (unlikely(perf_output_sample_reduced(event, data)))
+		return;
+
 	__perf_event_output(event, data, regs, perf_output_begin_backward);
 }
 
+/*
+ * Overflow handler of attr::aggregate events, the samples are counted per
+ * callchain and written out as PERF_RECORD_STACK_COUNT by aggregate.c.
+ */
+static void
+perf_aggr_overflow(struct perf_event *event,
+		   struct perf_sample_data *data,
+		   struct pt_regs *regs)
+{
+	/* protect the callchain buffers */
+	rcu_read_lock();
+	perf_aggr_add(event, perf_event_pid(event, current),
+		      perf_event_tid(event, current), data->period,
+		      perf_callchain(event, regs));
+	rcu_read_unlock();
+}
+
 int
 perf_event_output(struct perf_event *event,
 		  struct perf_sample_data *data,
@@ -8450,8 +8489,17 @@ static void perf_log_throttle(struct perf_event *event, int enable)
 		.stream_id	= event->id,
 	};
 
-	if (enable)
+	if (enable) {
 		throttle_event.header.type = PERF_RECORD_UNTHROTTLE;
+	} else {
+		struct perf_buffer *rb;
+
+		rcu_read_lock();
+		rb = rcu_dereference(event->parent ? event->parent->rb : event->rb);
+		if (rb)
+			rb_count_throttled(rb);
+		rcu_read_unlock();
+	}
 
 	perf_event_header__init_id(&throttle_event.header, &sample, event);
 
@@ -11216,6 +11264,9 @@ perf_event_alloc(struct perf_event_attr *attr, int cpu,
 	if (overflow_handler) {
 		event->overflow_handler	= overflow_handler;
 		event->overflow_handler_context = context;
+	} else if (attr->aggregate) {
+		event->overflow_handler = perf_aggr_overflow;
+		event->overflow_handler_context = NULL;
 	} else if (is_write_backward(event)){
 		event->overflow_handler = perf_event_output_backward;
 		event->overflow_handler_context = NULL;
@@ -11310,17 +11361,25 @@ perf_event_alloc(struct perf_event_attr *attr, int cpu,
 			if (err)
 				goto err_addr_filters;
 		}
+
+		if (attr->aggregate) {
+			err = perf_aggr_alloc(event);
+			if (err)
+				goto err_callchain_buffer;
+		}
 	}
 
 	err = security_perf_event_alloc(event);
 	if (err)
-		goto err_callchain_buffer;
+		goto err_aggr;
 
 	/* symmetric to unaccount_event() in _free_event() */
 	account_event(event);
 
 	return event;
 
+err_aggr:
+	perf_aggr_free(event);
 err_callchain_buffer:
 	if (!event->parent) {
 		if (event->attr.sample_type & PERF_SAMPLE_CALLCHAIN)
@@ -11376,7 +11435,11 @@ static int perf_copy_attr(struct perf_event_attr __user *uattr,
 
 	attr->size = size;
 
-	if (attr->__reserved_1 || attr->__reserved_2 || attr->__reserved_3)
+	if (attr->__reserved_1 || attr->__reserved_3)
+		return -EINVAL;
+
+	/* the wakeup watermark is adapted, a wakeup event count is not */
+	if (attr->adaptive_wakeup && !attr->watermark && attr->wakeup_events)
 		return -EINVAL;
 
 	if (attr->sample_type & ~(PERF_SAMPLE_MAX-1))
@@ -9,6 +9,11 @@
 /* Buffer handling */
 
 #define RING_BUFFER_WRITABLE		0x01
+#define RING_BUFFER_ADAPTIVE		0x02
+#define RING_BUFFER_REDUCE		0x04
+
+/* At most 1 in 2^RB_REDUCE_MAX_SHIFT samples is kept when overflowing */
+#define RB_REDUCE_MAX_SHIFT		6
 
 struct perf_buffer {
 	refcount_t			refcount;
@@ -31,6 +36,17 @@ struct perf_buffer {
 
 	long				watermark;	/* wakeup watermark  */
 	long				aux_watermark;
+
+	/* adaptive wakeup and overflow rate reduction */
+	int				adaptive;
+	int				reduce;
+	int				reduce_shift;	/* keep 1 in 2^shift */
+	local_t				reduce_seq;
+	long				adapt_lost;	/* lost_total at last tuning */
+	local_t				lost_total;
+	local_t				throttled;
+	local_t				rate_reduced;
+
 	/* poll crap */
 	spinlock_t			event_lock;
 	struct list_head		event_list;
@@ -76,8 +92,27 @@ static inline void rb_toggle_paused(struct perf_buffer *rb, bool pause)
 		rb->paused = 1;
 }
 
+/*
+ * The running totals are mirrored into the user page so that a reader
+ * can tell how much it missed without parsing PERF_RECORD_LOST.
+ */
+static inline void rb_count_lost(struct perf_buffer *rb)
+{
+	local_inc(&rb->lost);
+	WRITE_ONCE(rb->user_page->lost_records,
+		   local_inc_return(&rb->lost_total));
+}
+
+static inline void rb_count_throttled(struct perf_buffer *rb)
+{
+	WRITE_ONCE(rb->user_page->throttled,
+		   local_inc_return(&rb->throttled));
+}
+
 extern struct perf_buffer *
 rb_alloc(int nr_pages, long watermark, int cpu, int flags);
+extern bool perf_output_sample_reduced(struct perf_event *event,
+				       struct perf_sample_data *data);
 extern void perf_event_wakeup(struct perf_event *event);
 extern int rb_alloc_aux(struct perf_buffer *rb, struct perf_event *event,
 			pgoff_t pgoff, int nr_pages, long watermark, int flags);
@@ -227,6 +262,24 @@ static inline void put_recursion_context(int *recursion, int rctx)
 	recursion[rctx]--;
 }
 
+#ifdef CONFIG_PERF_EVENTS_AGGREGATE
+extern int perf_aggr_alloc(struct perf_event *event);
+extern void perf_aggr_free(struct perf_event *event);
+extern void perf_aggr_flush(struct perf_event *event);
+extern void perf_aggr_add(struct perf_event *event, u32 pid, u32 tid,
+			  u64 period, struct perf_callchain_entry *callchain);
+#else
+static inline int perf_aggr_alloc(struct perf_event *event)
+{
+	return -EOPNOTSUPP;
+}
+static inline void perf_aggr_free(struct perf_event *event) { }
+static inline void perf_aggr_flush(struct perf_event *event) { }
+static inline void perf_aggr_add(struct perf_event *event, u32 pid, u32 tid,
+				 u64 period,
+				 struct perf_callchain_entry *callchain) { }
+#endif
+
 #ifdef CONFIG_HAVE_PERF_USER_STACK_DUMP
 static inline bool arch_perf_have_user_stack_dump(void)
 {
@@ -145,6 +145,50 @@ ring_buffer_has_space(unsigned long head, unsigned long tail,
 		return CIRC_SPACE(tail, head, data_size) >= size;
 }
 
+/*
+ * Called each time the writer crosses the wakeup watermark. A reader that
+ * drains everything it is woken for leaves about one watermark worth of
+ * data behind, so the watermark is raised a quarter at a time to batch
+ * more records per wakeup. Once the reader falls behind, either the buffer
+ * fills past three quarters or records got lost, and the watermark is
+ * halved so that it is woken while there is still room left.
+ */
+static void rb_adapt_watermark(struct perf_buffer *rb, unsigned long fill)
+{
+	long size = perf_data_size(rb);
+	long lost = local_read(&rb->lost_total);
+	long wm = rb->watermark;
+
+	if (fill > size - size / 4 || lost != rb->adapt_lost)
+		wm = max_t(long, wm / 2, PAGE_SIZE);
+	else if (fill <= wm + wm / 4 && wm < size / 2)
+		wm = min_t(long, wm + wm / 4, size / 2);
+
+	rb->adapt_lost = lost;
+	if (wm == rb->watermark)
+		return;
+
+	WRITE_ONCE(rb->watermark, wm);
+	WRITE_ONCE(rb->user_page->wakeup_watermark, wm);
+}
+
+/*
+ * Sampling is thinned out one power of two at a time while the buffer is
+ * close to full, and restored the same way once the reader has caught up.
+ */
+static void rb_adapt_reduce(struct perf_buffer *rb, unsigned long fill)
+{
+	long size = perf_data_size(rb);
+	int shift = rb->reduce_shift;
+
+	if (size - (long)fill < size / 8 && shift < RB_REDUCE_MAX_SHIFT)
+		shift++;
+	else if (size - (long)fill > size / 2 && shift)
+		shift--;
+
+	WRITE_ONCE(rb->reduce_shift, shift);
+}
+
 static __always_inline int
 __perf_output_begin(struct perf_output_handle *handle,
 		    struct perf_sample_data *data,
@@ -173,7 +217,7 @@ __perf_output_begin(struct perf_output_handle *handle,
 
 	if (unlikely(rb->paused)) {
 		if (rb->nr_pages)
-			local_inc(&rb->lost);
+			rb_count_lost(rb);
 		goto out;
 	}
 
@@ -227,9 +271,18 @@ __perf_output_begin(struct perf_output_handle *handle,
 	 * none of the data stores below can be lifted up by the compiler.
 	 */
 
-	if (unlikely(head - local_read(&rb->wakeup) > rb->watermark))
+	if (unlikely(head - local_read(&rb->wakeup) > rb->watermark)) {
 		local_add(rb->watermark, &rb->wakeup);
 
+		/* tail only means something to a forward reader */
+		if (!rb->overwrite && !backward) {
+			if (rb->adaptive)
+				rb_adapt_watermark(rb, head - tail);
+			if (rb->reduce)
+				rb_adapt_reduce(rb, head - tail);
+		}
+	}
+
 	page_shift = PAGE_SHIFT + page_order(rb);
 
 	handle->page = (offset >> page_shift) & (rb->nr_pages - 1);
@@ -253,7 +306,11 @@ __perf_output_begin(struct perf_output_handle *handle,
 	return 0;
 
 fail:
-	local_inc(&rb->lost);
+	rb_count_lost(rb);
+	/* the first loss since the last PERF_RECORD_LOST cuts the rate */
+	if (rb->reduce && local_read(&rb->lost) == 1 &&
+	    rb->reduce_shift < RB_REDUCE_MAX_SHIFT)
+		WRITE_ONCE(rb->reduce_shift, rb->reduce_shift + 1);
 	perf_output_put_handle(handle);
 out:
 	rcu_read_unlock();
@@ -302,6 +359,45 @@ void perf_output_end(struct perf_output_handle *handle)
 	rcu_read_unlock();
 }
 
+/*
+ * With attr::overflow_reduce, a buffer that is about to overflow keeps
+ * only 1 in 2^reduce_shift samples. The period of the kept ones is scaled
+ * up by the same factor so that the totals derived from them stay right.
+ *
+ * Returns true if the sample should be dropped.
+ */
+bool perf_output_sample_reduced(struct perf_event *event,
+				struct perf_sample_data *data)
+{
+	struct perf_buffer *rb;
+	bool skip = false;
+	int shift;
+
+	rcu_read_lock();
+	if (event->parent)
+		event = event->parent;
+
+	rb = rcu_dereference(event->rb);
+	if (!rb || !rb->reduce)
+		goto unlock;
+
+	shift = READ_ONCE(rb->reduce_shift);
+	if (!shift)
+		goto unlock;
+
+	if (local_inc_return(&rb->reduce_seq) & ((1 << shift) - 1)) {
+		WRITE_ONCE(rb->user_page->rate_reduced,
+			   local_inc_return(&rb->rate_reduced));
+		skip = true;
+	} else {
+		data->period <<= shift;
+	}
+unlock:
+	rcu_read_unlock();
+
+	return skip;
+}
+
 static void
 ring_buffer_init(struct perf_buffer *rb, long watermark, int flags)
 {
@@ -318,6 +414,9 @@ ring_buffer_init(struct perf_buffer *rb, long watermark, int flags)
 	else
 		rb->overwrite = 1;
 
+	rb->adaptive = !!(flags & RING_BUFFER_ADAPTIVE);
+	rb->reduce = !!(flags & RING_BUFFER_REDUCE);
+
 	refcount_set(&rb->refcount, 1);
 
 	INIT_LIST_HEAD(&rb->event_list);
@@ -2638,6 +2638,16 @@ static struct ctl_table kern_table[] = {
 		.mode		= 0644,
 		.proc_handler	= bpf_stats_handler,
 	},
+#ifdef CONFIG_BPF_VERIFIER_CACHE
+	{
+		.procname	= "bpf_verifier_cache_kb",
+		.data		= &sysctl_bpf_verifier_cache_kb,
+		.maxlen		= sizeof(sysctl_bpf_verifier_cache_kb),
+		.mode		= 0644,
+		.proc_handler	= bpf_verifier_cache_handler,
+		.extra1		= SYSCTL_ZERO,
+	},
+#endif
 #endif
 #if defined(CONFIG_TREE_RCU)
 	{
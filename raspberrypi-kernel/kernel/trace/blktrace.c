@@ -18,9 +18,13 @@
 #include <linux/time.h>
 #include <linux/uaccess.h>
 #include <linux/list.h>
+#include <linux/seq_file.h>
 #include <linux/blk-cgroup.h>
+#include <linux/hash.h>
+#include <linux/log2.h>
 
 #include "../../block/blk.h"
+#include "../../block/blk-stat.h"
 
 #include <trace/events/block.h>
 
@@ -62,6 +66,7 @@ static int blk_probes_ref;
 
 static void blk_register_tracepoints(void);
 static void blk_unregister_tracepoints(void);
+static int blk_lat_set(struct request_queue *q, int mode);
 
 /*
  * Send out a notify message.
@@ -774,6 +779,7 @@ void blk_trace_shutdown(struct request_queue *q)
 		__blk_trace_startstop(q, 0);
 		__blk_trace_remove(q);
 	}
+	blk_lat_set(q, 0);
 
 	mutex_unlock(&q->debugfs_mutex);
 }
@@ -1952,6 +1958,438 @@ void blk_trace_remove_sysfs(struct device *dev)
 	sysfs_remove_group(&dev->kobj, &blk_trace_attr_group);
 }
 
+/*
+ * In-kernel latency histograms
+ *
+ * Writing 1 to <debugfs>/block/<dev>/latency_hist makes the completion
+ * probe account the queue to dispatch (Q2D), dispatch to completion (D2C)
+ * and queue to completion (Q2C) time of every request of the device into
+ * per operation log2 histograms, without a trace session or any event
+ * reaching userspace. Writing 2 also keeps them per cgroup, writing 0
+ * turns them off, and writing 1 or 2 again starts over from zero. Reading
+ * the file shows the histograms.
+ */
+
+enum {
+	BLK_LAT_Q2D,
+	BLK_LAT_D2C,
+	BLK_LAT_Q2C,
+	BLK_LAT_TYPES,
+};
+
+enum {
+	BLK_LAT_READ,
+	BLK_LAT_WRITE,
+	BLK_LAT_DISCARD,
+	BLK_LAT_FLUSH,
+	BLK_LAT_OPS,
+};
+
+static const char * const blk_lat_type_names[BLK_LAT_TYPES] = {
+	"q2d", "d2c", "q2c",
+};
+
+static const char * const blk_lat_op_names[BLK_LAT_OPS] = {
+	"read", "write", "discard", "flush",
+};
+
+/* Bucket n holds latencies in [2^n, 2^(n+1)) ns, the last one is open */
+#define BLK_LAT_BUCKETS		32
+
+#define BLK_LAT_CGROUP_BITS	5
+#define BLK_LAT_CGROUPS		(1 << BLK_LAT_CGROUP_BITS)
+
+struct blk_lat_buckets {
+	unsigned long		b[BLK_LAT_TYPES][BLK_LAT_OPS][BLK_LAT_BUCKETS];
+};
+
+/* Shared by all CPUs, the per cgroup ones would be too big per CPU */
+struct blk_lat_cgroup {
+	u64			id;
+	atomic_long_t		b[BLK_LAT_TYPES][BLK_LAT_OPS][BLK_LAT_BUCKETS];
+};
+
+struct blk_lat_hist {
+	struct blk_lat_buckets __percpu	*dev;
+	struct blk_lat_cgroup	*cgroups;	/* per cgroup mode only */
+	atomic_long_t		cgroups_missed;
+	struct rcu_head		rcu;
+};
+
+static DEFINE_MUTEX(blk_lat_probe_mutex);
+static int blk_lat_probe_ref;
+
+static int blk_lat_op(struct request *rq)
+{
+	switch (req_op(rq)) {
+	case REQ_OP_READ:
+		return BLK_LAT_READ;
+	case REQ_OP_WRITE:
+	case REQ_OP_WRITE_SAME:
+	case REQ_OP_WRITE_ZEROES:
+		return BLK_LAT_WRITE;
+	case REQ_OP_DISCARD:
+	case REQ_OP_SECURE_ERASE:
+		return BLK_LAT_DISCARD;
+	case REQ_OP_FLUSH:
+		return BLK_LAT_FLUSH;
+	default:
+		return -1;
+	}
+}
+
+static int blk_lat_bucket(u64 delta)
+{
+	return min_t(int, delta ? ilog2(delta) : 0, BLK_LAT_BUCKETS - 1);
+}
+
+#ifdef CONFIG_BLK_CGROUP
+static struct blk_lat_cgroup *blk_lat_cgroup(struct blk_lat_hist *lh,
+					     struct request *rq)
+{
+	struct blk_lat_cgroup *cg;
+	unsigned int idx;
+	u64 id, cur;
+	int i;
+
+	if (!rq->bio || !rq->bio->bi_blkg)
+		return NULL;
+
+	id = cgroup_id(bio_blkcg(rq->bio)->css.cgroup);
+	idx = hash_64(id, BLK_LAT_CGROUP_BITS);
+
+	for (i = 0; i < BLK_LAT_CGROUPS; i++) {
+		cg = &lh->cgroups[idx];
+		cur = READ_ONCE(cg->id);
+		if (cur == id)
+			return cg;
+		if (!cur) {
+			cur = cmpxchg64(&cg->id, 0, id);
+			if (!cur || cur == id)
+				return cg;
+		}
+		idx = (idx + 1) & (BLK_LAT_CGROUPS - 1);
+	}
+
+	atomic_long_inc(&lh->cgroups_missed);
+	return NULL;
+}
+#else
+static struct blk_lat_cgroup *blk_lat_cgroup(struct blk_lat_hist *lh,
+					     struct request *rq)
+{
+	return NULL;
+}
+#endif
+
+static void blk_lat_rq_complete(void *ignore, struct request *rq,
+				int error, unsigned int nr_bytes)
+{
+	struct blk_lat_cgroup *cg = NULL;
+	struct blk_lat_hist *lh;
+	u64 lat[BLK_LAT_TYPES] = {};
+	int op, type, idx;
+	u64 now;
+
+	/* Only the final part of a request completion counts */
+	if (nr_bytes < blk_rq_bytes(rq) || !rq->io_start_time_ns)
+		return;
+
+	op = blk_lat_op(rq);
+	if (op < 0)
+		return;
+
+	rcu_read_lock();
+	lh = rcu_dereference(rq->q->blk_lat);
+	if (likely(!lh))
+		goto out;
+
+	now = ktime_get_ns();
+	lat[BLK_LAT_D2C] = now - rq->io_start_time_ns;
+	if (rq->start_time_ns) {
+		lat[BLK_LAT_Q2D] = rq->io_start_time_ns - rq->start_time_ns;
+		lat[BLK_LAT_Q2C] = now - rq->start_time_ns;
+	}
+
+	if (lh->cgroups)
+		cg = blk_lat_cgroup(lh, rq);
+
+	for (type = 0; type < BLK_LAT_TYPES; type++) {
+		/* no queue time stamp without iostats or a scheduler */
+		if (type != BLK_LAT_D2C && !rq->start_time_ns)
+			continue;
+
+		idx = blk_lat_bucket(lat[type]);
+		this_cpu_inc(lh->dev->b[type][op][idx]);
+		if (cg)
+			atomic_long_inc(&cg->b[type][op][idx]);
+	}
+out:
+	rcu_read_unlock();
+}
+
+static int blk_lat_get_probe(void)
+{
+	int ret = 0;
+
+	mutex_lock(&blk_lat_probe_mutex);
+	if (!blk_lat_probe_ref) {
+		ret = register_trace_block_rq_complete(blk_lat_rq_complete,
+						       NULL);
+		if (ret)
+			goto out;
+	}
+	blk_lat_probe_ref++;
+out:
+	mutex_unlock(&blk_lat_probe_mutex);
+	return ret;
+}
+
+static void blk_lat_put_probe(void)
+{
+	mutex_lock(&blk_lat_probe_mutex);
+	if (!--blk_lat_probe_ref) {
+		unregister_trace_block_rq_complete(blk_lat_rq_complete, NULL);
+		tracepoint_synchronize_unregister();
+	}
+	mutex_unlock(&blk_lat_probe_mutex);
+}
+
+static void blk_lat_free(struct blk_lat_hist *lh)
+{
+	free_percpu(lh->dev);
+	kvfree(lh->cgroups);
+	kfree(lh);
+}
+
+static void blk_lat_free_rcu(struct rcu_head *rcu)
+{
+	blk_lat_free(container_of(rcu, struct blk_lat_hist, rcu));
+}
+
+static struct blk_lat_hist *blk_lat_alloc(bool cgroups)
+{
+	struct blk_lat_hist *lh;
+
+	lh = kzalloc(sizeof(*lh), GFP_KERNEL);
+	if (!lh)
+		return NULL;
+
+	lh->dev = alloc_percpu(struct blk_lat_buckets);
+	if (!lh->dev)
+		goto err;
+
+	if (cgroups && IS_ENABLED(CONFIG_BLK_CGROUP)) {
+		lh->cgroups = kvcalloc(BLK_LAT_CGROUPS, sizeof(*lh->cgroups),
+				       GFP_KERNEL);
+		if (!lh->cgroups)
+			goto err;
+	}
+
+	return lh;
+err:
+	blk_lat_free(lh);
+	return NULL;
+}
+
+/* Replaces the histograms of @q, with none if @mode is 0 */
+static int blk_lat_set(struct request_queue *q, int mode)
+{
+	struct blk_lat_hist *old, *lh = NULL;
+	int ret;
+
+	lockdep_assert_held(&q->debugfs_mutex);
+
+	old = rcu_dereference_protected(q->blk_lat,
+					lockdep_is_held(&q->debugfs_mutex));
+	if (!mode && !old)
+		return 0;
+
+	if (mode) {
+		lh = blk_lat_alloc(mode > 1);
+		if (!lh)
+			return -ENOMEM;
+
+		if (!old) {
+			ret = blk_lat_get_probe();
+			if (ret) {
+				blk_lat_free(lh);
+				return ret;
+			}
+
+			/* have the issue path stamp rq->io_start_time_ns */
+			blk_stat_enable_accounting(q);
+		}
+	}
+
+	rcu_assign_pointer(q->blk_lat, lh);
+
+	if (old) {
+		if (!lh) {
+			blk_stat_disable_accounting(q);
+			blk_lat_put_probe();
+		}
+		call_rcu(&old->rcu, blk_lat_free_rcu);
+	}
+
+	return 0;
+}
+
+static void blk_lat_show_buckets(struct seq_file *m, const char *name,
+				 unsigned long *buckets)
+{
+	unsigned long count = 0;
+	int first, last, i;
+
+	for (i = 0; i < BLK_LAT_BUCKETS; i++)
+		count += buckets[i];
+	if (!count)
+		return;
+
+	for (first = 0; !buckets[first]; first++)
+		;
+	for (last = BLK_LAT_BUCKETS - 1; !buckets[last]; last--)
+		;
+
+	seq_printf(m, "\n%s: count=%lu\n", name, count);
+	seq_puts(m, "         nsecs              : count\n");
+
+	for (i = first; i <= last; i++) {
+		unsigned long long low = i ? 1ULL << i : 0;
+
+		if (i == BLK_LAT_BUCKETS - 1)
+			seq_printf(m, "%10llu -> %-10s  : %lu\n",
+				   low, "inf", buckets[i]);
+		else
+			seq_printf(m, "%10llu -> %-10llu  : %lu\n",
+				   low, (1ULL << (i + 1)) - 1, buckets[i]);
+	}
+}
+
+static void blk_lat_show_all(struct seq_file *m, const char *prefix,
+			     struct blk_lat_buckets *sum)
+{
+	char name[64];
+	int type, op;
+
+	for (op = 0; op < BLK_LAT_OPS; op++) {
+		for (type = 0; type < BLK_LAT_TYPES; type++) {
+			snprintf(name, sizeof(name), "%s%s %s", prefix,
+				 blk_lat_op_names[op], blk_lat_type_names[type]);
+			blk_lat_show_buckets(m, name, sum->b[type][op]);
+		}
+	}
+}
+
+static int blk_lat_show(struct seq_file *m, void *v)
+{
+	struct request_queue *q = m->private;
+	struct blk_lat_buckets *sum;
+	struct blk_lat_hist *lh;
+	int cpu, i, j, k, l;
+	char prefix[32];
+
+	sum = kmalloc(sizeof(*sum), GFP_KERNEL);
+	if (!sum)
+		return -ENOMEM;
+
+	mutex_lock(&q->debugfs_mutex);
+	lh = rcu_dereference_protected(q->blk_lat,
+				       lockdep_is_held(&q->debugfs_mutex));
+	if (!lh) {
+		seq_puts(m, "disabled\n");
+		goto out;
+	}
+
+	memset(sum, 0, sizeof(*sum));
+	for_each_possible_cpu(cpu) {
+		struct blk_lat_buckets *b = per_cpu_ptr(lh->dev, cpu);
+
+		for (i = 0; i < BLK_LAT_TYPES; i++)
+			for (j = 0; j < BLK_LAT_OPS; j++)
+				for (k = 0; k < BLK_LAT_BUCKETS; k++)
+					sum->b[i][j][k] += READ_ONCE(b->b[i][j][k]);
+	}
+	blk_lat_show_all(m, "", sum);
+
+	if (!lh->cgroups)
+		goto out;
+
+	seq_printf(m, "\n# cgroups not accounted (table full): %lu\n",
+		   atomic_long_read(&lh->cgroups_missed));
+
+	for (i = 0; i < BLK_LAT_CGROUPS; i++) {
+		struct blk_lat_cgroup *cg = &lh->cgroups[i];
+		u64 id = READ_ONCE(cg->id);
+
+		if (!id)
+			continue;
+
+		for (j = 0; j < BLK_LAT_TYPES; j++)
+			for (k = 0; k < BLK_LAT_OPS; k++)
+				for (l = 0; l < BLK_LAT_BUCKETS; l++)
+					sum->b[j][k][l] =
+						atomic_long_read(&cg->b[j][k][l]);
+
+		snprintf(prefix, sizeof(prefix), "cgroup %llu ", id);
+		blk_lat_show_all(m, prefix, sum);
+	}
+out:
+	mutex_unlock(&q->debugfs_mutex);
+	kfree(sum);
+	return 0;
+}
+
+static int blk_lat_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, blk_lat_show, inode->i_private);
+}
+
+static ssize_t blk_lat_write(struct file *file, const char __user *buf,
+			     size_t count, loff_t *ppos)
+{
+	struct request_queue *q = file_inode(file)->i_private;
+	unsigned int mode;
+	int ret;
+
+	ret = kstrtouint_from_user(buf, count, 0, &mode);
+	if (ret)
+		return ret;
+	if (mode > 2)
+		return -EINVAL;
+
+	mutex_lock(&q->debugfs_mutex);
+	/* don't add histograms that blk_trace_shutdown() may not see */
+	if (blk_queue_dying(q))
+		ret = -ENODEV;
+	else
+		ret = blk_lat_set(q, mode);
+	mutex_unlock(&q->debugfs_mutex);
+
+	return ret ? ret : count;
+}
+
+static const struct file_operations blk_lat_fops = {
+	.owner		= THIS_MODULE,
+	.open		= blk_lat_open,
+	.read		= seq_read,
+	.write		= blk_lat_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/**
+ * blk_trace_register_latency - add the latency histogram control of a queue
+ * @q:    the request queue, whose debugfs directory was just created
+ **/
+void blk_trace_register_latency(struct request_queue *q)
+{
+	lockdep_assert_held(&q->debugfs_mutex);
+
+	debugfs_create_file("latency_hist", 0600, q->debugfs_dir, q,
+			    &blk_lat_fops);
+}
+
 #endif /* CONFIG_BLK_DEV_IO_TRACE */
 
 #ifdef CONFIG_EVENT_TRACING
@@ -4930,7 +4930,7 @@ ftrace_notrace_write(struct file *file, const char __user *ubuf,
 }
 
 static int
-ftrace_match_addr(struct ftrace_hash *hash, unsigned long ip, int remove)
+__ftrace_match_addr(struct ftrace_hash *hash, unsigned long ip, int remove)
 {
 	struct ftrace_func_entry *entry;
 
@@ -4948,9 +4948,30 @@ ftrace_match_addr(struct ftrace_hash *hash, unsigned long ip, int remove)
 	return add_hash_entry(hash, ip);
 }
 
+static int
+ftrace_match_addr(struct ftrace_hash *hash, unsigned long *ips,
+		  unsigned int cnt, int remove)
+{
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < cnt; i++) {
+		err = __ftrace_match_addr(hash, ips[i], remove);
+		if (err) {
+			/*
+			 * This expects the @hash is a temporary hash and if this
+			 * fails the caller must free the @hash.
+			 */
+			return err;
+		}
+	}
+	return 0;
+}
+
 static int
 ftrace_set_hash(struct ftrace_ops *ops, unsigned char *buf, int len,
-		unsigned long ip, int remove, int reset, int enable)
+		unsigned long *ips, unsigned int cnt,
+		int remove, int reset, int enable)
 {
 	struct ftrace_hash **orig_hash;
 	struct ftrace_hash *hash;
@@ -4980,8 +5001,8 @@ ftrace_set_hash(struct ftrace_ops *ops, unsigned char *buf, int len,
 		ret = -EINVAL;
 		goto out_regex_unlock;
 	}
-	if (ip) {
-		ret = ftrace_match_addr(hash, ip, remove);
+	if (ips) {
+		ret = ftrace_match_addr(hash, ips, cnt, remove);
 		if (ret < 0)
 			goto out_regex_unlock;
 	}
@@ -4998,10 +5019,10 @@ ftrace_set_hash(struct ftrace_ops *ops, unsigned char *buf, int len,
 }
 
 static int
-ftrace_set_addr(struct ftrace_ops *ops, unsigned long ip, int remove,
-		int reset, int enable)
+ftrace_set_addr(struct ftrace_ops *ops, unsigned long *ips, unsigned int cnt,
+		int remove, int reset, int enable)
 {
-	return ftrace_set_hash(ops, NULL, 0, ip, remove, reset, enable);
+	return ftrace_set_hash(ops, NULL, 0, ips, cnt, remove, reset, enable);
 }
 
 #ifdef CONFIG_DYNAMIC_FTRACE_WITH_DIRECT_CALLS
@@ -5239,6 +5260,234 @@ int unregister_ftrace_direct(unsigned long ip, unsigned long addr)
 }
 EXPORT_SYMBOL_GPL(unregister_ftrace_direct);
 
+/**
+ * register_ftrace_direct_ips - Call custom trampolines directly from many sites
+ * @ips: The addresses of the nops at the beginning of the functions
+ * @addrs: The addresses of the trampolines, @addrs[i] is called at @ips[i]
+ * @cnt: The number of entries in @ips and @addrs
+ *
+ * This does the same as register_ftrace_direct() for every pair in @ips
+ * and @addrs, but the filter of the direct ops is updated only once,
+ * so all the call sites are patched in a single pass over the text.
+ * Either all the sites are attached or none of them is. On success,
+ * @ips is updated to hold the exact addresses of the records.
+ *
+ * Returns:
+ *  0 on success
+ *  -EBUSY - Another direct function is already attached to one of @ips
+ *  -ENODEV - One of @ips does not point to a ftrace nop location
+ *  -ENOMEM - There was an allocation failure.
+ */
+int register_ftrace_direct_ips(unsigned long *ips, unsigned long *addrs,
+			       unsigned int cnt)
+{
+	struct ftrace_direct_func **directs;
+	struct ftrace_func_entry **entries;
+	struct ftrace_hash *free_hash = NULL;
+	struct ftrace_direct_func *direct;
+	unsigned int i, added = 0;
+	struct dyn_ftrace *rec;
+	bool sync = false;
+	int ret = -ENOMEM;
+
+	if (!cnt)
+		return 0;
+
+	entries = kvcalloc(cnt, sizeof(*entries), GFP_KERNEL);
+	directs = kvcalloc(cnt, sizeof(*directs), GFP_KERNEL);
+	if (!entries || !directs)
+		goto out_free;
+
+	mutex_lock(&direct_mutex);
+
+	/* Grow the hash once for all the new entries */
+	if (ftrace_hash_empty(direct_functions) ||
+	    direct_functions->count + cnt > 2 * (1 << direct_functions->size_bits)) {
+		struct ftrace_hash *new_hash;
+		int size = cnt + (ftrace_hash_empty(direct_functions) ? 0 :
+				  direct_functions->count + 1);
+
+		if (size < 32)
+			size = 32;
+
+		new_hash = dup_hash(direct_functions, size);
+		if (!new_hash)
+			goto out_unlock;
+
+		free_hash = direct_functions;
+		direct_functions = new_hash;
+	}
+
+	for (i = 0; i < cnt; i++) {
+		/* Duplicates in @ips are caught here as well */
+		ret = -EBUSY;
+		if (ftrace_find_rec_direct(ips[i]))
+			goto out_remove;
+
+		ret = -ENODEV;
+		rec = lookup_rec(ips[i], ips[i]);
+		if (!rec)
+			goto out_remove;
+
+		if (WARN_ON(rec->flags & FTRACE_FL_DIRECT))
+			goto out_remove;
+
+		if (ips[i] != rec->ip) {
+			ips[i] = rec->ip;
+			ret = -EBUSY;
+			if (ftrace_find_rec_direct(ips[i]))
+				goto out_remove;
+		}
+
+		ret = -ENOMEM;
+		entries[i] = kmalloc(sizeof(*entries[i]), GFP_KERNEL);
+		if (!entries[i])
+			goto out_remove;
+
+		direct = ftrace_find_direct_func(addrs[i]);
+		if (!direct) {
+			direct = kmalloc(sizeof(*direct), GFP_KERNEL);
+			if (!direct) {
+				kfree(entries[i]);
+				goto out_remove;
+			}
+			direct->addr = addrs[i];
+			direct->count = 0;
+			list_add_rcu(&direct->next, &ftrace_direct_funcs);
+			ftrace_direct_func_count++;
+		}
+		/* Taken right away, so that repeated @addrs share it */
+		direct->count++;
+		directs[i] = direct;
+
+		entries[i]->ip = ips[i];
+		entries[i]->direct = addrs[i];
+		__add_hash_entry(direct_functions, entries[i]);
+		added++;
+	}
+
+	ret = ftrace_set_filter_ips(&direct_ops, ips, cnt, 0, 0);
+
+	if (!ret && !(direct_ops.flags & FTRACE_OPS_FL_ENABLED)) {
+		ret = register_ftrace_function(&direct_ops);
+		if (ret)
+			ftrace_set_filter_ips(&direct_ops, ips, cnt, 1, 0);
+	}
+
+	if (!ret)
+		goto out_unlock;
+
+ out_remove:
+	for (i = 0; i < added; i++) {
+		remove_hash_entry(direct_functions, entries[i]);
+		kfree(entries[i]);
+
+		direct = directs[i];
+		directs[i] = NULL;
+		if (!--direct->count) {
+			list_del_rcu(&direct->next);
+			ftrace_direct_func_count--;
+			/* Freed below, after the readers are gone */
+			directs[i] = direct;
+			sync = true;
+		}
+	}
+ out_unlock:
+	mutex_unlock(&direct_mutex);
+
+	if (free_hash || sync) {
+		synchronize_rcu_tasks();
+		if (free_hash)
+			free_ftrace_hash(free_hash);
+		for (i = 0; sync && i < added; i++)
+			kfree(directs[i]);
+	}
+ out_free:
+	kvfree(entries);
+	kvfree(directs);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(register_ftrace_direct_ips);
+
+/**
+ * unregister_ftrace_direct_ips - Remove custom trampolines from many sites
+ * @ips: The addresses of the nops at the beginning of the functions
+ * @addrs: The addresses of the trampolines, @addrs[i] is called at @ips[i]
+ * @cnt: The number of entries in @ips and @addrs
+ *
+ * The counterpart of register_ftrace_direct_ips(). All the call sites
+ * are restored with a single update of the direct ops, and the freed
+ * descriptors wait for one RCU tasks grace period in total instead of
+ * one per trampoline. Nothing is removed if one of @ips is not
+ * attached.
+ */
+int unregister_ftrace_direct_ips(unsigned long *ips, unsigned long *addrs,
+				 unsigned int cnt)
+{
+	struct ftrace_direct_func **directs;
+	struct ftrace_func_entry **entries;
+	struct ftrace_direct_func *direct;
+	bool removed = false;
+	unsigned int i;
+	int ret = -ENOMEM;
+
+	if (!cnt)
+		return 0;
+
+	entries = kvcalloc(cnt, sizeof(*entries), GFP_KERNEL);
+	directs = kvcalloc(cnt, sizeof(*directs), GFP_KERNEL);
+	if (!entries || !directs)
+		goto out_free;
+
+	mutex_lock(&direct_mutex);
+
+	ret = -ENODEV;
+	for (i = 0; i < cnt; i++) {
+		entries[i] = find_direct_entry(&ips[i], NULL);
+		if (!entries[i])
+			goto out_unlock;
+	}
+
+	if (direct_functions->count == cnt)
+		unregister_ftrace_function(&direct_ops);
+
+	ret = ftrace_set_filter_ips(&direct_ops, ips, cnt, 1, 0);
+
+	WARN_ON(ret);
+
+	for (i = 0; i < cnt; i++) {
+		remove_hash_entry(direct_functions, entries[i]);
+
+		direct = ftrace_find_direct_func(addrs[i]);
+		if (WARN_ON(!direct))
+			continue;
+
+		direct->count--;
+		WARN_ON(direct->count < 0);
+		if (!direct->count) {
+			list_del_rcu(&direct->next);
+			ftrace_direct_func_count--;
+			directs[i] = direct;
+		}
+	}
+	removed = true;
+ out_unlock:
+	mutex_unlock(&direct_mutex);
+
+	if (removed) {
+		synchronize_rcu_tasks();
+		for (i = 0; i < cnt; i++) {
+			kfree(directs[i]);
+			kfree(entries[i]);
+		}
+	}
+ out_free:
+	kvfree(entries);
+	kvfree(directs);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(unregister_ftrace_direct_ips);
+
 static struct ftrace_ops stub_ops = {
 	.func		= ftrace_stub,
 };
@@ -5379,10 +5628,30 @@ int ftrace_set_filter_ip(struct ftrace_ops *ops, unsigned long ip,
 			 int remove, int reset)
 {
 	ftrace_ops_init(ops);
-	return ftrace_set_addr(ops, ip, remove, reset, 1);
+	return ftrace_set_addr(ops, &ip, 1, remove, reset, 1);
 }
 EXPORT_SYMBOL_GPL(ftrace_set_filter_ip);
 
+/**
+ * ftrace_set_filter_ips - set functions to filter on in ftrace by addresses
+ * @ops - the ops to set the filter with
+ * @ips - the array of addresses to add to or remove from the filter.
+ * @cnt - the number of addresses in @ips
+ * @remove - non zero to remove ips from the filter
+ * @reset - non zero to reset all filters before applying this filter.
+ *
+ * Filters denote which functions should be enabled when tracing is enabled
+ * If @ips array or any ip specified within is NULL , it fails to update filter.
+ * All the addresses are applied with a single update of the ops.
+ */
+int ftrace_set_filter_ips(struct ftrace_ops *ops, unsigned long *ips,
+			  unsigned int cnt, int remove, int reset)
+{
+	ftrace_ops_init(ops);
+	return ftrace_set_addr(ops, ips, cnt, remove, reset, 1);
+}
+EXPORT_SYMBOL_GPL(ftrace_set_filter_ips);
+
 /**
  * ftrace_ops_set_global_filter - setup ops to use global filters
  * @ops - the ops which will use the global filters
@@ -5404,7 +5673,7 @@ static int
 ftrace_set_regex(struct ftrace_ops *ops, unsigned char *buf, int len,
 		 int reset, int enable)
 {
-	return ftrace_set_hash(ops, buf, len, 0, 0, reset, enable);
+	return ftrace_set_hash(ops, buf, len, NULL, 0, 0, reset, enable);
 }
 
 /**
@@ -1675,6 +1675,30 @@ extern int create_event_filter(struct trace_array *tr,
 			       struct event_filter **filterp);
 extern void free_event_filter(struct event_filter *filter);
 
+/*
+ * Per event sampling and rate limiting, configured through the
+ * event's "sample" file. Applied before the event is reserved in
+ * the ring buffer, so suppressed events cost only a few instructions.
+ */
+struct event_sample_cpu {
+	int			countdown;	/* hits left until next sample */
+	unsigned long		sampled;
+	unsigned long		dropped;
+};
+
+struct event_sample {
+	unsigned int		every;		/* record 1 in @every hits */
+	unsigned int		rate;		/* events per second, 0 = no limit */
+	unsigned int		burst;
+	u64			interval;	/* ns between events at @rate */
+	u64			tolerance;	/* ns of credit allowed by @burst */
+	atomic64_t		tat;		/* GCRA theoretical arrival time */
+	struct event_sample_cpu __percpu *cpu;
+};
+
+extern bool trace_event_sample_drop(struct trace_event_file *file);
+extern void free_event_sample(struct event_sample *sample);
+
 struct ftrace_event_field *
 trace_find_event_field(struct trace_event_call *call, char *name);
 
@@ -1705,6 +1729,7 @@ extern const struct file_operations event_trigger_fops;
 extern const struct file_operations event_hist_fops;
 extern const struct file_operations event_hist_debug_fops;
 extern const struct file_operations event_inject_fops;
+extern const struct file_operations event_sample_fops;
 
 #ifdef CONFIG_HIST_TRIGGERS
 extern int register_trigger_hist_cmd(void);
@@ -258,6 +258,10 @@ void *trace_event_buffer_reserve(struct trace_event_buffer *fbuffer,
 	    trace_event_ignore_this_pid(trace_file))
 		return NULL;
 
+	if ((trace_file->flags & EVENT_FILE_FL_SAMPLE) &&
+	    trace_event_sample_drop(trace_file))
+		return NULL;
+
 	local_save_flags(fbuffer->flags);
 	fbuffer->pc = preempt_count();
 	/*
@@ -770,6 +774,7 @@ static void remove_event_file_dir(struct trace_event_file *file)
 	list_del(&file->list);
 	remove_subsystem(file->system);
 	free_event_filter(file->filter);
+	free_event_sample(file->sample);
 	kmem_cache_free(file_cachep, file);
 }
 
@@ -2215,6 +2220,9 @@ event_create_dir(struct dentry *parent, struct trace_event_file *file)
 
 		trace_create_file("trigger", 0644, file->dir, file,
 				  &event_trigger_fops);
+
+		trace_create_file("sample", 0644, file->dir, file,
+				  &event_sample_fops);
 	}
 
 #ifdef CONFIG_HIST_TRIGGERS
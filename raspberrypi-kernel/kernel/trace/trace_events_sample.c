@@ -0,0 +1,296 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * trace_events_sample - per event sampling and rate limiting
+ *
+ * Each event directory has a "sample" file that accepts:
+ *
+ *   every=N	record one in N hits of the event (per CPU)
+ *   rate=K	record at most K events per second
+ *   burst=B	allow bursts of up to B events above @rate (default K)
+ *
+ * Writing "0" removes the configuration. The decision is made before
+ * the event is reserved in the ring buffer, so a suppressed event never
+ * touches the buffer, the filter or the triggers with conditions.
+ */
+
+#include <linux/mutex.h>
+#include <linux/slab.h>
+#include <linux/percpu.h>
+#include <linux/timekeeping.h>
+
+#include "trace.h"
+
+/*
+ * Generic cell rate algorithm: an event is admitted if it does not
+ * arrive earlier than @tolerance before the theoretical arrival time,
+ * which then moves forward by one @interval. Events that are rejected
+ * only read the shared state, so a flood of suppressed events does not
+ * bounce the cache line between CPUs.
+ */
+static bool event_sample_admit(struct event_sample *sample)
+{
+	s64 now = ktime_get_mono_fast_ns();
+	s64 tat, new;
+
+	tat = atomic64_read(&sample->tat);
+	do {
+		if (now + (s64)sample->tolerance < tat)
+			return false;
+		new = max(tat, now) + sample->interval;
+	} while (!atomic64_try_cmpxchg(&sample->tat, &tat, new));
+
+	return true;
+}
+
+/*
+ * Called with preemption disabled from trace_event_buffer_reserve() and
+ * the syscall enter/exit probes when EVENT_FILE_FL_SAMPLE is set.
+ * Returns true if the event must not be recorded.
+ */
+bool trace_event_sample_drop(struct trace_event_file *file)
+{
+	struct event_sample *sample;
+
+	sample = rcu_dereference_raw(file->sample);
+	if (!sample)
+		return false;
+
+	if (sample->every) {
+		if (this_cpu_dec_return(sample->cpu->countdown) > 0)
+			goto drop;
+		this_cpu_write(sample->cpu->countdown, sample->every);
+	}
+
+	if (sample->rate && !event_sample_admit(sample))
+		goto drop;
+
+	this_cpu_inc(sample->cpu->sampled);
+	return false;
+
+ drop:
+	this_cpu_inc(sample->cpu->dropped);
+	return true;
+}
+
+void free_event_sample(struct event_sample *sample)
+{
+	if (!sample)
+		return;
+
+	free_percpu(sample->cpu);
+	kfree(sample);
+}
+
+static int parse_event_sample(char *str, struct event_sample *sample)
+{
+	char *tok, *val;
+	unsigned int num;
+	int ret;
+
+	while ((tok = strsep(&str, " \t\n")) != NULL) {
+		if (!*tok)
+			continue;
+
+		val = strchr(tok, '=');
+		if (!val)
+			return -EINVAL;
+		*val++ = '\0';
+
+		ret = kstrtouint(val, 0, &num);
+		if (ret)
+			return ret;
+
+		if (!strcmp(tok, "every"))
+			sample->every = num;
+		else if (!strcmp(tok, "rate"))
+			sample->rate = num;
+		else if (!strcmp(tok, "burst"))
+			sample->burst = num;
+		else
+			return -EINVAL;
+	}
+
+	if (sample->every == 1)
+		sample->every = 0;
+
+	if (sample->burst && !sample->rate)
+		return -EINVAL;
+
+	if (sample->rate) {
+		if (!sample->burst)
+			sample->burst = sample->rate;
+		sample->interval = div_u64(NSEC_PER_SEC, sample->rate);
+		if (!sample->interval)
+			sample->interval = 1;
+		sample->tolerance = sample->interval * (sample->burst - 1);
+	}
+
+	if (!sample->every && !sample->rate)
+		return -EINVAL;
+
+	return 0;
+}
+
+static struct event_sample *create_event_sample(char *str)
+{
+	struct event_sample *sample;
+	int cpu, ret;
+
+	sample = kzalloc(sizeof(*sample), GFP_KERNEL);
+	if (!sample)
+		return ERR_PTR(-ENOMEM);
+
+	ret = parse_event_sample(str, sample);
+	if (ret)
+		goto fail;
+
+	ret = -ENOMEM;
+	sample->cpu = alloc_percpu(struct event_sample_cpu);
+	if (!sample->cpu)
+		goto fail;
+
+	/* Record the first hit on every CPU */
+	for_each_possible_cpu(cpu)
+		per_cpu_ptr(sample->cpu, cpu)->countdown = 1;
+
+	atomic64_set(&sample->tat, ktime_get_mono_fast_ns());
+
+	return sample;
+ fail:
+	free_event_sample(sample);
+	return ERR_PTR(ret);
+}
+
+static int apply_event_sample(struct trace_event_file *file, char *str)
+{
+	struct event_sample *sample = NULL;
+	struct event_sample *old;
+
+	lockdep_assert_held(&event_mutex);
+
+	if (strcmp(strstrip(str), "0")) {
+		sample = create_event_sample(str);
+		if (IS_ERR(sample))
+			return PTR_ERR(sample);
+	}
+
+	old = rcu_dereference_protected(file->sample,
+					lockdep_is_held(&event_mutex));
+
+	if (!sample)
+		clear_bit(EVENT_FILE_FL_SAMPLE_BIT, &file->flags);
+
+	rcu_assign_pointer(file->sample, sample);
+
+	if (sample)
+		set_bit(EVENT_FILE_FL_SAMPLE_BIT, &file->flags);
+
+	if (old) {
+		/* Make sure the tracepoints are done with the old state */
+		tracepoint_synchronize_unregister();
+		free_event_sample(old);
+	}
+
+	return 0;
+}
+
+static void print_event_sample(struct trace_event_file *file,
+			       struct trace_seq *s)
+{
+	struct event_sample *sample;
+	unsigned long sampled = 0, dropped = 0;
+	int cpu;
+
+	sample = rcu_dereference_protected(file->sample,
+					   lockdep_is_held(&event_mutex));
+	if (!sample) {
+		trace_seq_puts(s, "none\n");
+		return;
+	}
+
+	if (sample->every)
+		trace_seq_printf(s, "every=%u ", sample->every);
+	if (sample->rate)
+		trace_seq_printf(s, "rate=%u burst=%u ",
+				 sample->rate, sample->burst);
+	trace_seq_putc(s, '\n');
+
+	for_each_possible_cpu(cpu) {
+		struct event_sample_cpu *c = per_cpu_ptr(sample->cpu, cpu);
+
+		sampled += READ_ONCE(c->sampled);
+		dropped += READ_ONCE(c->dropped);
+	}
+
+	trace_seq_printf(s, "# sampled: %lu\n", sampled);
+	trace_seq_printf(s, "# dropped: %lu\n", dropped);
+}
+
+static ssize_t
+event_sample_read(struct file *filp, char __user *ubuf, size_t cnt,
+		  loff_t *ppos)
+{
+	struct trace_event_file *file;
+	struct trace_seq *s;
+	int r = -ENODEV;
+
+	if (*ppos)
+		return 0;
+
+	s = kmalloc(sizeof(*s), GFP_KERNEL);
+	if (!s)
+		return -ENOMEM;
+
+	trace_seq_init(s);
+
+	mutex_lock(&event_mutex);
+	file = event_file_data(filp);
+	if (file)
+		print_event_sample(file, s);
+	mutex_unlock(&event_mutex);
+
+	if (file)
+		r = simple_read_from_buffer(ubuf, cnt, ppos,
+					    s->buffer, trace_seq_used(s));
+
+	kfree(s);
+
+	return r;
+}
+
+static ssize_t
+event_sample_write(struct file *filp, const char __user *ubuf, size_t cnt,
+		   loff_t *ppos)
+{
+	struct trace_event_file *file;
+	char *buf;
+	int err = -ENODEV;
+
+	if (cnt >= PAGE_SIZE)
+		return -EINVAL;
+
+	buf = memdup_user_nul(ubuf, cnt);
+	if (IS_ERR(buf))
+		return PTR_ERR(buf);
+
+	mutex_lock(&event_mutex);
+	file = event_file_data(filp);
+	if (file)
+		err = apply_event_sample(file, buf);
+	mutex_unlock(&event_mutex);
+
+	kfree(buf);
+	if (err < 0)
+		return err;
+
+	*ppos += cnt;
+
+	return cnt;
+}
+
+const struct file_operations event_sample_fops = {
+	.open = tracing_open_generic,
+	.read = event_sample_read,
+	.write = event_sample_write,
+	.llseek = default_llseek,
+};
@@ -0,0 +1,313 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Function latency histogram tracer
+ *
+ * Measures the duration of the functions listed in set_graph_function
+ * with the function graph infrastructure, and accumulates them into
+ * per function log2 histograms instead of writing entry and exit
+ * records to the ring buffer. The histograms are shown in
+ * trace_stat/funclatency and are reset each time the tracer is
+ * selected. Nothing is written to the ring buffer: the returns of
+ * functions that find no room in the function table are only counted.
+ */
+#include <linux/kallsyms.h>
+#include <linux/uaccess.h>
+#include <linux/ftrace.h>
+#include <linux/hash.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/log2.h>
+
+#include "trace.h"
+#include "trace_stat.h"
+
+#define FUNCLAT_HASH_BITS	8
+#define FUNCLAT_MAX_FUNCS	(1 << FUNCLAT_HASH_BITS)
+/* Slots looked at from the hashed one, bounds the cost of every return */
+#define FUNCLAT_PROBES		8
+
+/* Bucket n holds durations in [2^n, 2^(n+1)) ns, the last one is open */
+#define FUNCLAT_BUCKETS		32
+
+struct funclat_hist {
+	unsigned long		count;
+	u64			total;
+	unsigned long		buckets[FUNCLAT_BUCKETS];
+};
+
+static struct trace_array	*funclat_trace __read_mostly;
+
+/* Function addresses, claimed once and shared by all CPUs */
+static unsigned long		funclat_funcs[FUNCLAT_MAX_FUNCS];
+
+static DEFINE_PER_CPU(struct funclat_hist *, funclat_hists);
+static DEFINE_PER_CPU(unsigned long, funclat_missed);
+/* Some function found no free slot among its FUNCLAT_PROBES */
+static bool			funclat_full;
+
+static DEFINE_MUTEX(funclat_lock);
+
+static int funclat_slot(unsigned long func)
+{
+	unsigned int idx = hash_long(func, FUNCLAT_HASH_BITS);
+	unsigned long cur;
+	int i;
+
+	for (i = 0; i < FUNCLAT_PROBES; i++) {
+		cur = READ_ONCE(funclat_funcs[idx]);
+		if (cur == func)
+			return idx;
+		if (!cur) {
+			cur = cmpxchg(&funclat_funcs[idx], 0, func);
+			if (!cur || cur == func)
+				return idx;
+		}
+		idx = (idx + 1) & (FUNCLAT_MAX_FUNCS - 1);
+	}
+
+	return -1;
+}
+
+static int funclat_entry(struct ftrace_graph_ent *trace)
+{
+	if (!ftrace_trace_task(funclat_trace))
+		return 0;
+
+	if (trace->depth < 0)
+		return 0;
+
+	/*
+	 * Only the functions in set_graph_function get a return hook,
+	 * their children are not measured.
+	 */
+	return ftrace_graph_addr(trace);
+}
+
+static void funclat_return(struct ftrace_graph_ret *trace)
+{
+	struct funclat_hist *hist;
+	unsigned long flags;
+	u64 delta;
+	int idx;
+
+	ftrace_graph_addr_finish(trace);
+
+	idx = funclat_slot(trace->func);
+	if (idx < 0) {
+		/*
+		 * No room for another histogram, e.g. because
+		 * set_graph_function is empty and every function is
+		 * measured. Only count the miss.
+		 */
+		if (!READ_ONCE(funclat_full)) {
+			WRITE_ONCE(funclat_full, true);
+			pr_warn_once("funclatency: function table full (%d entries), further functions are not measured\n",
+				     FUNCLAT_MAX_FUNCS);
+		}
+		this_cpu_inc(funclat_missed);
+		return;
+	}
+
+	delta = trace->rettime - trace->calltime;
+
+	local_irq_save(flags);
+	hist = this_cpu_read(funclat_hists);
+	if (hist) {
+		hist += idx;
+		hist->count++;
+		hist->total += delta;
+		hist->buckets[min_t(int, delta ? ilog2(delta) : 0,
+				    FUNCLAT_BUCKETS - 1)]++;
+	}
+	local_irq_restore(flags);
+}
+
+static struct fgraph_ops funclat_ops = {
+	.entryfunc = &funclat_entry,
+	.retfunc = &funclat_return,
+};
+
+static void funclat_reset_hists(void)
+{
+	int cpu;
+
+	memset(funclat_funcs, 0, sizeof(funclat_funcs));
+	funclat_full = false;
+
+	for_each_possible_cpu(cpu) {
+		struct funclat_hist *hist = per_cpu(funclat_hists, cpu);
+
+		if (hist)
+			memset(hist, 0, sizeof(*hist) * FUNCLAT_MAX_FUNCS);
+		per_cpu(funclat_missed, cpu) = 0;
+	}
+}
+
+static int funclat_alloc_hists(void)
+{
+	struct funclat_hist *hist;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		if (per_cpu(funclat_hists, cpu))
+			continue;
+
+		hist = kvzalloc_node(sizeof(*hist) * FUNCLAT_MAX_FUNCS,
+				     GFP_KERNEL, cpu_to_node(cpu));
+		if (!hist)
+			return -ENOMEM;
+		per_cpu(funclat_hists, cpu) = hist;
+	}
+
+	return 0;
+}
+
+static int funclat_trace_init(struct trace_array *tr)
+{
+	int ret;
+
+	mutex_lock(&funclat_lock);
+	ret = funclat_alloc_hists();
+	if (!ret)
+		funclat_reset_hists();
+	mutex_unlock(&funclat_lock);
+	if (ret)
+		return ret;
+
+	funclat_trace = tr;
+	/* Make funclat_trace visible before we start tracing */
+	smp_mb();
+
+	return register_ftrace_graph(&funclat_ops);
+}
+
+static void funclat_trace_reset(struct trace_array *tr)
+{
+	unregister_ftrace_graph(&funclat_ops);
+}
+
+static struct tracer funclat_tracer __read_mostly = {
+	.name		= "funclatency",
+	.init		= funclat_trace_init,
+	.reset		= funclat_trace_reset,
+};
+
+static void *funclat_stat_next(void *v, int idx)
+{
+	unsigned long *func = v;
+
+	if (idx != 0)
+		func++;
+
+	for (; func < &funclat_funcs[FUNCLAT_MAX_FUNCS]; func++) {
+		if (READ_ONCE(*func))
+			return func;
+	}
+
+	return NULL;
+}
+
+static void *funclat_stat_start(struct tracer_stat *trace)
+{
+	return funclat_stat_next(&funclat_funcs[0], 0);
+}
+
+static void funclat_sum(int idx, struct funclat_hist *sum)
+{
+	int cpu, i;
+
+	memset(sum, 0, sizeof(*sum));
+
+	for_each_possible_cpu(cpu) {
+		struct funclat_hist *hist = per_cpu(funclat_hists, cpu);
+
+		if (!hist)
+			continue;
+		hist += idx;
+		sum->count += READ_ONCE(hist->count);
+		sum->total += READ_ONCE(hist->total);
+		for (i = 0; i < FUNCLAT_BUCKETS; i++)
+			sum->buckets[i] += READ_ONCE(hist->buckets[i]);
+	}
+}
+
+static int funclat_stat_headers(struct seq_file *m)
+{
+	unsigned long missed = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		missed += per_cpu(funclat_missed, cpu);
+
+	seq_printf(m, "# function table: %s (%d entries)\n",
+		   READ_ONCE(funclat_full) ? "full" : "not full",
+		   FUNCLAT_MAX_FUNCS);
+	seq_printf(m, "# calls not measured: %lu\n", missed);
+	return 0;
+}
+
+static int funclat_stat_show(struct seq_file *m, void *v)
+{
+	int idx = (unsigned long *)v - funclat_funcs;
+	char str[KSYM_SYMBOL_LEN];
+	struct funclat_hist *sum;
+	int first, last, i;
+
+	sum = kmalloc(sizeof(*sum), GFP_KERNEL);
+	if (!sum)
+		return -ENOMEM;
+
+	funclat_sum(idx, sum);
+	if (!sum->count)
+		goto out;
+
+	for (first = 0; !sum->buckets[first] && first < FUNCLAT_BUCKETS - 1; first++)
+		;
+	for (last = FUNCLAT_BUCKETS - 1; !sum->buckets[last] && last > first; last--)
+		;
+
+	kallsyms_lookup(READ_ONCE(funclat_funcs[idx]), NULL, NULL, NULL, str);
+	seq_printf(m, "\n%s: hits=%lu avg=%llu ns\n", str, sum->count,
+		   div64_ul(sum->total, sum->count));
+	seq_puts(m, "         nsecs              : count\n");
+
+	for (i = first; i <= last; i++) {
+		unsigned long long low = i ? 1ULL << i : 0;
+
+		if (i == FUNCLAT_BUCKETS - 1)
+			seq_printf(m, "%10llu -> %-10s  : %lu\n",
+				   low, "inf", sum->buckets[i]);
+		else
+			seq_printf(m, "%10llu -> %-10llu  : %lu\n",
+				   low, (1ULL << (i + 1)) - 1, sum->buckets[i]);
+	}
+ out:
+	kfree(sum);
+	return 0;
+}
+
+static struct tracer_stat funclat_stats = {
+	.name		= "funclatency",
+	.stat_start	= funclat_stat_start,
+	.stat_next	= funclat_stat_next,
+	.stat_headers	= funclat_stat_headers,
+	.stat_show	= funclat_stat_show,
+};
+
+static __init int init_funclat_stat(void)
+{
+	int ret;
+
+	ret = register_stat_tracer(&funclat_stats);
+	if (ret)
+		pr_warn("Warning: could not register funclatency stats\n");
+
+	return 0;
+}
+fs_initcall(init_funclat_stat);
+
+static __init int init_funclat_tracer(void)
+{
+	return register_tracer(&funclat_tracer);
+}
+core_initcall(init_funclat_tracer);
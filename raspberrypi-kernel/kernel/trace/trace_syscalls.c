@@ -316,6 +316,10 @@ static void ftrace_syscall_enter(void *data, struct pt_regs *regs, long id)
 	if (trace_trigger_soft_disabled(trace_file))
 		return;
 
+	if ((trace_file->flags & EVENT_FILE_FL_SAMPLE) &&
+	    trace_event_sample_drop(trace_file))
+		return;
+
 	sys_data = syscall_nr_to_meta(syscall_nr);
 	if (!sys_data)
 		return;
@@ -364,6 +368,10 @@ static void ftrace_syscall_exit(void *data, struct pt_regs *regs, long ret)
 	if (trace_trigger_soft_disabled(trace_file))
 		return;
 
+	if ((trace_file->flags & EVENT_FILE_FL_SAMPLE) &&
+	    trace_event_sample_drop(trace_file))
+		return;
+
 	sys_data = syscall_nr_to_meta(syscall_nr);
 	if (!sys_data)
 		return;
@@ -0,0 +1,106 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * test_alloc_pages_bulk.c: Compare alloc_pages_bulk_array() to alloc_page()
+ *
+ * Allocates and frees nr_pages order-0 pages in batches of batch pages,
+ * once with a loop of alloc_page() and once with alloc_pages_bulk_array(),
+ * and reports the pages per second of each, e.g.
+ *
+ *   modprobe test_alloc_pages_bulk nr_pages=4000000 batch=64
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/gfp.h>
+#include <linux/ktime.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+
+static unsigned int nr_pages = 1000 * 1000;
+module_param(nr_pages, uint, 0444);
+MODULE_PARM_DESC(nr_pages, "Number of pages to allocate per run");
+
+static unsigned int batch = 64;
+module_param(batch, uint, 0444);
+MODULE_PARM_DESC(batch, "Number of pages allocated at once");
+
+static void free_batch(struct page **pages, unsigned int nr)
+{
+	unsigned int i;
+
+	for (i = 0; i < nr; i++) {
+		__free_page(pages[i]);
+		pages[i] = NULL;
+	}
+}
+
+static unsigned int alloc_single(struct page **pages)
+{
+	unsigned int i;
+
+	for (i = 0; i < batch; i++) {
+		pages[i] = alloc_page(GFP_KERNEL);
+		if (!pages[i])
+			break;
+	}
+	return i;
+}
+
+static unsigned int alloc_bulk(struct page **pages)
+{
+	return alloc_pages_bulk_array(GFP_KERNEL, batch, pages);
+}
+
+static int run(const char *name, unsigned int (*alloc)(struct page **),
+	       struct page **pages)
+{
+	unsigned long done = 0;
+	unsigned int nr;
+	ktime_t start;
+	u64 ns;
+
+	start = ktime_get();
+	while (done < nr_pages) {
+		nr = alloc(pages);
+		if (!nr)
+			return -ENOMEM;
+		free_batch(pages, nr);
+		done += nr;
+		cond_resched();
+	}
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start)) ?: 1;
+
+	pr_info("%-6s %lu pages in %llu us, %llu pages/s\n", name, done,
+		div_u64(ns, NSEC_PER_USEC), div64_u64(done * NSEC_PER_SEC, ns));
+	return 0;
+}
+
+static int __init test_alloc_pages_bulk_init(void)
+{
+	struct page **pages;
+	int ret;
+
+	if (!nr_pages || !batch)
+		return -EINVAL;
+
+	pages = kcalloc(batch, sizeof(*pages), GFP_KERNEL);
+	if (!pages)
+		return -ENOMEM;
+
+	pr_info("batch of %u pages\n", batch);
+	ret = run("single", alloc_single, pages);
+	if (!ret)
+		ret = run("bulk", alloc_bulk, pages);
+
+	kfree(pages);
+	return ret;
+}
+
+static void __exit test_alloc_pages_bulk_exit(void)
+{
+}
+
+module_init(test_alloc_pages_bulk_init);
+module_exit(test_alloc_pages_bulk_exit);
+MODULE_LICENSE("GPL");
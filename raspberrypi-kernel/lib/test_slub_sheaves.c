@@ -0,0 +1,242 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * test_slub_sheaves.c: Measure slab objects freed on another cpu
+ *
+ * A kthread on cpu_alloc allocates batch objects at a time and hands them
+ * to a kthread on cpu_free, which frees them, until nr_objects went through.
+ * Without use_kmalloc the run is done on a cache without and a cache with
+ * SLAB_SHEAVES. With use_kmalloc the objects come from kmalloc() and the
+ * sheaves of the kmalloc cache are switched with its sheaf_capacity file
+ * between runs, e.g.
+ *
+ *   modprobe test_slub_sheaves object_size=256 cpu_alloc=0 cpu_free=2
+ *
+ *   echo 64 > /sys/kernel/slab/kmalloc-256/sheaf_capacity
+ *   modprobe test_slub_sheaves use_kmalloc=1 object_size=256
+ *
+ * Without use_kmalloc, a last run on a cache with SLAB_SHEAVES disables its
+ * sheaves while the objects are being freed. Loading fails if an object is
+ * left behind in a sheaf afterwards.
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/completion.h>
+#include <linux/cpumask.h>
+#include <linux/delay.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+
+static unsigned int object_size = 256;
+module_param(object_size, uint, 0444);
+MODULE_PARM_DESC(object_size, "Size of the objects");
+
+static unsigned long nr_objects = 10 * 1000 * 1000;
+module_param(nr_objects, ulong, 0444);
+MODULE_PARM_DESC(nr_objects, "Number of objects to allocate and free per run");
+
+static unsigned int batch = 512;
+module_param(batch, uint, 0444);
+MODULE_PARM_DESC(batch, "Number of objects handed over at once");
+
+static unsigned int cpu_alloc;
+module_param(cpu_alloc, uint, 0444);
+MODULE_PARM_DESC(cpu_alloc, "Cpu that allocates the objects");
+
+static unsigned int cpu_free = 1;
+module_param(cpu_free, uint, 0444);
+MODULE_PARM_DESC(cpu_free, "Cpu that frees the objects");
+
+static bool use_kmalloc;
+module_param(use_kmalloc, bool, 0444);
+MODULE_PARM_DESC(use_kmalloc, "Use kmalloc() instead of test caches");
+
+struct remote_free_test {
+	struct kmem_cache *cache;	/* NULL for kmalloc() */
+	void **objs;
+	unsigned long rounds;
+	struct completion filled;
+	struct completion freed;
+	struct completion done;
+	int ret;
+};
+
+static int alloc_fn(void *arg)
+{
+	struct remote_free_test *t = arg;
+	unsigned long i;
+	unsigned int j;
+
+	for (i = 0; i < t->rounds; i++) {
+		for (j = 0; j < batch; j++) {
+			if (t->cache)
+				t->objs[j] = kmem_cache_alloc(t->cache, GFP_KERNEL);
+			else
+				t->objs[j] = kmalloc(object_size, GFP_KERNEL);
+			if (!t->objs[j])
+				t->ret = -ENOMEM;
+		}
+		complete(&t->filled);
+		wait_for_completion(&t->freed);
+	}
+
+	complete(&t->done);
+	return 0;
+}
+
+static int free_fn(void *arg)
+{
+	struct remote_free_test *t = arg;
+	unsigned long i;
+	unsigned int j;
+
+	for (i = 0; i < t->rounds; i++) {
+		wait_for_completion(&t->filled);
+		for (j = 0; j < batch; j++) {
+			if (!t->objs[j])
+				continue;
+			if (t->cache)
+				kmem_cache_free(t->cache, t->objs[j]);
+			else
+				kfree(t->objs[j]);
+		}
+		complete(&t->freed);
+	}
+
+	complete(&t->done);
+	return 0;
+}
+
+static struct task_struct *start_thread(int (*fn)(void *),
+					struct remote_free_test *t,
+					unsigned int cpu, const char *name)
+{
+	struct task_struct *task;
+
+	task = kthread_create(fn, t, "%s/%u", name, cpu);
+	if (IS_ERR(task))
+		return task;
+
+	kthread_bind(task, cpu);
+	return task;
+}
+
+static int run(const char *name, struct kmem_cache *cache, bool drop)
+{
+	struct task_struct *alloc_task, *free_task;
+	struct remote_free_test t = {
+		.cache = cache,
+		.rounds = max(nr_objects / batch, 1UL),
+	};
+	ktime_t start;
+	int ret = 0;
+	u64 ns;
+
+	t.objs = kcalloc(batch, sizeof(void *), GFP_KERNEL);
+	if (!t.objs)
+		return -ENOMEM;
+	init_completion(&t.filled);
+	init_completion(&t.freed);
+	init_completion(&t.done);
+
+	alloc_task = start_thread(alloc_fn, &t, cpu_alloc, "sheaves_alloc");
+	if (IS_ERR(alloc_task)) {
+		kfree(t.objs);
+		return PTR_ERR(alloc_task);
+	}
+	free_task = start_thread(free_fn, &t, cpu_free, "sheaves_free");
+	if (IS_ERR(free_task)) {
+		kthread_stop(alloc_task);
+		kfree(t.objs);
+		return PTR_ERR(free_task);
+	}
+
+	start = ktime_get();
+	wake_up_process(alloc_task);
+	wake_up_process(free_task);
+	if (drop) {
+		/* Let the sheaf of cpu_free fill up, then disable the sheaves */
+		msleep(10);
+		ret = kmem_cache_set_sheaf_capacity(cache, 0);
+	}
+	wait_for_completion(&t.done);
+	wait_for_completion(&t.done);
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start)) ?: 1;
+
+	pr_info("%-12s %lu objects in %llu us, %llu objects/s\n", name,
+		t.rounds * batch, div_u64(ns, NSEC_PER_USEC),
+		div64_u64((u64)t.rounds * batch * NSEC_PER_SEC, ns));
+
+	kfree(t.objs);
+	return t.ret ?: ret;
+}
+
+/* With the sheaves disabled, none of them may hold an object */
+static int check_sheaves_empty(struct kmem_cache *cache)
+{
+	unsigned int cpu, size;
+	int ret = 0;
+
+	/* Debug caches, e.g. with slub_debug, have no sheaves */
+	if (!cache->cpu_sheaf)
+		return 0;
+
+	for_each_possible_cpu(cpu) {
+		size = per_cpu_ptr(cache->cpu_sheaf, cpu)->size;
+		if (size) {
+			pr_err("%u objects left in the sheaf of cpu %u\n",
+			       size, cpu);
+			ret = -EBUSY;
+		}
+	}
+	return ret;
+}
+
+static int run_cache(const char *name, slab_flags_t flags, bool drop)
+{
+	struct kmem_cache *cache;
+	int ret;
+
+	cache = kmem_cache_create(name, object_size, 0, flags, NULL);
+	if (!cache)
+		return -ENOMEM;
+
+	ret = run(name, cache, drop);
+	if (!ret && drop)
+		ret = check_sheaves_empty(cache);
+	kmem_cache_destroy(cache);
+	return ret;
+}
+
+static int __init test_slub_sheaves_init(void)
+{
+	int ret;
+
+	if (!object_size || !batch || cpu_alloc == cpu_free ||
+	    cpu_alloc >= nr_cpu_ids || cpu_free >= nr_cpu_ids ||
+	    !cpu_online(cpu_alloc) || !cpu_online(cpu_free))
+		return -EINVAL;
+
+	pr_info("%u byte objects, batch of %u, cpu %u to cpu %u\n",
+		object_size, batch, cpu_alloc, cpu_free);
+
+	if (use_kmalloc)
+		return run("kmalloc", NULL, false);
+
+	ret = run_cache("sheaves_off", 0, false);
+	if (!ret)
+		ret = run_cache("sheaves_on", SLAB_SHEAVES, false);
+	if (!ret)
+		ret = run_cache("sheaves_drop", SLAB_SHEAVES, true);
+	return ret;
+}
+
+static void __exit test_slub_sheaves_exit(void)
+{
+}
+
+module_init(test_slub_sheaves_init);
+module_exit(test_slub_sheaves_exit);
+MODULE_LICENSE("GPL");
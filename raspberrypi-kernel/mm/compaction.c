@@ -2564,9 +2564,38 @@ static void proactive_compact_node(pg_data_t *pgdat)
 
 		compact_zone(&cc, NULL);
 
+		count_compact_events(KCOMPACTD_MIGRATE_SCANNED,
+				     cc.total_migrate_scanned);
+		count_compact_events(KCOMPACTD_FREE_SCANNED,
+				     cc.total_free_scanned);
+
 		VM_BUG_ON(!list_empty(&cc.freepages));
 		VM_BUG_ON(!list_empty(&cc.migratepages));
 	}
+
+	count_compact_event(KCOMPACTD_PROACTIVE);
+}
+
+/*
+ * Number of fragmentation score checks to skip after a proactive compaction
+ * pass. A pass that did not lower the score backs off completely. Otherwise
+ * the pass is throttled by what it cost: kcompactd may spend up to
+ * proactiveness / 5 percent of its time, at least 1%, on proactive
+ * compaction. With the default proactiveness of 20, a pass that took 200ms
+ * is followed by 5s of rest.
+ */
+static unsigned int proactive_compact_defer(unsigned int prev_score,
+					    unsigned int score,
+					    unsigned int cost_msec)
+{
+	unsigned int duty = max(sysctl_compaction_proactiveness / 5, 1U);
+	unsigned int defer;
+
+	if (score >= prev_score)
+		return 1 << COMPACT_MAX_DEFER_SHIFT;
+
+	defer = cost_msec * 100 / duty / HPAGE_FRAG_CHECK_INTERVAL_MSEC;
+	return min(defer, 1U << COMPACT_MAX_DEFER_SHIFT);
 }
 
 /* Compact all zones within a node */
@@ -2829,20 +2858,24 @@ static int kcompactd(void *p)
 		/* kcompactd wait timeout */
 		if (should_proactive_compact_node(pgdat)) {
 			unsigned int prev_score, score;
+			unsigned long start;
 
 			if (proactive_defer) {
 				proactive_defer--;
+				count_compact_event(KCOMPACTD_PROACTIVE_DEFERRED);
 				continue;
 			}
 			prev_score = fragmentation_score_node(pgdat);
+			start = jiffies;
 			proactive_compact_node(pgdat);
 			score = fragmentation_score_node(pgdat);
 			/*
 			 * Defer proactive compaction if the fragmentation
-			 * score did not go down i.e. no progress made.
+			 * score did not go down i.e. no progress made, and
+			 * in proportion to the time the pass took otherwise.
 			 */
-			proactive_defer = score < prev_score ?
-					0 : 1 << COMPACT_MAX_DEFER_SHIFT;
+			proactive_defer = proactive_compact_defer(prev_score,
+					score, jiffies_to_msecs(jiffies - start));
 		}
 	}
 
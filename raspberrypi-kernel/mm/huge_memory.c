@@ -57,6 +57,13 @@ unsigned long transparent_hugepage_flags __read_mostly =
 	(1<<TRANSPARENT_HUGEPAGE_DEFRAG_KHUGEPAGED_FLAG)|
 	(1<<TRANSPARENT_HUGEPAGE_USE_ZERO_PAGE_FLAG);
 
+/*
+ * Anon faults in THP-enabled VMAs that cannot get a PMD map the naturally
+ * aligned block of 1 << anon_block_order pages around the fault at once,
+ * 64K by default. 0 maps one page per fault.
+ */
+unsigned int anon_block_order __read_mostly = ilog2(SZ_64K >> PAGE_SHIFT);
+
 static struct shrinker deferred_split_shrinker;
 
 static atomic_t huge_zero_refcount;
@@ -303,11 +310,37 @@ static ssize_t hpage_pmd_size_show(struct kobject *kobj,
 static struct kobj_attribute hpage_pmd_size_attr =
 	__ATTR_RO(hpage_pmd_size);
 
+static ssize_t anon_block_order_show(struct kobject *kobj,
+		struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", READ_ONCE(anon_block_order));
+}
+static ssize_t anon_block_order_store(struct kobject *kobj,
+		struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	unsigned int order;
+	int ret;
+
+	ret = kstrtouint(buf, 10, &order);
+	if (ret)
+		return ret;
+	/* larger blocks are the PMD's business */
+	if (order >= HPAGE_PMD_ORDER)
+		return -EINVAL;
+
+	WRITE_ONCE(anon_block_order, order);
+	return count;
+}
+static struct kobj_attribute anon_block_order_attr =
+	__ATTR(anon_block_order, 0644, anon_block_order_show,
+	       anon_block_order_store);
+
 static struct attribute *hugepage_attr[] = {
 	&enabled_attr.attr,
 	&defrag_attr.attr,
 	&use_zero_page_attr.attr,
 	&hpage_pmd_size_attr.attr,
+	&anon_block_order_attr.attr,
 #ifdef CONFIG_SHMEM
 	&shmem_enabled_attr.attr,
 #endif
@@ -2381,6 +2414,7 @@ static void __split_huge_page_tail(struct page *head, int tail,
 #ifdef CONFIG_64BIT
 			 (1L << PG_arch_2) |
 #endif
+			 LRU_GEN_MASK |
 			 (1L << PG_dirty)));
 
 	/* ->mapping in first tail page is compound_mapcount */
@@ -38,5 +38,8 @@ struct mm_struct init_mm = {
 	.mmlist		= LIST_HEAD_INIT(init_mm.mmlist),
 	.user_ns	= &init_user_ns,
 	.cpu_bitmap	= CPU_BITS_NONE,
+#ifdef CONFIG_LRU_GEN
+	.lru_gen.list	= LIST_HEAD_INIT(init_mm.lru_gen.list),
+#endif
 	INIT_MM_CONTEXT(init_mm)
 };
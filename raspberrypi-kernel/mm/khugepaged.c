@@ -18,6 +18,7 @@
 #include <linux/page_idle.h>
 #include <linux/swapops.h>
 #include <linux/shmem_fs.h>
+#include <linux/list_sort.h>
 
 #include <asm/tlb.h>
 #include <asm/pgalloc.h>
@@ -77,6 +78,7 @@ static DECLARE_WAIT_QUEUE_HEAD(khugepaged_wait);
 static unsigned int khugepaged_max_ptes_none __read_mostly;
 static unsigned int khugepaged_max_ptes_swap __read_mostly;
 static unsigned int khugepaged_max_ptes_shared __read_mostly;
+static bool khugepaged_scan_hot_first __read_mostly = true;
 
 #define MM_SLOTS_HASH_BITS 10
 static __read_mostly DEFINE_HASHTABLE(mm_slots_hash, MM_SLOTS_HASH_BITS);
@@ -84,18 +86,34 @@ static __read_mostly DEFINE_HASHTABLE(mm_slots_hash, MM_SLOTS_HASH_BITS);
 static struct kmem_cache *mm_slot_cache __read_mostly;
 
 #define MAX_PTE_MAPPED_THP 8
+#define MAX_HOT_RANGES 8
 
 /**
  * struct mm_slot - hash lookup from mm to mm_slot
  * @hash: hash collision list
  * @mm_node: khugepaged scan list headed in khugepaged_scan.mm_head
  * @mm: the mm that this information is valid for
+ * @heat: decaying average of the referenced ptes per scanned pmd range
+ * @nr_ranges: pmd ranges scanned in the current pass over this mm
+ * @nr_referenced: referenced ptes found in those ranges
+ * @hot_ranges: hot anon ranges that the previous pass left uncollapsed,
+ *		scanned before the rest of the mm in this pass
+ * @next_hot_ranges: those found in this pass, for the next one
  */
 struct mm_slot {
 	struct hlist_node hash;
 	struct list_head mm_node;
 	struct mm_struct *mm;
 
+	unsigned int heat;
+	unsigned int nr_ranges;
+	unsigned long nr_referenced;
+
+	int nr_hot_ranges;
+	unsigned long hot_ranges[MAX_HOT_RANGES];
+	int nr_next_hot_ranges;
+	unsigned long next_hot_ranges[MAX_HOT_RANGES];
+
 	/* pte-mapped THP in this mm */
 	int nr_pte_mapped_thp;
 	unsigned long pte_mapped_thp[MAX_PTE_MAPPED_THP];
@@ -119,6 +137,24 @@ static struct khugepaged_scan khugepaged_scan = {
 	.mm_head = LIST_HEAD_INIT(khugepaged_scan.mm_head),
 };
 
+/**
+ * struct collapse_control - state of a collapse request
+ * @is_khugepaged: the request comes from khugepaged, not MADV_COLLAPSE
+ * @node_load: pages of the scanned range found on each node
+ * @referenced: referenced ptes found by the last khugepaged_scan_pmd()
+ * @result: scan_result of the last khugepaged_scan_pmd()
+ */
+struct collapse_control {
+	bool is_khugepaged;
+	int node_load[MAX_NUMNODES];
+	int referenced;
+	int result;
+};
+
+static struct collapse_control khugepaged_collapse_control = {
+	.is_khugepaged = true,
+};
+
 #ifdef CONFIG_SYSFS
 static ssize_t scan_sleep_millisecs_show(struct kobject *kobj,
 					 struct kobj_attribute *attr,
@@ -323,6 +359,36 @@ static struct kobj_attribute khugepaged_max_ptes_shared_attr =
 	__ATTR(max_ptes_shared, 0644, khugepaged_max_ptes_shared_show,
 	       khugepaged_max_ptes_shared_store);
 
+/*
+ * scan_hot_first makes khugepaged start every pass over the registered mms
+ * with the ones whose ranges it found most referenced during the previous
+ * passes, so that the processes that benefit most from huge pages are not
+ * stuck behind thousands of idle ones. Within an mm, the hot ranges that
+ * the previous pass could not collapse are retried before the others.
+ */
+static ssize_t scan_hot_first_show(struct kobject *kobj,
+				   struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%d\n", khugepaged_scan_hot_first);
+}
+
+static ssize_t scan_hot_first_store(struct kobject *kobj,
+				    struct kobj_attribute *attr,
+				    const char *buf, size_t count)
+{
+	bool hot_first;
+
+	if (kstrtobool(buf, &hot_first))
+		return -EINVAL;
+
+	khugepaged_scan_hot_first = hot_first;
+
+	return count;
+}
+static struct kobj_attribute scan_hot_first_attr =
+	__ATTR(scan_hot_first, 0644, scan_hot_first_show,
+	       scan_hot_first_store);
+
 static struct attribute *khugepaged_attr[] = {
 	&khugepaged_defrag_attr.attr,
 	&khugepaged_max_ptes_none_attr.attr,
@@ -333,6 +399,7 @@ static struct attribute *khugepaged_attr[] = {
 	&full_scans_attr.attr,
 	&scan_sleep_millisecs_attr.attr,
 	&alloc_sleep_millisecs_attr.attr,
+	&scan_hot_first_attr.attr,
 	NULL,
 };
 
@@ -475,6 +542,9 @@ int __khugepaged_enter(struct mm_struct *mm)
 		return 0;
 	}
 
+	/* Nothing is known about the mm yet, rank it in the middle */
+	mm_slot->heat = HPAGE_PMD_NR / 2;
+
 	spin_lock(&khugepaged_mm_lock);
 	insert_to_mm_slots_hash(mm, mm_slot);
 	/*
@@ -587,8 +657,13 @@ static bool is_refcount_suitable(struct page *page)
 static int __collapse_huge_page_isolate(struct vm_area_struct *vma,
 					unsigned long address,
 					pte_t *pte,
+					struct collapse_control *cc,
 					struct list_head *compound_pagelist)
 {
+	unsigned int max_ptes_none = cc->is_khugepaged ?
+				     khugepaged_max_ptes_none : HPAGE_PMD_NR;
+	unsigned int max_ptes_shared = cc->is_khugepaged ?
+				       khugepaged_max_ptes_shared : HPAGE_PMD_NR;
 	struct page *page = NULL;
 	pte_t *_pte;
 	int none_or_zero = 0, shared = 0, result = 0, referenced = 0;
@@ -600,7 +675,7 @@ static int __collapse_huge_page_isolate(struct vm_area_struct *vma,
 		if (pte_none(pteval) || (pte_present(pteval) &&
 				is_zero_pfn(pte_pfn(pteval)))) {
 			if (!userfaultfd_armed(vma) &&
-			    ++none_or_zero <= khugepaged_max_ptes_none) {
+			    ++none_or_zero <= max_ptes_none) {
 				continue;
 			} else {
 				result = SCAN_EXCEED_NONE_PTE;
@@ -620,7 +695,7 @@ static int __collapse_huge_page_isolate(struct vm_area_struct *vma,
 		VM_BUG_ON_PAGE(!PageAnon(page), page);
 
 		if (page_mapcount(page) > 1 &&
-				++shared > khugepaged_max_ptes_shared) {
+				++shared > max_ptes_shared) {
 			result = SCAN_EXCEED_SHARED_PTE;
 			goto out;
 		}
@@ -705,7 +780,8 @@ next:
 			writable = true;
 	}
 	if (likely(writable)) {
-		if (likely(referenced)) {
+		/* MADV_COLLAPSE asked for the range, cold or not */
+		if (likely(referenced || !cc->is_khugepaged)) {
 			result = SCAN_SUCCEED;
 			trace_mm_collapse_huge_page_isolate(page, none_or_zero,
 							    referenced, writable, result);
@@ -787,9 +863,7 @@ static void khugepaged_alloc_sleep(void)
 	remove_wait_queue(&khugepaged_wait, &wait);
 }
 
-static int khugepaged_node_load[MAX_NUMNODES];
-
-static bool khugepaged_scan_abort(int nid)
+static bool khugepaged_scan_abort(int nid, struct collapse_control *cc)
 {
 	int i;
 
@@ -801,11 +875,11 @@ static bool khugepaged_scan_abort(int nid)
 		return false;
 
 	/* If there is a count for this node already, it must be acceptable */
-	if (khugepaged_node_load[nid])
+	if (cc->node_load[nid])
 		return false;
 
 	for (i = 0; i < MAX_NUMNODES; i++) {
-		if (!khugepaged_node_load[i])
+		if (!cc->node_load[i])
 			continue;
 		if (node_distance(nid, i) > node_reclaim_distance)
 			return true;
@@ -820,15 +894,15 @@ static inline gfp_t alloc_hugepage_khugepaged_gfpmask(void)
 }
 
 #ifdef CONFIG_NUMA
-static int khugepaged_find_target_node(void)
+static int khugepaged_find_target_node(struct collapse_control *cc)
 {
 	static int last_khugepaged_target_node = NUMA_NO_NODE;
 	int nid, target_node = 0, max_value = 0;
 
 	/* find first node with max normal pages hit */
 	for (nid = 0; nid < MAX_NUMNODES; nid++)
-		if (khugepaged_node_load[nid] > max_value) {
-			max_value = khugepaged_node_load[nid];
+		if (cc->node_load[nid] > max_value) {
+			max_value = cc->node_load[nid];
 			target_node = nid;
 		}
 
@@ -836,7 +910,7 @@ static int khugepaged_find_target_node(void)
 	if (target_node <= last_khugepaged_target_node)
 		for (nid = last_khugepaged_target_node + 1; nid < MAX_NUMNODES;
 				nid++)
-			if (max_value == khugepaged_node_load[nid]) {
+			if (max_value == cc->node_load[nid]) {
 				target_node = nid;
 				break;
 			}
@@ -879,7 +953,7 @@ khugepaged_alloc_page(struct page **hpage, gfp_t gfp, int node)
 	return *hpage;
 }
 #else
-static int khugepaged_find_target_node(void)
+static int khugepaged_find_target_node(struct collapse_control *cc)
 {
 	return 0;
 }
@@ -947,6 +1021,46 @@ khugepaged_alloc_page(struct page **hpage, gfp_t gfp, int node)
 }
 #endif
 
+/*
+ * MADV_COLLAPSE allocates its huge page itself rather than through the
+ * preallocation khugepaged does, and may reclaim and compact for it.
+ */
+static struct page *alloc_collapse_page(struct page **hpage, int node)
+{
+	*hpage = __alloc_pages_node(node, GFP_TRANSHUGE | __GFP_THISNODE,
+				    HPAGE_PMD_ORDER);
+	if (unlikely(!*hpage)) {
+		count_vm_event(THP_COLLAPSE_ALLOC_FAILED);
+		return NULL;
+	}
+
+	prep_transhuge_page(*hpage);
+	count_vm_event(THP_COLLAPSE_ALLOC);
+	return *hpage;
+}
+
+/*
+ * MADV_COLLAPSE is an explicit request, so it ignores the sysfs "enabled"
+ * mode and only honours the per-vma and per-process opt outs.
+ */
+static bool madvise_collapse_vma_check(struct vm_area_struct *vma)
+{
+	if ((vma->vm_flags & (VM_NOHUGEPAGE | VM_NO_KHUGEPAGED)) ||
+	    test_bit(MMF_DISABLE_THP, &vma->vm_mm->flags))
+		return false;
+	if (!vma->anon_vma || vma->vm_ops)
+		return false;
+	return !vma_is_temporary_stack(vma);
+}
+
+static bool collapse_vma_check(struct vm_area_struct *vma,
+			       struct collapse_control *cc)
+{
+	if (cc->is_khugepaged)
+		return hugepage_vma_check(vma, vma->vm_flags);
+	return madvise_collapse_vma_check(vma);
+}
+
 /*
  * If mmap_lock temporarily dropped, revalidate vma
  * before taking mmap_lock.
@@ -955,7 +1069,7 @@ khugepaged_alloc_page(struct page **hpage, gfp_t gfp, int node)
  */
 
 static int hugepage_vma_revalidate(struct mm_struct *mm, unsigned long address,
-		struct vm_area_struct **vmap)
+		struct vm_area_struct **vmap, struct collapse_control *cc)
 {
 	struct vm_area_struct *vma;
 	unsigned long hstart, hend;
@@ -971,7 +1085,7 @@ static int hugepage_vma_revalidate(struct mm_struct *mm, unsigned long address,
 	hend = vma->vm_end & HPAGE_PMD_MASK;
 	if (address < hstart || address + HPAGE_PMD_SIZE > hend)
 		return SCAN_ADDRESS_RANGE;
-	if (!hugepage_vma_check(vma, vma->vm_flags))
+	if (!collapse_vma_check(vma, cc))
 		return SCAN_VMA_CHECK;
 	/* Anon VMA expected */
 	if (!vma->anon_vma || vma->vm_ops)
@@ -990,7 +1104,8 @@ static int hugepage_vma_revalidate(struct mm_struct *mm, unsigned long address,
 static bool __collapse_huge_page_swapin(struct mm_struct *mm,
 					struct vm_area_struct *vma,
 					unsigned long address, pmd_t *pmd,
-					int referenced)
+					int referenced,
+					struct collapse_control *cc)
 {
 	int swapped_in = 0;
 	vm_fault_t ret = 0;
@@ -1014,7 +1129,7 @@ static bool __collapse_huge_page_swapin(struct mm_struct *mm,
 		/* do_swap_page returns VM_FAULT_RETRY with released mmap_lock */
 		if (ret & VM_FAULT_RETRY) {
 			mmap_read_lock(mm);
-			if (hugepage_vma_revalidate(mm, address, &vmf.vma)) {
+			if (hugepage_vma_revalidate(mm, address, &vmf.vma, cc)) {
 				/* vma is no longer available, don't continue to swapin */
 				trace_mm_collapse_huge_page_swapin(mm, swapped_in, referenced, 0);
 				return false;
@@ -1043,10 +1158,21 @@ static bool __collapse_huge_page_swapin(struct mm_struct *mm,
 	return true;
 }
 
-static void collapse_huge_page(struct mm_struct *mm,
+static void count_collapse_heat(int referenced)
+{
+	if (referenced >= HPAGE_PMD_NR / 2)
+		count_vm_event(THP_COLLAPSE_HOT);
+	else if (referenced >= HPAGE_PMD_NR / 8)
+		count_vm_event(THP_COLLAPSE_WARM);
+	else
+		count_vm_event(THP_COLLAPSE_COLD);
+}
+
+static int collapse_huge_page(struct mm_struct *mm,
 				   unsigned long address,
 				   struct page **hpage,
-				   int node, int referenced, int unmapped)
+				   int node, int referenced, int unmapped,
+				   struct collapse_control *cc)
 {
 	LIST_HEAD(compound_pagelist);
 	pmd_t *pmd, _pmd;
@@ -1071,7 +1197,10 @@ static void collapse_huge_page(struct mm_struct *mm,
 	 * that. We will recheck the vma after taking it again in write mode.
 	 */
 	mmap_read_unlock(mm);
-	new_page = khugepaged_alloc_page(hpage, gfp, node);
+	if (cc->is_khugepaged)
+		new_page = khugepaged_alloc_page(hpage, gfp, node);
+	else
+		new_page = alloc_collapse_page(hpage, node);
 	if (!new_page) {
 		result = SCAN_ALLOC_HUGE_PAGE_FAIL;
 		goto out_nolock;
@@ -1084,7 +1213,7 @@ static void collapse_huge_page(struct mm_struct *mm,
 	count_memcg_page_event(new_page, THP_COLLAPSE_ALLOC);
 
 	mmap_read_lock(mm);
-	result = hugepage_vma_revalidate(mm, address, &vma);
+	result = hugepage_vma_revalidate(mm, address, &vma, cc);
 	if (result) {
 		mmap_read_unlock(mm);
 		goto out_nolock;
@@ -1103,7 +1232,7 @@ static void collapse_huge_page(struct mm_struct *mm,
 	 * Continuing to collapse causes inconsistency.
 	 */
 	if (unmapped && !__collapse_huge_page_swapin(mm, vma, address,
-						     pmd, referenced)) {
+						     pmd, referenced, cc)) {
 		mmap_read_unlock(mm);
 		goto out_nolock;
 	}
@@ -1115,13 +1244,15 @@ static void collapse_huge_page(struct mm_struct *mm,
 	 * handled by the anon_vma lock + PG_lock.
 	 */
 	mmap_write_lock(mm);
-	result = hugepage_vma_revalidate(mm, address, &vma);
+	result = hugepage_vma_revalidate(mm, address, &vma, cc);
 	if (result)
 		goto out;
 	/* check if the pmd is still valid */
 	if (mm_find_pmd(mm, address) != pmd)
 		goto out;
 
+	/* faults under the VMA lock would not see the pmd go away */
+	vma_start_write(vma);
 	anon_vma_lock_write(vma->anon_vma);
 
 	mmu_notifier_range_init(&range, MMU_NOTIFY_CLEAR, 0, NULL, mm,
@@ -1143,7 +1274,7 @@ static void collapse_huge_page(struct mm_struct *mm,
 	mmu_notifier_invalidate_range_end(&range);
 
 	spin_lock(pte_ptl);
-	isolated = __collapse_huge_page_isolate(vma, address, pte,
+	isolated = __collapse_huge_page_isolate(vma, address, pte, cc,
 			&compound_pagelist);
 	spin_unlock(pte_ptl);
 
@@ -1196,7 +1327,9 @@ static void collapse_huge_page(struct mm_struct *mm,
 
 	*hpage = NULL;
 
-	khugepaged_pages_collapsed++;
+	if (cc->is_khugepaged)
+		khugepaged_pages_collapsed++;
+	count_collapse_heat(referenced);
 	result = SCAN_SUCCEED;
 out_up_write:
 	mmap_write_unlock(mm);
@@ -1204,7 +1337,7 @@ out_nolock:
 	if (!IS_ERR_OR_NULL(*hpage))
 		mem_cgroup_uncharge(*hpage);
 	trace_mm_collapse_huge_page(mm, isolated, result);
-	return;
+	return result;
 out:
 	goto out_up_write;
 }
@@ -1212,8 +1345,15 @@ out:
 static int khugepaged_scan_pmd(struct mm_struct *mm,
 			       struct vm_area_struct *vma,
 			       unsigned long address,
-			       struct page **hpage)
-{
+			       struct page **hpage,
+			       struct collapse_control *cc)
+{
+	unsigned int max_ptes_none = cc->is_khugepaged ?
+				     khugepaged_max_ptes_none : HPAGE_PMD_NR;
+	unsigned int max_ptes_swap = cc->is_khugepaged ?
+				     khugepaged_max_ptes_swap : HPAGE_PMD_NR;
+	unsigned int max_ptes_shared = cc->is_khugepaged ?
+				       khugepaged_max_ptes_shared : HPAGE_PMD_NR;
 	pmd_t *pmd;
 	pte_t *pte, *_pte;
 	int ret = 0, result = 0, referenced = 0;
@@ -1232,13 +1372,13 @@ static int khugepaged_scan_pmd(struct mm_struct *mm,
 		goto out;
 	}
 
-	memset(khugepaged_node_load, 0, sizeof(khugepaged_node_load));
+	memset(cc->node_load, 0, sizeof(cc->node_load));
 	pte = pte_offset_map_lock(mm, pmd, address, &ptl);
 	for (_address = address, _pte = pte; _pte < pte+HPAGE_PMD_NR;
 	     _pte++, _address += PAGE_SIZE) {
 		pte_t pteval = *_pte;
 		if (is_swap_pte(pteval)) {
-			if (++unmapped <= khugepaged_max_ptes_swap) {
+			if (++unmapped <= max_ptes_swap) {
 				/*
 				 * Always be strict with uffd-wp
 				 * enabled swap entries.  Please see
@@ -1256,7 +1396,7 @@ static int khugepaged_scan_pmd(struct mm_struct *mm,
 		}
 		if (pte_none(pteval) || is_zero_pfn(pte_pfn(pteval))) {
 			if (!userfaultfd_armed(vma) &&
-			    ++none_or_zero <= khugepaged_max_ptes_none) {
+			    ++none_or_zero <= max_ptes_none) {
 				continue;
 			} else {
 				result = SCAN_EXCEED_NONE_PTE;
@@ -1290,7 +1430,7 @@ static int khugepaged_scan_pmd(struct mm_struct *mm,
 		}
 
 		if (page_mapcount(page) > 1 &&
-				++shared > khugepaged_max_ptes_shared) {
+				++shared > max_ptes_shared) {
 			result = SCAN_EXCEED_SHARED_PTE;
 			goto out_unmap;
 		}
@@ -1299,16 +1439,16 @@ static int khugepaged_scan_pmd(struct mm_struct *mm,
 
 		/*
 		 * Record which node the original page is from and save this
-		 * information to khugepaged_node_load[].
+		 * information to cc->node_load[].
 		 * Khupaged will allocate hugepage from the node has the max
 		 * hit record.
 		 */
 		node = page_to_nid(page);
-		if (khugepaged_scan_abort(node)) {
+		if (khugepaged_scan_abort(node, cc)) {
 			result = SCAN_SCAN_ABORT;
 			goto out_unmap;
 		}
-		khugepaged_node_load[node]++;
+		cc->node_load[node]++;
 		if (!PageLRU(page)) {
 			result = SCAN_PAGE_LRU;
 			goto out_unmap;
@@ -1343,6 +1483,12 @@ static int khugepaged_scan_pmd(struct mm_struct *mm,
 			result = SCAN_PAGE_COUNT;
 			goto out_unmap;
 		}
+
+		/*
+		 * Only test the accessed bits: reclaim and the multi-gen LRU
+		 * aging clear them, and need them to tell hot pages from
+		 * cold ones.
+		 */
 		if (pte_young(pteval) ||
 		    page_is_young(page) || PageReferenced(page) ||
 		    mmu_notifier_test_young(vma->vm_mm, address))
@@ -1350,7 +1496,8 @@ static int khugepaged_scan_pmd(struct mm_struct *mm,
 	}
 	if (!writable) {
 		result = SCAN_PAGE_RO;
-	} else if (!referenced || (unmapped && referenced < HPAGE_PMD_NR/2)) {
+	} else if (cc->is_khugepaged && (!referenced ||
+		   (unmapped && referenced < HPAGE_PMD_NR/2))) {
 		result = SCAN_LACK_REFERENCED_PAGE;
 	} else {
 		result = SCAN_SUCCEED;
@@ -1359,14 +1506,16 @@ static int khugepaged_scan_pmd(struct mm_struct *mm,
 out_unmap:
 	pte_unmap_unlock(pte, ptl);
 	if (ret) {
-		node = khugepaged_find_target_node();
+		node = khugepaged_find_target_node(cc);
 		/* collapse_huge_page will return with the mmap_lock released */
-		collapse_huge_page(mm, address, hpage, node,
-				referenced, unmapped);
+		result = collapse_huge_page(mm, address, hpage, node,
+					    referenced, unmapped, cc);
 	}
 out:
 	trace_mm_khugepaged_scan_pmd(mm, page, writable, referenced,
 				     none_or_zero, result, unmapped);
+	cc->referenced = referenced;
+	cc->result = result;
 	return ret;
 }
 
@@ -1953,7 +2102,8 @@ out:
 }
 
 static void khugepaged_scan_file(struct mm_struct *mm,
-		struct file *file, pgoff_t start, struct page **hpage)
+		struct file *file, pgoff_t start, struct page **hpage,
+		struct collapse_control *cc)
 {
 	struct page *page = NULL;
 	struct address_space *mapping = file->f_mapping;
@@ -1964,7 +2114,7 @@ static void khugepaged_scan_file(struct mm_struct *mm,
 
 	present = 0;
 	swap = 0;
-	memset(khugepaged_node_load, 0, sizeof(khugepaged_node_load));
+	memset(cc->node_load, 0, sizeof(cc->node_load));
 	rcu_read_lock();
 	xas_for_each(&xas, page, start + HPAGE_PMD_NR - 1) {
 		if (xas_retry(&xas, page))
@@ -1984,11 +2134,11 @@ static void khugepaged_scan_file(struct mm_struct *mm,
 		}
 
 		node = page_to_nid(page);
-		if (khugepaged_scan_abort(node)) {
+		if (khugepaged_scan_abort(node, cc)) {
 			result = SCAN_SCAN_ABORT;
 			break;
 		}
-		khugepaged_node_load[node]++;
+		cc->node_load[node]++;
 
 		if (!PageLRU(page)) {
 			result = SCAN_PAGE_LRU;
@@ -2020,7 +2170,7 @@ static void khugepaged_scan_file(struct mm_struct *mm,
 		if (present < HPAGE_PMD_NR - khugepaged_max_ptes_none) {
 			result = SCAN_EXCEED_NONE_PTE;
 		} else {
-			node = khugepaged_find_target_node();
+			node = khugepaged_find_target_node(cc);
 			collapse_file(mm, file, start, hpage, node);
 		}
 	}
@@ -2029,7 +2179,8 @@ static void khugepaged_scan_file(struct mm_struct *mm,
 }
 #else
 static void khugepaged_scan_file(struct mm_struct *mm,
-		struct file *file, pgoff_t start, struct page **hpage)
+		struct file *file, pgoff_t start, struct page **hpage,
+		struct collapse_control *cc)
 {
 	BUILD_BUG();
 }
@@ -2040,11 +2191,94 @@ static int khugepaged_collapse_pte_mapped_thps(struct mm_slot *mm_slot)
 }
 #endif
 
+static int mm_slot_heat_cmp(void *priv, struct list_head *a,
+			    struct list_head *b)
+{
+	struct mm_slot *slot_a = list_entry(a, struct mm_slot, mm_node);
+	struct mm_slot *slot_b = list_entry(b, struct mm_slot, mm_node);
+
+	/* hottest first, list_sort() keeps the order of equal ones */
+	return slot_a->heat < slot_b->heat;
+}
+
+/* Fold the ranges sampled in the pass that just ended into the mm's heat */
+static void mm_slot_update_heat(struct mm_slot *mm_slot)
+{
+	unsigned int sample = 0;
+
+	if (mm_slot->nr_ranges)
+		sample = mm_slot->nr_referenced / mm_slot->nr_ranges;
+	mm_slot->heat = (mm_slot->heat + sample) / 2;
+	mm_slot->nr_ranges = 0;
+	mm_slot->nr_referenced = 0;
+
+	memcpy(mm_slot->hot_ranges, mm_slot->next_hot_ranges,
+	       sizeof(mm_slot->hot_ranges));
+	mm_slot->nr_hot_ranges = mm_slot->nr_next_hot_ranges;
+	mm_slot->nr_next_hot_ranges = 0;
+}
+
+/* Remember a hot anon range that didn't collapse, for the next pass */
+static void mm_slot_note_hot_range(struct mm_slot *mm_slot,
+				   unsigned long address,
+				   struct collapse_control *cc)
+{
+	int i;
+
+	if (!khugepaged_scan_hot_first || cc->result == SCAN_SUCCEED ||
+	    cc->referenced < HPAGE_PMD_NR / 2)
+		return;
+
+	for (i = 0; i < mm_slot->nr_next_hot_ranges; i++)
+		if (mm_slot->next_hot_ranges[i] == address)
+			return;
+	if (mm_slot->nr_next_hot_ranges < MAX_HOT_RANGES)
+		mm_slot->next_hot_ranges[mm_slot->nr_next_hot_ranges++] = address;
+}
+
+/*
+ * Retry the hot ranges of the previous pass before walking the mm in
+ * address order. Called with the mmap_lock held for read, returns true if
+ * a collapse released it. The ranges are consumed as they are scanned, so
+ * the next call resumes with the ones left.
+ */
+static bool khugepaged_scan_hot_ranges(struct mm_slot *mm_slot,
+				       struct page **hpage, int *progress)
+{
+	struct collapse_control *cc = &khugepaged_collapse_control;
+	struct mm_struct *mm = mm_slot->mm;
+	struct vm_area_struct *vma;
+	unsigned long address;
+	int ret;
+
+	while (mm_slot->nr_hot_ranges) {
+		cond_resched();
+		if (unlikely(khugepaged_test_exit(mm)))
+			break;
+
+		address = mm_slot->hot_ranges[--mm_slot->nr_hot_ranges];
+		vma = find_vma(mm, address);
+		if (!vma || address < vma->vm_start ||
+		    address + HPAGE_PMD_SIZE > vma->vm_end ||
+		    vma->vm_file || !hugepage_vma_check(vma, vma->vm_flags))
+			continue;
+
+		ret = khugepaged_scan_pmd(mm, vma, address, hpage, cc);
+		mm_slot_note_hot_range(mm_slot, address, cc);
+		*progress += HPAGE_PMD_NR;
+		if (ret)
+			return true;
+	}
+
+	return false;
+}
+
 static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 					    struct page **hpage)
 	__releases(&khugepaged_mm_lock)
 	__acquires(&khugepaged_mm_lock)
 {
+	struct collapse_control *cc = &khugepaged_collapse_control;
 	struct mm_slot *mm_slot;
 	struct mm_struct *mm;
 	struct vm_area_struct *vma;
@@ -2056,6 +2290,10 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 	if (khugepaged_scan.mm_slot)
 		mm_slot = khugepaged_scan.mm_slot;
 	else {
+		/* A new pass starts, visit the hottest mms first */
+		if (khugepaged_scan_hot_first)
+			list_sort(NULL, &khugepaged_scan.mm_head,
+				  mm_slot_heat_cmp);
 		mm_slot = list_entry(khugepaged_scan.mm_head.next,
 				     struct mm_slot, mm_node);
 		khugepaged_scan.address = 0;
@@ -2076,6 +2314,10 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 		vma = find_vma(mm, khugepaged_scan.address);
 
 	progress++;
+	if (vma && khugepaged_scan_hot_ranges(mm_slot, hpage, &progress))
+		goto breakouterloop_mmap_lock;
+	if (progress >= pages)
+		goto breakouterloop;
 	for (; vma; vma = vma->vm_next) {
 		unsigned long hstart, hend;
 
@@ -2117,12 +2359,17 @@ skip:
 
 				mmap_read_unlock(mm);
 				ret = 1;
-				khugepaged_scan_file(mm, file, pgoff, hpage);
+				khugepaged_scan_file(mm, file, pgoff, hpage,
+						     cc);
 				fput(file);
 			} else {
 				ret = khugepaged_scan_pmd(mm, vma,
 						khugepaged_scan.address,
-						hpage);
+						hpage, cc);
+				mm_slot->nr_ranges++;
+				mm_slot->nr_referenced += cc->referenced;
+				mm_slot_note_hot_range(mm_slot,
+						khugepaged_scan.address, cc);
 			}
 			/* move to next address */
 			khugepaged_scan.address += HPAGE_PMD_SIZE;
@@ -2145,6 +2392,7 @@ breakouterloop_mmap_lock:
 	 * if we scanned all vmas of this mm.
 	 */
 	if (khugepaged_test_exit(mm) || !vma) {
+		mm_slot_update_heat(mm_slot);
 		/*
 		 * Make sure that if mm_users is reaching zero while
 		 * khugepaged runs here, khugepaged_exit will find
@@ -2341,3 +2589,112 @@ void khugepaged_min_free_kbytes_update(void)
 		set_recommended_min_free_kbytes();
 	mutex_unlock(&khugepaged_mutex);
 }
+
+static bool pmd_range_is_huge(struct mm_struct *mm, unsigned long address)
+{
+	pgd_t *pgd;
+	p4d_t *p4d;
+	pud_t *pud;
+
+	pgd = pgd_offset(mm, address);
+	if (!pgd_present(*pgd))
+		return false;
+	p4d = p4d_offset(pgd, address);
+	if (!p4d_present(*p4d))
+		return false;
+	pud = pud_offset(p4d, address);
+	if (!pud_present(*pud))
+		return false;
+	return pmd_trans_huge(READ_ONCE(*pmd_offset(pud, address)));
+}
+
+static int madvise_collapse_errno(int result)
+{
+	switch (result) {
+	case SCAN_ALLOC_HUGE_PAGE_FAIL:
+		return -ENOMEM;
+	case SCAN_CGROUP_CHARGE_FAIL:
+		return -EBUSY;
+	/* transient, the caller may retry */
+	case SCAN_PAGE_COUNT:
+	case SCAN_PAGE_LOCK:
+	case SCAN_PAGE_LRU:
+	case SCAN_DEL_PAGE_LRU:
+		return -EAGAIN;
+	default:
+		return -EINVAL;
+	}
+}
+
+/*
+ * MADV_COLLAPSE: collapse the anonymous pmd ranges in [start, end) into
+ * huge pages synchronously, in the context of the caller, rather than
+ * waiting for khugepaged to get to them. Unlike khugepaged it collapses
+ * ranges whatever their max_ptes_* counts and however cold they are.
+ *
+ * Called with mmap_lock held for read; the lock is dropped and taken again
+ * for every collapse, so *prev is cleared once that happened.
+ */
+int madvise_collapse(struct vm_area_struct *vma, struct vm_area_struct **prev,
+		     unsigned long start, unsigned long end)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long hstart, hend, addr;
+	struct collapse_control *cc;
+	int thps = 0, last_fail = SCAN_FAIL;
+	bool mmap_locked = true;
+
+	*prev = vma;
+	if (!madvise_collapse_vma_check(vma))
+		return -EINVAL;
+
+	cc = kmalloc(sizeof(*cc), GFP_KERNEL);
+	if (!cc)
+		return -ENOMEM;
+	cc->is_khugepaged = false;
+
+	lru_add_drain_all();
+
+	hstart = (start + ~HPAGE_PMD_MASK) & HPAGE_PMD_MASK;
+	hend = end & HPAGE_PMD_MASK;
+	for (addr = hstart; addr < hend; addr += HPAGE_PMD_SIZE) {
+		struct page *hpage = NULL;
+		int result;
+
+		cond_resched();
+		if (!mmap_locked) {
+			mmap_read_lock(mm);
+			mmap_locked = true;
+			*prev = NULL;
+			result = hugepage_vma_revalidate(mm, addr, &vma, cc);
+			if (result) {
+				last_fail = result;
+				break;
+			}
+		}
+
+		/* collapse_huge_page() returns with the mmap_lock released */
+		mmap_locked = !khugepaged_scan_pmd(mm, vma, addr, &hpage, cc);
+		if (!IS_ERR_OR_NULL(hpage))
+			put_page(hpage);
+
+		result = cc->result;
+		if (result == SCAN_PMD_NULL && mmap_locked &&
+		    pmd_range_is_huge(mm, addr))
+			result = SCAN_SUCCEED;
+		if (result == SCAN_SUCCEED)
+			thps++;
+		else
+			last_fail = result;
+	}
+
+	if (!mmap_locked) {
+		mmap_read_lock(mm);
+		*prev = NULL;
+	}
+	kfree(cc);
+
+	if (hstart >= hend || thps == (hend - hstart) / HPAGE_PMD_SIZE)
+		return 0;
+	return madvise_collapse_errno(last_fail);
+}
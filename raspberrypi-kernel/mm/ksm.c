@@ -38,6 +38,7 @@
 #include <linux/freezer.h>
 #include <linux/oom.h>
 #include <linux/numa.h>
+#include <linux/workqueue.h>
 
 #include <asm/tlbflush.h>
 #include "internal.h"
@@ -150,6 +151,7 @@ struct ksm_scan {
  * @kpfn: page frame number of this ksm page (perhaps temporarily on wrong nid)
  * @chain_prune_time: time of the last full garbage collection
  * @rmap_hlist_len: number of rmap_item entries in hlist or STABLE_NODE_CHAIN
+ * @checksum: checksum of the ksm page, counted in ksm_stable_fp
  * @nid: NUMA node id of stable tree in which linked (may not match kpfn)
  */
 struct stable_node {
@@ -175,6 +177,7 @@ struct stable_node {
 	 */
 #define STABLE_NODE_CHAIN -1024
 	int rmap_hlist_len;
+	u32 checksum;
 #ifdef CONFIG_NUMA
 	int nid;
 #endif
@@ -260,6 +263,30 @@ static unsigned long ksm_stable_node_chains;
 /* The number of stable_node dups linked to the stable_node chains */
 static unsigned long ksm_stable_node_dups;
 
+/* The number of pages ksmd has scanned */
+static unsigned long ksm_pages_scanned;
+
+/* The number of stable tree searches skipped by the checksum filter */
+static unsigned long ksm_stable_skipped;
+
+/*
+ * Saturating counts of the stable tree pages whose checksum falls into
+ * each bucket. An empty bucket means that no ksm page can be identical to
+ * a page with such a checksum, and the stable tree walk can be skipped.
+ * ksm_stable_fp_nr is the number of stable tree pages counted.
+ */
+static u8 *ksm_stable_fp __read_mostly;
+static unsigned long ksm_stable_fp_mask __read_mostly;
+static unsigned long ksm_stable_fp_nr;
+
+/*
+ * Buckets kept per stable tree page: with 16 of them, a page whose content
+ * has no ksm page yet finds its bucket empty more than nine times in ten.
+ */
+#define STABLE_FP_BUCKETS	16
+#define STABLE_FP_MIN_SIZE	(1UL << 16)
+#define STABLE_FP_MAX_SIZE	(1UL << 30)
+
 /* Delay in pruning stale stable_node_dups in the stable_node_chains */
 static int ksm_stable_node_chains_prune_millisecs = 2000;
 
@@ -409,6 +436,88 @@ static inline void free_stable_node(struct stable_node *stable_node)
 	kmem_cache_free(stable_node_cache, stable_node);
 }
 
+static void stable_fp_count(u32 checksum)
+{
+	u8 *count;
+
+	if (!ksm_stable_fp)
+		return;
+	count = &ksm_stable_fp[checksum & ksm_stable_fp_mask];
+	if (*count < U8_MAX)
+		(*count)++;
+}
+
+static void stable_fp_add(struct stable_node *stable_node, u32 checksum)
+{
+	stable_node->checksum = checksum;
+	ksm_stable_fp_nr++;
+	stable_fp_count(checksum);
+}
+
+static void stable_fp_del(struct stable_node *stable_node)
+{
+	u8 *count;
+
+	ksm_stable_fp_nr--;
+	if (!ksm_stable_fp)
+		return;
+	count = &ksm_stable_fp[stable_node->checksum & ksm_stable_fp_mask];
+	/* A saturated count no longer knows how many pages it stands for */
+	if (*count && *count < U8_MAX)
+		(*count)--;
+}
+
+static bool stable_fp_maybe(u32 checksum)
+{
+	return !ksm_stable_fp || ksm_stable_fp[checksum & ksm_stable_fp_mask];
+}
+
+/*
+ * Called with ksm_thread_mutex held before each full scan: once the stable
+ * tree pages outnumber a STABLE_FP_BUCKETS'th of the buckets, replace the
+ * table with one large enough for them and count them all again, which
+ * also forgets the counts that saturated in the old one.
+ */
+static void stable_fp_grow(void)
+{
+	struct stable_node *stable_node, *dup;
+	struct rb_node *node;
+	unsigned long size;
+	u8 *table;
+	int nid;
+
+	size = ksm_stable_fp_mask + 1;
+	if (ksm_stable_fp && (ksm_stable_fp_nr * STABLE_FP_BUCKETS <= size ||
+			      size >= STABLE_FP_MAX_SIZE))
+		return;
+
+	size = max(ksm_stable_fp_nr * STABLE_FP_BUCKETS, STABLE_FP_MIN_SIZE);
+	size = min(roundup_pow_of_two(size), STABLE_FP_MAX_SIZE);
+	table = kvzalloc(size, GFP_KERNEL | __GFP_NOWARN);
+	if (!table)
+		return;
+	kvfree(ksm_stable_fp);
+	ksm_stable_fp = table;
+	ksm_stable_fp_mask = size - 1;
+
+	for (nid = 0; nid < ksm_nr_node_ids; nid++) {
+		for (node = rb_first(root_stable_tree + nid); node;
+		     node = rb_next(node)) {
+			stable_node = rb_entry(node, struct stable_node, node);
+			if (!is_stable_node_chain(stable_node)) {
+				stable_fp_count(stable_node->checksum);
+				continue;
+			}
+			hlist_for_each_entry(dup, &stable_node->hlist,
+					     hlist_dup)
+				stable_fp_count(dup->checksum);
+			cond_resched();
+		}
+	}
+	list_for_each_entry(stable_node, &migrate_nodes, list)
+		stable_fp_count(stable_node->checksum);
+}
+
 static inline struct mm_slot *alloc_mm_slot(void)
 {
 	if (!mm_slot_cache)	/* initialization failed */
@@ -664,6 +773,7 @@ static void remove_node_from_stable_tree(struct stable_node *stable_node)
 		list_del(&stable_node->list);
 	else
 		stable_node_dup_del(stable_node);
+	stable_fp_del(stable_node);
 	free_stable_node(stable_node);
 }
 
@@ -1902,6 +2012,8 @@ again:
 		}
 		stable_node_chain_add_dup(stable_node_dup, stable_node);
 	}
+	/* kpage is write protected, its checksum stays valid */
+	stable_fp_add(stable_node_dup, calc_checksum(kpage));
 
 	return stable_node_dup;
 }
@@ -1919,12 +2031,16 @@ again:
  *
  * This function does both searching and inserting, because they share
  * the same walking algorithm in an rbtree.
+ *
+ * The tree is ordered by the checksum of the pages, which the caller left
+ * in rmap_item->oldchecksum, and only then by their contents.
  */
 static
 struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
 					      struct page *page,
 					      struct page **tree_pagep)
 {
+	u32 checksum = rmap_item->oldchecksum;
 	struct rb_node **new;
 	struct rb_root *root;
 	struct rb_node *parent = NULL;
@@ -1941,6 +2057,20 @@ struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
 
 		cond_resched();
 		tree_rmap_item = rb_entry(*new, struct rmap_item, node);
+
+		/*
+		 * Pages with different checksums certainly differ: no need
+		 * to look up and compare the tree page to know where to go.
+		 */
+		if (checksum != tree_rmap_item->oldchecksum) {
+			parent = *new;
+			if (checksum < tree_rmap_item->oldchecksum)
+				new = &parent->rb_left;
+			else
+				new = &parent->rb_right;
+			continue;
+		}
+
 		tree_page = get_mergeable_page(tree_rmap_item);
 		if (!tree_page)
 			return NULL;
@@ -2032,15 +2162,16 @@ static void stable_tree_append(struct rmap_item *rmap_item,
  *
  * @page: the page that we are searching identical page to.
  * @rmap_item: the reverse mapping into the virtual address of this page
+ * @checksum: the current checksum of the page
  */
-static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
+static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item,
+			       u32 checksum)
 {
 	struct mm_struct *mm = rmap_item->mm;
 	struct rmap_item *tree_rmap_item;
 	struct page *tree_page = NULL;
 	struct stable_node *stable_node;
 	struct page *kpage;
-	unsigned int checksum;
 	int err;
 	bool max_page_sharing_bypass = false;
 
@@ -2064,8 +2195,16 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 			max_page_sharing_bypass = true;
 	}
 
-	/* We first start with searching the page inside the stable tree */
-	kpage = stable_tree_search(page);
+	/*
+	 * We first start with searching the page inside the stable tree,
+	 * unless no ksm page has the same checksum as this one.
+	 */
+	if (stable_node || stable_fp_maybe(checksum)) {
+		kpage = stable_tree_search(page);
+	} else {
+		kpage = NULL;
+		ksm_stable_skipped++;
+	}
 	if (kpage == page && rmap_item->head == stable_node) {
 		put_page(kpage);
 		return;
@@ -2098,7 +2237,6 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	 * don't want to insert it in the unstable tree, and we don't want
 	 * to waste our time searching for something identical to it there.
 	 */
-	checksum = calc_checksum(page);
 	if (rmap_item->oldchecksum != checksum) {
 		rmap_item->oldchecksum = checksum;
 		return;
@@ -2222,16 +2360,29 @@ static struct rmap_item *get_next_rmap_item(struct mm_slot *mm_slot,
 	return rmap_item;
 }
 
-static struct rmap_item *scan_get_next_rmap_item(struct page **page)
+/*
+ * scan_get_next_rmap_items - collect the next pages to scan, with their
+ * rmap_items, into @rmap_items and @pages.
+ *
+ * All the pages of a batch belong to the same mm and are collected under
+ * one mmap_lock hold. The mm is only left, or torn down if it exited, on
+ * the next call, after the caller is done with the batch.
+ *
+ * Returns the number of pages collected, at most @max, and 0 at the end
+ * of a full scan.
+ */
+static int scan_get_next_rmap_items(struct rmap_item **rmap_items,
+				    struct page **pages, int max)
 {
 	struct mm_struct *mm;
 	struct mm_slot *slot;
 	struct vm_area_struct *vma;
 	struct rmap_item *rmap_item;
-	int nid;
+	struct page *page;
+	int nid, nr = 0;
 
 	if (list_empty(&ksm_mm_head.mm_list))
-		return NULL;
+		return 0;
 
 	slot = ksm_scan.mm_slot;
 	if (slot == &ksm_mm_head) {
@@ -2255,7 +2406,6 @@ static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 		 */
 		if (!ksm_merge_across_nodes) {
 			struct stable_node *stable_node, *next;
-			struct page *page;
 
 			list_for_each_entry_safe(stable_node, next,
 						 &migrate_nodes, list) {
@@ -2267,6 +2417,8 @@ static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 			}
 		}
 
+		stable_fp_grow();
+
 		for (nid = 0; nid < ksm_nr_node_ids; nid++)
 			root_unstable_tree[nid] = RB_ROOT;
 
@@ -2279,7 +2431,7 @@ static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 		 * of the last mm on the list may have removed it since then.
 		 */
 		if (slot == &ksm_mm_head)
-			return NULL;
+			return 0;
 next_mm:
 		ksm_scan.address = 0;
 		ksm_scan.rmap_list = &slot->rmap_list;
@@ -2303,32 +2455,44 @@ next_mm:
 		while (ksm_scan.address < vma->vm_end) {
 			if (ksm_test_exit(mm))
 				break;
-			*page = follow_page(vma, ksm_scan.address, FOLL_GET);
-			if (IS_ERR_OR_NULL(*page)) {
+			page = follow_page(vma, ksm_scan.address, FOLL_GET);
+			if (IS_ERR_OR_NULL(page)) {
 				ksm_scan.address += PAGE_SIZE;
 				cond_resched();
 				continue;
 			}
-			if (PageAnon(*page)) {
-				flush_anon_page(vma, *page, ksm_scan.address);
-				flush_dcache_page(*page);
+			if (PageAnon(page)) {
+				flush_anon_page(vma, page, ksm_scan.address);
+				flush_dcache_page(page);
 				rmap_item = get_next_rmap_item(slot,
 					ksm_scan.rmap_list, ksm_scan.address);
-				if (rmap_item) {
-					ksm_scan.rmap_list =
-							&rmap_item->rmap_list;
-					ksm_scan.address += PAGE_SIZE;
-				} else
-					put_page(*page);
-				mmap_read_unlock(mm);
-				return rmap_item;
+				if (!rmap_item) {
+					put_page(page);
+					mmap_read_unlock(mm);
+					return nr;
+				}
+				ksm_scan.rmap_list = &rmap_item->rmap_list;
+				ksm_scan.address += PAGE_SIZE;
+				rmap_items[nr] = rmap_item;
+				pages[nr++] = page;
+				if (nr == max) {
+					mmap_read_unlock(mm);
+					return nr;
+				}
+				continue;
 			}
-			put_page(*page);
+			put_page(page);
 			ksm_scan.address += PAGE_SIZE;
 			cond_resched();
 		}
 	}
 
+	/* Hand out what we have, the next call finishes off this mm */
+	if (nr) {
+		mmap_read_unlock(mm);
+		return nr;
+	}
+
 	if (ksm_test_exit(mm)) {
 		ksm_scan.address = 0;
 		ksm_scan.rmap_list = &slot->rmap_list;
@@ -2378,7 +2542,87 @@ next_mm:
 		goto next_mm;
 
 	ksm_scan.seqnr++;
-	return NULL;
+	return 0;
+}
+
+/* Pages ksmd collects and checksums at a time */
+#define KSM_SCAN_BATCH	32
+
+/**
+ * struct ksm_hash_work - checksums the pages of a batch on one node
+ * @work: queued on a worker of @nid
+ * @pages: the pages of the batch
+ * @checksums: where to store the checksums of the pages
+ * @nr: number of pages in the batch
+ * @nid: only the pages on this node are checksummed
+ */
+struct ksm_hash_work {
+	struct work_struct work;
+	struct page **pages;
+	u32 *checksums;
+	int nr;
+	int nid;
+};
+
+/* Only set up on NUMA machines, one ksm_hash_work per node */
+static struct workqueue_struct *ksm_hash_wq;
+static struct ksm_hash_work *ksm_hash_works;
+
+static void calc_node_checksums(struct page **pages, u32 *checksums, int nr,
+				int nid)
+{
+	int i;
+
+	for (i = 0; i < nr; i++)
+		if (page_to_nid(pages[i]) == nid)
+			checksums[i] = calc_checksum(pages[i]);
+}
+
+static void ksm_hash_workfn(struct work_struct *work)
+{
+	struct ksm_hash_work *hw = container_of(work, struct ksm_hash_work,
+						work);
+
+	calc_node_checksums(hw->pages, hw->checksums, hw->nr, hw->nid);
+}
+
+/*
+ * Checksumming reads every byte of every scanned page, which makes it the
+ * bulk of the work for pages that then need no tree walk. On NUMA machines
+ * the pages on other nodes are checksummed by workers on those nodes, from
+ * their local memory and in parallel with ksmd doing its own node's pages.
+ */
+static void calc_checksums(struct page **pages, u32 *checksums, int nr)
+{
+	nodemask_t nodes = NODE_MASK_NONE;
+	int i, nid, local = numa_node_id();
+
+	if (!ksm_hash_wq) {
+		for (i = 0; i < nr; i++)
+			checksums[i] = calc_checksum(pages[i]);
+		return;
+	}
+
+	for (i = 0; i < nr; i++)
+		node_set(page_to_nid(pages[i]), nodes);
+
+	for_each_node_mask(nid, nodes) {
+		struct ksm_hash_work *hw = &ksm_hash_works[nid];
+
+		if (nid == local)
+			continue;
+		hw->pages = pages;
+		hw->checksums = checksums;
+		hw->nr = nr;
+		queue_work_node(nid, ksm_hash_wq, &hw->work);
+	}
+
+	if (node_isset(local, nodes))
+		calc_node_checksums(pages, checksums, nr, local);
+
+	for_each_node_mask(nid, nodes)
+		if (nid != local)
+			flush_work(&ksm_hash_works[nid].work);
 }
 
 /**
@@ -2387,16 +2631,27 @@ next_mm:
  */
 static void ksm_do_scan(unsigned int scan_npages)
 {
-	struct rmap_item *rmap_item;
-	struct page *page;
+	struct rmap_item *rmap_items[KSM_SCAN_BATCH];
+	struct page *pages[KSM_SCAN_BATCH];
+	u32 checksums[KSM_SCAN_BATCH];
+	int nr, i;
 
-	while (scan_npages-- && likely(!freezing(current))) {
+	while (scan_npages && likely(!freezing(current))) {
 		cond_resched();
-		rmap_item = scan_get_next_rmap_item(&page);
-		if (!rmap_item)
+		nr = scan_get_next_rmap_items(rmap_items, pages,
+				min_t(unsigned int, scan_npages, KSM_SCAN_BATCH));
+		if (!nr)
 			return;
-		cmp_and_merge_page(page, rmap_item);
-		put_page(page);
+		scan_npages -= nr;
+		ksm_pages_scanned += nr;
+
+		calc_checksums(pages, checksums, nr);
+		for (i = 0; i < nr; i++) {
+			cmp_and_merge_page(pages[i], rmap_items[i],
+					   checksums[i]);
+			put_page(pages[i]);
+			cond_resched();
+		}
 	}
 }
 
@@ -3131,6 +3386,20 @@ static ssize_t full_scans_show(struct kobject *kobj,
 }
 KSM_ATTR_RO(full_scans);
 
+static ssize_t pages_scanned_show(struct kobject *kobj,
+				  struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_pages_scanned);
+}
+KSM_ATTR_RO(pages_scanned);
+
+static ssize_t stable_skipped_show(struct kobject *kobj,
+				   struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%lu\n", ksm_stable_skipped);
+}
+KSM_ATTR_RO(stable_skipped);
+
 static struct attribute *ksm_attrs[] = {
 	&sleep_millisecs_attr.attr,
 	&pages_to_scan_attr.attr,
@@ -3140,6 +3409,8 @@ static struct attribute *ksm_attrs[] = {
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+	&pages_scanned_attr.attr,
+	&stable_skipped_attr.attr,
 #ifdef CONFIG_NUMA
 	&merge_across_nodes_attr.attr,
 #endif
@@ -3157,6 +3428,31 @@ static const struct attribute_group ksm_attr_group = {
 };
 #endif /* CONFIG_SYSFS */
 
+static void __init ksm_hash_init(void)
+{
+#ifdef CONFIG_NUMA
+	int nid;
+
+	if (nr_node_ids == 1)
+		return;
+
+	ksm_hash_works = kcalloc(nr_node_ids, sizeof(*ksm_hash_works),
+				 GFP_KERNEL);
+	if (!ksm_hash_works)
+		return;
+	ksm_hash_wq = alloc_workqueue("ksm_hash", WQ_UNBOUND, 0);
+	if (!ksm_hash_wq) {
+		kfree(ksm_hash_works);
+		ksm_hash_works = NULL;
+		return;
+	}
+	for (nid = 0; nid < nr_node_ids; nid++) {
+		INIT_WORK(&ksm_hash_works[nid].work, ksm_hash_workfn);
+		ksm_hash_works[nid].nid = nid;
+	}
+#endif
+}
+
 static int __init ksm_init(void)
 {
 	struct task_struct *ksm_thread;
@@ -3171,6 +3467,9 @@ static int __init ksm_init(void)
 	if (err)
 		goto out;
 
+	/* Only speeds up scanning, ksm works without it */
+	ksm_hash_init();
+
 	ksm_thread = kthread_run(ksm_scan_thread, NULL, "ksmd");
 	if (IS_ERR(ksm_thread)) {
 		pr_err("ksm: creating kthread failed\n");
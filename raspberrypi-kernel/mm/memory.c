@@ -3263,6 +3263,12 @@ vm_fault_t do_swap_page(struct vm_fault *vmf)
 	if (!pte_unmap_same(vma->vm_mm, vmf->pmd, vmf->pte, vmf->orig_pte))
 		goto out;
 
+	/* swap-in may have to drop the lock for I/O, retry under mmap_lock */
+	if (vmf->flags & FAULT_FLAG_VMA_LOCK) {
+		ret = VM_FAULT_RETRY;
+		goto out;
+	}
+
 	entry = pte_to_swp_entry(vmf->orig_pte);
 	if (unlikely(non_swap_entry(entry))) {
 		if (is_migration_entry(entry)) {
@@ -3472,6 +3478,123 @@ out_release:
 	return ret;
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*
+ * Map the naturally aligned block of 1 << anon_block_order pages around an
+ * anon write fault at once. The block is allocated physically contiguous
+ * and split into base pages, so the pages are ordinary order-0 pages to the
+ * rest of mm, but a sequential writer takes one fault, one trip to the page
+ * allocator and one page table lock round trip per block instead of per
+ * page. Returns VM_FAULT_FALLBACK if the block cannot be used, for the
+ * caller to map a single page.
+ */
+static vm_fault_t do_anonymous_block(struct vm_fault *vmf)
+{
+	struct vm_area_struct *vma = vmf->vma;
+	unsigned int order = READ_ONCE(anon_block_order);
+	unsigned long addr, nr, i;
+	struct page *page;
+	vm_fault_t ret;
+	pte_t *pte;
+	gfp_t gfp;
+
+	/*
+	 * Like a THP, the block fills memory the task may never touch, so it
+	 * is only used where the THP mode, MADV_[NO]HUGEPAGE and
+	 * PR_SET_THP_DISABLE allow a THP. The VMA need not have room for one.
+	 */
+	if (!order || !__transparent_hugepage_enabled(vma) ||
+	    userfaultfd_armed(vma))
+		return VM_FAULT_FALLBACK;
+
+	nr = 1UL << order;
+	addr = ALIGN_DOWN(vmf->address, nr << PAGE_SHIFT);
+	if (addr < vma->vm_start || addr + (nr << PAGE_SHIFT) > vma->vm_end)
+		return VM_FAULT_FALLBACK;
+
+	/* Only fill blocks that are still empty, checked again under the ptl */
+	pte = pte_offset_map(vmf->pmd, addr);
+	for (i = 0; i < nr; i++)
+		if (!pte_none(pte[i]))
+			break;
+	pte_unmap(pte);
+	if (i < nr)
+		return VM_FAULT_FALLBACK;
+
+	/* Don't reclaim or compact for it, a single page will do as well */
+	gfp = (GFP_HIGHUSER_MOVABLE | __GFP_NOWARN) & ~__GFP_DIRECT_RECLAIM;
+	page = alloc_pages_vma(gfp, order, vma, addr, numa_node_id(), false);
+	if (!page) {
+		count_vm_event(ANON_BLOCK_FALLBACK);
+		return VM_FAULT_FALLBACK;
+	}
+	split_page(page, order);
+
+	for (i = 0; i < nr; i++) {
+		/*
+		 * A memcg near its limit gets a single page instead, without
+		 * going OOM for the block.  Freeing the pages below uncharges
+		 * the ones already charged.
+		 */
+		if (mem_cgroup_charge(page + i, vma->vm_mm,
+				      GFP_KERNEL | __GFP_NORETRY)) {
+			ret = VM_FAULT_FALLBACK;
+			goto release;
+		}
+		clear_user_highpage(page + i, addr + (i << PAGE_SHIFT));
+		/* See the comment in do_anonymous_page() */
+		__SetPageUptodate(page + i);
+	}
+	cgroup_throttle_swaprate(page, GFP_KERNEL);
+
+	vmf->pte = pte_offset_map_lock(vma->vm_mm, vmf->pmd, addr, &vmf->ptl);
+	for (i = 0; i < nr; i++) {
+		if (!pte_none(vmf->pte[i])) {
+			ret = VM_FAULT_FALLBACK;
+			goto unlock_release;
+		}
+	}
+
+	ret = check_stable_address_space(vma->vm_mm);
+	if (ret)
+		goto unlock_release;
+
+	add_mm_counter(vma->vm_mm, MM_ANONPAGES, nr);
+	for (i = 0; i < nr; i++) {
+		unsigned long a = addr + (i << PAGE_SHIFT);
+		pte_t entry;
+
+		entry = mk_pte(page + i, vma->vm_page_prot);
+		entry = pte_sw_mkyoung(entry);
+		if (vma->vm_flags & VM_WRITE)
+			entry = pte_mkwrite(pte_mkdirty(entry));
+
+		page_add_new_anon_rmap(page + i, vma, a, false);
+		lru_cache_add_inactive_or_unevictable(page + i, vma);
+		set_pte_at(vma->vm_mm, a, vmf->pte + i, entry);
+		/* No need to invalidate - it was non-present before */
+		update_mmu_cache(vma, a, vmf->pte + i);
+	}
+	pte_unmap_unlock(vmf->pte, vmf->ptl);
+	count_vm_event(ANON_BLOCK_ALLOC);
+	return 0;
+
+unlock_release:
+	pte_unmap_unlock(vmf->pte, vmf->ptl);
+release:
+	if (ret == VM_FAULT_FALLBACK)
+		count_vm_event(ANON_BLOCK_FALLBACK);
+	for (i = 0; i < nr; i++)
+		put_page(page + i);
+	return ret;
+}
+#else
+static vm_fault_t do_anonymous_block(struct vm_fault *vmf)
+{
+	return VM_FAULT_FALLBACK;
+}
+#endif
+
 /*
  * We enter with non-exclusive mmap_lock (to exclude vma changes,
  * but allow concurrent faults), and pte mapped but not yet locked.
@@ -3530,6 +3653,12 @@ static vm_fault_t do_anonymous_page(struct vm_fault *vmf)
 	/* Allocate our own private page. */
 	if (unlikely(anon_vma_prepare(vma)))
 		goto oom;
+
+	ret = do_anonymous_block(vmf);
+	if (ret != VM_FAULT_FALLBACK)
+		return ret;
+	ret = 0;
+
 	page = alloc_zeroed_user_highpage_movable(vma, vmf->address);
 	if (!page)
 		goto oom;
@@ -4635,6 +4764,64 @@ vm_fault_t handle_mm_fault(struct vm_area_struct *vma, unsigned long address,
 }
 EXPORT_SYMBOL_GPL(handle_mm_fault);
 
+#ifdef CONFIG_PER_VMA_LOCK
+/*
+ * Find and read-lock the VMA that covers address without taking mmap_lock,
+ * for handle_mm_fault() with FAULT_FLAG_VMA_LOCK. Returns NULL if the VMA
+ * is not found, is being modified or is not one that we can fault in under
+ * its own lock, in which case the caller falls back to mmap_lock.
+ */
+struct vm_area_struct *lock_vma_under_rcu(struct mm_struct *mm,
+					  unsigned long address)
+{
+	struct vm_area_struct *vma;
+
+	rcu_read_lock();
+	vma = find_vma_rcu(mm, address);
+	if (!vma)
+		goto miss;
+
+	/* Only anonymous VMAs, file faults may drop mmap_lock for I/O */
+	if (!vma_is_anonymous(vma))
+		goto abort;
+
+	/*
+	 * anon_vma_prepare() looks at the neighbouring VMAs, which we do not
+	 * lock, so leave the first fault of a VMA to the mmap_lock path.
+	 */
+	if (!READ_ONCE(vma->anon_vma))
+		goto abort;
+
+	if (!vma_start_read(vma))
+		goto abort;
+
+	/* The VMA may have changed or gone away before we locked it */
+	if (unlikely(vma->detached ||
+		     address < vma->vm_start || address >= vma->vm_end)) {
+		vma_end_read(vma);
+		goto miss;
+	}
+
+	/* handle_userfault() needs mmap_lock */
+	if (userfaultfd_armed(vma)) {
+		vma_end_read(vma);
+		goto abort;
+	}
+
+	rcu_read_unlock();
+	return vma;
+
+miss:
+	rcu_read_unlock();
+	count_vm_vma_lock_event(VMA_LOCK_MISS);
+	return NULL;
+abort:
+	rcu_read_unlock();
+	count_vm_vma_lock_event(VMA_LOCK_ABORT);
+	return NULL;
+}
+#endif /* CONFIG_PER_VMA_LOCK */
+
 #ifndef __PAGETABLE_P4D_FOLDED
 /*
  * Allocate p4d page table.
@@ -574,6 +574,7 @@ success:
 	 * It's okay if try_to_unmap_one unmaps a page just after we
 	 * set VM_LOCKED, populate_vma_page_range will bring it back.
 	 */
+	vma_start_write(vma);
 
 	if (lock)
 		vma->vm_flags = newflags;
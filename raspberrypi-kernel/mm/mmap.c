@@ -483,6 +483,9 @@ static __always_inline void vma_rb_erase_ignore(struct vm_area_struct *vma,
 	 */
 	validate_mm_rb(root, ignore);
 
+	/* lockless lookups can still find it, make sure they fail */
+	vma_start_write(vma);
+	vma_mark_detached(vma, true);
 	__vma_rb_erase(vma, root);
 }
 
@@ -648,7 +651,11 @@ void __vma_link_rb(struct mm_struct *mm, struct vm_area_struct *vma,
 	 * immediately update the gap to the correct value. Finally we
 	 * rebalance the rbtree after all augmented values have been set.
 	 */
-	rb_link_node(&vma->vm_rb, rb_parent, rb_link);
+	/* the caller may still be setting the vma up */
+	vma_start_write(vma);
+	vma_mark_detached(vma, false);
+	/* find_vma_rcu() must see the vma initialised once it is linked */
+	rb_link_node_rcu(&vma->vm_rb, rb_parent, rb_link);
 	vma->rb_subtree_gap = 0;
 	vma_gap_update(vma);
 	vma_rb_insert(vma, &mm->mm_rb);
@@ -750,6 +757,10 @@ int __vma_adjust(struct vm_area_struct *vma, unsigned long start,
 	long adjust_next = 0;
 	int remove_next = 0;
 
+	vma_start_write(vma);
+	if (next)
+		vma_start_write(next);
+
 	if (next && !insert) {
 		struct vm_area_struct *exporter = NULL, *importer = NULL;
 
@@ -783,6 +794,8 @@ int __vma_adjust(struct vm_area_struct *vma, unsigned long start,
 				remove_next = 1 + (end > next->vm_end);
 				VM_WARN_ON(remove_next == 2 &&
 					   end != next->vm_next->vm_end);
+				if (remove_next == 2)
+					vma_start_write(next->vm_next);
 				/* trim end to next, for case 6 first pass */
 				end = next->vm_end;
 			}
@@ -2330,6 +2343,35 @@ struct vm_area_struct *find_vma(struct mm_struct *mm, unsigned long addr)
 
 EXPORT_SYMBOL(find_vma);
 
+#ifdef CONFIG_PER_VMA_LOCK
+/*
+ * Look up the VMA that contains addr without mmap_lock. The caller has to
+ * be in an RCU read-side critical section, which keeps the VMAs we walk
+ * over from being freed. The tree can change under us, so the walk may
+ * miss the VMA, and the one it returns has to be locked with
+ * vma_start_read() and checked again before use.
+ */
+struct vm_area_struct *find_vma_rcu(struct mm_struct *mm, unsigned long addr)
+{
+	struct rb_node *rb_node = READ_ONCE(mm->mm_rb.rb_node);
+
+	while (rb_node) {
+		struct vm_area_struct *tmp;
+
+		tmp = rb_entry(rb_node, struct vm_area_struct, vm_rb);
+
+		if (READ_ONCE(tmp->vm_end) <= addr)
+			rb_node = READ_ONCE(rb_node->rb_right);
+		else if (READ_ONCE(tmp->vm_start) > addr)
+			rb_node = READ_ONCE(rb_node->rb_left);
+		else
+			return tmp;
+	}
+
+	return NULL;
+}
+#endif
+
 /*
  * Same as find_vma, but also return a pointer to the previous VMA in *pprev.
  */
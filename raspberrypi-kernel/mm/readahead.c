@@ -23,6 +23,7 @@
 #include <linux/blk-cgroup.h>
 #include <linux/fadvise.h>
 #include <linux/sched/mm.h>
+#include <linux/cpuset.h>
 
 #include "internal.h"
 
@@ -157,6 +158,49 @@ out:
 		rac->_index++;
 }
 
+/*
+ * Readahead takes its pages out of physically contiguous blocks of this
+ * order when it can, so that the bios built from them need fewer segments
+ * and the page allocator is entered once per block instead of per page.
+ */
+#define RA_BLOCK_ORDER	ilog2(SZ_64K >> PAGE_SHIFT)
+
+struct ra_block {
+	struct page *page;
+	unsigned long nr;
+};
+
+static struct page *ra_alloc_page(struct ra_block *blk, gfp_t gfp_mask,
+		unsigned long nr_left)
+{
+	if (!blk->nr && RA_BLOCK_ORDER && nr_left >= 1UL << RA_BLOCK_ORDER &&
+	    !cpuset_do_page_mem_spread()) {
+		gfp_t gfp = (gfp_mask | __GFP_NORETRY | __GFP_NOWARN) &
+			    ~__GFP_DIRECT_RECLAIM;
+
+		blk->page = alloc_pages(gfp, RA_BLOCK_ORDER);
+		if (blk->page) {
+			split_page(blk->page, RA_BLOCK_ORDER);
+			blk->nr = 1UL << RA_BLOCK_ORDER;
+		}
+	}
+
+	if (blk->nr) {
+		blk->nr--;
+		return blk->page++;
+	}
+
+	return __page_cache_alloc(gfp_mask);
+}
+
+static void ra_free_block(struct ra_block *blk)
+{
+	while (blk->nr) {
+		put_page(blk->page++);
+		blk->nr--;
+	}
+}
+
 /**
  * page_cache_ra_unbounded - Start unchecked readahead.
  * @ractl: Readahead control.
@@ -178,6 +222,7 @@ void page_cache_ra_unbounded(struct readahead_control *ractl,
 	unsigned long index = readahead_index(ractl);
 	LIST_HEAD(page_pool);
 	gfp_t gfp_mask = readahead_gfp_mask(mapping);
+	struct ra_block blk = { };
 	unsigned long i;
 
 	/*
@@ -213,7 +258,7 @@ void page_cache_ra_unbounded(struct readahead_control *ractl,
 			continue;
 		}
 
-		page = __page_cache_alloc(gfp_mask);
+		page = ra_alloc_page(&blk, gfp_mask, nr_to_read - i);
 		if (!page)
 			break;
 		if (mapping->a_ops->readpages) {
@@ -236,6 +281,7 @@ void page_cache_ra_unbounded(struct readahead_control *ractl,
 	 * will then handle the error.
 	 */
 	read_pages(ractl, &page_pool, false);
+	ra_free_block(&blk);
 	memalloc_nofs_restore(nofs);
 }
 EXPORT_SYMBOL_GPL(page_cache_ra_unbounded);
@@ -224,6 +224,28 @@ static inline int sysfs_slab_alias(struct kmem_cache *s, const char *p)
 							{ return 0; }
 #endif
 
+#ifdef CONFIG_SLUB_SHEAVES
+static void *sheaf_alloc(struct kmem_cache *s);
+static bool sheaf_free(struct kmem_cache *s, struct page *page, void *object,
+		       unsigned long addr);
+static void sheaf_flush_cpu(struct kmem_cache *s, int cpu);
+static bool sheaf_has_objects(struct kmem_cache *s, int cpu);
+
+static inline bool slub_sheaves_enabled(struct kmem_cache *s)
+{
+	return READ_ONCE(s->sheaf_capacity);
+}
+#else
+static inline void *sheaf_alloc(struct kmem_cache *s) { return NULL; }
+static inline bool sheaf_free(struct kmem_cache *s, struct page *page,
+			      void *object, unsigned long addr)
+							{ return false; }
+static inline void sheaf_flush_cpu(struct kmem_cache *s, int cpu) { }
+static inline bool sheaf_has_objects(struct kmem_cache *s, int cpu)
+							{ return false; }
+static inline bool slub_sheaves_enabled(struct kmem_cache *s) { return false; }
+#endif
+
 static inline void stat(const struct kmem_cache *s, enum stat_item si)
 {
 #ifdef CONFIG_SLUB_STATS
@@ -2438,6 +2460,9 @@ static inline void __flush_cpu_slab(struct kmem_cache *s, int cpu)
 {
 	struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
 
+	/* The sheaf goes first, its objects may land in the cpu slab */
+	sheaf_flush_cpu(s, cpu);
+
 	if (c->page)
 		flush_slab(s, c);
 
@@ -2456,7 +2481,7 @@ static bool has_cpu_slab(int cpu, void *info)
 	struct kmem_cache *s = info;
 	struct kmem_cache_cpu *c = per_cpu_ptr(s->cpu_slab, cpu);
 
-	return c->page || slub_percpu_partial(c);
+	return c->page || slub_percpu_partial(c) || sheaf_has_objects(s, cpu);
 }
 
 static void flush_all(struct kmem_cache *s)
@@ -2816,6 +2841,12 @@ static __always_inline void *slab_alloc_node(struct kmem_cache *s,
 	s = slab_pre_alloc_hook(s, &objcg, 1, gfpflags);
 	if (!s)
 		return NULL;
+
+	if (slub_sheaves_enabled(s) && node == NUMA_NO_NODE) {
+		object = sheaf_alloc(s);
+		if (object)
+			goto out;
+	}
 redo:
 	/*
 	 * Must read kmem_cache cpu data via this cpu ptr. Preemption is
@@ -2883,6 +2914,7 @@ redo:
 		stat(s, ALLOC_FASTPATH);
 	}
 
+out:
 	maybe_wipe_obj_freeptr(s, object);
 
 	if (unlikely(slab_want_init_on_alloc(gfpflags, s)) && object)
@@ -3139,8 +3171,14 @@ static __always_inline void slab_free(struct kmem_cache *s, struct page *page,
 	 * With KASAN enabled slab_free_freelist_hook modifies the freelist
 	 * to remove objects, whose reuse must be delayed.
 	 */
-	if (slab_free_freelist_hook(s, &head, &tail))
-		do_slab_free(s, page, head, tail, cnt, addr);
+	if (!slab_free_freelist_hook(s, &head, &tail))
+		return;
+
+	if (slub_sheaves_enabled(s) && cnt == 1 &&
+	    sheaf_free(s, page, head, addr))
+		return;
+
+	do_slab_free(s, page, head, tail, cnt, addr);
 }
 
 #ifdef CONFIG_KASAN_GENERIC
@@ -3343,6 +3381,219 @@ error:
 }
 EXPORT_SYMBOL(kmem_cache_alloc_bulk);
 
+#ifdef CONFIG_SLUB_SHEAVES
+/*
+ * Sheaves: per cpu arrays of objects in front of the slabs.
+ *
+ * A free that does not hit the cpu slab of the freeing cpu has to go
+ * through __slab_free(), which needs a cmpxchg_double on the slab and may
+ * need the node list_lock. When objects are routinely freed on another cpu
+ * than the one that allocated them that is the common case. A cache with a
+ * sheaf pushes freed objects to the sheaf of the freeing cpu instead, and
+ * allocations on that cpu pop them again. Only a full sheaf goes back to the
+ * slabs, half of it at once, grouped by slab with build_detached_freelist()
+ * so that each slab is only touched once. An empty sheaf is refilled with
+ * a batch from the freelist of the cpu slab.
+ *
+ * The sheaf of a cpu is only accessed with interrupts disabled on that cpu,
+ * or from slub_cpu_dead() once the cpu is gone. Objects from pfmemalloc
+ * slabs never enter a sheaf, and neither do objects of debug caches, which
+ * cannot enable sheaves at all.
+ */
+
+/* Hand the nr oldest objects of the sheaf back to their slabs */
+static void sheaf_flush(struct kmem_cache *s, struct slub_sheaf *sheaf,
+			unsigned int nr, unsigned long addr)
+{
+	size_t size = nr;
+
+	if (!nr)
+		return;
+
+	do {
+		struct detached_freelist df;
+
+		size = build_detached_freelist(s, size, sheaf->objects, &df);
+		if (!df.page)
+			continue;
+
+		do_slab_free(df.s, df.page, df.freelist, df.tail, df.cnt, addr);
+	} while (likely(size));
+
+	sheaf->size -= nr;
+	memmove(sheaf->objects, sheaf->objects + nr,
+		sheaf->size * sizeof(void *));
+	stat(s, SHEAF_FLUSH);
+}
+
+/* Move up to half a sheaf of objects from the cpu slab freelist */
+static unsigned int sheaf_refill(struct kmem_cache *s,
+				 struct slub_sheaf *sheaf, unsigned int capacity)
+{
+	struct kmem_cache_cpu *c = this_cpu_ptr(s->cpu_slab);
+	unsigned int batch = max(capacity / 2, 1U);
+	void *object;
+
+	if (!c->page || !c->freelist || PageSlabPfmemalloc(c->page))
+		return 0;
+
+	while (sheaf->size < batch && (object = c->freelist)) {
+		c->freelist = get_freepointer(s, object);
+		sheaf->objects[sheaf->size++] = object;
+	}
+	c->tid = next_tid(c->tid);
+	stat(s, SHEAF_REFILL);
+
+	return sheaf->size;
+}
+
+static void *sheaf_alloc(struct kmem_cache *s)
+{
+	struct slub_sheaf __percpu *pcp;
+	struct slub_sheaf *sheaf;
+	unsigned int capacity;
+	unsigned long flags;
+	void *object = NULL;
+
+	local_irq_save(flags);
+	pcp = READ_ONCE(s->cpu_sheaf);
+	capacity = READ_ONCE(s->sheaf_capacity);
+	if (unlikely(!pcp || !capacity))
+		goto out;
+
+	sheaf = this_cpu_ptr(pcp);
+	if (sheaf->size || sheaf_refill(s, sheaf, capacity)) {
+		object = sheaf->objects[--sheaf->size];
+		stat(s, SHEAF_ALLOC);
+	}
+out:
+	local_irq_restore(flags);
+	return object;
+}
+
+static bool sheaf_free(struct kmem_cache *s, struct page *page, void *object,
+		       unsigned long addr)
+{
+	struct slub_sheaf __percpu *pcp;
+	struct slub_sheaf *sheaf;
+	unsigned int capacity;
+	unsigned long flags;
+
+	if (unlikely(PageSlabPfmemalloc(page)))
+		return false;
+
+	/* Uncharge now, the object is charged again when it is reused */
+	memcg_slab_free_hook(s, &object, 1);
+
+	local_irq_save(flags);
+	pcp = READ_ONCE(s->cpu_sheaf);
+	capacity = READ_ONCE(s->sheaf_capacity);
+	if (unlikely(!pcp || !capacity)) {
+		local_irq_restore(flags);
+		return false;
+	}
+
+	sheaf = this_cpu_ptr(pcp);
+	if (unlikely(sheaf->size >= capacity))
+		sheaf_flush(s, sheaf, sheaf->size - capacity / 2, addr);
+	sheaf->objects[sheaf->size++] = object;
+	stat(s, SHEAF_FREE);
+	local_irq_restore(flags);
+
+	return true;
+}
+
+/* Called with interrupts disabled, or for a dead cpu */
+static void sheaf_flush_cpu(struct kmem_cache *s, int cpu)
+{
+	struct slub_sheaf __percpu *pcp = READ_ONCE(s->cpu_sheaf);
+	struct slub_sheaf *sheaf;
+
+	if (!pcp)
+		return;
+
+	sheaf = per_cpu_ptr(pcp, cpu);
+	sheaf_flush(s, sheaf, sheaf->size, _RET_IP_);
+}
+
+static bool sheaf_has_objects(struct kmem_cache *s, int cpu)
+{
+	struct slub_sheaf __percpu *pcp = READ_ONCE(s->cpu_sheaf);
+
+	return pcp && per_cpu_ptr(pcp, cpu)->size;
+}
+
+static unsigned int sheaf_default_capacity(struct kmem_cache *s)
+{
+	if (s->size >= PAGE_SIZE)
+		return 8;
+	else if (s->size >= 1024)
+		return 16;
+	else if (s->size >= 256)
+		return 32;
+	else
+		return SLUB_SHEAF_MAX;
+}
+
+/*
+ * Set the sheaf capacity of a cache, allocating the sheaves on first use.
+ * The sheaves stay around until the cache is released so that the alloc
+ * and free paths never see them go away. Once the cache is set up, the
+ * capacity is only changed through kmem_cache_set_sheaf_capacity().
+ */
+static int set_sheaf_capacity(struct kmem_cache *s, unsigned int capacity)
+{
+	struct slub_sheaf __percpu *pcp;
+
+	if (capacity > SLUB_SHEAF_MAX)
+		return -EINVAL;
+	if (capacity && kmem_cache_debug(s))
+		return -EINVAL;
+
+	if (capacity && !s->cpu_sheaf) {
+		pcp = alloc_percpu(struct slub_sheaf);
+		if (!pcp)
+			return -ENOMEM;
+		/* Publish the zeroed sheaves before the capacity */
+		if (cmpxchg(&s->cpu_sheaf, NULL, pcp))
+			free_percpu(pcp);
+	}
+
+	WRITE_ONCE(s->sheaf_capacity, capacity);
+	return 0;
+}
+
+/*
+ * Change the sheaf capacity of a live cache, 0 disables the sheaves.
+ *
+ * Every sheaf is flushed afterwards, even one that looks empty: a free may
+ * have read the old capacity and be about to add its object, and with the
+ * sheaves disabled nothing else would flush that object. The flush runs in
+ * an IPI, so it comes after any such free, which has interrupts disabled.
+ */
+int kmem_cache_set_sheaf_capacity(struct kmem_cache *s, unsigned int capacity)
+{
+	int err;
+
+	err = set_sheaf_capacity(s, capacity);
+	if (err)
+		return err;
+
+	on_each_cpu(flush_cpu_slab, s, 1);
+	return 0;
+}
+EXPORT_SYMBOL(kmem_cache_set_sheaf_capacity);
+
+static void init_kmem_cache_sheaves(struct kmem_cache *s)
+{
+	/* Caches work fine without sheaves, so failing here is not fatal */
+	if ((s->flags & SLAB_SHEAVES) && !kmem_cache_debug(s))
+		set_sheaf_capacity(s, sheaf_default_capacity(s));
+}
+#else
+static inline void init_kmem_cache_sheaves(struct kmem_cache *s) { }
+#endif /* CONFIG_SLUB_SHEAVES */
+
 
 /*
  * Object placement in a slab is made very easy because we always start at
@@ -3563,6 +3814,9 @@ static void free_kmem_cache_nodes(struct kmem_cache *s)
 void __kmem_cache_release(struct kmem_cache *s)
 {
 	cache_random_seq_destroy(s);
+#ifdef CONFIG_SLUB_SHEAVES
+	free_percpu(s->cpu_sheaf);
+#endif
 	free_percpu(s->cpu_slab);
 	free_kmem_cache_nodes(s);
 }
@@ -3830,8 +4084,10 @@ static int kmem_cache_open(struct kmem_cache *s, slab_flags_t flags)
 	if (!init_kmem_cache_nodes(s))
 		goto error;
 
-	if (alloc_kmem_cache_cpus(s))
+	if (alloc_kmem_cache_cpus(s)) {
+		init_kmem_cache_sheaves(s);
 		return 0;
+	}
 
 	free_kmem_cache_nodes(s);
 error:
@@ -5094,6 +5350,31 @@ static ssize_t cpu_partial_store(struct kmem_cache *s, const char *buf,
 }
 SLAB_ATTR(cpu_partial);
 
+#ifdef CONFIG_SLUB_SHEAVES
+static ssize_t sheaf_capacity_show(struct kmem_cache *s, char *buf)
+{
+	return sprintf(buf, "%u\n", READ_ONCE(s->sheaf_capacity));
+}
+
+static ssize_t sheaf_capacity_store(struct kmem_cache *s, const char *buf,
+				    size_t length)
+{
+	unsigned int objects;
+	int err;
+
+	err = kstrtouint(buf, 10, &objects);
+	if (err)
+		return err;
+
+	err = kmem_cache_set_sheaf_capacity(s, objects);
+	if (err)
+		return err;
+
+	return length;
+}
+SLAB_ATTR(sheaf_capacity);
+#endif
+
 static ssize_t ctor_show(struct kmem_cache *s, char *buf)
 {
 	if (!s->ctor)
@@ -5409,6 +5690,10 @@ STAT_ATTR(CPU_PARTIAL_ALLOC, cpu_partial_alloc);
 STAT_ATTR(CPU_PARTIAL_FREE, cpu_partial_free);
 STAT_ATTR(CPU_PARTIAL_NODE, cpu_partial_node);
 STAT_ATTR(CPU_PARTIAL_DRAIN, cpu_partial_drain);
+STAT_ATTR(SHEAF_ALLOC, sheaf_alloc);
+STAT_ATTR(SHEAF_FREE, sheaf_free);
+STAT_ATTR(SHEAF_REFILL, sheaf_refill);
+STAT_ATTR(SHEAF_FLUSH, sheaf_flush);
 #endif	/* CONFIG_SLUB_STATS */
 
 static struct attribute *slab_attrs[] = {
@@ -5418,6 +5703,9 @@ static struct attribute *slab_attrs[] = {
 	&order_attr.attr,
 	&min_partial_attr.attr,
 	&cpu_partial_attr.attr,
+#ifdef CONFIG_SLUB_SHEAVES
+	&sheaf_capacity_attr.attr,
+#endif
 	&objects_attr.attr,
 	&objects_partial_attr.attr,
 	&partial_attr.attr,
@@ -5475,6 +5763,10 @@ static struct attribute *slab_attrs[] = {
 	&cpu_partial_free_attr.attr,
 	&cpu_partial_node_attr.attr,
 	&cpu_partial_drain_attr.attr,
+	&sheaf_alloc_attr.attr,
+	&sheaf_free_attr.attr,
+	&sheaf_refill_attr.attr,
+	&sheaf_flush_attr.attr,
 #endif
 #ifdef CONFIG_FAILSLAB
 	&failslab_attr.attr,
@@ -51,6 +51,8 @@
 #include <linux/printk.h>
 #include <linux/dax.h>
 #include <linux/psi.h>
+#include <linux/pagewalk.h>
+#include <linux/memory_hotplug.h>
 
 #include <asm/tlbflush.h>
 #include <asm/div64.h>
@@ -101,6 +103,9 @@ struct scan_control {
 	/* Can pages be swapped as part of reclaim? */
 	unsigned int may_swap:1;
 
+	/* Proactive reclaim invoked by userspace through memory.reclaim */
+	unsigned int proactive:1;
+
 	/*
 	 * Cgroups are not reclaimed below their configured memory.low,
 	 * unless we threaten to OOM. If any cgroups are skipped due to
@@ -129,6 +134,9 @@ struct scan_control {
 	/* The highest zone to isolate pages for reclaim from */
 	s8 reclaim_idx;
 
+	/* Swappiness of a proactive reclaim, in place of the memcg's */
+	int *proactive_swappiness;
+
 	/* This context's GFP mask */
 	gfp_t gfp_mask;
 
@@ -1867,13 +1875,13 @@ static unsigned noinline_for_stack move_pages_to_lru(struct lruvec *lruvec,
 		lru = page_lru(page);
 
 		nr_pages = thp_nr_pages(page);
-		update_lru_size(lruvec, lru, page_zonenum(page), nr_pages);
-		list_move(&page->lru, &lruvec->lists[lru]);
+		list_del(&page->lru);
+		add_page_to_lru_list(page, lruvec, lru);
 
 		if (put_page_testzero(page)) {
 			__ClearPageLRU(page);
-			__ClearPageActive(page);
 			del_page_from_lru_list(page, lruvec, lru);
+			__ClearPageActive(page);
 
 			if (unlikely(PageCompound(page))) {
 				spin_unlock_irq(&pgdat->lru_lock);
@@ -1883,7 +1891,7 @@ static unsigned noinline_for_stack move_pages_to_lru(struct lruvec *lruvec,
 				list_add(&page->lru, &pages_to_free);
 		} else {
 			nr_moved += nr_pages;
-			if (PageActive(page))
+			if (is_active_lru(lru))
 				workingset_age_nonresident(lruvec, nr_pages);
 		}
 	}
@@ -2216,6 +2224,14 @@ static bool inactive_is_low(struct lruvec *lruvec, enum lru_list inactive_lru)
 	return inactive * inactive_ratio < active;
 }
 
+static int sc_swappiness(struct scan_control *sc, struct mem_cgroup *memcg)
+{
+	if (sc->proactive && sc->proactive_swappiness)
+		return *sc->proactive_swappiness;
+
+	return mem_cgroup_swappiness(memcg);
+}
+
 enum scan_balance {
 	SCAN_EQUAL,
 	SCAN_FRACT,
@@ -2237,13 +2253,28 @@ static void get_scan_count(struct lruvec *lruvec, struct scan_control *sc,
 {
 	struct mem_cgroup *memcg = lruvec_memcg(lruvec);
 	unsigned long anon_cost, file_cost, total_cost;
-	int swappiness = mem_cgroup_swappiness(memcg);
+	int swappiness = sc_swappiness(sc, memcg);
 	u64 fraction[ANON_AND_FILE];
 	u64 denominator = 0;	/* gcc */
 	enum scan_balance scan_balance;
 	unsigned long ap, fp;
 	enum lru_list lru;
 
+	/*
+	 * Proactive reclaim asked for anon pages only. Without swap space
+	 * there is nothing it may reclaim, which must not turn into file
+	 * reclaim.
+	 */
+	if (swappiness == SWAPPINESS_ANON_ONLY) {
+		if (!sc->may_swap || mem_cgroup_get_nr_swap_pages(memcg) <= 0) {
+			for_each_evictable_lru(lru)
+				nr[lru] = 0;
+			return;
+		}
+		scan_balance = SCAN_ANON;
+		goto out;
+	}
+
 	/* If we have no swap space, do not bother scanning anon pages. */
 	if (!sc->may_swap || mem_cgroup_get_nr_swap_pages(memcg) <= 0) {
 		scan_balance = SCAN_FILE;
@@ -2420,6 +2451,837 @@ out:
 	}
 }
 
+#ifdef CONFIG_LRU_GEN
+
+/*
+ * The multi-gen LRU, see the comment above struct lru_gen_struct.
+ *
+ * The aging walks page tables rather than the rmap: it finds the accessed
+ * pages of a process in one pass over its address space, and the pages it
+ * finds are mostly hot, which keeps the number of generations it has to
+ * open small. The eviction then only looks at the oldest generation and
+ * leaves the rmap walks of shrink_page_list() to the pages found there.
+ */
+
+#ifdef CONFIG_LRU_GEN_ENABLED
+DEFINE_STATIC_KEY_TRUE(lru_gen_key);
+#else
+DEFINE_STATIC_KEY_FALSE(lru_gen_key);
+#endif
+
+/* pages moved or isolated per lru_lock hold */
+#define LRU_GEN_BATCH		64
+
+static DEFINE_MUTEX(lru_gen_state_mutex);
+
+void lru_gen_init_lruvec(struct lruvec *lruvec)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int gen, type, zone;
+
+	/* the generation is stored plus one, zero meaning not on the list */
+	BUILD_BUG_ON(MAX_NR_GENS + 1 > BIT(LRU_GEN_WIDTH));
+
+	memset(lrugen, 0, sizeof(*lrugen));
+	lrugen->max_seq = MIN_NR_GENS + 1;
+	lrugen->enabled = lru_gen_enabled();
+
+	for (gen = 0; gen < MAX_NR_GENS; gen++) {
+		lrugen->timestamps[gen] = jiffies;
+		for (type = 0; type < ANON_AND_FILE; type++)
+			for (zone = 0; zone < MAX_NR_ZONES; zone++)
+				INIT_LIST_HEAD(&lrugen->lists[gen][type][zone]);
+	}
+}
+
+static bool lru_gen_lruvec_enabled(struct lruvec *lruvec)
+{
+	return READ_ONCE(lruvec->lrugen.enabled);
+}
+
+static int get_nr_gens(struct lruvec *lruvec, int type)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+
+	return READ_ONCE(lrugen->max_seq) -
+	       READ_ONCE(lrugen->min_seq[type]) + 1;
+}
+
+/* Returns -1 for anon only reclaim without swap space, which has no work */
+static int lru_gen_swappiness(struct lruvec *lruvec, struct scan_control *sc)
+{
+	struct mem_cgroup *memcg = lruvec_memcg(lruvec);
+	int swappiness = sc_swappiness(sc, memcg);
+
+	if (!sc->may_swap || mem_cgroup_get_nr_swap_pages(memcg) <= 0)
+		return swappiness == SWAPPINESS_ANON_ONLY ? -1 : 0;
+
+	return swappiness;
+}
+
+static void lru_gen_set_gen(struct lruvec *lruvec, struct page *page,
+			    int old_gen, int new_gen)
+{
+	set_mask_bits(&page->flags, LRU_GEN_MASK,
+		      (new_gen + 1UL) << LRU_GEN_PGOFF);
+	lru_gen_update_size(lruvec, page, old_gen, new_gen);
+}
+
+/* Retires the oldest generations of @type that are empty */
+static bool try_to_inc_min_seq(struct lruvec *lruvec, int type)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	bool success = false;
+	int gen, zone;
+
+	lockdep_assert_held(&lruvec_pgdat(lruvec)->lru_lock);
+
+	while (get_nr_gens(lruvec, type) > MIN_NR_GENS) {
+		gen = lru_gen_from_seq(lrugen->min_seq[type]);
+		for (zone = 0; zone < MAX_NR_ZONES; zone++) {
+			if (!list_empty(&lrugen->lists[gen][type][zone]))
+				return success;
+		}
+
+		WRITE_ONCE(lrugen->min_seq[type], lrugen->min_seq[type] + 1);
+		success = true;
+	}
+
+	return success;
+}
+
+/*
+ * Folds the oldest generation of @type into the next one, for when pages
+ * can't be evicted, e.g. anon pages without swap. Returns false if the
+ * batch ran out first.
+ */
+static bool inc_min_seq(struct lruvec *lruvec, int type)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int old_gen = lru_gen_from_seq(lrugen->min_seq[type]);
+	int new_gen = lru_gen_from_seq(lrugen->min_seq[type] + 1);
+	int remaining = LRU_GEN_BATCH;
+	int zone;
+
+	lockdep_assert_held(&lruvec_pgdat(lruvec)->lru_lock);
+
+	for (zone = 0; zone < MAX_NR_ZONES; zone++) {
+		struct list_head *head = &lrugen->lists[old_gen][type][zone];
+
+		/* youngest first, so that they end up in order behind the tail */
+		while (!list_empty(head)) {
+			struct page *page = list_first_entry(head, struct page,
+							     lru);
+
+			lru_gen_set_gen(lruvec, page, old_gen, new_gen);
+			list_move_tail(&page->lru,
+				       &lrugen->lists[new_gen][type][zone]);
+
+			if (!--remaining)
+				return false;
+		}
+	}
+
+	WRITE_ONCE(lrugen->min_seq[type], lrugen->min_seq[type] + 1);
+	return true;
+}
+
+/* Opens a new generation, unless someone else already did */
+static bool inc_max_seq(struct lruvec *lruvec, unsigned long max_seq)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int prev, next, type, zone;
+
+	lockdep_assert_held(&lruvec_pgdat(lruvec)->lru_lock);
+
+	if (max_seq != lrugen->max_seq)
+		return false;
+
+	for (type = 0; type < ANON_AND_FILE; type++) {
+		if (get_nr_gens(lruvec, type) != MAX_NR_GENS)
+			continue;
+
+		if (!try_to_inc_min_seq(lruvec, type) &&
+		    !inc_min_seq(lruvec, type))
+			return false;
+	}
+
+	/* the second youngest generation turns inactive */
+	prev = lru_gen_from_seq(max_seq - 1);
+	for (type = 0; type < ANON_AND_FILE; type++) {
+		for (zone = 0; zone < MAX_NR_ZONES; zone++) {
+			enum lru_list lru = type * LRU_FILE;
+			long delta = lrugen->nr_pages[prev][type][zone];
+
+			if (!delta)
+				continue;
+
+			update_lru_size(lruvec, lru, zone, delta);
+			update_lru_size(lruvec, lru + LRU_ACTIVE, zone, -delta);
+		}
+	}
+
+	next = lru_gen_from_seq(max_seq + 1);
+	WRITE_ONCE(lrugen->timestamps[next], jiffies);
+	WRITE_ONCE(lrugen->max_seq, max_seq + 1);
+
+	return true;
+}
+
+struct lru_gen_walk {
+	struct lruvec *lruvec;
+	struct pglist_data *pgdat;
+	struct mem_cgroup *memcg;
+	unsigned long max_seq;
+	/* whether the lru_lock is held, taken on the first young page */
+	bool locked;
+};
+
+/* A cheap filter, the lruvec is checked again under the lru_lock */
+static bool lru_gen_page_in_walk(struct lru_gen_walk *walk, struct page *page)
+{
+	return page_to_nid(page) == walk->pgdat->node_id &&
+	       page_memcg(page) == walk->memcg;
+}
+
+/* Moves a page found accessed into the youngest generation */
+static void lru_gen_promote(struct lru_gen_walk *walk, struct page *page)
+{
+	struct lruvec *lruvec = walk->lruvec;
+	int new_gen = lru_gen_from_seq(walk->max_seq);
+	int old_gen;
+
+	if (!walk->locked) {
+		spin_lock_irq(&walk->pgdat->lru_lock);
+		walk->locked = true;
+	}
+
+	page = compound_head(page);
+	if (!PageLRU(page) ||
+	    mem_cgroup_page_lruvec(page, walk->pgdat) != lruvec)
+		return;
+
+	old_gen = page_lru_gen(page);
+	if (old_gen < 0 || old_gen == new_gen)
+		return;
+
+	lru_gen_set_gen(lruvec, page, old_gen, new_gen);
+	list_move(&page->lru, &lruvec->lrugen.lists[new_gen]
+			[page_is_file_lru(page)][page_zonenum(page)]);
+}
+
+static void lru_gen_walk_unlock(struct lru_gen_walk *walk)
+{
+	if (walk->locked) {
+		spin_unlock_irq(&walk->pgdat->lru_lock);
+		walk->locked = false;
+	}
+}
+
+static int lru_gen_walk_pmd(pmd_t *pmd, unsigned long addr, unsigned long end,
+			    struct mm_walk *args)
+{
+	struct lru_gen_walk *walk = args->private;
+	struct vm_area_struct *vma = args->vma;
+	struct page *page;
+	pte_t *pte, *orig;
+	spinlock_t *ptl;
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	ptl = pmd_trans_huge_lock(pmd, vma);
+	if (ptl) {
+		if (pmd_present(*pmd) && pmd_young(*pmd) &&
+		    !is_huge_zero_pmd(*pmd)) {
+			page = pmd_page(*pmd);
+			if (lru_gen_page_in_walk(walk, page) &&
+			    pmdp_test_and_clear_young(vma, addr, pmd))
+				lru_gen_promote(walk, page);
+		}
+		lru_gen_walk_unlock(walk);
+		spin_unlock(ptl);
+		goto out;
+	}
+#endif
+
+	if (pmd_trans_unstable(pmd))
+		goto out;
+
+	orig = pte = pte_offset_map_lock(args->mm, pmd, addr, &ptl);
+	for (; addr != end; pte++, addr += PAGE_SIZE) {
+		if (!pte_present(*pte) || !pte_young(*pte))
+			continue;
+
+		page = vm_normal_page(vma, addr, *pte);
+		if (!page || !lru_gen_page_in_walk(walk, page))
+			continue;
+
+		if (ptep_test_and_clear_young(vma, addr, pte))
+			lru_gen_promote(walk, page);
+	}
+	lru_gen_walk_unlock(walk);
+	pte_unmap_unlock(orig, ptl);
+out:
+	cond_resched();
+	return 0;
+}
+
+static int lru_gen_walk_test(unsigned long start, unsigned long end,
+			     struct mm_walk *args)
+{
+	/* the pages of these are not on the evictable LRU lists */
+	if (args->vma->vm_flags & (VM_LOCKED | VM_SPECIAL | VM_HUGETLB))
+		return 1;
+
+	return 0;
+}
+
+static const struct mm_walk_ops lru_gen_walk_ops = {
+	.pmd_entry	= lru_gen_walk_pmd,
+	.test_walk	= lru_gen_walk_test,
+};
+
+/* used when the memory controller is compiled out or disabled */
+static struct lru_gen_mm_list lru_gen_mm_list = {
+	.fifo = LIST_HEAD_INIT(lru_gen_mm_list.fifo),
+	.lock = __SPIN_LOCK_UNLOCKED(lru_gen_mm_list.lock),
+};
+
+static struct lru_gen_mm_list *get_mm_list(struct mem_cgroup *memcg)
+{
+#ifdef CONFIG_MEMCG
+	if (memcg)
+		return &memcg->mm_list;
+#endif
+	VM_WARN_ON_ONCE(!mem_cgroup_disabled());
+
+	return &lru_gen_mm_list;
+}
+
+void lru_gen_add_mm(struct mm_struct *mm)
+{
+	struct mem_cgroup *memcg = get_mem_cgroup_from_mm(mm);
+	struct lru_gen_mm_list *mm_list = get_mm_list(memcg);
+
+	VM_WARN_ON_ONCE(!list_empty(&mm->lru_gen.list));
+#ifdef CONFIG_MEMCG
+	VM_WARN_ON_ONCE(mm->lru_gen.memcg);
+	/* the reference is dropped by lru_gen_del_mm() */
+	mm->lru_gen.memcg = memcg;
+#endif
+	spin_lock(&mm_list->lock);
+	list_add_tail(&mm->lru_gen.list, &mm_list->fifo);
+	spin_unlock(&mm_list->lock);
+}
+
+void lru_gen_del_mm(struct mm_struct *mm)
+{
+	struct mem_cgroup *memcg = NULL;
+	struct lru_gen_mm_list *mm_list;
+
+	if (list_empty(&mm->lru_gen.list))
+		return;
+
+#ifdef CONFIG_MEMCG
+	memcg = mm->lru_gen.memcg;
+#endif
+	mm_list = get_mm_list(memcg);
+
+	spin_lock(&mm_list->lock);
+	list_del_init(&mm->lru_gen.list);
+	spin_unlock(&mm_list->lock);
+
+#ifdef CONFIG_MEMCG
+	mem_cgroup_put(mm->lru_gen.memcg);
+	mm->lru_gen.memcg = NULL;
+#endif
+}
+
+#ifdef CONFIG_MEMCG
+/* Called with the owner's task_lock held when the owner or its memcg changes */
+void lru_gen_migrate_mm(struct mm_struct *mm)
+{
+	struct mem_cgroup *memcg;
+	struct task_struct *task = rcu_dereference_protected(mm->owner, true);
+
+	VM_WARN_ON_ONCE(task->mm != mm);
+	lockdep_assert_held(&task->alloc_lock);
+
+	if (mem_cgroup_disabled())
+		return;
+
+	/* not yet added by kernel_clone(), or already deleted by __mmput() */
+	if (list_empty(&mm->lru_gen.list))
+		return;
+
+	rcu_read_lock();
+	memcg = mem_cgroup_from_task(task);
+	rcu_read_unlock();
+	if (memcg == mm->lru_gen.memcg)
+		return;
+
+	lru_gen_del_mm(mm);
+	lru_gen_add_mm(mm);
+}
+#endif
+
+/*
+ * Walks the address spaces of the processes charged to the lruvec's memcg.
+ * Each mm_struct visited is rotated to the tail of the list, so a walk cut
+ * short by a fatal signal resumes where it stopped on the next aging, and
+ * the number of entries visited is bounded by the list length at the start.
+ */
+static void lru_gen_walk_mms(struct lru_gen_walk *walk)
+{
+	struct lru_gen_mm_list *mm_list = get_mm_list(walk->memcg);
+	struct mm_struct *mm;
+	struct list_head *pos;
+	unsigned long nr = 0;
+
+	spin_lock(&mm_list->lock);
+	list_for_each(pos, &mm_list->fifo)
+		nr++;
+	spin_unlock(&mm_list->lock);
+
+	while (nr--) {
+		spin_lock(&mm_list->lock);
+		if (list_empty(&mm_list->fifo)) {
+			spin_unlock(&mm_list->lock);
+			break;
+		}
+		mm = list_first_entry(&mm_list->fifo, struct mm_struct,
+				      lru_gen.list);
+		list_move_tail(&mm->lru_gen.list, &mm_list->fifo);
+		/* __mmput() deletes it under the lock before freeing it */
+		if (!mmget_not_zero(mm))
+			mm = NULL;
+		spin_unlock(&mm_list->lock);
+
+		if (!mm)
+			continue;
+
+		if (mmap_read_trylock(mm)) {
+			walk_page_range(mm, 0, mm->highest_vm_end,
+					&lru_gen_walk_ops, walk);
+			mmap_read_unlock(mm);
+		}
+		mmput_async(mm);
+
+		if (fatal_signal_pending(current))
+			return;
+		cond_resched();
+	}
+}
+
+static void lru_gen_age(struct lruvec *lruvec)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	struct pglist_data *pgdat = lruvec_pgdat(lruvec);
+	struct lru_gen_walk walk = {
+		.lruvec = lruvec,
+		.pgdat = pgdat,
+		.memcg = lruvec_memcg(lruvec),
+	};
+
+	/* one walk per lruvec at a time, the others evict what they can */
+	spin_lock_irq(&pgdat->lru_lock);
+	if (lrugen->aging) {
+		spin_unlock_irq(&pgdat->lru_lock);
+		return;
+	}
+	lrugen->aging = true;
+	walk.max_seq = lrugen->max_seq;
+	spin_unlock_irq(&pgdat->lru_lock);
+
+	lru_gen_walk_mms(&walk);
+
+	spin_lock_irq(&pgdat->lru_lock);
+	while (!inc_max_seq(lruvec, walk.max_seq) &&
+	       walk.max_seq == lrugen->max_seq) {
+		spin_unlock_irq(&pgdat->lru_lock);
+		cond_resched();
+		spin_lock_irq(&pgdat->lru_lock);
+	}
+	lrugen->aging = false;
+	spin_unlock_irq(&pgdat->lru_lock);
+}
+
+static unsigned long lru_gen_isolate(struct lruvec *lruvec,
+				     struct scan_control *sc, int type,
+				     struct list_head *list,
+				     unsigned long *nr_scanned)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int gen = lru_gen_from_seq(lrugen->min_seq[type]);
+	int next = lru_gen_from_seq(lrugen->min_seq[type] + 1);
+	isolate_mode_t mode = sc->may_unmap ? 0 : ISOLATE_UNMAPPED;
+	unsigned long nr_taken = 0, scanned = 0;
+	int zone;
+
+	for (zone = MAX_NR_ZONES - 1; zone >= 0; zone--) {
+		struct list_head *head = &lrugen->lists[gen][type][zone];
+		LIST_HEAD(busy);
+
+		while (!list_empty(head) && scanned < LRU_GEN_BATCH &&
+		       nr_taken < SWAP_CLUSTER_MAX) {
+			struct page *page = lru_to_page(head);
+			int nr_pages = thp_nr_pages(page);
+
+			scanned += nr_pages;
+
+			/*
+			 * Pages in zones this reclaim can't use would keep
+			 * the oldest generation from retiring.
+			 */
+			if (zone > sc->reclaim_idx) {
+				lru_gen_set_gen(lruvec, page, gen, next);
+				list_move_tail(&page->lru,
+					       &lrugen->lists[next][type][zone]);
+				continue;
+			}
+
+			if (__isolate_lru_page(page, mode)) {
+				list_move(&page->lru, &busy);
+				continue;
+			}
+
+			lru_gen_del_page(lruvec, page, true);
+			list_add(&page->lru, list);
+			nr_taken += nr_pages;
+		}
+
+		list_splice(&busy, head);
+	}
+
+	*nr_scanned = scanned;
+	return nr_taken;
+}
+
+/* Evicts from the oldest generation of @type, returns the pages scanned */
+static unsigned long lru_gen_evict(struct lruvec *lruvec,
+				   struct scan_control *sc, int type)
+{
+	struct pglist_data *pgdat = lruvec_pgdat(lruvec);
+	struct mem_cgroup *memcg = lruvec_memcg(lruvec);
+	unsigned long nr_scanned, nr_taken;
+	unsigned int nr_reclaimed;
+	struct reclaim_stat stat;
+	enum vm_event_item item;
+	LIST_HEAD(page_list);
+
+	spin_lock_irq(&pgdat->lru_lock);
+
+	/* the oldest generation of @type may have retired meanwhile */
+	if (get_nr_gens(lruvec, type) <= MIN_NR_GENS) {
+		spin_unlock_irq(&pgdat->lru_lock);
+		return 0;
+	}
+
+	nr_taken = lru_gen_isolate(lruvec, sc, type, &page_list, &nr_scanned);
+	try_to_inc_min_seq(lruvec, type);
+
+	__mod_node_page_state(pgdat, NR_ISOLATED_ANON + type, nr_taken);
+	item = current_is_kswapd() ? PGSCAN_KSWAPD : PGSCAN_DIRECT;
+	if (!cgroup_reclaim(sc))
+		__count_vm_events(item, nr_scanned);
+	__count_memcg_events(memcg, item, nr_scanned);
+	__count_vm_events(PGSCAN_ANON + type, nr_scanned);
+
+	spin_unlock_irq(&pgdat->lru_lock);
+
+	if (!nr_taken)
+		return nr_scanned;
+
+	nr_reclaimed = shrink_page_list(&page_list, pgdat, sc, &stat, false);
+
+	spin_lock_irq(&pgdat->lru_lock);
+
+	move_pages_to_lru(lruvec, &page_list);
+
+	__mod_node_page_state(pgdat, NR_ISOLATED_ANON + type, -nr_taken);
+	item = current_is_kswapd() ? PGSTEAL_KSWAPD : PGSTEAL_DIRECT;
+	if (!cgroup_reclaim(sc))
+		__count_vm_events(item, nr_reclaimed);
+	__count_memcg_events(memcg, item, nr_reclaimed);
+	__count_vm_events(PGSTEAL_ANON + type, nr_reclaimed);
+
+	spin_unlock_irq(&pgdat->lru_lock);
+
+	mem_cgroup_uncharge_list(&page_list);
+	free_unref_page_list(&page_list);
+
+	if (stat.nr_unqueued_dirty == nr_taken)
+		wakeup_flusher_threads(WB_REASON_VMSCAN);
+
+	sc->nr.dirty += stat.nr_dirty;
+	sc->nr.congested += stat.nr_congested;
+	sc->nr.unqueued_dirty += stat.nr_unqueued_dirty;
+	sc->nr.writeback += stat.nr_writeback;
+	sc->nr.immediate += stat.nr_immediate;
+	sc->nr.taken += nr_taken;
+	if (type)
+		sc->nr.file_taken += nr_taken;
+	sc->nr_reclaimed += nr_reclaimed;
+
+	trace_mm_vmscan_lru_shrink_inactive(pgdat->node_id, nr_scanned,
+			nr_reclaimed, &stat, sc->priority, type);
+	return nr_scanned;
+}
+
+/*
+ * Evicts the type whose oldest generation is older; on a tie, file pages
+ * unless swappiness favors anon.
+ */
+static int lru_gen_type_to_evict(struct lruvec *lruvec, int swappiness)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	unsigned long anon_seq = READ_ONCE(lrugen->min_seq[LRU_GEN_ANON]);
+	unsigned long file_seq = READ_ONCE(lrugen->min_seq[LRU_GEN_FILE]);
+
+	if (!swappiness)
+		return LRU_GEN_FILE;
+	if (swappiness >= MAX_SWAPPINESS)
+		return LRU_GEN_ANON;
+	if (anon_seq != file_seq)
+		return anon_seq < file_seq ? LRU_GEN_ANON : LRU_GEN_FILE;
+
+	return swappiness > 100 ? LRU_GEN_ANON : LRU_GEN_FILE;
+}
+
+static unsigned long lru_gen_nr_to_scan(struct lruvec *lruvec,
+					struct scan_control *sc,
+					int swappiness)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	unsigned long size = 0;
+	int gen, type, zone;
+
+	for (type = !swappiness;
+	     type <= (swappiness == SWAPPINESS_ANON_ONLY ? LRU_GEN_ANON :
+							   LRU_GEN_FILE);
+	     type++) {
+		for (gen = 0; gen < MAX_NR_GENS; gen++) {
+			for (zone = 0; zone <= sc->reclaim_idx; zone++)
+				size += max(READ_ONCE(lrugen->nr_pages[gen][type][zone]),
+					    0L);
+		}
+	}
+
+	size >>= sc->priority;
+
+	/* see get_scan_count() */
+	if (!size && !mem_cgroup_online(lruvec_memcg(lruvec)))
+		size = SWAP_CLUSTER_MAX;
+
+	return size;
+}
+
+static void lru_gen_shrink_lruvec(struct lruvec *lruvec,
+				  struct scan_control *sc)
+{
+	int swappiness = lru_gen_swappiness(lruvec, sc);
+	unsigned long nr_to_scan;
+	struct blk_plug plug;
+
+	if (swappiness < 0)
+		return;
+
+	nr_to_scan = lru_gen_nr_to_scan(lruvec, sc, swappiness);
+	lru_add_drain();
+
+	blk_start_plug(&plug);
+
+	while (nr_to_scan) {
+		int type = lru_gen_type_to_evict(lruvec, swappiness);
+		unsigned long scanned;
+
+		/* the pages found accessed need somewhere younger to go */
+		if (get_nr_gens(lruvec, type) <= MIN_NR_GENS)
+			lru_gen_age(lruvec);
+
+		scanned = lru_gen_evict(lruvec, sc, type);
+		if (!scanned && swappiness &&
+		    swappiness != SWAPPINESS_ANON_ONLY)
+			scanned = lru_gen_evict(lruvec, sc, !type);
+		if (!scanned)
+			break;
+
+		nr_to_scan -= min(scanned, nr_to_scan);
+		if (sc->nr_reclaimed >= sc->nr_to_reclaim)
+			break;
+
+		cond_resched();
+	}
+
+	blk_finish_plug(&plug);
+}
+
+/*
+ * Moves the pages of @lruvec between the classic and the multi-gen LRU, a
+ * batch at a time. Returns false if there are more to move.
+ */
+static bool lru_gen_switch_lruvec(struct lruvec *lruvec, bool enable)
+{
+	struct lru_gen_struct *lrugen = &lruvec->lrugen;
+	int remaining = LRU_GEN_BATCH;
+	int gen, type, zone;
+	enum lru_list lru;
+
+	lockdep_assert_held(&lruvec_pgdat(lruvec)->lru_lock);
+
+	/* pages added from now on go to the new lists */
+	lrugen->enabled = enable;
+
+	/* youngest first, so that they end up in order behind the tail */
+	if (enable) {
+		for_each_evictable_lru(lru) {
+			struct list_head *head = &lruvec->lists[lru];
+
+			while (!list_empty(head)) {
+				struct page *page = list_first_entry(head,
+							struct page, lru);
+
+				del_page_from_lru_list(page, lruvec, lru);
+				add_page_to_lru_list_tail(page, lruvec, lru);
+
+				if (!--remaining)
+					return false;
+			}
+		}
+
+		return true;
+	}
+
+	for (gen = 0; gen < MAX_NR_GENS; gen++) {
+		for (type = 0; type < ANON_AND_FILE; type++) {
+			for (zone = 0; zone < MAX_NR_ZONES; zone++) {
+				struct list_head *head =
+					&lrugen->lists[gen][type][zone];
+
+				while (!list_empty(head)) {
+					struct page *page = list_first_entry(
+							head, struct page, lru);
+
+					/* sets PG_active for page_lru() */
+					lru_gen_del_page(lruvec, page, false);
+					add_page_to_lru_list_tail(page, lruvec,
+							page_lru(page));
+
+					if (!--remaining)
+						return false;
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+static void lru_gen_change_state(bool enable)
+{
+	struct mem_cgroup *memcg;
+	int nid;
+
+	mutex_lock(&lru_gen_state_mutex);
+#ifdef CONFIG_MEMCG
+	/* new memcgs read the key in lruvec_init(), under cgroup_mutex */
+	mutex_lock(&cgroup_mutex);
+#endif
+	cpus_read_lock();
+
+	if (enable == lru_gen_enabled())
+		goto unlock;
+
+	/* new lruvecs follow the key, the existing ones are switched below */
+	if (enable)
+		static_branch_enable_cpuslocked(&lru_gen_key);
+	else
+		static_branch_disable_cpuslocked(&lru_gen_key);
+
+	get_online_mems();
+
+	memcg = mem_cgroup_iter(NULL, NULL, NULL);
+	do {
+		for_each_online_node(nid) {
+			struct pglist_data *pgdat = NODE_DATA(nid);
+			struct lruvec *lruvec = mem_cgroup_lruvec(memcg, pgdat);
+
+			spin_lock_irq(&pgdat->lru_lock);
+			while (!lru_gen_switch_lruvec(lruvec, enable)) {
+				spin_unlock_irq(&pgdat->lru_lock);
+				cond_resched();
+				spin_lock_irq(&pgdat->lru_lock);
+			}
+			spin_unlock_irq(&pgdat->lru_lock);
+		}
+
+		cond_resched();
+	} while ((memcg = mem_cgroup_iter(NULL, memcg, NULL)));
+
+	put_online_mems();
+unlock:
+	cpus_read_unlock();
+#ifdef CONFIG_MEMCG
+	mutex_unlock(&cgroup_mutex);
+#endif
+	mutex_unlock(&lru_gen_state_mutex);
+}
+
+#ifdef CONFIG_SYSFS
+static ssize_t enabled_show(struct kobject *kobj, struct kobj_attribute *attr,
+			    char *buf)
+{
+	return sprintf(buf, "%d\n", lru_gen_enabled());
+}
+
+static ssize_t enabled_store(struct kobject *kobj, struct kobj_attribute *attr,
+			     const char *buf, size_t len)
+{
+	bool enable;
+
+	if (kstrtobool(buf, &enable))
+		return -EINVAL;
+
+	lru_gen_change_state(enable);
+
+	return len;
+}
+
+static struct kobj_attribute lru_gen_enabled_attr = __ATTR_RW(enabled);
+
+static struct attribute *lru_gen_attrs[] = {
+	&lru_gen_enabled_attr.attr,
+	NULL
+};
+
+static const struct attribute_group lru_gen_attr_group = {
+	.name = "lru_gen",
+	.attrs = lru_gen_attrs,
+};
+
+static int __init lru_gen_init(void)
+{
+	if (sysfs_create_group(mm_kobj, &lru_gen_attr_group))
+		pr_err("lru_gen: failed to create sysfs group\n");
+
+	return 0;
+}
+late_initcall(lru_gen_init);
+#endif /* CONFIG_SYSFS */
+
+#else /* !CONFIG_LRU_GEN */
+
+static bool lru_gen_lruvec_enabled(struct lruvec *lruvec)
+{
+	return false;
+}
+
+static void lru_gen_shrink_lruvec(struct lruvec *lruvec,
+				  struct scan_control *sc)
+{
+}
+
+#endif /* CONFIG_LRU_GEN */
+
 static void shrink_lruvec(struct lruvec *lruvec, struct scan_control *sc)
 {
 	unsigned long nr[NR_LRU_LISTS];
@@ -2431,6 +3293,11 @@ static void shrink_lruvec(struct lruvec *lruvec, struct scan_control *sc)
 	struct blk_plug plug;
 	bool scan_adjusted;
 
+	if (lru_gen_lruvec_enabled(lruvec)) {
+		lru_gen_shrink_lruvec(lruvec, sc);
+		return;
+	}
+
 	get_scan_count(lruvec, sc, nr);
 
 	/* Record the original scan target for proportional adjustments later */
@@ -2655,9 +3522,10 @@ static void shrink_node_memcgs(pg_data_t *pgdat, struct scan_control *sc)
 			    sc->priority);
 
 		/* Record the group's reclaim efficiency */
-		vmpressure(sc->gfp_mask, memcg, false,
-			   sc->nr_scanned - scanned,
-			   sc->nr_reclaimed - reclaimed);
+		if (!sc->proactive)
+			vmpressure(sc->gfp_mask, memcg, false,
+				   sc->nr_scanned - scanned,
+				   sc->nr_reclaimed - reclaimed);
 
 	} while ((memcg = mem_cgroup_iter(target_memcg, memcg, NULL)));
 }
@@ -2774,9 +3642,10 @@ again:
 	}
 
 	/* Record the subtree's reclaim efficiency */
-	vmpressure(sc->gfp_mask, sc->target_mem_cgroup, true,
-		   sc->nr_scanned - nr_scanned,
-		   sc->nr_reclaimed - nr_reclaimed);
+	if (!sc->proactive)
+		vmpressure(sc->gfp_mask, sc->target_mem_cgroup, true,
+			   sc->nr_scanned - nr_scanned,
+			   sc->nr_reclaimed - nr_reclaimed);
 
 	if (sc->nr_reclaimed - nr_reclaimed)
 		reclaimable = true;
@@ -3316,7 +4185,8 @@ unsigned long mem_cgroup_shrink_node(struct mem_cgroup *memcg,
 unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
 					   unsigned long nr_pages,
 					   gfp_t gfp_mask,
-					   bool may_swap)
+					   unsigned int reclaim_options,
+					   int *swappiness)
 {
 	unsigned long nr_reclaimed;
 	unsigned int noreclaim_flag;
@@ -3329,7 +4199,9 @@ unsigned long try_to_free_mem_cgroup_pages(struct mem_cgroup *memcg,
 		.priority = DEF_PRIORITY,
 		.may_writepage = !laptop_mode,
 		.may_unmap = 1,
-		.may_swap = may_swap,
+		.may_swap = !!(reclaim_options & MEMCG_RECLAIM_MAY_SWAP),
+		.proactive = !!(reclaim_options & MEMCG_RECLAIM_PROACTIVE),
+		.proactive_swappiness = swappiness,
 	};
 	/*
 	 * Traverse the ZONELIST_FALLBACK zonelist of the current node to put
@@ -3358,7 +4230,8 @@ static void age_active_anon(struct pglist_data *pgdat,
 	struct mem_cgroup *memcg;
 	struct lruvec *lruvec;
 
-	if (!total_swap_pages)
+	/* the aging of the multi-gen LRU covers anon pages too */
+	if (!total_swap_pages || lru_gen_enabled())
 		return;
 
 	lruvec = mem_cgroup_lruvec(NULL, pgdat);
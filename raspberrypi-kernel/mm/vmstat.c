@@ -1289,9 +1289,12 @@ const char * const vmstat_text[] = {
 	"compact_stall",
 	"compact_fail",
 	"compact_success",
+	"compact_stall_us",
 	"compact_daemon_wake",
 	"compact_daemon_migrate_scanned",
 	"compact_daemon_free_scanned",
+	"compact_daemon_proactive",
+	"compact_daemon_proactive_deferred",
 #endif
 
 #ifdef CONFIG_HUGETLB_PAGE
@@ -1312,6 +1315,9 @@ const char * const vmstat_text[] = {
 	"thp_fault_fallback_charge",
 	"thp_collapse_alloc",
 	"thp_collapse_alloc_failed",
+	"thp_collapse_cold",
+	"thp_collapse_warm",
+	"thp_collapse_hot",
 	"thp_file_alloc",
 	"thp_file_fallback",
 	"thp_file_fallback_charge",
@@ -1327,6 +1333,8 @@ const char * const vmstat_text[] = {
 	"thp_zero_page_alloc_failed",
 	"thp_swpout",
 	"thp_swpout_fallback",
+	"anon_block_alloc",
+	"anon_block_fallback",
 #endif
 #ifdef CONFIG_MEMORY_BALLOON
 	"balloon_inflate",
@@ -1350,6 +1358,15 @@ const char * const vmstat_text[] = {
 	"swap_ra",
 	"swap_ra_hit",
 #endif
+#ifdef CONFIG_ZSWAP
+	"zswpwb",
+#endif
+#ifdef CONFIG_PER_VMA_LOCK
+	"vma_lock_success",
+	"vma_lock_abort",
+	"vma_lock_retry",
+	"vma_lock_miss",
+#endif
 #endif /* CONFIG_VM_EVENT_COUNTERS || CONFIG_MEMCG */
 };
 #endif /* CONFIG_PROC_FS || CONFIG_SYSFS || CONFIG_NUMA || CONFIG_MEMCG */
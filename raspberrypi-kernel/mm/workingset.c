@@ -214,6 +214,40 @@ static void unpack_shadow(void *shadow, int *memcgidp, pg_data_t **pgdat,
 	*workingsetp = workingset;
 }
 
+#ifdef CONFIG_LRU_GEN
+/*
+ * On the multi-gen LRU, a shadow entry records the oldest generation at
+ * the time of the eviction instead of nonresident_age, and the refault
+ * distance is counted in generations.
+ */
+static bool lru_gen_eviction_seq(struct lruvec *lruvec, bool file,
+				 unsigned long *seq)
+{
+	if (!READ_ONCE(lruvec->lrugen.enabled))
+		return false;
+
+	*seq = READ_ONCE(lruvec->lrugen.min_seq[file]) << bucket_order;
+	return true;
+}
+
+/* Activates pages evicted less than MAX_NR_GENS generations ago */
+static bool lru_gen_refault_recent(unsigned long refault_distance)
+{
+	return refault_distance < ((unsigned long)MAX_NR_GENS << bucket_order);
+}
+#else
+static bool lru_gen_eviction_seq(struct lruvec *lruvec, bool file,
+				 unsigned long *seq)
+{
+	return false;
+}
+
+static bool lru_gen_refault_recent(unsigned long refault_distance)
+{
+	return false;
+}
+#endif
+
 /**
  * workingset_age_nonresident - age non-resident entries as LRU ages
  * @lruvec: the lruvec that was aged
@@ -266,7 +300,8 @@ void *workingset_eviction(struct page *page, struct mem_cgroup *target_memcg)
 	workingset_age_nonresident(lruvec, thp_nr_pages(page));
 	/* XXX: target_memcg can be NULL, go through lruvec */
 	memcgid = mem_cgroup_id(lruvec_memcg(lruvec));
-	eviction = atomic_long_read(&lruvec->nonresident_age);
+	if (!lru_gen_eviction_seq(lruvec, page_is_file_lru(page), &eviction))
+		eviction = atomic_long_read(&lruvec->nonresident_age);
 	return pack_shadow(memcgid, pgdat, eviction, PageWorkingset(page));
 }
 
@@ -292,6 +327,7 @@ void workingset_refault(struct page *page, void *shadow)
 	struct lruvec *lruvec;
 	unsigned long refault;
 	bool workingset;
+	bool lru_gen;
 	int memcgid;
 
 	unpack_shadow(shadow, &memcgid, &pgdat, &eviction, &workingset);
@@ -317,7 +353,9 @@ void workingset_refault(struct page *page, void *shadow)
 	if (!mem_cgroup_disabled() && !eviction_memcg)
 		goto out;
 	eviction_lruvec = mem_cgroup_lruvec(eviction_memcg, pgdat);
-	refault = atomic_long_read(&eviction_lruvec->nonresident_age);
+	lru_gen = lru_gen_eviction_seq(eviction_lruvec, file, &refault);
+	if (!lru_gen)
+		refault = atomic_long_read(&eviction_lruvec->nonresident_age);
 
 	/*
 	 * Calculate the refault distance
@@ -350,6 +388,12 @@ void workingset_refault(struct page *page, void *shadow)
 
 	inc_lruvec_state(lruvec, WORKINGSET_REFAULT_BASE + file);
 
+	if (lru_gen) {
+		if (!lru_gen_refault_recent(refault_distance))
+			goto out;
+		goto activate;
+	}
+
 	/*
 	 * Compare the distance to the existing workingset size. We
 	 * don't activate pages that couldn't stay resident even if
@@ -373,6 +417,7 @@ void workingset_refault(struct page *page, void *shadow)
 	if (refault_distance > workingset_size)
 		goto out;
 
+activate:
 	SetPageActive(page);
 	workingset_age_nonresident(lruvec, thp_nr_pages(page));
 	inc_lruvec_state(lruvec, WORKINGSET_ACTIVATE_BASE + file);
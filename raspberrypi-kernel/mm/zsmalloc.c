@@ -1358,6 +1358,29 @@ size_t zs_huge_class_size(struct zs_pool *pool)
 }
 EXPORT_SYMBOL_GPL(zs_huge_class_size);
 
+/**
+ * zs_lookup_class_index() - Returns the index of the zsmalloc &size_class
+ *                           that holds objects of the given size.
+ * @pool: zsmalloc pool to use
+ * @size: object size
+ *
+ * Objects whose sizes map to the same index take the same amount of memory,
+ * so callers can use it to tell whether shrinking an object saves anything.
+ *
+ * Context: Any context.
+ *
+ * Return: the index of the zsmalloc &size_class for @size.
+ */
+unsigned int zs_lookup_class_index(struct zs_pool *pool, unsigned int size)
+{
+	struct size_class *class;
+
+	class = pool->size_class[get_size_class_index(size + ZS_HANDLE_SIZE)];
+
+	return class->index;
+}
+EXPORT_SYMBOL_GPL(zs_lookup_class_index);
+
 static unsigned long obj_malloc(struct size_class *class,
 				struct zspage *zspage, unsigned long handle)
 {
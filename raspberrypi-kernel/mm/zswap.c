@@ -26,6 +26,9 @@
 #include <linux/crypto.h>
 #include <linux/mempool.h>
 #include <linux/zpool.h>
+#include <linux/list_lru.h>
+#include <linux/memcontrol.h>
+#include <linux/sched/mm.h>
 
 #include <linux/mm_types.h>
 #include <linux/page-flags.h>
@@ -34,6 +37,8 @@
 #include <linux/pagemap.h>
 #include <linux/workqueue.h>
 
+#include "internal.h"
+
 /*********************************
 * statistics
 **********************************/
@@ -53,9 +58,9 @@ static atomic_t zswap_same_filled_pages = ATOMIC_INIT(0);
 
 /* Pool limit was hit (see zswap_max_pool_percent) */
 static u64 zswap_pool_limit_hit;
-/* Pages written back when pool limit was reached */
+/* Pages written back when pool limit was reached or by the shrinker */
 static u64 zswap_written_back_pages;
-/* Store failed due to a reclaim failure after pool limit was reached */
+/* Writeback of an entry to the swap device failed */
 static u64 zswap_reject_reclaim_fail;
 /* Compressed page was too big for the allocator to (optimally) store */
 static u64 zswap_reject_compress_poor;
@@ -123,6 +128,10 @@ static bool zswap_same_filled_pages_enabled = true;
 module_param_named(same_filled_pages_enabled, zswap_same_filled_pages_enabled,
 		   bool, 0644);
 
+/* Enable/disable writeback of cold entries from memory reclaim */
+static bool zswap_shrinker_enabled = IS_ENABLED(CONFIG_ZSWAP_SHRINKER_DEFAULT_ON);
+module_param_named(shrinker_enabled, zswap_shrinker_enabled, bool, 0644);
+
 /*********************************
 * data structures
 **********************************/
@@ -135,6 +144,10 @@ struct zswap_pool {
 	struct work_struct release_work;
 	struct work_struct shrink_work;
 	struct hlist_node node;
+	struct list_lru list_lru;
+	struct shrinker shrinker;
+	/* the memcg shrink_worker() takes the next entry from */
+	struct mem_cgroup *next_shrink;
 	char tfm_name[CRYPTO_MAX_ALG_NAME];
 };
 
@@ -145,7 +158,8 @@ struct zswap_pool {
  * page within zswap.
  *
  * rbnode - links the entry into red-black tree for the appropriate swap type
- * offset - the swap offset for the entry.  Index into the red-black tree.
+ * swpentry - the swap entry of the page.  Its offset indexes the red-black
+ *            tree, its type tells writeback which tree to look in.
  * refcount - the number of outstanding reference to the entry. This is needed
  *            to protect against premature freeing of the entry by code
  *            concurrent calls to load, invalidate, and writeback.  The lock
@@ -157,10 +171,13 @@ struct zswap_pool {
  * pool - the zswap_pool the entry's data is in
  * handle - zpool allocation handle that stores the compressed page data
  * value - value of the same-value filled pages which have same content
+ * lru - links the entry into the LRU of its pool, on the list of the memcg
+ *       the entry is charged to.  Same-value filled entries hold no pool
+ *       memory and are never on an LRU.
  */
 struct zswap_entry {
 	struct rb_node rbnode;
-	pgoff_t offset;
+	swp_entry_t swpentry;
 	int refcount;
 	unsigned int length;
 	struct zswap_pool *pool;
@@ -168,16 +185,15 @@ struct zswap_entry {
 		unsigned long handle;
 		unsigned long value;
 	};
-};
-
-struct zswap_header {
-	swp_entry_t swpentry;
+	struct list_head lru;
 };
 
 /*
  * The tree lock in the zswap_tree struct protects a few things:
  * - the rbtree
  * - the refcount field of each entry in the tree
+ *
+ * It nests outside of the pool LRU locks.
  */
 struct zswap_tree {
 	struct rb_root rbroot;
@@ -210,13 +226,15 @@ static bool zswap_has_pool;
 	pr_debug("%s pool %s/%s\n", msg, (p)->tfm_name,		\
 		 zpool_get_type((p)->zpool))
 
-static int zswap_writeback_entry(struct zpool *pool, unsigned long handle);
 static int zswap_pool_get(struct zswap_pool *pool);
 static void zswap_pool_put(struct zswap_pool *pool);
-
-static const struct zpool_ops zswap_zpool_ops = {
-	.evict = zswap_writeback_entry
-};
+static enum lru_status zswap_lru_isolate(struct list_head *item,
+					 struct list_lru_one *l,
+					 spinlock_t *lock, void *arg);
+static unsigned long zswap_shrinker_count(struct shrinker *shrinker,
+					  struct shrink_control *sc);
+static unsigned long zswap_shrinker_scan(struct shrinker *shrinker,
+					 struct shrink_control *sc);
 
 static bool zswap_is_full(void)
 {
@@ -253,7 +271,8 @@ static struct kmem_cache *zswap_entry_cache;
 
 static int __init zswap_entry_cache_create(void)
 {
-	zswap_entry_cache = KMEM_CACHE(zswap_entry, 0);
+	/* charged so that list_lru files each entry under its memcg */
+	zswap_entry_cache = KMEM_CACHE(zswap_entry, SLAB_ACCOUNT);
 	return zswap_entry_cache == NULL;
 }
 
@@ -270,6 +289,7 @@ static struct zswap_entry *zswap_entry_cache_alloc(gfp_t gfp)
 		return NULL;
 	entry->refcount = 1;
 	RB_CLEAR_NODE(&entry->rbnode);
+	INIT_LIST_HEAD(&entry->lru);
 	return entry;
 }
 
@@ -288,9 +308,9 @@ static struct zswap_entry *zswap_rb_search(struct rb_root *root, pgoff_t offset)
 
 	while (node) {
 		entry = rb_entry(node, struct zswap_entry, rbnode);
-		if (entry->offset > offset)
+		if (swp_offset(entry->swpentry) > offset)
 			node = node->rb_left;
-		else if (entry->offset < offset)
+		else if (swp_offset(entry->swpentry) < offset)
 			node = node->rb_right;
 		else
 			return entry;
@@ -307,13 +327,14 @@ static int zswap_rb_insert(struct rb_root *root, struct zswap_entry *entry,
 {
 	struct rb_node **link = &root->rb_node, *parent = NULL;
 	struct zswap_entry *myentry;
+	pgoff_t offset = swp_offset(entry->swpentry);
 
 	while (*link) {
 		parent = *link;
 		myentry = rb_entry(parent, struct zswap_entry, rbnode);
-		if (myentry->offset > entry->offset)
+		if (swp_offset(myentry->swpentry) > offset)
 			link = &(*link)->rb_left;
-		else if (myentry->offset < entry->offset)
+		else if (swp_offset(myentry->swpentry) < offset)
 			link = &(*link)->rb_right;
 		else {
 			*dupentry = myentry;
@@ -342,6 +363,7 @@ static void zswap_free_entry(struct zswap_entry *entry)
 	if (!entry->length)
 		atomic_dec(&zswap_same_filled_pages);
 	else {
+		list_lru_del(&entry->pool->list_lru, &entry->lru);
 		zpool_free(entry->pool->zpool, entry->handle);
 		zswap_pool_put(entry->pool);
 	}
@@ -518,13 +540,49 @@ static struct zswap_pool *zswap_pool_find_get(char *type, char *compressor)
 	return NULL;
 }
 
+/*
+ * Writes back the coldest entries of the pool until it drops below the
+ * accept threshold again, giving up once the LRU runs dry or writeback
+ * keeps failing.  Each step takes one entry per node from the next memcg
+ * in turn, so that the pool limit isn't enforced on the first memcg of
+ * the LRU alone; the NULL step of the iteration covers the entries not
+ * charged to any memcg.
+ */
 static void shrink_worker(struct work_struct *w)
 {
 	struct zswap_pool *pool = container_of(w, typeof(*pool),
 						shrink_work);
+	unsigned long nr_written = 0;
+	struct mem_cgroup *memcg;
+	int failures = 0;
+	int nid;
 
-	if (zpool_shrink(pool->zpool, 1, NULL))
-		zswap_reject_reclaim_fail++;
+	do {
+		if (!list_lru_count(&pool->list_lru))
+			break;
+
+		memcg = mem_cgroup_iter(NULL, pool->next_shrink, NULL);
+		pool->next_shrink = memcg;
+
+		/* the entries of an offline memcg went to its parent */
+		if (!memcg || mem_cgroup_online(memcg)) {
+			for_each_node_state(nid, N_NORMAL_MEMORY) {
+				unsigned long nr_to_walk = 1;
+
+				list_lru_walk_one(&pool->list_lru, nid, memcg,
+						  zswap_lru_isolate,
+						  &nr_written, &nr_to_walk);
+			}
+		}
+
+		/* count failures per round over all the memcgs */
+		if (!memcg) {
+			if (!nr_written && ++failures == MAX_RECLAIM_RETRIES)
+				break;
+			nr_written = 0;
+		}
+		cond_resched();
+	} while (!zswap_can_accept());
 	zswap_pool_put(pool);
 }
 
@@ -553,7 +611,8 @@ static struct zswap_pool *zswap_pool_create(char *type, char *compressor)
 	/* unique name for each pool specifically required by zsmalloc */
 	snprintf(name, 38, "zswap%x", atomic_inc_return(&zswap_pools_count));
 
-	pool->zpool = zpool_create_pool(type, name, gfp, &zswap_zpool_ops);
+	/* zswap keeps its own LRU, the zpool doesn't need to evict */
+	pool->zpool = zpool_create_pool(type, name, gfp, NULL);
 	if (!pool->zpool) {
 		pr_err("%s zpool not available\n", type);
 		goto error;
@@ -567,10 +626,20 @@ static struct zswap_pool *zswap_pool_create(char *type, char *compressor)
 		goto error;
 	}
 
+	pool->shrinker.count_objects = zswap_shrinker_count;
+	pool->shrinker.scan_objects = zswap_shrinker_scan;
+	pool->shrinker.seeks = DEFAULT_SEEKS;
+	pool->shrinker.flags = SHRINKER_NUMA_AWARE | SHRINKER_MEMCG_AWARE;
+	if (prealloc_shrinker(&pool->shrinker))
+		goto error;
+
+	if (list_lru_init_memcg(&pool->list_lru, &pool->shrinker))
+		goto lru_fail;
+
 	ret = cpuhp_state_add_instance(CPUHP_MM_ZSWP_POOL_PREPARE,
 				       &pool->node);
 	if (ret)
-		goto error;
+		goto hp_fail;
 	pr_debug("using %s compressor\n", pool->tfm_name);
 
 	/* being the current pool takes 1 ref; this func expects the
@@ -579,11 +648,16 @@ static struct zswap_pool *zswap_pool_create(char *type, char *compressor)
 	kref_init(&pool->kref);
 	INIT_LIST_HEAD(&pool->list);
 	INIT_WORK(&pool->shrink_work, shrink_worker);
+	register_shrinker_prepared(&pool->shrinker);
 
 	zswap_pool_debug("created", pool);
 
 	return pool;
 
+hp_fail:
+	list_lru_destroy(&pool->list_lru);
+lru_fail:
+	free_prealloced_shrinker(&pool->shrinker);
 error:
 	free_percpu(pool->tfm);
 	if (pool->zpool)
@@ -651,6 +725,9 @@ static void zswap_pool_destroy(struct zswap_pool *pool)
 {
 	zswap_pool_debug("destroying", pool);
 
+	unregister_shrinker(&pool->shrinker);
+	mem_cgroup_iter_break(NULL, pool->next_shrink);
+	list_lru_destroy(&pool->list_lru);
 	cpuhp_state_remove_instance(CPUHP_MM_ZSWP_POOL_PREPARE, &pool->node);
 	free_percpu(pool->tfm);
 	zpool_destroy_pool(pool->zpool);
@@ -872,6 +949,18 @@ static int zswap_get_swap_cache_page(swp_entry_t entry,
 	return ZSWAP_SWAPCACHE_EXIST;
 }
 
+/* accounts a writeback to the memcg the entry is charged to */
+static void zswap_count_memcg_writeback(struct zswap_entry *entry)
+{
+	struct mem_cgroup *memcg;
+
+	rcu_read_lock();
+	memcg = mem_cgroup_from_obj(entry);
+	if (memcg)
+		count_memcg_events(memcg, ZSWPWB, 1);
+	rcu_read_unlock();
+}
+
 /*
  * Attempts to free an entry by adding a page to the swap cache,
  * decompressing the entry data into the page, and issuing a
@@ -883,14 +972,19 @@ static int zswap_get_swap_cache_page(swp_entry_t entry,
  * in the first place.  After the page has been decompressed into
  * the swap cache, the compressed version stored by zswap can be
  * freed.
+ *
+ * The caller holds no reference on the entry, which may have been
+ * invalidated and freed already.  Allocating the swap cache page first
+ * pins the swap device: swapoff can't free the tree before it has swapped
+ * in every page, which needs the lock of this one.  Only then is the entry
+ * looked up in the tree and compared against @entry.
  */
-static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
+static int zswap_writeback_entry(struct zswap_entry *entry,
+				 swp_entry_t swpentry)
 {
-	struct zswap_header *zhdr;
-	swp_entry_t swpentry;
+	pgoff_t offset = swp_offset(swpentry);
 	struct zswap_tree *tree;
-	pgoff_t offset;
-	struct zswap_entry *entry;
+	struct zpool *pool;
 	struct page *page;
 	struct crypto_comp *tfm;
 	u8 *src, *dst;
@@ -900,52 +994,48 @@ static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
 		.sync_mode = WB_SYNC_NONE,
 	};
 
-	/* extract swpentry from data */
-	zhdr = zpool_map_handle(pool, handle, ZPOOL_MM_RO);
-	swpentry = zhdr->swpentry; /* here */
-	tree = zswap_trees[swp_type(swpentry)];
-	offset = swp_offset(swpentry);
-
-	/* find and ref zswap entry */
-	spin_lock(&tree->lock);
-	entry = zswap_entry_find_get(&tree->rbroot, offset);
-	if (!entry) {
-		/* entry was invalidated */
-		spin_unlock(&tree->lock);
-		zpool_unmap_handle(pool, handle);
-		return 0;
-	}
-	spin_unlock(&tree->lock);
-	BUG_ON(offset != entry->offset);
-
 	/* try to allocate swap cache page */
 	switch (zswap_get_swap_cache_page(swpentry, &page)) {
 	case ZSWAP_SWAPCACHE_FAIL: /* no memory or invalidate happened */
-		ret = -ENOMEM;
-		goto fail;
+		return -ENOMEM;
 
 	case ZSWAP_SWAPCACHE_EXIST:
 		/* page is already in the swap cache, ignore for now */
 		put_page(page);
-		ret = -EEXIST;
-		goto fail;
+		return -EEXIST;
 
 	case ZSWAP_SWAPCACHE_NEW: /* page is locked */
-		/* decompress */
-		dlen = PAGE_SIZE;
-		src = (u8 *)zhdr + sizeof(struct zswap_header);
-		dst = kmap_atomic(page);
-		tfm = *get_cpu_ptr(entry->pool->tfm);
-		ret = crypto_comp_decompress(tfm, src, entry->length,
-					     dst, &dlen);
-		put_cpu_ptr(entry->pool->tfm);
-		kunmap_atomic(dst);
-		BUG_ON(ret);
-		BUG_ON(dlen != PAGE_SIZE);
+		break;
+	}
 
-		/* page is up to date */
-		SetPageUptodate(page);
+	tree = zswap_trees[swp_type(swpentry)];
+	spin_lock(&tree->lock);
+	if (entry != zswap_rb_search(&tree->rbroot, offset)) {
+		/* entry was invalidated */
+		spin_unlock(&tree->lock);
+		delete_from_swap_cache(page);
+		unlock_page(page);
+		put_page(page);
+		return -ENOMEM;
 	}
+	zswap_entry_get(entry);
+	spin_unlock(&tree->lock);
+
+	/* decompress */
+	pool = entry->pool->zpool;
+	dlen = PAGE_SIZE;
+	src = zpool_map_handle(pool, entry->handle, ZPOOL_MM_RO);
+	dst = kmap_atomic(page);
+	tfm = *get_cpu_ptr(entry->pool->tfm);
+	ret = crypto_comp_decompress(tfm, src, entry->length, dst, &dlen);
+	put_cpu_ptr(entry->pool->tfm);
+	kunmap_atomic(dst);
+	zpool_unmap_handle(pool, entry->handle);
+	BUG_ON(ret);
+	BUG_ON(dlen != PAGE_SIZE);
+
+	/* page is up to date */
+	SetPageUptodate(page);
 
 	/* move it to the tail of the inactive list after end_writeback */
 	SetPageReclaim(page);
@@ -953,7 +1043,10 @@ static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
 	/* start writeback */
 	__swap_writepage(page, &wbc, end_swap_bio_write);
 	put_page(page);
+
 	zswap_written_back_pages++;
+	count_vm_event(ZSWPWB);
+	zswap_count_memcg_writeback(entry);
 
 	spin_lock(&tree->lock);
 	/* drop local reference */
@@ -970,23 +1063,67 @@ static int zswap_writeback_entry(struct zpool *pool, unsigned long handle)
 		zswap_entry_put(tree, entry);
 	spin_unlock(&tree->lock);
 
-	goto end;
+	return 0;
+}
 
-	/*
-	* if we get here due to ZSWAP_SWAPCACHE_EXIST
-	* a load may happening concurrently
-	* it is safe and okay to not free the entry
-	* if we free the entry in the following put
-	* it it either okay to return !0
-	*/
-fail:
-	spin_lock(&tree->lock);
-	zswap_entry_put(tree, entry);
-	spin_unlock(&tree->lock);
+/*
+ * list_lru callback that writes back the entry at the cold end of an LRU.
+ * @arg counts the pages written.
+ *
+ * The entry is only known to be alive while the LRU lock is held, since
+ * zswap_free_entry() takes it to delete the entry from the LRU.  So copy
+ * the swap entry before dropping the lock and leave the entry on the LRU,
+ * rotated to the hot end: one that can't be written back, e.g. because
+ * its page is being swapped in, stays there, and one that is freed is
+ * taken off by zswap_free_entry().
+ */
+static enum lru_status zswap_lru_isolate(struct list_head *item,
+					 struct list_lru_one *l,
+					 spinlock_t *lock, void *arg)
+{
+	struct zswap_entry *entry = container_of(item, struct zswap_entry, lru);
+	swp_entry_t swpentry = entry->swpentry;
+	unsigned long *nr_written = arg;
 
-end:
-	zpool_unmap_handle(pool, handle);
-	return ret;
+	list_move_tail(item, &l->list);
+	spin_unlock(lock);
+
+	if (zswap_writeback_entry(entry, swpentry))
+		zswap_reject_reclaim_fail++;
+	else
+		(*nr_written)++;
+
+	spin_lock(lock);
+	return LRU_RETRY;
+}
+
+static unsigned long zswap_shrinker_count(struct shrinker *shrinker,
+					  struct shrink_control *sc)
+{
+	struct zswap_pool *pool = container_of(shrinker, typeof(*pool),
+					       shrinker);
+
+	/* writeback needs to allocate swap cache pages and issue IO */
+	if (!zswap_shrinker_enabled || !(sc->gfp_mask & __GFP_IO))
+		return 0;
+
+	return list_lru_shrink_count(&pool->list_lru, sc);
+}
+
+static unsigned long zswap_shrinker_scan(struct shrinker *shrinker,
+					 struct shrink_control *sc)
+{
+	struct zswap_pool *pool = container_of(shrinker, typeof(*pool),
+					       shrinker);
+	unsigned long nr_written = 0;
+
+	if (!zswap_shrinker_enabled || !(sc->gfp_mask & __GFP_IO))
+		return SHRINK_STOP;
+
+	list_lru_shrink_walk(&pool->list_lru, sc, zswap_lru_isolate,
+			     &nr_written);
+
+	return nr_written;
 }
 
 static int zswap_is_page_same_filled(void *ptr, unsigned long *value)
@@ -1020,13 +1157,13 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 {
 	struct zswap_tree *tree = zswap_trees[type];
 	struct zswap_entry *entry, *dupentry;
+	struct mem_cgroup *old_memcg;
 	struct crypto_comp *tfm;
 	int ret;
-	unsigned int hlen, dlen = PAGE_SIZE;
+	unsigned int dlen = PAGE_SIZE;
 	unsigned long handle, value;
 	char *buf;
 	u8 *src, *dst;
-	struct zswap_header zhdr = { .swpentry = swp_entry(type, offset) };
 	gfp_t gfp;
 
 	/* THP isn't supported */
@@ -1061,8 +1198,10 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 			zswap_pool_reached_full = false;
 	}
 
-	/* allocate entry */
+	/* allocate entry, charged to the memcg that owns the page */
+	old_memcg = set_active_memcg(page_memcg(page));
 	entry = zswap_entry_cache_alloc(GFP_KERNEL);
+	set_active_memcg(old_memcg);
 	if (!entry) {
 		zswap_reject_kmemcache_fail++;
 		ret = -ENOMEM;
@@ -1073,7 +1212,7 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 		src = kmap_atomic(page);
 		if (zswap_is_page_same_filled(src, &value)) {
 			kunmap_atomic(src);
-			entry->offset = offset;
+			entry->swpentry = swp_entry(type, offset);
 			entry->length = 0;
 			entry->value = value;
 			atomic_inc(&zswap_same_filled_pages);
@@ -1102,11 +1241,10 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 	}
 
 	/* store */
-	hlen = zpool_evictable(entry->pool->zpool) ? sizeof(zhdr) : 0;
 	gfp = __GFP_NORETRY | __GFP_NOWARN | __GFP_KSWAPD_RECLAIM;
 	if (zpool_malloc_support_movable(entry->pool->zpool))
 		gfp |= __GFP_HIGHMEM | __GFP_MOVABLE;
-	ret = zpool_malloc(entry->pool->zpool, hlen + dlen, gfp, &handle);
+	ret = zpool_malloc(entry->pool->zpool, dlen, gfp, &handle);
 	if (ret == -ENOSPC) {
 		zswap_reject_compress_poor++;
 		goto put_dstmem;
@@ -1116,13 +1254,12 @@ static int zswap_frontswap_store(unsigned type, pgoff_t offset,
 		goto put_dstmem;
 	}
 	buf = zpool_map_handle(entry->pool->zpool, handle, ZPOOL_MM_RW);
-	memcpy(buf, &zhdr, hlen);
-	memcpy(buf + hlen, dst, dlen);
+	memcpy(buf, dst, dlen);
 	zpool_unmap_handle(entry->pool->zpool, handle);
 	put_cpu_var(zswap_dstmem);
 
 	/* populate entry */
-	entry->offset = offset;
+	entry->swpentry = swp_entry(type, offset);
 	entry->handle = handle;
 	entry->length = dlen;
 
@@ -1138,6 +1275,8 @@ insert_entry:
 			zswap_entry_put(tree, dupentry);
 		}
 	} while (ret == -EEXIST);
+	if (entry->length)
+		list_lru_add(&entry->pool->list_lru, &entry->lru);
 	spin_unlock(&tree->lock);
 
 	/* update stats */
@@ -1177,6 +1316,9 @@ static int zswap_frontswap_load(unsigned type, pgoff_t offset,
 		spin_unlock(&tree->lock);
 		return -1;
 	}
+	/* rotate to the hot end, unless writeback has isolated it */
+	if (entry->length && list_lru_del(&entry->pool->list_lru, &entry->lru))
+		list_lru_add(&entry->pool->list_lru, &entry->lru);
 	spin_unlock(&tree->lock);
 
 	if (!entry->length) {
@@ -1189,8 +1331,6 @@ static int zswap_frontswap_load(unsigned type, pgoff_t offset,
 	/* decompress */
 	dlen = PAGE_SIZE;
 	src = zpool_map_handle(entry->pool->zpool, entry->handle, ZPOOL_MM_RO);
-	if (zpool_evictable(entry->pool->zpool))
-		src += sizeof(struct zswap_header);
 	dst = kmap_atomic(page);
 	tfm = *get_cpu_ptr(entry->pool->tfm);
 	ret = crypto_comp_decompress(tfm, src, entry->length, dst, &dlen);
@@ -384,7 +384,10 @@ struct perf_event_attr {
 				aux_output     :  1, /* generate AUX records instead of events */
 				cgroup         :  1, /* include cgroup events */
 				text_poke      :  1, /* include text poke events */
-				__reserved_1   : 30;
+				adaptive_wakeup:  1, /* tune the wakeup watermark to the reader */
+				overflow_reduce:  1, /* subsample instead of losing records */
+				aggregate      :  1, /* count stacks instead of sampling */
+				__reserved_1   : 27;
 
 	union {
 		__u32		wakeup_events;	  /* wakeup every n events */
@@ -433,7 +436,7 @@ struct perf_event_attr {
 	 */
 	__u32	aux_watermark;
 	__u16	sample_max_stack;
-	__u16	__reserved_2;
+	__u16	aggregate_ms;		/* aggregate flush interval */
 	__u32	aux_sample_size;
 	__u32	__reserved_3;
 };
@@ -536,7 +539,8 @@ struct perf_event_mmap_page {
 				cap_user_time		: 1, /* The time_{shift,mult,offset} fields are used */
 				cap_user_time_zero	: 1, /* The time_zero field is used */
 				cap_user_time_short	: 1, /* the time_{cycle,mask} fields are used */
-				cap_____res		: 58;
+				cap_user_rb_stats	: 1, /* The buffer statistics below are maintained */
+				cap_____res		: 57;
 		};
 	};
 
@@ -613,11 +617,29 @@ struct perf_event_mmap_page {
 	__u64	time_cycles;
 	__u64	time_mask;
 
+	/*
+	 * If cap_user_rb_stats, the kernel keeps running totals for the
+	 * data buffer here:
+	 *
+	 *   lost_records:     records dropped because the buffer was full
+	 *   throttled:        times the events were throttled for too many
+	 *                     interrupts
+	 *   rate_reduced:     samples skipped by attr::overflow_reduce
+	 *   wakeup_watermark: current wakeup watermark in bytes, as tuned by
+	 *                     attr::adaptive_wakeup
+	 *
+	 * They are only ever written by the kernel and never reset.
+	 */
+	__u64	lost_records;
+	__u64	throttled;
+	__u64	rate_reduced;
+	__u64	wakeup_watermark;
+
 		/*
 		 * Hole for extension of the self monitor capabilities
 		 */
 
-	__u8	__reserved[116*8];	/* align to 1k. */
+	__u8	__reserved[112*8];	/* align to 1k. */
 
 	/*
 	 * Control data for the mmap() data buffer.
@@ -1060,6 +1082,26 @@ enum perf_event_type {
 	 */
 	PERF_RECORD_TEXT_POKE			= 20,
 
+	/*
+	 * With attr::aggregate, samples are not written out but counted per
+	 * task and callchain, and the counts are written every aggregate_ms
+	 * milliseconds (1000 if 0) and when the event is disabled or closed.
+	 * 'count' is the number of samples since the last record for the
+	 * same task and callchain, 'period' the sum of their periods. 'ips'
+	 * is laid out like PERF_SAMPLE_CALLCHAIN.
+	 *
+	 * struct {
+	 *	struct perf_event_header	header;
+	 *	u32				pid, tid;
+	 *	u64				count;
+	 *	u64				period;
+	 *	u64				nr;
+	 *	u64				ips[nr];
+	 *	struct sample_id		sample_id;
+	 * };
+	 */
+	PERF_RECORD_STACK_COUNT			= 21,
+
 	PERF_RECORD_MAX,			/* non-ABI */
 };
 
@@ -501,6 +501,28 @@ static int record__parse_comp_level(const struct option *opt, const char *str, i
 #endif
 static unsigned int comp_level_max = 22;
 
+static int record__parse_aggr_stacks(const struct option *opt, const char *str, int unset)
+{
+	struct record_opts *opts = opt->value;
+
+	opts->aggr_stacks = !unset;
+	if (unset)
+		return 0;
+
+	if (str)
+		opts->aggr_stacks_ms = strtoul(str, NULL, 0);
+	if (opts->aggr_stacks_ms > UINT16_MAX) {
+		pr_err("--aggr-stacks interval is limited to %u ms\n", UINT16_MAX);
+		return -1;
+	}
+
+	/* the kernel aggregates callchains, so record them like -g does */
+	callchain_param.enabled = true;
+	if (callchain_param.record_mode == CALLCHAIN_NONE)
+		callchain_param.record_mode = CALLCHAIN_FP;
+	return 0;
+}
+
 static int record__comp_enabled(struct record *rec)
 {
 	return rec->opts.comp_level > 0;
@@ -2582,6 +2604,9 @@ static struct option __record_options[] = {
 			    "n", "Compressed records using specified level (default: 1 - fastest compression, 22 - greatest compression)",
 			    record__parse_comp_level),
 #endif
+	OPT_CALLBACK_OPTARG(0, "aggr-stacks", &record.opts, NULL, "ms",
+			    "Count samples per callchain in the kernel, writing the counts out every <ms> (default: 1000)",
+			    record__parse_aggr_stacks),
 	OPT_CALLBACK(0, "max-size", &record.output_max_size,
 		     "size", "Limit the maximum size of the output file", parse_output_max_size),
 	OPT_UINTEGER(0, "num-thread-synthesize",
@@ -2665,6 +2690,14 @@ int cmd_record(int argc, const char **argv)
 		rec->no_buildid = true;
 	}
 
+	/* the kernel only aggregates events bound to a CPU */
+	if (rec->opts.aggr_stacks && rec->opts.target.per_thread) {
+		ui__error("--aggr-stacks is not available with --per-thread\n");
+		parse_options_usage(record_usage, record_options, "aggr-stacks", 0);
+		err = -EINVAL;
+		goto out_opts;
+	}
+
 	if (rec->opts.record_switch_events &&
 	    !perf_can_record_switch_events()) {
 		ui__error("kernel does not support recording context switch events\n");
@@ -129,6 +129,7 @@ struct perf_script {
 	bool			show_bpf_events;
 	bool			show_cgroup_events;
 	bool			show_text_poke_events;
+	bool			show_stack_count_events;
 	bool			allocated;
 	bool			per_event_dump;
 	bool			stitch_lbr;
@@ -2409,6 +2410,16 @@ static int process_text_poke_events(struct perf_tool *tool,
 			   sample->tid);
 }
 
+static int process_stack_count_events(struct perf_tool *tool,
+				      union perf_event *event,
+				      struct perf_sample *sample,
+				      struct machine *machine)
+{
+	struct perf_record_stack_count *sc = perf_record_stack_count(event);
+
+	return print_event(tool, event, sample, machine, sc->pid, sc->tid);
+}
+
 static void sig_handler(int sig __maybe_unused)
 {
 	session_done = 1;
@@ -2521,6 +2532,8 @@ static int __cmd_script(struct perf_script *script)
 		script->tool.ksymbol   = process_bpf_events;
 		script->tool.text_poke = process_text_poke_events;
 	}
+	if (script->show_stack_count_events)
+		script->tool.stack_count = process_stack_count_events;
 
 	if (perf_script__setup_per_event_dump(script)) {
 		pr_err("Couldn't create the per event dump files\n");
@@ -3559,6 +3572,8 @@ int cmd_script(int argc, const char **argv)
 		    "Show bpf related events (if recorded)"),
 	OPT_BOOLEAN('\0', "show-text-poke-events", &script.show_text_poke_events,
 		    "Show text poke related events (if recorded)"),
+	OPT_BOOLEAN('\0', "show-stack-count-events", &script.show_stack_count_events,
+		    "Show callchains counted in the kernel (if recorded with --aggr-stacks)"),
 	OPT_BOOLEAN('\0', "per-event-dump", &script.per_event_dump,
 		    "Dump trace output to files named by the monitored events"),
 	OPT_BOOLEAN('f', "force", &symbol_conf.force, "don't complain, do it"),
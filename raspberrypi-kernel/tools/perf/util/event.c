@@ -57,6 +57,7 @@ static const char *perf_event__names[] = {
 	[PERF_RECORD_BPF_EVENT]			= "BPF_EVENT",
 	[PERF_RECORD_CGROUP]			= "CGROUP",
 	[PERF_RECORD_TEXT_POKE]			= "TEXT_POKE",
+	[PERF_RECORD_STACK_COUNT]		= "STACK_COUNT",
 	[PERF_RECORD_HEADER_ATTR]		= "ATTR",
 	[PERF_RECORD_HEADER_EVENT_TYPE]		= "EVENT_TYPE",
 	[PERF_RECORD_HEADER_TRACING_DATA]	= "TRACING_DATA",
@@ -468,6 +469,19 @@ size_t perf_event__fprintf_text_poke(union perf_event *event, struct machine *ma
 	return ret;
 }
 
+size_t perf_event__fprintf_stack_count(union perf_event *event, FILE *fp)
+{
+	struct perf_record_stack_count *sc = perf_record_stack_count(event);
+	size_t ret;
+	u64 i;
+
+	ret = fprintf(fp, " %d/%d count %" PRI_lu64 " period %" PRI_lu64 " nr %" PRI_lu64 "\n",
+		      sc->pid, sc->tid, sc->count, sc->period, sc->nr);
+	for (i = 0; i < sc->nr; i++)
+		ret += fprintf(fp, "\t%016" PRI_lx64 "\n", sc->ips[i]);
+	return ret;
+}
+
 size_t perf_event__fprintf(union perf_event *event, struct machine *machine, FILE *fp)
 {
 	size_t ret = fprintf(fp, "PERF_RECORD_%s",
@@ -515,6 +529,9 @@ size_t perf_event__fprintf(union perf_event *event, struct machine *machine, FIL
 	case PERF_RECORD_TEXT_POKE:
 		ret += perf_event__fprintf_text_poke(event, machine, fp);
 		break;
+	case PERF_RECORD_STACK_COUNT:
+		ret += perf_event__fprintf_stack_count(event, fp);
+		break;
 	default:
 		ret += fprintf(fp, "\n");
 	}
@@ -77,6 +77,26 @@ struct sample_read {
 	};
 };
 
+/*
+ * PERF_RECORD_STACK_COUNT, samples counted per callchain by the kernel for
+ * attr.aggregate events. Not part of union perf_event, get it from there
+ * with perf_record_stack_count().
+ */
+struct perf_record_stack_count {
+	struct perf_event_header header;
+	__u32			 pid, tid;
+	__u64			 count;
+	__u64			 period;
+	__u64			 nr;
+	__u64			 ips[];
+};
+
+static inline struct perf_record_stack_count *
+perf_record_stack_count(union perf_event *event)
+{
+	return (struct perf_record_stack_count *)event;
+}
+
 struct ip_callchain {
 	u64 nr;
 	u64 ips[];
@@ -390,6 +410,7 @@ size_t perf_event__fprintf_cgroup(union perf_event *event, FILE *fp);
 size_t perf_event__fprintf_ksymbol(union perf_event *event, FILE *fp);
 size_t perf_event__fprintf_bpf(union perf_event *event, FILE *fp);
 size_t perf_event__fprintf_text_poke(union perf_event *event, struct machine *machine,FILE *fp);
+size_t perf_event__fprintf_stack_count(union perf_event *event, FILE *fp);
 size_t perf_event__fprintf(union perf_event *event, struct machine *machine, FILE *fp);
 
 int kallsyms__get_function_start(const char *kallsyms_filename,
@@ -1193,6 +1193,11 @@ void evsel__config(struct evsel *evsel, struct record_opts *opts,
 	if (opts->record_switch_events)
 		attr->context_switch = track;
 
+	if (opts->aggr_stacks && (attr->sample_type & PERF_SAMPLE_CALLCHAIN)) {
+		attr->aggregate = 1;
+		attr->aggregate_ms = opts->aggr_stacks_ms;
+	}
+
 	if (opts->sample_transaction)
 		evsel__set_sample_bit(evsel, TRANSACTION);
 
@@ -148,6 +148,8 @@ int perf_event_attr__fprintf(FILE *fp, struct perf_event_attr *attr,
 	PRINT_ATTRf(sample_max_stack, p_unsigned);
 	PRINT_ATTRf(aux_sample_size, p_unsigned);
 	PRINT_ATTRf(text_poke, p_unsigned);
+	PRINT_ATTRf(aggregate, p_unsigned);
+	PRINT_ATTRf(aggregate_ms, p_unsigned);
 
 	return ret;
 }
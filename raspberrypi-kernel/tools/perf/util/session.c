@@ -492,6 +492,8 @@ void perf_tool__fill_defaults(struct perf_tool *tool)
 		tool->bpf = perf_event__process_bpf;
 	if (tool->text_poke == NULL)
 		tool->text_poke = perf_event__process_text_poke;
+	if (tool->stack_count == NULL)
+		tool->stack_count = process_event_stub;
 	if (tool->read == NULL)
 		tool->read = process_event_sample_stub;
 	if (tool->throttle == NULL)
@@ -680,6 +682,25 @@ static void perf_event__text_poke_swap(union perf_event *event, bool sample_id_a
 	}
 }
 
+static void perf_event__stack_count_swap(union perf_event *event,
+					 bool sample_id_all)
+{
+	struct perf_record_stack_count *sc = perf_record_stack_count(event);
+	u64 i;
+
+	sc->pid	   = bswap_32(sc->pid);
+	sc->tid	   = bswap_32(sc->tid);
+	sc->count  = bswap_64(sc->count);
+	sc->period = bswap_64(sc->period);
+	sc->nr	   = bswap_64(sc->nr);
+
+	for (i = 0; i < sc->nr; i++)
+		sc->ips[i] = bswap_64(sc->ips[i]);
+
+	if (sample_id_all)
+		swap_sample_id_all(event, &sc->ips[sc->nr]);
+}
+
 static void perf_event__throttle_swap(union perf_event *event,
 				      bool sample_id_all)
 {
@@ -967,6 +988,7 @@ static perf_event__swap_op perf_event__swap_ops[] = {
 	[PERF_RECORD_NAMESPACES]	  = perf_event__namespaces_swap,
 	[PERF_RECORD_CGROUP]		  = perf_event__cgroup_swap,
 	[PERF_RECORD_TEXT_POKE]		  = perf_event__text_poke_swap,
+	[PERF_RECORD_STACK_COUNT]	  = perf_event__stack_count_swap,
 	[PERF_RECORD_HEADER_ATTR]	  = perf_event__hdr_attr_swap,
 	[PERF_RECORD_HEADER_EVENT_TYPE]	  = perf_event__event_type_swap,
 	[PERF_RECORD_HEADER_TRACING_DATA] = perf_event__tracing_data_swap,
@@ -1511,6 +1533,8 @@ static int machines__deliver_event(struct machines *machines,
 		return tool->bpf(tool, event, sample, machine);
 	case PERF_RECORD_TEXT_POKE:
 		return tool->text_poke(tool, event, sample, machine);
+	case PERF_RECORD_STACK_COUNT:
+		return tool->stack_count(tool, event, sample, machine);
 	default:
 		++evlist->stats.nr_unknown_events;
 		return -1;
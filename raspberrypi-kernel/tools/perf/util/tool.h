@@ -58,7 +58,8 @@ struct perf_tool {
 			unthrottle,
 			ksymbol,
 			bpf,
-			text_poke;
+			text_poke,
+			stack_count;
 
 	event_attr_op	attr;
 	event_attr_op	event_update;
@@ -131,9 +131,19 @@ static const struct argp_option opts[] = {
 };
 
 extern struct argp bench_ringbufs_argp;
+extern struct argp bench_htab_argp;
+extern struct argp bench_bloom_filter_argp;
+extern struct argp bench_lpm_trie_argp;
+extern struct argp bench_verifier_argp;
+extern struct argp bench_trampoline_multi_argp;
 
 static const struct argp_child bench_parsers[] = {
 	{ &bench_ringbufs_argp, 0, "Ring buffers benchmark", 0 },
+	{ &bench_htab_argp, 0, "Hash map benchmark", 0 },
+	{ &bench_bloom_filter_argp, 0, "Bloom filter map benchmark", 0 },
+	{ &bench_lpm_trie_argp, 0, "LPM trie benchmark", 0 },
+	{ &bench_verifier_argp, 0, "Verifier load benchmark", 0 },
+	{ &bench_trampoline_multi_argp, 0, "Multi function attach benchmark", 0 },
 	{},
 };
 
@@ -320,8 +330,24 @@ extern const struct bench bench_trig_fentry_sleep;
 extern const struct bench bench_trig_fmodret;
 extern const struct bench bench_rb_libbpf;
 extern const struct bench bench_rb_custom;
+extern const struct bench bench_rb_libbpf_batch;
+extern const struct bench bench_rb_custom_batch;
 extern const struct bench bench_pb_libbpf;
 extern const struct bench bench_pb_custom;
+extern const struct bench bench_htab;
+extern const struct bench bench_stackmap_ips;
+extern const struct bench bench_stackmap_build_id;
+extern const struct bench bench_bloom_lookup;
+extern const struct bench bench_hashmap_lookup;
+extern const struct bench bench_hashmap_with_bloom;
+extern const struct bench bench_lpm_trie_lookup;
+extern const struct bench bench_verifier_load;
+extern const struct bench bench_trampoline_multi;
+extern const struct bench bench_uprobe_base;
+extern const struct bench bench_uprobe_nop;
+extern const struct bench bench_uprobe_push;
+extern const struct bench bench_uprobe_mov;
+extern const struct bench bench_uprobe_xol;
 
 static const struct bench *benchs[] = {
 	&bench_count_global,
@@ -341,8 +367,24 @@ static const struct bench *benchs[] = {
 	&bench_trig_fmodret,
 	&bench_rb_libbpf,
 	&bench_rb_custom,
+	&bench_rb_libbpf_batch,
+	&bench_rb_custom_batch,
 	&bench_pb_libbpf,
 	&bench_pb_custom,
+	&bench_htab,
+	&bench_stackmap_ips,
+	&bench_stackmap_build_id,
+	&bench_bloom_lookup,
+	&bench_hashmap_lookup,
+	&bench_hashmap_with_bloom,
+	&bench_lpm_trie_lookup,
+	&bench_verifier_load,
+	&bench_trampoline_multi,
+	&bench_uprobe_base,
+	&bench_uprobe_nop,
+	&bench_uprobe_push,
+	&bench_uprobe_mov,
+	&bench_uprobe_xol,
 };
 
 static void setup_benchmark()
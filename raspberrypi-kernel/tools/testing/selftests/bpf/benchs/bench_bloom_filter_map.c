@@ -0,0 +1,217 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <argp.h>
+#include <limits.h>
+#include "bench.h"
+#include "bloom_filter_bench.skel.h"
+
+static struct {
+	__u32 nr_entries;
+	__u8 nr_hash_funcs;
+} args = {
+	.nr_entries = 1000,
+	.nr_hash_funcs = 3,
+};
+
+enum {
+	ARG_BLOOM_ENTRIES = 3200,
+	ARG_BLOOM_HASH_FUNCS = 3201,
+};
+
+static const struct argp_option opts[] = {
+	{ "bloom-entries", ARG_BLOOM_ENTRIES, "ENTRIES", 0,
+	  "Number of values inserted in the maps"},
+	{ "bloom-hash-funcs", ARG_BLOOM_HASH_FUNCS, "FUNCS", 0,
+	  "Number of hash functions of the bloom filter (1-15)"},
+	{},
+};
+
+static error_t parse_arg(int key, char *arg, struct argp_state *state)
+{
+	long ret;
+
+	switch (key) {
+	case ARG_BLOOM_ENTRIES:
+		ret = strtol(arg, NULL, 10);
+		if (ret < 1 || ret > UINT_MAX / 2) {
+			fprintf(stderr, "Invalid number of entries.");
+			argp_usage(state);
+		}
+		args.nr_entries = ret;
+		break;
+	case ARG_BLOOM_HASH_FUNCS:
+		ret = strtol(arg, NULL, 10);
+		if (ret < 1 || ret > 15) {
+			fprintf(stderr, "Invalid number of hash functions.");
+			argp_usage(state);
+		}
+		args.nr_hash_funcs = ret;
+		break;
+	default:
+		return ARGP_ERR_UNKNOWN;
+	}
+	return 0;
+}
+
+/* exported into benchmark runner */
+const struct argp bench_bloom_filter_argp = {
+	.options = opts,
+	.parser = parse_arg,
+};
+
+static struct bloom_ctx {
+	struct bloom_filter_bench *skel;
+	long false_hits;
+	long negatives;
+} ctx;
+
+static void bloom_validate(void)
+{
+	if (env.consumer_cnt != 1) {
+		fprintf(stderr, "benchmark doesn't support multi-consumer!\n");
+		exit(1);
+	}
+}
+
+static void setup_ctx(void)
+{
+	int bloom_fd, hash_fd;
+	__u64 val64;
+	__u32 i, val;
+
+	setup_libbpf();
+
+	ctx.skel = bloom_filter_bench__open();
+	if (!ctx.skel) {
+		fprintf(stderr, "failed to open skeleton\n");
+		exit(1);
+	}
+
+	ctx.skel->rodata->nr_entries = args.nr_entries;
+
+	bpf_map__set_max_entries(ctx.skel->maps.bloom_map, args.nr_entries);
+	bpf_map__set_map_extra(ctx.skel->maps.bloom_map, args.nr_hash_funcs);
+	bpf_map__set_max_entries(ctx.skel->maps.hashmap, args.nr_entries);
+
+	if (bloom_filter_bench__load(ctx.skel)) {
+		fprintf(stderr, "failed to load skeleton\n");
+		exit(1);
+	}
+
+	bloom_fd = bpf_map__fd(ctx.skel->maps.bloom_map);
+	hash_fd = bpf_map__fd(ctx.skel->maps.hashmap);
+	for (i = 0; i < args.nr_entries; i++) {
+		val = 2 * i;
+		val64 = val;
+		if (bpf_map_update_elem(bloom_fd, NULL, &val, BPF_ANY) ||
+		    bpf_map_update_elem(hash_fd, &val, &val64, BPF_ANY)) {
+			fprintf(stderr, "failed to populate maps\n");
+			exit(1);
+		}
+	}
+}
+
+static void attach_bpf(struct bpf_program *prog)
+{
+	struct bpf_link *link;
+
+	link = bpf_program__attach(prog);
+	if (IS_ERR(link)) {
+		fprintf(stderr, "failed to attach program!\n");
+		exit(1);
+	}
+}
+
+static void bloom_lookup_setup(void)
+{
+	setup_ctx();
+	attach_bpf(ctx.skel->progs.bloom_lookup);
+}
+
+static void hashmap_lookup_setup(void)
+{
+	setup_ctx();
+	attach_bpf(ctx.skel->progs.hashmap_lookup);
+}
+
+static void hashmap_with_bloom_setup(void)
+{
+	setup_ctx();
+	attach_bpf(ctx.skel->progs.hashmap_with_bloom_lookup);
+}
+
+static void *bloom_producer(void *input)
+{
+	while (true)
+		(void)syscall(__NR_getpgid);
+	return NULL;
+}
+
+static void *bloom_consumer(void *input)
+{
+	return NULL;
+}
+
+static void bloom_measure(struct bench_res *res)
+{
+	res->hits = atomic_swap(&ctx.skel->bss->hits, 0);
+	/* false positives are reported as drops */
+	res->drops = atomic_swap(&ctx.skel->bss->false_hits, 0);
+	ctx.false_hits += res->drops;
+	ctx.negatives += atomic_swap(&ctx.skel->bss->negatives, 0);
+}
+
+static void bloom_report_final(struct bench_res res[], int res_cnt)
+{
+	double hits_mean = 0.0;
+	long tested;
+	int i;
+
+	hits_drops_report_final(res, res_cnt);
+
+	for (i = 0; i < res_cnt; i++)
+		hits_mean += res[i].hits / (0.0 + res_cnt);
+
+	/* includes the getpgid() syscall cost spread over 16 lookups */
+	if (hits_mean > 0)
+		printf("Per lookup: %.1lf ns (per producer)\n",
+		       1000000000.0 * env.producer_cnt / hits_mean);
+
+	/* counted over the whole run, warmup included */
+	tested = ctx.false_hits + ctx.negatives;
+	if (tested)
+		printf("False positive rate: %.3lf%% (%ld of %ld absent values)\n",
+		       100.0 * ctx.false_hits / tested, ctx.false_hits, tested);
+}
+
+const struct bench bench_bloom_lookup = {
+	.name = "bloom-lookup",
+	.validate = bloom_validate,
+	.setup = bloom_lookup_setup,
+	.producer_thread = bloom_producer,
+	.consumer_thread = bloom_consumer,
+	.measure = bloom_measure,
+	.report_progress = hits_drops_report_progress,
+	.report_final = bloom_report_final,
+};
+
+const struct bench bench_hashmap_lookup = {
+	.name = "hashmap-lookup",
+	.validate = bloom_validate,
+	.setup = hashmap_lookup_setup,
+	.producer_thread = bloom_producer,
+	.consumer_thread = bloom_consumer,
+	.measure = bloom_measure,
+	.report_progress = hits_drops_report_progress,
+	.report_final = bloom_report_final,
+};
+
+const struct bench bench_hashmap_with_bloom = {
+	.name = "hashmap-with-bloom",
+	.validate = bloom_validate,
+	.setup = hashmap_with_bloom_setup,
+	.producer_thread = bloom_producer,
+	.consumer_thread = bloom_consumer,
+	.measure = bloom_measure,
+	.report_progress = hits_drops_report_progress,
+	.report_final = bloom_report_final,
+};
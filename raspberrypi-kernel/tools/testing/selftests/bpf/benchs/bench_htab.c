@@ -0,0 +1,161 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <argp.h>
+#include "bench.h"
+#include "htab_bench.skel.h"
+
+/* map operations done per triggering syscall, see progs/htab_bench.c */
+#define HTAB_BENCH_OPS 16
+
+static struct {
+	__u32 nr_keys;
+	__u32 update_pct;
+	bool lockless;
+} args = {
+	.nr_keys = 1024,
+	.update_pct = 10,
+	.lockless = false,
+};
+
+enum {
+	ARG_HTAB_KEYS = 3000,
+	ARG_HTAB_UPDATE_PCT = 3001,
+	ARG_HTAB_LOCKLESS = 3002,
+};
+
+static const struct argp_option opts[] = {
+	{ "htab-keys", ARG_HTAB_KEYS, "KEYS", 0, "Number of distinct keys"},
+	{ "htab-update-pct", ARG_HTAB_UPDATE_PCT, "PCT", 0,
+	  "Percentage of operations that are updates, the rest are lookups"},
+	{ "htab-lockless", ARG_HTAB_LOCKLESS, NULL, 0,
+	  "Create the map with BPF_F_LOCKLESS"},
+	{},
+};
+
+static error_t parse_arg(int key, char *arg, struct argp_state *state)
+{
+	switch (key) {
+	case ARG_HTAB_KEYS:
+		args.nr_keys = strtol(arg, NULL, 10);
+		if (!args.nr_keys) {
+			fprintf(stderr, "Invalid number of keys.");
+			argp_usage(state);
+		}
+		break;
+	case ARG_HTAB_UPDATE_PCT:
+		args.update_pct = strtol(arg, NULL, 10);
+		if (args.update_pct > 100) {
+			fprintf(stderr, "Invalid update percentage.");
+			argp_usage(state);
+		}
+		break;
+	case ARG_HTAB_LOCKLESS:
+		args.lockless = true;
+		break;
+	default:
+		return ARGP_ERR_UNKNOWN;
+	}
+	return 0;
+}
+
+/* exported into benchmark runner */
+const struct argp bench_htab_argp = {
+	.options = opts,
+	.parser = parse_arg,
+};
+
+static struct htab_ctx {
+	struct htab_bench *skel;
+	struct counter *hits;
+} ctx;
+
+static void htab_validate(void)
+{
+	if (env.consumer_cnt != 1) {
+		fprintf(stderr, "benchmark doesn't support multi-consumer!\n");
+		exit(1);
+	}
+}
+
+static void htab_setup(void)
+{
+	struct bpf_link *link;
+	__u64 val;
+	__u32 i;
+	int fd;
+
+	setup_libbpf();
+
+	ctx.hits = calloc(env.producer_cnt, sizeof(*ctx.hits));
+	if (!ctx.hits)
+		exit(1);
+
+	ctx.skel = htab_bench__open();
+	if (!ctx.skel) {
+		fprintf(stderr, "failed to open skeleton\n");
+		exit(1);
+	}
+
+	ctx.skel->rodata->nr_keys = args.nr_keys;
+	ctx.skel->rodata->update_pct = args.update_pct;
+
+	bpf_map__set_max_entries(ctx.skel->maps.htab, args.nr_keys);
+	if (args.lockless)
+		bpf_map__set_map_flags(ctx.skel->maps.htab, BPF_F_LOCKLESS);
+
+	if (htab_bench__load(ctx.skel)) {
+		fprintf(stderr, "failed to load skeleton\n");
+		exit(1);
+	}
+
+	fd = bpf_map__fd(ctx.skel->maps.htab);
+	for (i = 0; i < args.nr_keys; i++) {
+		val = i;
+		if (bpf_map_update_elem(fd, &i, &val, BPF_ANY)) {
+			fprintf(stderr, "failed to populate map\n");
+			exit(1);
+		}
+	}
+
+	link = bpf_program__attach(ctx.skel->progs.bench_htab);
+	if (IS_ERR(link)) {
+		fprintf(stderr, "failed to attach program!\n");
+		exit(1);
+	}
+}
+
+static void *htab_producer(void *input)
+{
+	struct counter *hits = &ctx.hits[(long)input];
+
+	while (true) {
+		(void)syscall(__NR_getpgid);
+		atomic_add(&hits->value, HTAB_BENCH_OPS);
+	}
+	return NULL;
+}
+
+static void *htab_consumer(void *input)
+{
+	return NULL;
+}
+
+static void htab_measure(struct bench_res *res)
+{
+	int i;
+
+	res->hits = 0;
+	for (i = 0; i < env.producer_cnt; i++)
+		res->hits += atomic_swap(&ctx.hits[i].value, 0);
+	res->drops = atomic_swap(&ctx.skel->bss->drops, 0);
+}
+
+const struct bench bench_htab = {
+	.name = "htab",
+	.validate = htab_validate,
+	.setup = htab_setup,
+	.producer_thread = htab_producer,
+	.consumer_thread = htab_consumer,
+	.measure = htab_measure,
+	.report_progress = hits_drops_report_progress,
+	.report_final = hits_drops_report_final,
+};
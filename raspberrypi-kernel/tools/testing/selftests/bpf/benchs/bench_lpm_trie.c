@@ -0,0 +1,178 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <argp.h>
+#include <limits.h>
+#include <unistd.h>
+#include "bench.h"
+#include "lpm_trie_bench.skel.h"
+
+static struct {
+	__u32 nr_prefixes;
+	bool level_compress;
+} args = {
+	.nr_prefixes = 1000000,
+	.level_compress = false,
+};
+
+enum {
+	ARG_LPM_PREFIXES = 3300,
+	ARG_LPM_LEVEL_COMPRESS = 3301,
+};
+
+static const struct argp_option opts[] = {
+	{ "lpm-prefixes", ARG_LPM_PREFIXES, "PREFIXES", 0,
+	  "Number of random IPv6 prefixes inserted in the trie"},
+	{ "lpm-lc", ARG_LPM_LEVEL_COMPRESS, NULL, 0,
+	  "Create the trie with BPF_F_LEVEL_COMPRESS"},
+	{},
+};
+
+static error_t parse_arg(int key, char *arg, struct argp_state *state)
+{
+	long ret;
+
+	switch (key) {
+	case ARG_LPM_PREFIXES:
+		ret = strtol(arg, NULL, 10);
+		if (ret < 1 || ret > UINT_MAX) {
+			fprintf(stderr, "Invalid number of prefixes.");
+			argp_usage(state);
+		}
+		args.nr_prefixes = ret;
+		break;
+	case ARG_LPM_LEVEL_COMPRESS:
+		args.level_compress = true;
+		break;
+	default:
+		return ARGP_ERR_UNKNOWN;
+	}
+	return 0;
+}
+
+/* exported into benchmark runner */
+const struct argp bench_lpm_trie_argp = {
+	.options = opts,
+	.parser = parse_arg,
+};
+
+struct lpm_key {
+	__u32 prefixlen;
+	__u8 data[16];
+};
+
+static struct lpm_ctx {
+	struct lpm_trie_bench *skel;
+	long matches;
+	long lookups;
+} ctx;
+
+static void lpm_validate(void)
+{
+	if (env.consumer_cnt != 1) {
+		fprintf(stderr, "benchmark doesn't support multi-consumer!\n");
+		exit(1);
+	}
+}
+
+static void lpm_setup(void)
+{
+	struct bpf_link *link;
+	struct lpm_key key;
+	__u32 i, j, flags;
+	int map_fd;
+
+	setup_libbpf();
+
+	ctx.skel = lpm_trie_bench__open();
+	if (!ctx.skel) {
+		fprintf(stderr, "failed to open skeleton\n");
+		exit(1);
+	}
+
+	flags = BPF_F_NO_PREALLOC;
+	if (args.level_compress)
+		flags |= BPF_F_LEVEL_COMPRESS;
+	bpf_map__set_map_flags(ctx.skel->maps.lpm_map, flags);
+	bpf_map__set_max_entries(ctx.skel->maps.lpm_map, args.nr_prefixes);
+
+	if (lpm_trie_bench__load(ctx.skel)) {
+		fprintf(stderr, "failed to load skeleton\n");
+		exit(1);
+	}
+
+	/* /32 to /64 prefixes in 2000::/3, roughly the shape of a global
+	 * IPv6 routing table. Duplicates are simply overwritten.
+	 */
+	map_fd = bpf_map__fd(ctx.skel->maps.lpm_map);
+	srandom(1);
+	for (i = 0; i < args.nr_prefixes; i++) {
+		for (j = 0; j < sizeof(key.data); j++)
+			key.data[j] = random();
+		key.data[0] = 0x20 | (key.data[0] & 0x1f);
+		key.prefixlen = 32 + random() % 33;
+		if (bpf_map_update_elem(map_fd, &key, &i, BPF_ANY)) {
+			fprintf(stderr, "failed to populate trie\n");
+			exit(1);
+		}
+	}
+
+	/* let the lookup index be rebuilt after the last update */
+	if (args.level_compress)
+		sleep(1);
+
+	link = bpf_program__attach(ctx.skel->progs.lpm_lookup);
+	if (IS_ERR(link)) {
+		fprintf(stderr, "failed to attach program!\n");
+		exit(1);
+	}
+}
+
+static void *lpm_producer(void *input)
+{
+	while (true)
+		(void)syscall(__NR_getpgid);
+	return NULL;
+}
+
+static void *lpm_consumer(void *input)
+{
+	return NULL;
+}
+
+static void lpm_measure(struct bench_res *res)
+{
+	res->hits = atomic_swap(&ctx.skel->bss->hits, 0);
+	ctx.lookups += res->hits;
+	ctx.matches += atomic_swap(&ctx.skel->bss->matches, 0);
+}
+
+static void lpm_report_final(struct bench_res res[], int res_cnt)
+{
+	double hits_mean = 0.0;
+	int i;
+
+	hits_drops_report_final(res, res_cnt);
+
+	for (i = 0; i < res_cnt; i++)
+		hits_mean += res[i].hits / (0.0 + res_cnt);
+
+	/* includes the getpgid() syscall cost spread over 16 lookups */
+	if (hits_mean > 0)
+		printf("Per lookup: %.1lf ns (per producer)\n",
+		       1000000000.0 * env.producer_cnt / hits_mean);
+
+	/* counted over the whole run, warmup included */
+	if (ctx.lookups)
+		printf("Matched: %.1lf%% of lookups\n",
+		       100.0 * ctx.matches / ctx.lookups);
+}
+
+const struct bench bench_lpm_trie_lookup = {
+	.name = "lpm-trie-lookup",
+	.validate = lpm_validate,
+	.setup = lpm_setup,
+	.producer_thread = lpm_producer,
+	.consumer_thread = lpm_consumer,
+	.measure = lpm_measure,
+	.report_progress = hits_drops_report_progress,
+	.report_final = lpm_report_final,
+};
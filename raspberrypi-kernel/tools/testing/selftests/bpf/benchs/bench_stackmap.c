@@ -0,0 +1,105 @@
+// SPDX-License-Identifier: GPL-2.0
+#include "bench.h"
+#include "stackmap_bench.skel.h"
+
+static struct stackmap_ctx {
+	struct stackmap_bench *skel;
+} ctx;
+
+static void stackmap_validate(void)
+{
+	if (env.consumer_cnt != 1) {
+		fprintf(stderr, "benchmark doesn't support multi-consumer!\n");
+		exit(1);
+	}
+}
+
+static void setup_ctx(void)
+{
+	setup_libbpf();
+
+	ctx.skel = stackmap_bench__open_and_load();
+	if (!ctx.skel) {
+		fprintf(stderr, "failed to open skeleton\n");
+		exit(1);
+	}
+}
+
+static void attach_bpf(struct bpf_program *prog)
+{
+	struct bpf_link *link;
+
+	link = bpf_program__attach(prog);
+	if (IS_ERR(link)) {
+		fprintf(stderr, "failed to attach program!\n");
+		exit(1);
+	}
+}
+
+static void stackmap_ips_setup(void)
+{
+	setup_ctx();
+	attach_bpf(ctx.skel->progs.bench_stack_ips);
+}
+
+static void stackmap_build_id_setup(void)
+{
+	setup_ctx();
+	attach_bpf(ctx.skel->progs.bench_stack_build_id);
+}
+
+static void *stackmap_producer(void *input)
+{
+	while (true)
+		(void)syscall(__NR_getpgid);
+	return NULL;
+}
+
+static void *stackmap_consumer(void *input)
+{
+	return NULL;
+}
+
+static void stackmap_measure(struct bench_res *res)
+{
+	res->hits = atomic_swap(&ctx.skel->bss->hits, 0);
+	res->drops = atomic_swap(&ctx.skel->bss->drops, 0);
+}
+
+static void stackmap_report_final(struct bench_res res[], int res_cnt)
+{
+	double hits_mean = 0.0;
+	int i;
+
+	hits_drops_report_final(res, res_cnt);
+
+	for (i = 0; i < res_cnt; i++)
+		hits_mean += res[i].hits / (0.0 + res_cnt);
+
+	/* includes the getpgid() syscall itself, compare with trig-tp */
+	if (hits_mean > 0)
+		printf("Per stack: %.1lf ns (per producer)\n",
+		       1000000000.0 * env.producer_cnt / hits_mean);
+}
+
+const struct bench bench_stackmap_ips = {
+	.name = "stackmap-ips",
+	.validate = stackmap_validate,
+	.setup = stackmap_ips_setup,
+	.producer_thread = stackmap_producer,
+	.consumer_thread = stackmap_consumer,
+	.measure = stackmap_measure,
+	.report_progress = hits_drops_report_progress,
+	.report_final = stackmap_report_final,
+};
+
+const struct bench bench_stackmap_build_id = {
+	.name = "stackmap-build-id",
+	.validate = stackmap_validate,
+	.setup = stackmap_build_id_setup,
+	.producer_thread = stackmap_producer,
+	.consumer_thread = stackmap_consumer,
+	.measure = stackmap_measure,
+	.report_progress = hits_drops_report_progress,
+	.report_final = stackmap_report_final,
+};
@@ -0,0 +1,355 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <argp.h>
+#include <linux/btf.h>
+#include <linux/filter.h>
+#include <stdio.h>
+#include <string.h>
+#include <bpf/btf.h>
+#include "bench.h"
+
+static struct {
+	__u32 nr_funcs;
+	bool fexit;
+} args = {
+	.nr_funcs = 5000,
+	.fexit = false,
+};
+
+enum {
+	ARG_MULTI_FUNCS = 3500,
+	ARG_MULTI_FEXIT = 3501,
+};
+
+static const struct argp_option opts[] = {
+	{ "multi-funcs", ARG_MULTI_FUNCS, "FUNCS", 0,
+	  "Number of kernel functions to attach to at once"},
+	{ "multi-fexit", ARG_MULTI_FEXIT, NULL, 0,
+	  "Attach a fexit program instead of a fentry one"},
+	{},
+};
+
+static error_t parse_arg(int key, char *arg, struct argp_state *state)
+{
+	long ret;
+
+	switch (key) {
+	case ARG_MULTI_FUNCS:
+		ret = strtol(arg, NULL, 10);
+		if (ret < 1 || ret > 65536) {
+			fprintf(stderr, "Invalid number of functions.");
+			argp_usage(state);
+		}
+		args.nr_funcs = ret;
+		break;
+	case ARG_MULTI_FEXIT:
+		args.fexit = true;
+		break;
+	default:
+		return ARGP_ERR_UNKNOWN;
+	}
+	return 0;
+}
+
+/* exported into benchmark runner */
+const struct argp bench_trampoline_multi_argp = {
+	.options = opts,
+	.parser = parse_arg,
+};
+
+static struct multi_ctx {
+	int prog_fd;
+	__u32 *btf_ids;
+	__u32 cnt;
+	long cycles;
+	long attach_ns;
+	long detach_ns;
+	long total_cycles;
+	long total_attach_ns;
+	long total_detach_ns;
+} ctx;
+
+static int str_cmp(const void *a, const void *b)
+{
+	return strcmp(*(const char **)a, *(const char **)b);
+}
+
+/* Sorted names of the functions ftrace can hook, modules left out */
+static char **read_ftrace_funcs(size_t *cnt)
+{
+	const char *paths[] = {
+		"/sys/kernel/debug/tracing/available_filter_functions",
+		"/sys/kernel/tracing/available_filter_functions",
+	};
+	size_t len = 0, cap = 0;
+	char **funcs = NULL;
+	char buf[256];
+	FILE *f = NULL;
+	int i;
+
+	for (i = 0; i < 2 && !f; i++)
+		f = fopen(paths[i], "r");
+	if (!f)
+		return NULL;
+
+	while (fgets(buf, sizeof(buf), f)) {
+		if (strchr(buf, '['))
+			continue;
+		buf[strcspn(buf, " \n")] = '\0';
+		if (len == cap) {
+			cap = cap ? cap * 2 : 4096;
+			funcs = realloc(funcs, cap * sizeof(*funcs));
+			if (!funcs)
+				break;
+		}
+		funcs[len++] = strdup(buf);
+	}
+	fclose(f);
+
+	if (funcs)
+		qsort(funcs, len, sizeof(*funcs), str_cmp);
+	*cnt = len;
+	return funcs;
+}
+
+/* Scalars and pointers of up to 8 bytes, like the kernel expects */
+static bool multi_type_ok(const struct btf *btf, __u32 id, bool ret)
+{
+	const struct btf_type *t;
+
+	t = btf__type_by_id(btf, id);
+	while (t && (btf_is_mod(t) || btf_is_typedef(t)))
+		t = btf__type_by_id(btf, t->type);
+	if (!t)
+		return false;
+	if (ret && btf_is_void(t))
+		return true;
+	if (btf_is_ptr(t))
+		return true;
+	if (btf_is_int(t) || btf_is_enum(t))
+		return t->size <= 8;
+	return false;
+}
+
+static bool multi_func_ok(const struct btf *btf, const struct btf_type *t)
+{
+	const struct btf_param *p;
+	int i;
+
+	t = btf__type_by_id(btf, t->type);
+	if (!t || !btf_is_func_proto(t) || btf_vlen(t) > 6)
+		return false;
+	if (!multi_type_ok(btf, t->type, true))
+		return false;
+
+	p = btf_params(t);
+	for (i = 0; i < btf_vlen(t); i++, p++) {
+		/* a trailing va_list or '...' shows up with a zero type */
+		if (!p->type || !multi_type_ok(btf, p->type, false))
+			return false;
+	}
+	return true;
+}
+
+static const char * const multi_deny[] = {
+	/* called by the trampoline itself */
+	"migrate_disable",
+	"migrate_enable",
+	"__rcu_read_lock",
+	"__rcu_read_unlock",
+};
+
+static void multi_collect_funcs(void)
+{
+	size_t nr_ftrace = 0, i;
+	const char **seen;
+	char **ftrace;
+	struct btf *btf;
+	__u32 id, nr;
+
+	btf = libbpf_find_kernel_btf();
+	if (IS_ERR(btf)) {
+		fprintf(stderr, "failed to load vmlinux BTF\n");
+		exit(1);
+	}
+
+	ftrace = read_ftrace_funcs(&nr_ftrace);
+	if (!ftrace) {
+		fprintf(stderr, "failed to read available_filter_functions\n");
+		exit(1);
+	}
+
+	ctx.btf_ids = calloc(args.nr_funcs, sizeof(*ctx.btf_ids));
+	seen = calloc(args.nr_funcs, sizeof(*seen));
+	if (!ctx.btf_ids || !seen) {
+		fprintf(stderr, "failed to allocate btf ids\n");
+		exit(1);
+	}
+
+	nr = btf__get_nr_types(btf);
+	for (id = 1; id <= nr && ctx.cnt < args.nr_funcs; id++) {
+		const struct btf_type *t = btf__type_by_id(btf, id);
+		const char *name;
+		bool skip = false;
+
+		if (!btf_is_func(t))
+			continue;
+		name = btf__name_by_offset(btf, t->name_off);
+		if (!name || !bsearch(&name, ftrace, nr_ftrace,
+				      sizeof(*ftrace), str_cmp))
+			continue;
+		for (i = 0; i < sizeof(multi_deny) / sizeof(multi_deny[0]); i++)
+			skip |= !strcmp(name, multi_deny[i]);
+		/* static functions that share a name share an address too */
+		for (i = 0; i < ctx.cnt && !skip; i++)
+			skip = !strcmp(name, seen[i]);
+		if (skip || !multi_func_ok(btf, t))
+			continue;
+		seen[ctx.cnt] = name;
+		ctx.btf_ids[ctx.cnt++] = id;
+	}
+
+	if (ctx.cnt < args.nr_funcs)
+		fprintf(stderr, "only %u functions can be attached to\n",
+			ctx.cnt);
+
+	for (i = 0; i < nr_ftrace; i++)
+		free(ftrace[i]);
+	free(ftrace);
+	free(seen);
+	/* the names in seen[] belong to btf */
+	btf__free(btf);
+}
+
+static void multi_validate(void)
+{
+	if (env.consumer_cnt != 1) {
+		fprintf(stderr, "benchmark doesn't support multi-consumer!\n");
+		exit(1);
+	}
+	if (env.producer_cnt != 1) {
+		fprintf(stderr, "benchmark doesn't support multi-producer!\n");
+		exit(1);
+	}
+}
+
+static void multi_setup(void)
+{
+	struct bpf_insn insns[] = {
+		BPF_MOV64_IMM(BPF_REG_0, 0),
+		BPF_EXIT_INSN(),
+	};
+	struct bpf_load_program_attr attr = {};
+
+	setup_libbpf();
+	multi_collect_funcs();
+
+	attr.prog_type = BPF_PROG_TYPE_TRACING;
+	attr.expected_attach_type = args.fexit ? BPF_TRACE_FEXIT :
+						 BPF_TRACE_FENTRY;
+	attr.insns = insns;
+	attr.insns_cnt = sizeof(insns) / sizeof(insns[0]);
+	attr.license = "GPL";
+	attr.prog_flags = BPF_F_MULTI_FUNC;
+
+	ctx.prog_fd = bpf_load_program_xattr(&attr, NULL, 0);
+	if (ctx.prog_fd < 0) {
+		fprintf(stderr, "failed to load program: %d\n", -errno);
+		exit(1);
+	}
+}
+
+static void *multi_producer(void *input)
+{
+	DECLARE_LIBBPF_OPTS(bpf_link_create_opts, opts,
+		.btf_ids = ctx.btf_ids,
+		.btf_ids_cnt = ctx.cnt,
+	);
+	__u64 start, attached, detached;
+	int link_fd;
+
+	while (true) {
+		start = get_time_ns();
+		link_fd = bpf_link_create(ctx.prog_fd, 0,
+					  args.fexit ? BPF_TRACE_FEXIT :
+						       BPF_TRACE_FENTRY,
+					  &opts);
+		if (link_fd < 0) {
+			fprintf(stderr, "failed to attach to %u functions: %d\n",
+				ctx.cnt, -errno);
+			exit(1);
+		}
+		attached = get_time_ns();
+		close(link_fd);
+		detached = get_time_ns();
+
+		atomic_add(&ctx.attach_ns, attached - start);
+		atomic_add(&ctx.detach_ns, detached - attached);
+		atomic_inc(&ctx.cycles);
+	}
+	return NULL;
+}
+
+static void *multi_consumer(void *input)
+{
+	return NULL;
+}
+
+static void multi_measure(struct bench_res *res)
+{
+	res->hits = atomic_swap(&ctx.cycles, 0);
+	res->drops = 0;
+}
+
+static void multi_report_progress(int iter, struct bench_res *res,
+				  long delta_ns)
+{
+	long attach_ns = atomic_swap(&ctx.attach_ns, 0);
+	long detach_ns = atomic_swap(&ctx.detach_ns, 0);
+
+	printf("Iter %3d (%7.3lfus): ", iter,
+	       (delta_ns - 1000000000) / 1000.0);
+	if (!res->hits) {
+		printf("no attach completed\n");
+		return;
+	}
+	printf("attach %8.2lfms detach %8.2lfms (%ld cycles)\n",
+	       attach_ns / 1000000.0 / res->hits,
+	       detach_ns / 1000000.0 / res->hits, res->hits);
+
+	/* the warmup iterations don't count */
+	if (iter >= env.warmup_sec) {
+		ctx.total_cycles += res->hits;
+		ctx.total_attach_ns += attach_ns;
+		ctx.total_detach_ns += detach_ns;
+	}
+}
+
+static void multi_report_final(struct bench_res res[], int res_cnt)
+{
+	double attach_ms, detach_ms;
+
+	if (!ctx.total_cycles) {
+		printf("Summary: no attach completed, try a longer duration\n");
+		return;
+	}
+
+	attach_ms = ctx.total_attach_ns / 1000000.0 / ctx.total_cycles;
+	detach_ms = ctx.total_detach_ns / 1000000.0 / ctx.total_cycles;
+	printf("Summary: %u functions, %ld cycles, attach %.2lfms "
+	       "(%.2lfus per function), detach %.2lfms "
+	       "(%.2lfus per function)\n",
+	       ctx.cnt, ctx.total_cycles,
+	       attach_ms, attach_ms * 1000.0 / ctx.cnt,
+	       detach_ms, detach_ms * 1000.0 / ctx.cnt);
+}
+
+const struct bench bench_trampoline_multi = {
+	.name = "trampoline-multi",
+	.validate = multi_validate,
+	.setup = multi_setup,
+	.producer_thread = multi_producer,
+	.consumer_thread = multi_consumer,
+	.measure = multi_measure,
+	.report_progress = multi_report_progress,
+	.report_final = multi_report_final,
+};
@@ -0,0 +1,271 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <linux/perf_event.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include "bench.h"
+
+/*
+ * Probe targets, each a short function around one kind of instruction
+ * commonly found at probe sites. The uprobe goes on the instruction at
+ * the given offset into the function.
+ */
+void uprobe_target_nop(void);
+void uprobe_target_push(void);
+void uprobe_target_mov(void);
+void uprobe_target_xol(void);
+
+#if defined(__x86_64__)
+asm(
+"	.pushsection .text\n"
+"	.globl uprobe_target_nop\n"
+"	.type uprobe_target_nop, @function\n"
+"uprobe_target_nop:\n"
+"	nop\n"
+"	ret\n"
+"	.globl uprobe_target_push\n"
+"	.type uprobe_target_push, @function\n"
+"uprobe_target_push:\n"
+"	push %rbp\n"
+"	pop %rbp\n"
+"	ret\n"
+"	.globl uprobe_target_mov\n"
+"	.type uprobe_target_mov, @function\n"
+"uprobe_target_mov:\n"
+"	push %rbp\n"
+"	mov %rsp, %rbp\n"
+"	pop %rbp\n"
+"	ret\n"
+"	.globl uprobe_target_xol\n"
+"	.type uprobe_target_xol, @function\n"
+"uprobe_target_xol:\n"
+"	sub $8, %rsp\n"
+"	add $8, %rsp\n"
+"	ret\n"
+"	.popsection\n"
+);
+#define UPROBE_MOV_OFFSET	1
+#elif defined(__aarch64__)
+asm(
+"	.pushsection .text\n"
+"	.globl uprobe_target_nop\n"
+"	.type uprobe_target_nop, %function\n"
+"uprobe_target_nop:\n"
+"	nop\n"
+"	ret\n"
+"	.globl uprobe_target_push\n"
+"	.type uprobe_target_push, %function\n"
+"uprobe_target_push:\n"
+"	stp x29, x30, [sp, #-16]!\n"
+"	ldp x29, x30, [sp], #16\n"
+"	ret\n"
+"	.globl uprobe_target_mov\n"
+"	.type uprobe_target_mov, %function\n"
+"uprobe_target_mov:\n"
+"	stp x29, x30, [sp, #-16]!\n"
+"	mov x29, sp\n"
+"	ldp x29, x30, [sp], #16\n"
+"	ret\n"
+"	.globl uprobe_target_xol\n"
+"	.type uprobe_target_xol, %function\n"
+"uprobe_target_xol:\n"
+"	and x9, x9, x9\n"
+"	ret\n"
+"	.popsection\n"
+);
+#define UPROBE_MOV_OFFSET	4
+#else
+#define UPROBE_NO_TARGETS
+void uprobe_target_nop(void) {}
+void uprobe_target_push(void) {}
+void uprobe_target_mov(void) {}
+void uprobe_target_xol(void) {}
+#define UPROBE_MOV_OFFSET	0
+#endif
+
+static struct uprobe_ctx {
+	void (*func)(void);
+	int *fds;
+	int nr_fds;
+	struct counter hits;
+} ctx;
+
+static void uprobe_validate(void)
+{
+#ifdef UPROBE_NO_TARGETS
+	fprintf(stderr, "benchmark doesn't support this architecture!\n");
+	exit(1);
+#endif
+	if (env.consumer_cnt != 1) {
+		fprintf(stderr, "benchmark doesn't support multi-consumer!\n");
+		exit(1);
+	}
+}
+
+/* File offset of @addr in the executable, as uprobes want it */
+static long uprobe_file_offset(const void *addr)
+{
+	unsigned long start, end, pgoff;
+	char perms[8], line[512];
+	long ret = -1;
+	FILE *f;
+
+	f = fopen("/proc/self/maps", "r");
+	if (!f)
+		return -1;
+
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%lx-%lx %7s %lx", &start, &end, perms,
+			   &pgoff) != 4)
+			continue;
+		if ((unsigned long)addr < start || (unsigned long)addr >= end)
+			continue;
+		if (perms[2] == 'x')
+			ret = (unsigned long)addr - start + pgoff;
+		break;
+	}
+	fclose(f);
+	return ret;
+}
+
+static int uprobe_pmu_type(void)
+{
+	const char *file = "/sys/bus/event_source/devices/uprobe/type";
+	int type = -1;
+	FILE *f;
+
+	f = fopen(file, "r");
+	if (!f)
+		return -1;
+	if (fscanf(f, "%d", &type) != 1)
+		type = -1;
+	fclose(f);
+	return type;
+}
+
+static void uprobe_attach(void (*func)(void), int insn_off)
+{
+	struct perf_event_attr attr = {};
+	char path[PATH_MAX];
+	long offset;
+	int cpu, type;
+	ssize_t len;
+
+	ctx.func = func;
+	if (insn_off < 0)
+		return;
+
+	len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+	if (len < 0) {
+		fprintf(stderr, "failed to resolve executable: %d\n", -errno);
+		exit(1);
+	}
+	path[len] = '\0';
+
+	offset = uprobe_file_offset(func);
+	type = uprobe_pmu_type();
+	if (offset < 0 || type < 0) {
+		fprintf(stderr, "failed to find uprobe target or PMU\n");
+		exit(1);
+	}
+
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config1 = (__u64)(unsigned long)path;
+	attr.config2 = offset + insn_off;
+
+	/* one event per CPU catches all producer threads, like BPF does */
+	ctx.nr_fds = libbpf_num_possible_cpus();
+	ctx.fds = calloc(ctx.nr_fds, sizeof(*ctx.fds));
+	if (!ctx.fds) {
+		fprintf(stderr, "failed to allocate perf event fds\n");
+		exit(1);
+	}
+
+	for (cpu = 0; cpu < ctx.nr_fds; cpu++) {
+		ctx.fds[cpu] = syscall(__NR_perf_event_open, &attr, -1, cpu,
+				       -1, PERF_FLAG_FD_CLOEXEC);
+		/* possible but offline CPUs are fine to skip */
+		if (ctx.fds[cpu] < 0 && errno != ENODEV) {
+			fprintf(stderr, "failed to open uprobe: %d\n", -errno);
+			exit(1);
+		}
+	}
+}
+
+static void uprobe_base_setup(void)
+{
+	uprobe_attach(uprobe_target_nop, -1);
+}
+
+static void uprobe_nop_setup(void)
+{
+	uprobe_attach(uprobe_target_nop, 0);
+}
+
+static void uprobe_push_setup(void)
+{
+	uprobe_attach(uprobe_target_push, 0);
+}
+
+static void uprobe_mov_setup(void)
+{
+	uprobe_attach(uprobe_target_mov, UPROBE_MOV_OFFSET);
+}
+
+static void uprobe_xol_setup(void)
+{
+	uprobe_attach(uprobe_target_xol, 0);
+}
+
+static void *uprobe_producer(void *input)
+{
+	while (true) {
+		ctx.func();
+		atomic_inc(&ctx.hits.value);
+	}
+	return NULL;
+}
+
+static void *uprobe_consumer(void *input)
+{
+	return NULL;
+}
+
+static void uprobe_measure(struct bench_res *res)
+{
+	res->hits = atomic_swap(&ctx.hits.value, 0);
+}
+
+static void uprobe_report_final(struct bench_res res[], int res_cnt)
+{
+	double hits_mean = 0.0;
+	int i;
+
+	hits_drops_report_final(res, res_cnt);
+
+	for (i = 0; i < res_cnt; i++)
+		hits_mean += res[i].hits / (0.0 + res_cnt);
+
+	if (hits_mean > 0)
+		printf("Per hit: %.1lf ns (per producer)\n",
+		       1000000000.0 * env.producer_cnt / hits_mean);
+}
+
+#define UPROBE_BENCH(_name, _setup)				\
+const struct bench bench_uprobe_##_name = {			\
+	.name = "uprobe-" #_name,				\
+	.validate = uprobe_validate,				\
+	.setup = _setup,					\
+	.producer_thread = uprobe_producer,			\
+	.consumer_thread = uprobe_consumer,			\
+	.measure = uprobe_measure,				\
+	.report_progress = hits_drops_report_progress,		\
+	.report_final = uprobe_report_final,			\
+}
+
+UPROBE_BENCH(base, uprobe_base_setup);
+UPROBE_BENCH(nop, uprobe_nop_setup);
+UPROBE_BENCH(push, uprobe_push_setup);
+UPROBE_BENCH(mov, uprobe_mov_setup);
+UPROBE_BENCH(xol, uprobe_xol_setup);
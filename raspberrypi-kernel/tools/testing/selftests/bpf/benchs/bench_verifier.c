@@ -0,0 +1,222 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <argp.h>
+#include <linux/filter.h>
+#include <string.h>
+#include "bench.h"
+
+static struct {
+	__u32 nr_blocks;
+	bool cold;
+} args = {
+	.nr_blocks = 4096,
+	.cold = false,
+};
+
+enum {
+	ARG_VERIF_BLOCKS = 3400,
+	ARG_VERIF_COLD = 3401,
+};
+
+static const struct argp_option opts[] = {
+	{ "verif-blocks", ARG_VERIF_BLOCKS, "BLOCKS", 0,
+	  "Number of branching blocks in the loaded program"},
+	{ "verif-cold", ARG_VERIF_COLD, NULL, 0,
+	  "Make every load differ, so that none is served by the verifier cache"},
+	{},
+};
+
+static error_t parse_arg(int key, char *arg, struct argp_state *state)
+{
+	long ret;
+
+	switch (key) {
+	case ARG_VERIF_BLOCKS:
+		ret = strtol(arg, NULL, 10);
+		if (ret < 1 || ret > 100000) {
+			fprintf(stderr, "Invalid number of blocks.");
+			argp_usage(state);
+		}
+		args.nr_blocks = ret;
+		break;
+	case ARG_VERIF_COLD:
+		args.cold = true;
+		break;
+	default:
+		return ARGP_ERR_UNKNOWN;
+	}
+	return 0;
+}
+
+/* exported into benchmark runner */
+const struct argp bench_verifier_argp = {
+	.options = opts,
+	.parser = parse_arg,
+};
+
+/* insns before the blocks, the first one is what --verif-cold changes */
+#define VERIF_PROLOGUE	9
+#define VERIF_BLOCK	5
+#define VERIF_EPILOGUE	2
+
+static struct verif_ctx {
+	int map_fd;
+	__u32 insn_cnt;
+	__u32 verified_insns;
+	long loads;
+} ctx;
+
+static struct bpf_insn *verif_gen_prog(void)
+{
+	struct bpf_insn prologue[VERIF_PROLOGUE] = {
+		BPF_MOV64_IMM(BPF_REG_0, 0),
+		BPF_MOV64_IMM(BPF_REG_6, 0),
+		BPF_ST_MEM(BPF_W, BPF_REG_10, -4, 0),
+		BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -4),
+		BPF_LD_MAP_FD(BPF_REG_1, ctx.map_fd),
+		BPF_EMIT_CALL(BPF_FUNC_map_lookup_elem),
+		BPF_MOV64_REG(BPF_REG_7, BPF_REG_0),
+	};
+	struct bpf_insn *insns, *insn;
+	__u32 i;
+
+	insns = calloc(ctx.insn_cnt, sizeof(*insns));
+	if (!insns)
+		return NULL;
+
+	memcpy(insns, prologue, sizeof(prologue));
+	insn = insns + VERIF_PROLOGUE;
+
+	/* Each block forks the verifier state on an unknown value */
+	for (i = 0; i < args.nr_blocks; i++) {
+		*insn++ = BPF_EMIT_CALL(BPF_FUNC_get_prandom_u32);
+		*insn++ = BPF_JMP_IMM(BPF_JGT, BPF_REG_0, i % 1000, 2);
+		*insn++ = BPF_ALU64_IMM(BPF_ADD, BPF_REG_6, 1);
+		*insn++ = BPF_JMP_IMM(BPF_JA, 0, 0, 1);
+		*insn++ = BPF_ALU64_IMM(BPF_SUB, BPF_REG_6, 1);
+	}
+
+	*insn++ = BPF_MOV64_IMM(BPF_REG_0, 0);
+	*insn++ = BPF_EXIT_INSN();
+
+	return insns;
+}
+
+static int verif_load(const struct bpf_insn *insns)
+{
+	struct bpf_load_program_attr attr = {};
+
+	attr.prog_type = BPF_PROG_TYPE_SOCKET_FILTER;
+	attr.insns = insns;
+	attr.insns_cnt = ctx.insn_cnt;
+	attr.license = "GPL";
+
+	return bpf_load_program_xattr(&attr, NULL, 0);
+}
+
+static void verif_validate(void)
+{
+	if (env.consumer_cnt != 1) {
+		fprintf(stderr, "benchmark doesn't support multi-consumer!\n");
+		exit(1);
+	}
+}
+
+static void verif_setup(void)
+{
+	struct bpf_prog_info info = {};
+	__u32 len = sizeof(info);
+	struct bpf_insn *insns;
+	int fd;
+
+	setup_libbpf();
+
+	ctx.map_fd = bpf_create_map(BPF_MAP_TYPE_ARRAY, sizeof(__u32),
+				    sizeof(__u64), 1, 0);
+	if (ctx.map_fd < 0) {
+		fprintf(stderr, "failed to create map: %d\n", -errno);
+		exit(1);
+	}
+
+	ctx.insn_cnt = VERIF_PROLOGUE + args.nr_blocks * VERIF_BLOCK +
+		       VERIF_EPILOGUE;
+	insns = verif_gen_prog();
+	if (!insns) {
+		fprintf(stderr, "failed to generate program\n");
+		exit(1);
+	}
+
+	fd = verif_load(insns);
+	if (fd < 0) {
+		fprintf(stderr, "failed to load program: %d\n", -errno);
+		exit(1);
+	}
+	if (!bpf_obj_get_info_by_fd(fd, &info, &len))
+		ctx.verified_insns = info.verified_insns;
+	close(fd);
+	free(insns);
+}
+
+static void *verif_producer(void *input)
+{
+	struct bpf_insn *insns;
+	__s32 seq = 0;
+	int fd;
+
+	insns = verif_gen_prog();
+	if (!insns) {
+		fprintf(stderr, "failed to generate program\n");
+		exit(1);
+	}
+
+	while (true) {
+		if (args.cold)
+			insns[0].imm = ++seq;
+		fd = verif_load(insns);
+		if (fd < 0) {
+			fprintf(stderr, "failed to load program: %d\n", -errno);
+			exit(1);
+		}
+		close(fd);
+		atomic_inc(&ctx.loads);
+	}
+	return NULL;
+}
+
+static void *verif_consumer(void *input)
+{
+	return NULL;
+}
+
+static void verif_measure(struct bench_res *res)
+{
+	res->hits = atomic_swap(&ctx.loads, 0);
+}
+
+static void verif_report_final(struct bench_res res[], int res_cnt)
+{
+	double hits_mean = 0.0;
+	int i;
+
+	hits_drops_report_final(res, res_cnt);
+
+	for (i = 0; i < res_cnt; i++)
+		hits_mean += res[i].hits / (0.0 + res_cnt);
+
+	printf("Program: %u insns, %u processed by the verifier\n",
+	       ctx.insn_cnt, ctx.verified_insns);
+	if (hits_mean > 0)
+		printf("Per load: %.1lf us (per producer)\n",
+		       1000000.0 * env.producer_cnt / hits_mean);
+}
+
+const struct bench bench_verifier_load = {
+	.name = "verifier-load",
+	.validate = verif_validate,
+	.setup = verif_setup,
+	.producer_thread = verif_producer,
+	.consumer_thread = verif_consumer,
+	.measure = verif_measure,
+	.report_progress = hits_drops_report_progress,
+	.report_final = verif_report_final,
+};
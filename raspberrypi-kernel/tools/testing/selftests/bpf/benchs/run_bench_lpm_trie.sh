@@ -0,0 +1,32 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+
+set -eufo pipefail
+
+RUN_BENCH="sudo ./bench -w3 -d10 -a"
+
+function header()
+{
+	local len=${#1}
+
+	printf "\n%s\n" "$1"
+	for i in $(seq 1 $len); do printf '='; done
+	printf '\n'
+}
+
+function summarize()
+{
+	bench="$1"
+	summary=$(echo "$2" | grep "Per lookup")
+	printf "%-20s %s\n" "$bench" "$summary"
+}
+
+for n in 10000 100000 1000000; do
+	header "LPM trie, $n IPv6 prefixes"
+	for mode in "" "--lpm-lc"; do
+		for p in 1 4 16; do
+			summarize "lpm${mode:+-lc}-p$p" \
+				"$($RUN_BENCH -p$p --lpm-prefixes $n $mode lpm-trie-lookup)"
+		done
+	done
+done
@@ -0,0 +1,42 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+
+set -eufo pipefail
+
+RUN_BENCH="sudo ./bench -w3 -d10 -a"
+
+function hits()
+{
+	echo "$*" | sed -E "s/.*hits\s+([0-9]+\.[0-9]+ ± [0-9]+\.[0-9]+M\/s).*/\1/"
+}
+
+function drops()
+{
+	echo "$*" | sed -E "s/.*drops\s+([0-9]+\.[0-9]+ ± [0-9]+\.[0-9]+M\/s).*/\1/"
+}
+
+function header()
+{
+	local len=${#1}
+
+	printf "\n%s\n" "$1"
+	for i in $(seq 1 $len); do printf '='; done
+	printf '\n'
+}
+
+function summarize()
+{
+	bench="$1"
+	summary=$(echo $2 | tail -n1)
+	printf "%-20s %s (drops %s)\n" "$bench" "$(hits $summary)" "$(drops $summary)"
+}
+
+header "Many producers, 8 byte records"
+for p in 1 2 4 8 16 24 32 48 64; do
+	summarize "rb-libbpf-p$p" "$($RUN_BENCH -p$p --rb-use-output rb-libbpf)"
+done
+
+header "Many producers, 8 byte records, batched"
+for p in 1 2 4 8 16 24 32 48 64; do
+	summarize "rb-libbpf-batch-p$p" "$($RUN_BENCH -p$p rb-libbpf-batch)"
+done
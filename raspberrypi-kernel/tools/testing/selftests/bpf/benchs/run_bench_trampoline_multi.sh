@@ -0,0 +1,30 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+
+set -eufo pipefail
+
+RUN_BENCH="sudo ./bench -w1 -d10 -a"
+
+function header()
+{
+	local len=${#1}
+
+	printf "\n%s\n" "$1"
+	for i in $(seq 1 $len); do printf '='; done
+	printf '\n'
+}
+
+function summarize()
+{
+	bench="$1"
+	summary=$(echo "$2" | grep "Summary")
+	printf "%-20s %s\n" "$bench" "$summary"
+}
+
+for mode in "" "--multi-fexit"; do
+	header "Multi function attach${mode:+, fexit}"
+	for funcs in 100 1000 5000; do
+		summarize "multi-$funcs" \
+			"$($RUN_BENCH --multi-funcs $funcs $mode trampoline-multi)"
+	done
+done
@@ -0,0 +1,27 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+
+set -eufo pipefail
+
+RUN_BENCH="sudo ./bench -w2 -d10 -a"
+
+function header()
+{
+	local len=${#1}
+
+	printf "\n%s\n" "$1"
+	for i in $(seq 1 $len); do printf '='; done
+	printf '\n'
+}
+
+function summarize()
+{
+	bench="$1"
+	summary=$(echo "$2" | grep "Per hit")
+	printf "%-20s %s\n" "$bench" "$summary"
+}
+
+header "Uprobe hit cost"
+for b in base nop push mov xol; do
+	summarize "uprobe-$b" "$($RUN_BENCH uprobe-$b)"
+done
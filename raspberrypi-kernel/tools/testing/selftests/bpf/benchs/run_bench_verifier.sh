@@ -0,0 +1,33 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+
+set -eufo pipefail
+
+RUN_BENCH="sudo ./bench -w2 -d10 -a"
+
+function header()
+{
+	local len=${#1}
+
+	printf "\n%s\n" "$1"
+	for i in $(seq 1 $len); do printf '='; done
+	printf '\n'
+}
+
+function summarize()
+{
+	bench="$1"
+	summary=$(echo "$2" | grep "Per load")
+	printf "%-20s %s\n" "$bench" "$summary"
+}
+
+for blocks in 1024 4096 16384; do
+	header "Verifier, $blocks blocks"
+	echo "$($RUN_BENCH --verif-blocks $blocks verifier-load | grep Program)"
+	for mode in "--verif-cold" ""; do
+		for p in 1 4; do
+			summarize "verif${mode:+-cold}-p$p" \
+				"$($RUN_BENCH -p$p --verif-blocks $blocks $mode verifier-load)"
+		done
+	done
+done
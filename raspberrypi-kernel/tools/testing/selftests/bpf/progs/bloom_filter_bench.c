@@ -0,0 +1,96 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <linux/bpf.h>
+#include <stdint.h>
+#include <bpf/bpf_helpers.h>
+
+char _license[] SEC("license") = "GPL";
+
+/* lookups done per triggering syscall */
+#define BLOOM_BENCH_OPS 16
+
+struct {
+	__uint(type, BPF_MAP_TYPE_BLOOM_FILTER);
+	__uint(max_entries, 1);
+	__type(value, __u32);
+} bloom_map SEC(".maps");
+
+struct {
+	__uint(type, BPF_MAP_TYPE_HASH);
+	__uint(max_entries, 1);
+	__type(key, __u32);
+	__type(value, __u64);
+} hashmap SEC(".maps");
+
+/* User space inserts the even values below 2 * nr_entries, so every odd
+ * value that the bloom filter reports as present is a false positive.
+ */
+const volatile __u32 nr_entries = 1;
+
+long hits = 0;
+long false_hits = 0;
+long negatives = 0;
+
+static __always_inline __u32 rand_value(void)
+{
+	return bpf_get_prandom_u32() % (2 * nr_entries);
+}
+
+static __always_inline void account(__u32 val, int present)
+{
+	if (!(val & 1))
+		return;
+	if (present)
+		__sync_add_and_fetch(&false_hits, 1);
+	else
+		__sync_add_and_fetch(&negatives, 1);
+}
+
+SEC("tp/syscalls/sys_enter_getpgid")
+int bloom_lookup(void *ctx)
+{
+	__u32 val;
+	int i;
+
+	for (i = 0; i < BLOOM_BENCH_OPS; i++) {
+		val = rand_value();
+		account(val, !bpf_map_peek_elem(&bloom_map, &val));
+	}
+	__sync_add_and_fetch(&hits, BLOOM_BENCH_OPS);
+
+	return 0;
+}
+
+SEC("tp/syscalls/sys_enter_getpgid")
+int hashmap_lookup(void *ctx)
+{
+	__u32 val;
+	int i;
+
+	for (i = 0; i < BLOOM_BENCH_OPS; i++) {
+		val = rand_value();
+		bpf_map_lookup_elem(&hashmap, &val);
+	}
+	__sync_add_and_fetch(&hits, BLOOM_BENCH_OPS);
+
+	return 0;
+}
+
+SEC("tp/syscalls/sys_enter_getpgid")
+int hashmap_with_bloom_lookup(void *ctx)
+{
+	int present;
+	__u32 val;
+	int i;
+
+	for (i = 0; i < BLOOM_BENCH_OPS; i++) {
+		val = rand_value();
+		present = !bpf_map_peek_elem(&bloom_map, &val);
+		account(val, present);
+		if (present)
+			bpf_map_lookup_elem(&hashmap, &val);
+	}
+	__sync_add_and_fetch(&hits, BLOOM_BENCH_OPS);
+
+	return 0;
+}
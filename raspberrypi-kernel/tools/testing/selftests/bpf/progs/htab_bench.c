@@ -0,0 +1,47 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <linux/bpf.h>
+#include <stdint.h>
+#include <bpf/bpf_helpers.h>
+
+char _license[] SEC("license") = "GPL";
+
+/* map operations done per triggering syscall, keep in sync with
+ * benchs/bench_htab.c
+ */
+#define HTAB_BENCH_OPS 16
+
+struct {
+	__uint(type, BPF_MAP_TYPE_HASH);
+	__uint(max_entries, 1);
+	__type(key, __u32);
+	__type(value, __u64);
+} htab SEC(".maps");
+
+const volatile __u32 nr_keys = 1;
+const volatile __u32 update_pct = 10;
+
+long drops = 0;
+
+SEC("tp/syscalls/sys_enter_getpgid")
+int bench_htab(void *ctx)
+{
+	__u64 val, *v;
+	__u32 key;
+	int i;
+
+	for (i = 0; i < HTAB_BENCH_OPS; i++) {
+		key = bpf_get_prandom_u32() % nr_keys;
+		if (bpf_get_prandom_u32() % 100 < update_pct) {
+			val = key;
+			if (bpf_map_update_elem(&htab, &key, &val, BPF_ANY))
+				__sync_add_and_fetch(&drops, 1);
+		} else {
+			v = bpf_map_lookup_elem(&htab, &key);
+			if (!v)
+				__sync_add_and_fetch(&drops, 1);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <linux/bpf.h>
+#include <stdint.h>
+#include <bpf/bpf_helpers.h>
+
+char _license[] SEC("license") = "GPL";
+
+/* lookups done per triggering syscall */
+#define LPM_BENCH_OPS 16
+
+struct lpm_key {
+	__u32 prefixlen;
+	union {
+		__u8 data[16];
+		__u32 words[4];
+	};
+};
+
+struct {
+	__uint(type, BPF_MAP_TYPE_LPM_TRIE);
+	__uint(max_entries, 1);
+	__uint(map_flags, BPF_F_NO_PREALLOC);
+	__type(key, struct lpm_key);
+	__type(value, __u32);
+} lpm_map SEC(".maps");
+
+long hits = 0;
+long matches = 0;
+
+SEC("tp/syscalls/sys_enter_getpgid")
+int lpm_lookup(void *ctx)
+{
+	struct lpm_key key = { .prefixlen = 128 };
+	long found = 0;
+	int i;
+
+	for (i = 0; i < LPM_BENCH_OPS; i++) {
+		/* random address in 2000::/3, like the inserted prefixes */
+		key.words[0] = bpf_get_prandom_u32();
+		key.words[1] = bpf_get_prandom_u32();
+		key.words[2] = bpf_get_prandom_u32();
+		key.words[3] = bpf_get_prandom_u32();
+		key.data[0] = 0x20 | (key.data[0] & 0x1f);
+		if (bpf_map_lookup_elem(&lpm_map, &key))
+			found++;
+	}
+	__sync_add_and_fetch(&hits, LPM_BENCH_OPS);
+	__sync_add_and_fetch(&matches, found);
+
+	return 0;
+}
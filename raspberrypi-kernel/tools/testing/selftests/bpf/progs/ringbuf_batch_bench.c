@@ -0,0 +1,33 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <linux/bpf.h>
+#include <stdint.h>
+#include <bpf/bpf_helpers.h>
+
+char _license[] SEC("license") = "GPL";
+
+struct {
+	__uint(type, BPF_MAP_TYPE_RINGBUF);
+} ringbuf SEC(".maps");
+
+const volatile int batch_cnt = 0;
+
+long sample_val = 42;
+long dropped = 0;
+long lost = 0;
+
+SEC("tp/syscalls/sys_enter_getpgid")
+int bench_ringbuf_batch(void *ctx)
+{
+	int i;
+
+	/* small fixed size records, the worst case for reservation cost */
+	for (i = 0; i < batch_cnt; i++) {
+		if (bpf_ringbuf_output(&ringbuf, &sample_val,
+				       sizeof(sample_val), 0))
+			__sync_add_and_fetch(&dropped, 1);
+	}
+
+	lost = bpf_ringbuf_query(&ringbuf, BPF_RB_BATCH_LOST);
+	return 0;
+}
@@ -0,0 +1,51 @@
+// SPDX-License-Identifier: GPL-2.0
+
+#include <linux/bpf.h>
+#include <stdint.h>
+#include <bpf/bpf_helpers.h>
+
+char _license[] SEC("license") = "GPL";
+
+#define PERF_MAX_STACK_DEPTH 127
+
+typedef __u64 stack_trace_t[PERF_MAX_STACK_DEPTH];
+
+struct {
+	__uint(type, BPF_MAP_TYPE_STACK_TRACE);
+	__uint(max_entries, 16384);
+	__uint(key_size, sizeof(__u32));
+	__uint(value_size, sizeof(stack_trace_t));
+} stackmap_ips SEC(".maps");
+
+struct {
+	__uint(type, BPF_MAP_TYPE_STACK_TRACE);
+	__uint(max_entries, 16384);
+	__uint(key_size, sizeof(__u32));
+	__uint(map_flags, BPF_F_STACK_BUILD_ID);
+	__uint(value_size, sizeof(struct bpf_stack_build_id) * PERF_MAX_STACK_DEPTH);
+} stackmap_build_id SEC(".maps");
+
+long hits = 0;
+long drops = 0;
+
+static __always_inline void account(long id)
+{
+	if (id < 0)
+		__sync_add_and_fetch(&drops, 1);
+	else
+		__sync_add_and_fetch(&hits, 1);
+}
+
+SEC("tp/syscalls/sys_enter_getpgid")
+int bench_stack_ips(void *ctx)
+{
+	account(bpf_get_stackid(ctx, &stackmap_ips, BPF_F_USER_STACK));
+	return 0;
+}
+
+SEC("tp/syscalls/sys_enter_getpgid")
+int bench_stack_build_id(void *ctx)
+{
+	account(bpf_get_stackid(ctx, &stackmap_build_id, BPF_F_USER_STACK));
+	return 0;
+}
@@ -206,10 +206,60 @@ static void test_lpm_order(void)
 	tlpm_clear(l2);
 }
 
-static void test_lpm_map(int keysize)
+/* Read the state of the level-compressed index of @map from its fdinfo */
+static void lpm_lc_state(int map, unsigned int *index, unsigned long *builds)
+{
+	char path[64], line[128];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/proc/self/fdinfo/%d", map);
+	f = fopen(path, "r");
+	assert(f);
+
+	*index = 0;
+	*builds = 0;
+	while (fgets(line, sizeof(line), f)) {
+		sscanf(line, "lc_index:\t%u", index);
+		sscanf(line, "lc_builds:\t%lu", builds);
+	}
+	fclose(f);
+}
+
+/* Wait up to 5s for the index to be rebuilt and return its build count */
+static unsigned long lpm_lc_wait(int map)
+{
+	unsigned long builds;
+	unsigned int index;
+	int i;
+
+	for (i = 0; i < 500; i++) {
+		lpm_lc_state(map, &index, &builds);
+		if (index)
+			break;
+		usleep(10000);
+	}
+	assert(index);
+
+	return builds;
+}
+
+/* Every lookup since lpm_lc_wait() went through the index if it is still
+ * the same one.
+ */
+static void lpm_lc_check(int map, unsigned long builds)
+{
+	unsigned long builds_now;
+	unsigned int index;
+
+	lpm_lc_state(map, &index, &builds_now);
+	assert(index && builds_now == builds);
+}
+
+static void test_lpm_map(int keysize, __u32 map_flags)
 {
 	size_t i, j, n_matches, n_matches_after_delete, n_nodes, n_lookups;
 	struct tlpm_node *t, *list = NULL;
+	unsigned long lc_builds = 0;
 	struct bpf_lpm_trie_key *key;
 	uint8_t *data, *value;
 	int r, map;
@@ -237,7 +287,7 @@ static void test_lpm_map(int keysize)
 			     sizeof(*key) + keysize,
 			     keysize + 1,
 			     4096,
-			     BPF_F_NO_PREALLOC);
+			     map_flags);
 	assert(map >= 0);
 
 	for (i = 0; i < n_nodes; ++i) {
@@ -253,6 +303,12 @@ static void test_lpm_map(int keysize)
 		assert(!r);
 	}
 
+	/* Make sure the lookups below go through the level-compressed index
+	 * rather than through the plain trie.
+	 */
+	if (map_flags & BPF_F_LEVEL_COMPRESS)
+		lc_builds = lpm_lc_wait(map);
+
 	for (i = 0; i < n_lookups; ++i) {
 		for (j = 0; j < keysize; ++j)
 			data[j] = rand() & 0xff;
@@ -273,6 +329,8 @@ static void test_lpm_map(int keysize)
 				       (value[j / 8] & (1 << (7 - j % 8))));
 		}
 	}
+	if (map_flags & BPF_F_LEVEL_COMPRESS)
+		lpm_lc_check(map, lc_builds);
 
 	/* Remove the first half of the elements in the tlpm and the
 	 * corresponding nodes from the bpf-lpm.  Then run the same
@@ -290,6 +348,8 @@ static void test_lpm_map(int keysize)
 		list = tlpm_delete(list, list->key, list->n_bits);
 		assert(list);
 	}
+	if (map_flags & BPF_F_LEVEL_COMPRESS)
+		lc_builds = lpm_lc_wait(map);
 	for (i = 0; i < n_lookups; ++i) {
 		for (j = 0; j < keysize; ++j)
 			data[j] = rand() & 0xff;
@@ -310,6 +370,8 @@ static void test_lpm_map(int keysize)
 				       (value[j / 8] & (1 << (7 - j % 8))));
 		}
 	}
+	if (map_flags & BPF_F_LEVEL_COMPRESS)
+		lpm_lc_check(map, lc_builds);
 
 	close(map);
 	tlpm_clear(list);
@@ -792,7 +854,11 @@ int main(void)
 
 	/* Test with 8, 16, 24, 32, ... 128 bit prefix length */
 	for (i = 1; i <= 16; ++i)
-		test_lpm_map(i);
+		test_lpm_map(i, BPF_F_NO_PREALLOC);
+
+	/* Same, with the level-compressed lookup index */
+	for (i = 1; i <= 16; ++i)
+		test_lpm_map(i, BPF_F_NO_PREALLOC | BPF_F_LEVEL_COMPRESS);
 
 	test_lpm_ipaddr();
 	test_lpm_delete();
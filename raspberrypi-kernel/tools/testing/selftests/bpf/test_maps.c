@@ -15,6 +15,7 @@
 #include <time.h>
 
 #include <sys/wait.h>
+#include <sys/syscall.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <linux/bpf.h>
@@ -639,6 +640,101 @@ static void test_stackmap(unsigned int task, void *data)
 	close(fd);
 }
 
+static int create_map_extra(enum bpf_map_type type, __u32 value_size,
+			    __u32 max_entries, __u32 flags, __u64 map_extra)
+{
+	union bpf_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.map_type = type;
+	attr.value_size = value_size;
+	attr.max_entries = max_entries;
+	attr.map_flags = flags;
+	attr.map_extra = map_extra;
+
+	return syscall(__NR_bpf, BPF_MAP_CREATE, &attr, sizeof(attr));
+}
+
+static void test_bloom_filter_map(unsigned int task, void *data)
+{
+	const int MAP_SIZE = 1000;
+	__u32 vals[MAP_SIZE], val;
+	int fd, i, fp = 0;
+
+	/* Invalid key size */
+	fd = bpf_create_map(BPF_MAP_TYPE_BLOOM_FILTER, 4, sizeof(val),
+			    MAP_SIZE, map_flags);
+	assert(fd < 0 && errno == EINVAL);
+
+	/* Too many hash functions requested */
+	fd = create_map_extra(BPF_MAP_TYPE_BLOOM_FILTER, sizeof(val),
+			      MAP_SIZE, 0, 16);
+	assert(fd < 0 && errno == EINVAL);
+
+	/* Value too large */
+	fd = create_map_extra(BPF_MAP_TYPE_BLOOM_FILTER, 1U << 30,
+			      MAP_SIZE, 0, 0);
+	assert(fd < 0 && errno == E2BIG);
+
+	/* map_extra is rejected for other map types */
+	fd = create_map_extra(BPF_MAP_TYPE_QUEUE, sizeof(val), MAP_SIZE, 0, 3);
+	assert(fd < 0 && errno == EINVAL);
+
+	fd = create_map_extra(BPF_MAP_TYPE_BLOOM_FILTER, sizeof(val),
+			      MAP_SIZE, map_flags, 3);
+	/* Bloom filter map does not support BPF_F_NO_PREALLOC */
+	if (map_flags & BPF_F_NO_PREALLOC) {
+		assert(fd < 0 && errno == EINVAL);
+		return;
+	}
+	if (fd < 0) {
+		printf("Failed to create bloom filter map '%s'!\n",
+		       strerror(errno));
+		exit(1);
+	}
+
+	/* Empty filter has no members */
+	val = rand();
+	assert(bpf_map_lookup_elem(fd, NULL, &val) == -1 && errno == ENOENT);
+
+	/* Only BPF_ANY is a valid push flag */
+	assert(bpf_map_update_elem(fd, NULL, &val, BPF_EXIST) == -1 &&
+	       errno == EINVAL);
+
+	for (i = 0; i < MAP_SIZE; i++) {
+		vals[i] = rand();
+		assert(bpf_map_update_elem(fd, NULL, &vals[i], 0) == 0);
+	}
+
+	/* No false negatives */
+	for (i = 0; i < MAP_SIZE; i++)
+		assert(bpf_map_lookup_elem(fd, NULL, &vals[i]) == 0);
+
+	/* The false positive rate stays well below 1 in 4 */
+	for (i = 0; i < MAP_SIZE; i++) {
+		val = rand();
+		if (!bpf_map_lookup_elem(fd, NULL, &val))
+			fp++;
+	}
+	assert(fp < MAP_SIZE / 4);
+
+	/* Elements cannot be removed or iterated */
+	assert(bpf_map_lookup_and_delete_elem(fd, NULL, &val) == -1);
+	assert(bpf_map_delete_elem(fd, NULL) == -1 && errno == EOPNOTSUPP);
+	assert(bpf_map_get_next_key(fd, NULL, &val) == -1 &&
+	       errno == EOPNOTSUPP);
+
+	close(fd);
+
+	/* Values whose size is not a multiple of 4 hash byte-wise */
+	fd = create_map_extra(BPF_MAP_TYPE_BLOOM_FILTER, 3, MAP_SIZE,
+			      map_flags, 0);
+	assert(fd >= 0);
+	assert(bpf_map_update_elem(fd, NULL, "abc", 0) == 0);
+	assert(bpf_map_lookup_elem(fd, NULL, "abc") == 0);
+	close(fd);
+}
+
 #include <sys/ioctl.h>
 #include <arpa/inet.h>
 #include <sys/select.h>
@@ -1382,6 +1478,72 @@ static void test_map_parallel(void)
 	assert(bpf_map_get_next_key(fd, &key, &key) == -1 && errno == ENOENT);
 }
 
+#define LOCKLESS_TASKS 100
+
+static void test_update_full(unsigned int task, void *data)
+{
+	int fd = *(int *)data;
+	int i, key, value;
+
+	for (i = 0; i < MAP_SIZE; i++) {
+		key = i;
+		value = task;
+		assert(bpf_map_update_elem(fd, &key, &value,
+					   task & 1 ? BPF_EXIST : BPF_ANY) == 0);
+	}
+}
+
+static void test_map_lockless_full(void)
+{
+	int i, fd, key, value;
+
+	/* lockless maps are always preallocated */
+	if (map_flags & BPF_F_NO_PREALLOC)
+		return;
+
+	fd = bpf_create_map(BPF_MAP_TYPE_HASH, sizeof(key), sizeof(value),
+			    MAP_SIZE, map_flags | BPF_F_LOCKLESS);
+	if (fd < 0) {
+		printf("Failed to create lockless map '%s'!\n",
+		       strerror(errno));
+		exit(1);
+	}
+
+	for (i = 0; i < MAP_SIZE; i++) {
+		key = value = i;
+		assert(bpf_map_update_elem(fd, &key, &value, BPF_NOEXIST) == 0);
+	}
+
+	/* The map is full, so a new key must not fit... */
+	key = MAP_SIZE;
+	assert(bpf_map_update_elem(fd, &key, &value, BPF_ANY) == -1 &&
+	       errno == E2BIG);
+
+	/* ... but every existing key can still be updated concurrently. */
+	run_parallel(LOCKLESS_TASKS, test_update_full, &fd);
+
+	for (i = 0; i < MAP_SIZE; i++) {
+		key = i;
+		assert(bpf_map_lookup_elem(fd, &key, &value) == 0 &&
+		       value < LOCKLESS_TASKS);
+	}
+
+	key = MAP_SIZE;
+	assert(bpf_map_update_elem(fd, &key, &value, BPF_ANY) == -1 &&
+	       errno == E2BIG);
+
+	/* Deleting a key makes room for exactly one new key. */
+	key = 0;
+	assert(bpf_map_delete_elem(fd, &key) == 0);
+	key = MAP_SIZE;
+	assert(bpf_map_update_elem(fd, &key, &value, BPF_NOEXIST) == 0);
+	key = MAP_SIZE + 1;
+	assert(bpf_map_update_elem(fd, &key, &value, BPF_NOEXIST) == -1 &&
+	       errno == E2BIG);
+
+	close(fd);
+}
+
 static void test_map_rdonly(void)
 {
 	int fd, key = 0, value = 0;
@@ -1740,6 +1902,7 @@ static void run_all_tests(void)
 
 	test_map_large();
 	test_map_parallel();
+	test_map_lockless_full();
 	test_map_stress();
 
 	test_map_rdonly();
@@ -1749,6 +1912,7 @@ static void run_all_tests(void)
 
 	test_queuemap(0, NULL);
 	test_stackmap(0, NULL);
+	test_bloom_filter_map(0, NULL);
 
 	test_map_in_map();
 }
@@ -0,0 +1,184 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Measures how THP faults fare on fragmented memory, to compare settings
+ * of vm.compaction_proactiveness.
+ *
+ * The benchmark fragments -f MB of memory by faulting it in as small pages
+ * and then freeing every other page, waits -w seconds to give kcompactd a
+ * chance to compact proactively, and faults in -t MB with MADV_HUGEPAGE.
+ * It reports the THP fault success rate, the direct compaction stalls the
+ * faults took and how long they stalled, and the proactive compaction
+ * passes kcompactd ran in the meantime, e.g.
+ *
+ *   echo 0 > /proc/sys/vm/compaction_proactiveness
+ *   ./compaction_bench -f 4096 -t 1024 -w 30
+ *   echo 60 > /proc/sys/vm/compaction_proactiveness
+ *   ./compaction_bench -f 4096 -t 1024 -w 30
+ *
+ * -f should be a good part of the free memory for the fragmentation to
+ * matter.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HPAGE_SIZE	(2UL << 20)
+
+static size_t frag_mb = 1024;
+static size_t thp_mb = 512;
+static int wait_secs = 10;
+
+enum {
+	THP_FAULT_ALLOC,
+	THP_FAULT_FALLBACK,
+	COMPACT_STALL,
+	COMPACT_STALL_US,
+	COMPACT_SUCCESS,
+	COMPACT_DAEMON_PROACTIVE,
+	COMPACT_DAEMON_PROACTIVE_DEFERRED,
+	NR_EVENTS,
+};
+
+static const char * const event_names[NR_EVENTS] = {
+	"thp_fault_alloc",
+	"thp_fault_fallback",
+	"compact_stall",
+	"compact_stall_us",
+	"compact_success",
+	"compact_daemon_proactive",
+	"compact_daemon_proactive_deferred",
+};
+
+static void read_events(unsigned long long *vals)
+{
+	unsigned long long v;
+	char key[64];
+	FILE *f;
+	int i;
+
+	memset(vals, 0, NR_EVENTS * sizeof(*vals));
+	f = fopen("/proc/vmstat", "r");
+	if (!f)
+		return;
+
+	while (fscanf(f, "%63s %llu", key, &v) == 2) {
+		for (i = 0; i < NR_EVENTS; i++) {
+			if (!strcmp(key, event_names[i]))
+				vals[i] = v;
+		}
+	}
+	fclose(f);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Leave every other page of the region allocated */
+static char *fragment(size_t size, size_t page_size)
+{
+	size_t off;
+	char *p;
+
+	p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		return NULL;
+
+	madvise(p, size, MADV_NOHUGEPAGE);
+	for (off = 0; off < size; off += page_size)
+		p[off] = 1;
+	for (off = 0; off < size; off += 2 * page_size)
+		madvise(p + off, page_size, MADV_DONTNEED);
+
+	return p;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-f fragmented MB] [-t THP MB] [-w seconds to wait]\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long before[NR_EVENTS], after[NR_EVENTS], d[NR_EVENTS];
+	size_t page_size = getpagesize(), size, off;
+	char *frag, *map, *mem;
+	double start, secs;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "f:t:w:")) != -1) {
+		switch (opt) {
+		case 'f':
+			frag_mb = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			thp_mb = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			wait_secs = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!thp_mb || wait_secs < 0)
+		usage(argv[0]);
+
+	read_events(before);
+	frag = fragment(frag_mb << 20, page_size);
+	if (frag_mb && !frag) {
+		perror("mmap");
+		return 1;
+	}
+	sleep(wait_secs);
+
+	size = thp_mb << 20;
+	map = mmap(NULL, size + HPAGE_SIZE, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	mem = (char *)(((unsigned long)map + HPAGE_SIZE - 1) &
+		       ~(HPAGE_SIZE - 1));
+	madvise(mem, size, MADV_HUGEPAGE);
+
+	start = now();
+	for (off = 0; off < size; off += page_size)
+		mem[off] = 1;
+	secs = now() - start;
+	read_events(after);
+
+	for (i = 0; i < NR_EVENTS; i++)
+		d[i] = after[i] - before[i];
+
+	printf("%zu MB fragmented, %d s wait, %zu MB THP faults in %.2f s\n",
+	       frag_mb, wait_secs, thp_mb, secs);
+	printf("thp fault success    %11.1f%% (%llu of %llu)\n",
+	       d[THP_FAULT_ALLOC] + d[THP_FAULT_FALLBACK] ?
+	       100.0 * d[THP_FAULT_ALLOC] /
+	       (d[THP_FAULT_ALLOC] + d[THP_FAULT_FALLBACK]) : 0,
+	       d[THP_FAULT_ALLOC], d[THP_FAULT_ALLOC] + d[THP_FAULT_FALLBACK]);
+	printf("compact stalls       %12llu (%llu succeeded)\n",
+	       d[COMPACT_STALL], d[COMPACT_SUCCESS]);
+	printf("compact stall ms     %12.1f\n", d[COMPACT_STALL_US] / 1e3);
+	printf("proactive passes     %12llu (%llu checks deferred)\n",
+	       d[COMPACT_DAEMON_PROACTIVE],
+	       d[COMPACT_DAEMON_PROACTIVE_DEFERRED]);
+
+	munmap(map, size + HPAGE_SIZE);
+	if (frag)
+		munmap(frag, frag_mb << 20);
+	return 0;
+}
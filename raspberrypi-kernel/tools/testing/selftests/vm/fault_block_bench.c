@@ -0,0 +1,235 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Measures the effect of anon_block_order on anon faults and of block
+ * allocated readahead on sequential file reads.
+ *
+ * The anon pass writes one byte to every page of a fresh anon region. The
+ * region is marked MADV_HUGEPAGE, which the blocks need unless THP is set
+ * to always, and split into 1M VMAs by PROT_NONE guard pages, so that no
+ * PMD fits and THP faults don't hide the blocks. The
+ * file pass drops the page cache of a test file, reads it sequentially with
+ * read() and then reads it again through a private mapping. Each pass
+ * reports its time, the minor faults it took and, where the PMU offers the
+ * event, its dTLB read misses, e.g.
+ *
+ *   echo 4 > /sys/kernel/mm/transparent_hugepage/anon_block_order
+ *   ./fault_block_bench -s 256 -f /mnt/fault_block_bench.dat
+ *
+ * Run it once with anon_block_order set to 0 for the baseline.
+ */
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+static size_t size_mb = 256;
+static const char *file_path;
+
+static size_t page_size;
+
+struct sample {
+	struct timespec ts;
+	long minflt;
+	long long tlb_misses;
+};
+
+static int tlb_fd = -1;
+
+static void open_tlb_counter(void)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.config = PERF_COUNT_HW_CACHE_DTLB |
+		      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+		      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	tlb_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void take_sample(struct sample *s)
+{
+	struct rusage ru;
+
+	s->tlb_misses = -1;
+	if (tlb_fd >= 0 &&
+	    read(tlb_fd, &s->tlb_misses, sizeof(s->tlb_misses)) !=
+	    sizeof(s->tlb_misses))
+		s->tlb_misses = -1;
+	getrusage(RUSAGE_SELF, &ru);
+	s->minflt = ru.ru_minflt;
+	clock_gettime(CLOCK_MONOTONIC, &s->ts);
+}
+
+static void report(const char *name, struct sample *start, struct sample *end)
+{
+	double secs = end->ts.tv_sec - start->ts.tv_sec +
+		      (end->ts.tv_nsec - start->ts.tv_nsec) / 1e9;
+
+	printf("%-10s %10.1f %10.0f %10ld", name, secs * 1e3, size_mb / secs,
+	       end->minflt - start->minflt);
+	if (start->tlb_misses >= 0 && end->tlb_misses >= 0)
+		printf(" %14lld\n", end->tlb_misses - start->tlb_misses);
+	else
+		printf(" %14s\n", "n/a");
+}
+
+#define ANON_CHUNK	(1UL << 20)
+
+static int anon_pass(void)
+{
+	size_t stride = ANON_CHUNK + page_size, size = size_mb * stride;
+	struct sample start, end;
+	size_t chunk, off;
+	char *p;
+
+	p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	for (chunk = 0; chunk < size_mb; chunk++) {
+		if (mprotect(p + chunk * stride + ANON_CHUNK, page_size,
+			     PROT_NONE)) {
+			perror("mprotect");
+			goto err;
+		}
+	}
+	if (madvise(p, size, MADV_HUGEPAGE)) {
+		perror("madvise");
+		goto err;
+	}
+
+	take_sample(&start);
+	for (chunk = 0; chunk < size_mb; chunk++)
+		for (off = 0; off < ANON_CHUNK; off += page_size)
+			p[chunk * stride + off] = 1;
+	take_sample(&end);
+	report("anon", &start, &end);
+
+	munmap(p, size);
+	return 0;
+err:
+	munmap(p, size);
+	return 1;
+}
+
+static int create_file(int fd)
+{
+	size_t len = 1 << 20, done;
+	char *buf;
+
+	buf = malloc(len);
+	if (!buf)
+		return 1;
+	memset(buf, 0x5a, len);
+	for (done = 0; done < size_mb; done++) {
+		if (write(fd, buf, len) != (ssize_t)len) {
+			perror("write");
+			free(buf);
+			return 1;
+		}
+	}
+	free(buf);
+	fsync(fd);
+	return 0;
+}
+
+static int file_pass(void)
+{
+	size_t size = size_mb << 20, off, len = 1 << 20;
+	struct sample start, end;
+	volatile char sum = 0;
+	char *buf, *p;
+	int fd;
+
+	fd = open(file_path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		perror("open");
+		return 1;
+	}
+	buf = malloc(len);
+	if (!buf || create_file(fd))
+		goto err;
+
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	lseek(fd, 0, SEEK_SET);
+	take_sample(&start);
+	while (read(fd, buf, len) > 0)
+		;
+	take_sample(&end);
+	report("read", &start, &end);
+
+	posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+	p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (p == MAP_FAILED) {
+		perror("mmap");
+		goto err;
+	}
+	take_sample(&start);
+	for (off = 0; off < size; off += page_size)
+		sum += p[off];
+	take_sample(&end);
+	report("mmap read", &start, &end);
+
+	munmap(p, size);
+	free(buf);
+	close(fd);
+	unlink(file_path);
+	return 0;
+err:
+	free(buf);
+	close(fd);
+	unlink(file_path);
+	return 1;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-s size in MB] [-f test file]\n", prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "s:f:")) != -1) {
+		switch (opt) {
+		case 's':
+			size_mb = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			file_path = optarg;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!size_mb)
+		usage(argv[0]);
+
+	page_size = getpagesize();
+	open_tlb_counter();
+
+	printf("%zu MB per pass\n", size_mb);
+	printf("pass             ms       MB/s     faults    dTLB misses\n");
+	if (anon_pass())
+		return 1;
+	if (file_path && file_pass())
+		return 1;
+
+	return 0;
+}
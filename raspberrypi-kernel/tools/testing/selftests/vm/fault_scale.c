@@ -0,0 +1,206 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Measures how anon page faults scale with the number of faulting threads.
+ *
+ * Like will-it-scale's page_fault1, every thread touches each page of its
+ * own anon region, in a loop. The region is dropped with MADV_DONTNEED
+ * rather than munmap(), so that the loop doesn't take mmap_lock for write.
+ * With -m, one more thread keeps calling mmap() and munmap() on a small
+ * unrelated region, which takes mmap_lock for write and stalls the faults
+ * that need mmap_lock, e.g.
+ *
+ *   ./fault_scale -t 8 -d 5 -m
+ *
+ * It runs with 1 to -t threads and reports the fault rate of each run, and
+ * how many of the faults /proc/vmstat counted as handled under the VMA lock
+ * (vma_lock_success) rather than under mmap_lock.
+ */
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+static size_t size_mb = 64;
+static int max_threads;
+static int duration = 5;
+static bool mmap_churn;
+
+static size_t page_size;
+static volatile bool stop;
+
+struct worker {
+	pthread_t thread;
+	char *region;
+	unsigned long long faults;
+};
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	size_t size = size_mb << 20, off;
+
+	while (!stop) {
+		for (off = 0; off < size && !stop; off += page_size) {
+			w->region[off] = 1;
+			w->faults++;
+		}
+		madvise(w->region, size, MADV_DONTNEED);
+	}
+
+	return NULL;
+}
+
+static void *churn_fn(void *arg)
+{
+	unsigned long long *ops = arg;
+	char *p;
+
+	while (!stop) {
+		p = mmap(NULL, page_size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			break;
+		*p = 1;
+		munmap(p, page_size);
+		(*ops)++;
+	}
+
+	return NULL;
+}
+
+static unsigned long long read_vmstat(const char *name)
+{
+	unsigned long long val = 0, v;
+	char key[64];
+	FILE *f;
+
+	f = fopen("/proc/vmstat", "r");
+	if (!f)
+		return 0;
+
+	while (fscanf(f, "%63s %llu", key, &v) == 2) {
+		if (!strcmp(key, name)) {
+			val = v;
+			break;
+		}
+	}
+	fclose(f);
+	return val;
+}
+
+static int run(int nr_threads, struct worker *workers)
+{
+	unsigned long long faults = 0, churn_ops = 0, spf;
+	struct timespec start, end;
+	pthread_t churn;
+	double secs;
+	int i;
+
+	stop = false;
+	spf = read_vmstat("vma_lock_success");
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < nr_threads; i++) {
+		workers[i].faults = 0;
+		if (pthread_create(&workers[i].thread, NULL, worker_fn,
+				   &workers[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+	if (mmap_churn && pthread_create(&churn, NULL, churn_fn, &churn_ops)) {
+		perror("pthread_create");
+		return 1;
+	}
+
+	sleep(duration);
+	stop = true;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		faults += workers[i].faults;
+	}
+	if (mmap_churn)
+		pthread_join(churn, NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	secs = end.tv_sec - start.tv_sec + (end.tv_nsec - start.tv_nsec) / 1e9;
+	spf = read_vmstat("vma_lock_success") - spf;
+
+	printf("%7d %14.0f %14.0f %9.1f%%", nr_threads, faults / secs,
+	       faults / secs / nr_threads, faults ? 100.0 * spf / faults : 0);
+	if (mmap_churn)
+		printf(" %12.0f", churn_ops / secs);
+	printf("\n");
+
+	return 0;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-s region size in MB] [-t max threads] [-d seconds] [-m]\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct worker *workers;
+	int opt, i;
+
+	max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	while ((opt = getopt(argc, argv, "s:t:d:m")) != -1) {
+		switch (opt) {
+		case 's':
+			size_mb = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			max_threads = atoi(optarg);
+			break;
+		case 'd':
+			duration = atoi(optarg);
+			break;
+		case 'm':
+			mmap_churn = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!size_mb || max_threads < 1 || duration < 1)
+		usage(argv[0]);
+
+	page_size = getpagesize();
+	workers = calloc(max_threads, sizeof(*workers));
+	if (!workers) {
+		perror("calloc");
+		return 1;
+	}
+
+	for (i = 0; i < max_threads; i++) {
+		workers[i].region = mmap(NULL, size_mb << 20,
+					 PROT_READ | PROT_WRITE,
+					 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (workers[i].region == MAP_FAILED) {
+			perror("mmap");
+			return 1;
+		}
+		/* keep THP from hiding the per-page faults */
+		madvise(workers[i].region, size_mb << 20, MADV_NOHUGEPAGE);
+	}
+
+	printf("region %zu MB per thread, %d s per run%s\n", size_mb, duration,
+	       mmap_churn ? ", with mmap/munmap churn" : "");
+	printf("threads       faults/s   per thread/s  vma lock%s\n",
+	       mmap_churn ? "  mmap+munmap/s" : "");
+	for (i = 1; i <= max_threads; i++)
+		if (run(i, workers))
+			return 1;
+
+	return 0;
+}
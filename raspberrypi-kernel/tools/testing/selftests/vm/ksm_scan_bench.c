@@ -0,0 +1,193 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Measures how fast ksmd scans and merges.
+ *
+ * The benchmark maps an anon region with MADV_MERGEABLE, in which -d
+ * percent of the pages repeat one of a few contents and the rest are
+ * unique, runs ksmd flat out (sleep_millisecs 0) for -n full scans and
+ * reports the pages scanned per second, the merges per second and, where
+ * the kernel exports them, how many stable tree searches were skipped by
+ * the checksum filter, e.g.
+ *
+ *   ./ksm_scan_bench -s 1024 -d 25 -n 3
+ *
+ * It needs root. The ksm settings are restored and the region is unmerged
+ * on exit.
+ */
+#define _GNU_SOURCE
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#define KSM_DIR		"/sys/kernel/mm/ksm/"
+#define NR_CONTENTS	16
+
+static size_t size_mb = 256;
+static unsigned int dup_percent = 25;
+static unsigned int nr_scans = 3;
+static unsigned int pages_to_scan = 1000;
+static int timeout = 600;
+
+static long ksm_read(const char *name)
+{
+	char path[128];
+	long val = -1;
+	FILE *f;
+
+	snprintf(path, sizeof(path), KSM_DIR "%s", name);
+	f = fopen(path, "r");
+	if (!f)
+		return -1;
+	if (fscanf(f, "%ld", &val) != 1)
+		val = -1;
+	fclose(f);
+	return val;
+}
+
+static int ksm_write(const char *name, long val)
+{
+	char path[128];
+	FILE *f;
+	int ret;
+
+	snprintf(path, sizeof(path), KSM_DIR "%s", name);
+	f = fopen(path, "w");
+	if (!f)
+		return -1;
+	ret = fprintf(f, "%ld", val) < 0 ? -1 : 0;
+	if (fclose(f))
+		ret = -1;
+	return ret;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fill(char *mem, size_t nr_pages, size_t page_size)
+{
+	size_t i, j;
+
+	srand(1);
+	for (i = 0; i < nr_pages; i++) {
+		char *page = mem + i * page_size;
+
+		if ((unsigned int)(rand() % 100) < dup_percent) {
+			memset(page, 'a' + i % NR_CONTENTS, page_size);
+			continue;
+		}
+		/* unique, and different from the first byte on */
+		for (j = 0; j < page_size; j += sizeof(size_t))
+			*(size_t *)(page + j) = i * page_size + j + 1;
+	}
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-s size in MB] [-d duplicate percent] [-n full scans] [-p pages_to_scan] [-t timeout]\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	long old_run, old_sleep, old_pages, scans0, scanned0, sharing0, skipped0;
+	long scans, scanned, sharing, skipped;
+	size_t size, page_size = getpagesize();
+	double start, secs;
+	char *mem;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "s:d:n:p:t:")) != -1) {
+		switch (opt) {
+		case 's':
+			size_mb = strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			dup_percent = atoi(optarg);
+			break;
+		case 'n':
+			nr_scans = atoi(optarg);
+			break;
+		case 'p':
+			pages_to_scan = atoi(optarg);
+			break;
+		case 't':
+			timeout = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!size_mb || dup_percent > 100 || !nr_scans || !pages_to_scan)
+		usage(argv[0]);
+
+	old_run = ksm_read("run");
+	old_sleep = ksm_read("sleep_millisecs");
+	old_pages = ksm_read("pages_to_scan");
+	if (old_run < 0 || ksm_write("run", old_run)) {
+		fprintf(stderr, "ksm is not available or we are not root\n");
+		return 4;
+	}
+
+	size = size_mb << 20;
+	mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+	fill(mem, size / page_size, page_size);
+	if (madvise(mem, size, MADV_MERGEABLE)) {
+		perror("madvise");
+		return 1;
+	}
+
+	ksm_write("sleep_millisecs", 0);
+	ksm_write("pages_to_scan", pages_to_scan);
+
+	scans0 = ksm_read("full_scans");
+	scanned0 = ksm_read("pages_scanned");
+	sharing0 = ksm_read("pages_sharing");
+	skipped0 = ksm_read("stable_skipped");
+	start = now();
+	ksm_write("run", 1);
+
+	do {
+		usleep(100000);
+		scans = ksm_read("full_scans");
+		secs = now() - start;
+	} while (scans - scans0 < nr_scans && secs < timeout);
+
+	scanned = ksm_read("pages_scanned");
+	sharing = ksm_read("pages_sharing");
+	skipped = ksm_read("stable_skipped");
+	ksm_write("run", 0);
+
+	printf("%zu MB, %u%% duplicates, %ld full scans in %.1f s\n", size_mb,
+	       dup_percent, scans - scans0, secs);
+	if (scanned >= 0)
+		printf("pages scanned/s   %12.0f\n", (scanned - scanned0) / secs);
+	else	/* no pages_scanned, estimate from the full scans */
+		printf("pages scanned/s   %12.0f (estimated)\n",
+		       (scans - scans0) * (double)(size / page_size) / secs);
+	printf("pages merged/s    %12.0f\n", (sharing - sharing0) / secs);
+	printf("pages_sharing     %12ld\n", sharing);
+	if (skipped >= 0)
+		printf("stable_skipped    %12ld\n", skipped - skipped0);
+
+	ksm_write("run", 2);
+	ksm_write("pages_to_scan", old_pages);
+	ksm_write("sleep_millisecs", old_sleep);
+	ksm_write("run", old_run);
+
+	return scans - scans0 < nr_scans;
+}
@@ -0,0 +1,279 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Functional test for the multi-gen LRU.
+ *
+ * Checks that /sys/kernel/mm/lru_gen/enabled can be switched at runtime,
+ * then runs a child in a memcg whose memory.max is well below the data it
+ * streams through. The child maps a small "hot" file and a large "cold"
+ * one, touches every hot page through its page tables after each chunk of
+ * the cold file and reads the cold file once. The hot pages are only ever
+ * referenced through the mapping, so keeping them resident relies on the
+ * aging walking the child's mm, which sits on the memcg's mm list only
+ * after the child moved itself into the memcg. All the pages are checked
+ * for their content as they are read back.
+ *
+ * The files are created in the given directory, which should be on a
+ * block device backed filesystem so that clean pages can be reclaimed
+ * without swap:
+ *
+ *   ./lru_gen [dir]
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../kselftest.h"
+
+#define LRU_GEN_ENABLED	"/sys/kernel/mm/lru_gen/enabled"
+#define CGROUP		"/sys/fs/cgroup/lru_gen_test"
+
+#define HOT_MB		16
+#define COLD_MB		256
+#define MEMORY_MAX_MB	64
+#define CHUNK_MB	1
+/* the share of the hot pages that has to be resident at the end */
+#define HOT_RESIDENT_PCT	90
+
+static size_t page_size;
+
+static int write_file(const char *path, const char *buf)
+{
+	ssize_t ret;
+	int fd;
+
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return -errno;
+	ret = write(fd, buf, strlen(buf));
+	if (ret < 0)
+		ret = -errno;
+	close(fd);
+
+	return ret < 0 ? ret : 0;
+}
+
+static int read_file(const char *path, char *buf, size_t len)
+{
+	ssize_t ret;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+	ret = read(fd, buf, len - 1);
+	if (ret < 0)
+		ret = -errno;
+	else
+		buf[ret] = '\0';
+	close(fd);
+
+	return ret < 0 ? ret : 0;
+}
+
+static bool set_enabled(const char *val)
+{
+	char buf[16];
+
+	if (write_file(LRU_GEN_ENABLED, val))
+		return false;
+	if (read_file(LRU_GEN_ENABLED, buf, sizeof(buf)))
+		return false;
+
+	return buf[0] == val[0];
+}
+
+/* the first byte of each page names the file and the page */
+static char page_tag(int file, size_t idx)
+{
+	return (file * 131 + idx) & 0xff;
+}
+
+static int create_file(const char *path, int file, size_t size)
+{
+	char *page;
+	size_t i;
+	int fd;
+
+	fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0)
+		return -1;
+
+	page = calloc(1, page_size);
+	if (!page)
+		goto err;
+	for (i = 0; i < size / page_size; i++) {
+		page[0] = page_tag(file, i);
+		if (write(fd, page, page_size) != (ssize_t)page_size)
+			goto err;
+	}
+	free(page);
+	page = NULL;
+
+	/* start cold, so that the child's memcg is charged for the pages */
+	if (fsync(fd) || posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED))
+		goto err;
+
+	return fd;
+err:
+	free(page);
+	close(fd);
+	return -1;
+}
+
+static bool touch_pages(const char *mem, int file, size_t start, size_t end)
+{
+	size_t i;
+
+	for (i = start; i < end; i++) {
+		if (*(volatile const char *)(mem + i * page_size) !=
+		    page_tag(file, i)) {
+			ksft_print_msg("page %zu of file %d is corrupted\n",
+				       i, file);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static int run_workload(int hot_fd, int cold_fd)
+{
+	size_t nr_hot = (HOT_MB << 20) / page_size;
+	size_t nr_cold = (COLD_MB << 20) / page_size;
+	size_t chunk = (CHUNK_MB << 20) / page_size;
+	size_t i, resident = 0;
+	unsigned char *vec;
+	char *hot, *cold;
+
+	if (write_file(CGROUP "/cgroup.procs", "0")) {
+		ksft_print_msg("can't move into " CGROUP "\n");
+		return KSFT_FAIL;
+	}
+
+	hot = mmap(NULL, nr_hot * page_size, PROT_READ, MAP_SHARED, hot_fd, 0);
+	cold = mmap(NULL, nr_cold * page_size, PROT_READ, MAP_SHARED,
+		    cold_fd, 0);
+	vec = malloc(nr_hot);
+	if (hot == MAP_FAILED || cold == MAP_FAILED || !vec) {
+		ksft_print_msg("mmap: %s\n", strerror(errno));
+		return KSFT_FAIL;
+	}
+
+	if (!touch_pages(hot, 0, 0, nr_hot))
+		return KSFT_FAIL;
+
+	for (i = 0; i < nr_cold; i += chunk) {
+		if (!touch_pages(cold, 1, i, i + chunk) ||
+		    !touch_pages(hot, 0, 0, nr_hot))
+			return KSFT_FAIL;
+	}
+
+	if (mincore(hot, nr_hot * page_size, vec)) {
+		ksft_print_msg("mincore: %s\n", strerror(errno));
+		return KSFT_FAIL;
+	}
+	for (i = 0; i < nr_hot; i++)
+		resident += vec[i] & 1;
+
+	ksft_print_msg("%zu of %zu hot pages resident\n", resident, nr_hot);
+	if (resident * 100 < nr_hot * HOT_RESIDENT_PCT)
+		return KSFT_FAIL;
+
+	return KSFT_PASS;
+}
+
+int main(int argc, char **argv)
+{
+	const char *dir = argc > 1 ? argv[1] : ".";
+	char hot_path[PATH_MAX], cold_path[PATH_MAX];
+	int hot_fd = -1, cold_fd = -1, status;
+	int ret = KSFT_FAIL;
+	char old[16], buf[32];
+	pid_t pid;
+
+	page_size = getpagesize();
+	snprintf(hot_path, sizeof(hot_path), "%s/lru_gen.hot", dir);
+	snprintf(cold_path, sizeof(cold_path), "%s/lru_gen.cold", dir);
+
+	if (geteuid()) {
+		ksft_print_msg("Please run this test as root\n");
+		return KSFT_SKIP;
+	}
+
+	if (read_file(LRU_GEN_ENABLED, old, sizeof(old))) {
+		ksft_print_msg("multi-gen LRU is not available\n");
+		return KSFT_SKIP;
+	}
+
+	if (read_file("/sys/fs/cgroup/cgroup.controllers", buf, sizeof(buf)) ||
+	    !strstr(buf, "memory")) {
+		ksft_print_msg("cgroup2 with the memory controller is not mounted\n");
+		return KSFT_SKIP;
+	}
+
+	/* switching moves the pages of all lruvecs between the two lists */
+	if (!set_enabled("0") || !set_enabled("1") ||
+	    !set_enabled("0") || !set_enabled("1")) {
+		ksft_print_msg("can't switch " LRU_GEN_ENABLED "\n");
+		goto out;
+	}
+
+	hot_fd = create_file(hot_path, 0, HOT_MB << 20);
+	cold_fd = create_file(cold_path, 1, COLD_MB << 20);
+	if (hot_fd < 0 || cold_fd < 0) {
+		ksft_print_msg("can't create the files in %s\n", dir);
+		ret = KSFT_SKIP;
+		goto out;
+	}
+
+	write_file("/sys/fs/cgroup/cgroup.subtree_control", "+memory");
+	if (mkdir(CGROUP, 0755) && errno != EEXIST) {
+		ksft_print_msg("mkdir " CGROUP ": %s\n", strerror(errno));
+		goto out;
+	}
+	snprintf(buf, sizeof(buf), "%d", MEMORY_MAX_MB << 20);
+	if (write_file(CGROUP "/memory.max", buf)) {
+		ksft_print_msg("can't set memory.max\n");
+		goto out_rmdir;
+	}
+
+	pid = fork();
+	if (pid < 0) {
+		ksft_print_msg("fork: %s\n", strerror(errno));
+		goto out_rmdir;
+	}
+	if (!pid)
+		exit(run_workload(hot_fd, cold_fd));
+
+	if (waitpid(pid, &status, 0) == pid && WIFEXITED(status))
+		ret = WEXITSTATUS(status);
+
+out_rmdir:
+	rmdir(CGROUP);
+out:
+	if (hot_fd >= 0)
+		close(hot_fd);
+	if (cold_fd >= 0)
+		close(cold_fd);
+	unlink(hot_path);
+	unlink(cold_path);
+	write_file(LRU_GEN_ENABLED, old);
+
+	if (ret == KSFT_PASS)
+		ksft_print_msg("[PASS]\n");
+	else if (ret == KSFT_SKIP)
+		ksft_print_msg("[SKIP]\n");
+	else
+		ksft_print_msg("[FAIL]\n");
+
+	return ret;
+}
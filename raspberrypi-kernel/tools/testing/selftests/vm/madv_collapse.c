@@ -0,0 +1,137 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Checks that MADV_COLLAPSE collapses a range of small anon pages into
+ * huge pages right away, without waiting for khugepaged.
+ *
+ * The test maps an aligned region with MADV_NOHUGEPAGE so that the faults
+ * only populate small pages, then drops the opt out, touches a single page
+ * of every pmd range, which leaves the ranges far below khugepaged's
+ * max_ptes_none and cold, and asks for the collapse. AnonHugePages of the
+ * region in /proc/self/smaps has to cover all of it afterwards and the
+ * contents have to survive. The thp_collapse_{cold,warm,hot} events of
+ * /proc/vmstat show how the collapses were bucketed.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../kselftest.h"
+
+#ifndef MADV_COLLAPSE
+#define MADV_COLLAPSE	25
+#endif
+
+#define HPAGE_SIZE	(2UL << 20)
+#define NR_HPAGES	8
+
+static unsigned long long read_vmstat(const char *name)
+{
+	unsigned long long val = 0, v;
+	char key[64];
+	FILE *f;
+
+	f = fopen("/proc/vmstat", "r");
+	if (!f)
+		return 0;
+
+	while (fscanf(f, "%63s %llu", key, &v) == 2) {
+		if (!strcmp(key, name)) {
+			val = v;
+			break;
+		}
+	}
+	fclose(f);
+	return val;
+}
+
+/* AnonHugePages of the mapping that starts at addr, in kB */
+static long smaps_anon_huge_kb(void *addr)
+{
+	unsigned long start, end;
+	bool found = false;
+	char line[256];
+	long kb = -1;
+	FILE *f;
+
+	f = fopen("/proc/self/smaps", "r");
+	if (!f)
+		return -1;
+
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%lx-%lx", &start, &end) == 2) {
+			found = start == (unsigned long)addr;
+			continue;
+		}
+		if (found && sscanf(line, "AnonHugePages: %ld kB", &kb) == 1)
+			break;
+	}
+	fclose(f);
+	return kb;
+}
+
+int main(void)
+{
+	static const char *events[] = {
+		"thp_collapse_cold", "thp_collapse_warm", "thp_collapse_hot",
+	};
+	unsigned long long before[3];
+	size_t size = NR_HPAGES * HPAGE_SIZE, page_size = getpagesize();
+	char *map, *mem;
+	long kb;
+	int i;
+
+	map = mmap(NULL, size + HPAGE_SIZE, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (map == MAP_FAILED) {
+		ksft_print_msg("mmap: %s\n", strerror(errno));
+		return KSFT_FAIL;
+	}
+
+	/* an empty range only checks that the advice is known */
+	if (madvise(map, 0, MADV_COLLAPSE)) {
+		ksft_print_msg("MADV_COLLAPSE is not supported\n");
+		return KSFT_SKIP;
+	}
+	mem = (char *)(((unsigned long)map + HPAGE_SIZE - 1) &
+		       ~(HPAGE_SIZE - 1));
+	munmap(map, mem - map);
+	munmap(mem + size, map + HPAGE_SIZE - mem);
+
+	madvise(mem, size, MADV_NOHUGEPAGE);
+	for (i = 0; i < NR_HPAGES; i++)
+		mem[i * HPAGE_SIZE + page_size] = i + 1;
+	madvise(mem, size, MADV_HUGEPAGE);
+
+	for (i = 0; i < 3; i++)
+		before[i] = read_vmstat(events[i]);
+
+	if (madvise(mem, size, MADV_COLLAPSE)) {
+		ksft_print_msg("MADV_COLLAPSE: %s\n", strerror(errno));
+		return KSFT_FAIL;
+	}
+
+	for (i = 0; i < NR_HPAGES; i++) {
+		if (mem[i * HPAGE_SIZE + page_size] != i + 1) {
+			ksft_print_msg("range %d is corrupted\n", i);
+			return KSFT_FAIL;
+		}
+	}
+
+	kb = smaps_anon_huge_kb(mem);
+	if (kb != (long)(size >> 10)) {
+		ksft_print_msg("AnonHugePages %ld kB, expected %zu kB\n",
+			       kb, size >> 10);
+		return KSFT_FAIL;
+	}
+
+	for (i = 0; i < 3; i++)
+		ksft_print_msg("%s +%llu\n", events[i],
+			       read_vmstat(events[i]) - before[i]);
+
+	return KSFT_PASS;
+}
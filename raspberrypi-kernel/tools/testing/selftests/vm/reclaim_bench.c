@@ -0,0 +1,235 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * A memcached-like workload for comparing page reclaim policies.
+ *
+ * The threads look up random items in a large anon "cache", with a skewed
+ * popularity so that a small part of the items gets most of the lookups,
+ * and update one item in every SET_RATIO lookups. Run it with swap (or
+ * zram) enabled and a cache size above the free memory of the system, so
+ * that kswapd does the reclaim, e.g. on a board booted with mem=2G:
+ *
+ *   echo 1 > /sys/kernel/mm/lru_gen/enabled
+ *   ./reclaim_bench -s 2560 -t 4 -d 60
+ *
+ * It reports the lookup throughput, the refaults and the pages scanned by
+ * kswapd and by direct reclaim from /proc/vmstat, the CPU time the kswapd
+ * threads used and the system time of the benchmark itself, which is where
+ * direct reclaim is charged. Under a memcg limit (memory.max) all of the
+ * reclaim is direct and the kswapd figures stay close to zero.
+ */
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#define ITEM_SIZE	1024
+#define SET_RATIO	10
+
+static size_t size_mb = 1024;
+static int nr_threads = 4;
+static int duration = 30;
+
+static char *cache;
+static size_t nr_items;
+static volatile bool stop;
+
+struct worker {
+	pthread_t thread;
+	unsigned long long ops;
+	unsigned int seed;
+};
+
+/* The lowest items are the most popular ones, about a cubic falloff */
+static size_t pick_item(unsigned int *seed)
+{
+	double u = (double)rand_r(seed) / RAND_MAX;
+
+	return (size_t)(u * u * u * (nr_items - 1));
+}
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	unsigned long long sum = 0;
+
+	while (!stop) {
+		char *item = cache + pick_item(&w->seed) * ITEM_SIZE;
+		int i;
+
+		if (w->ops % SET_RATIO == 0) {
+			memset(item, w->ops & 0xff, ITEM_SIZE);
+		} else {
+			for (i = 0; i < ITEM_SIZE; i += 64)
+				sum += item[i];
+		}
+		w->ops++;
+	}
+
+	/* keep the reads from being optimized out */
+	return (void *)(unsigned long)sum;
+}
+
+static unsigned long long read_vmstat(const char *name)
+{
+	unsigned long long val = 0, v;
+	char key[64];
+	FILE *f;
+
+	f = fopen("/proc/vmstat", "r");
+	if (!f)
+		return 0;
+
+	while (fscanf(f, "%63s %llu", key, &v) == 2) {
+		if (!strcmp(key, name)) {
+			val = v;
+			break;
+		}
+	}
+	fclose(f);
+	return val;
+}
+
+/* utime + stime of all the kswapd threads, in clock ticks */
+static unsigned long long kswapd_ticks(void)
+{
+	unsigned long long total = 0, utime, stime;
+	char path[300], buf[512], *p;
+	struct dirent *de;
+	DIR *dir;
+	FILE *f;
+
+	dir = opendir("/proc");
+	if (!dir)
+		return 0;
+
+	while ((de = readdir(dir))) {
+		if (de->d_name[0] < '0' || de->d_name[0] > '9')
+			continue;
+
+		snprintf(path, sizeof(path), "/proc/%s/stat", de->d_name);
+		f = fopen(path, "r");
+		if (!f)
+			continue;
+		p = fgets(buf, sizeof(buf), f);
+		fclose(f);
+		if (!p || !strstr(buf, "(kswapd"))
+			continue;
+
+		/* skip to the fields after the command name */
+		p = strrchr(buf, ')');
+		if (p && sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+				&utime, &stime) == 2)
+			total += utime + stime;
+	}
+	closedir(dir);
+	return total;
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-s cache size in MB] [-t threads] [-d seconds]\n",
+		prog);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long long refault_anon, refault_file, ticks, ops = 0;
+	unsigned long long scan_kswapd, scan_direct;
+	struct rusage ru_start, ru_end;
+	struct timespec start, end;
+	struct worker *workers;
+	double secs;
+	size_t item;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "s:t:d:")) != -1) {
+		switch (opt) {
+		case 's':
+			size_mb = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			nr_threads = atoi(optarg);
+			break;
+		case 'd':
+			duration = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (!size_mb || nr_threads < 1 || duration < 1)
+		usage(argv[0]);
+
+	nr_items = (size_mb << 20) / ITEM_SIZE;
+	cache = mmap(NULL, nr_items * ITEM_SIZE, PROT_READ | PROT_WRITE,
+		     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (cache == MAP_FAILED) {
+		perror("mmap");
+		return 1;
+	}
+
+	/* fill the cache once, which already pushes it past the limit */
+	for (item = 0; item < nr_items; item++)
+		memset(cache + item * ITEM_SIZE, item & 0xff, ITEM_SIZE);
+
+	workers = calloc(nr_threads, sizeof(*workers));
+	if (!workers) {
+		perror("calloc");
+		return 1;
+	}
+
+	refault_anon = read_vmstat("workingset_refault_anon");
+	refault_file = read_vmstat("workingset_refault_file");
+	scan_kswapd = read_vmstat("pgscan_kswapd");
+	scan_direct = read_vmstat("pgscan_direct");
+	ticks = kswapd_ticks();
+	getrusage(RUSAGE_SELF, &ru_start);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for (i = 0; i < nr_threads; i++) {
+		workers[i].seed = i + 1;
+		if (pthread_create(&workers[i].thread, NULL, worker_fn,
+				   &workers[i])) {
+			perror("pthread_create");
+			return 1;
+		}
+	}
+
+	sleep(duration);
+	stop = true;
+
+	for (i = 0; i < nr_threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		ops += workers[i].ops;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	getrusage(RUSAGE_SELF, &ru_end);
+	secs = end.tv_sec - start.tv_sec + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	printf("cache %zu MB, %d threads, %.1f s\n", size_mb, nr_threads, secs);
+	printf("throughput:      %.0f ops/s\n", ops / secs);
+	printf("refaults anon:   %llu\n",
+	       read_vmstat("workingset_refault_anon") - refault_anon);
+	printf("refaults file:   %llu\n",
+	       read_vmstat("workingset_refault_file") - refault_file);
+	printf("scanned kswapd:  %llu\n",
+	       read_vmstat("pgscan_kswapd") - scan_kswapd);
+	printf("scanned direct:  %llu\n",
+	       read_vmstat("pgscan_direct") - scan_direct);
+	printf("kswapd cpu:      %.1f%%\n",
+	       100.0 * (kswapd_ticks() - ticks) / sysconf(_SC_CLK_TCK) / secs);
+	printf("bench sys time:  %.1f s\n",
+	       ru_end.ru_stime.tv_sec - ru_start.ru_stime.tv_sec +
+	       (ru_end.ru_stime.tv_usec - ru_start.ru_stime.tv_usec) / 1e6);
+
+	return 0;
+}
@@ -0,0 +1,159 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Checks that memcg reclaim writes cold zswap entries back to the swap
+ * device and that the pages come back intact.
+ *
+ * The test moves itself into the given cgroup, fills an anon buffer with
+ * compressible but not same-filled pages and pushes it out with
+ * memory.reclaim. Once the pages sit in zswap, further reclaim has to go
+ * through the zswap shrinker, which should show up as zswpwb in the
+ * memory.stat of the cgroup. zswap_writeback.sh sets up the swap file,
+ * zswap and the cgroup before running it.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../kselftest.h"
+
+#define PATTERN_SIZE	64
+#define RECLAIM_ROUNDS	32
+
+static size_t page_size;
+
+static int cg_write(const char *cgroup, const char *file, const char *buf)
+{
+	char path[PATH_MAX];
+	ssize_t ret;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/%s", cgroup, file);
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return -errno;
+	ret = write(fd, buf, strlen(buf));
+	if (ret < 0)
+		ret = -errno;
+	close(fd);
+
+	return ret < 0 ? ret : 0;
+}
+
+static long cg_read_stat(const char *cgroup, const char *key)
+{
+	char path[PATH_MAX], name[64];
+	unsigned long val;
+	long ret = -1;
+	FILE *fp;
+
+	snprintf(path, sizeof(path), "%s/memory.stat", cgroup);
+	fp = fopen(path, "r");
+	if (!fp)
+		return -1;
+	while (fscanf(fp, "%63s %lu", name, &val) == 2) {
+		if (!strcmp(name, key)) {
+			ret = val;
+			break;
+		}
+	}
+	fclose(fp);
+
+	return ret;
+}
+
+/* repeats a short pattern that is unique to the page */
+static void fill_page(char *page, size_t idx)
+{
+	size_t i;
+
+	for (i = 0; i < page_size; i++)
+		page[i] = (idx + i % PATTERN_SIZE) & 0xff;
+}
+
+static bool check_page(const char *page, size_t idx)
+{
+	size_t i;
+
+	for (i = 0; i < page_size; i++)
+		if (page[i] != (char)((idx + i % PATTERN_SIZE) & 0xff))
+			return false;
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	long before, after = -1;
+	size_t size, nr_pages, i;
+	const char *cgroup;
+	char buf[64];
+	char *mem;
+	int round;
+
+	if (argc != 3) {
+		fprintf(stderr, "usage: %s <cgroup> <size in MiB>\n", argv[0]);
+		return KSFT_FAIL;
+	}
+	cgroup = argv[1];
+	size = strtoul(argv[2], NULL, 0) << 20;
+	page_size = getpagesize();
+	nr_pages = size / page_size;
+
+	snprintf(buf, sizeof(buf), "%d", getpid());
+	if (cg_write(cgroup, "cgroup.procs", buf)) {
+		ksft_print_msg("can't move into %s\n", cgroup);
+		return KSFT_SKIP;
+	}
+
+	before = cg_read_stat(cgroup, "zswpwb");
+	if (before < 0) {
+		ksft_print_msg("no zswpwb in memory.stat\n");
+		return KSFT_SKIP;
+	}
+
+	mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED) {
+		ksft_print_msg("mmap: %s\n", strerror(errno));
+		return KSFT_FAIL;
+	}
+	for (i = 0; i < nr_pages; i++)
+		fill_page(mem + i * page_size, i);
+
+	/* the first rounds fill zswap, the later ones have to write back */
+	snprintf(buf, sizeof(buf), "%zu type=anon", size);
+	for (round = 0; round < RECLAIM_ROUNDS; round++) {
+		int ret = cg_write(cgroup, "memory.reclaim", buf);
+
+		if (ret && ret != -EAGAIN) {
+			ksft_print_msg("memory.reclaim: %s\n", strerror(-ret));
+			return KSFT_SKIP;
+		}
+		after = cg_read_stat(cgroup, "zswpwb");
+		if (after > before)
+			break;
+	}
+
+	for (i = 0; i < nr_pages; i++) {
+		if (!check_page(mem + i * page_size, i)) {
+			ksft_print_msg("page %zu is corrupted\n", i);
+			return KSFT_FAIL;
+		}
+	}
+
+	if (after <= before) {
+		ksft_print_msg("no pages were written back in %d rounds\n",
+			       RECLAIM_ROUNDS);
+		return KSFT_FAIL;
+	}
+	ksft_print_msg("zswpwb %ld -> %ld after %d rounds\n",
+		       before, after, round + 1);
+
+	return KSFT_PASS;
+}
@@ -0,0 +1,83 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Runs zswap_writeback against a swap file on a real block device. It is
+# meant for a QEMU guest with a scratch virtio disk, e.g.
+#
+#   qemu-img create -f raw scratch.img 2G
+#   qemu-system-aarch64 ... -drive file=scratch.img,if=virtio,format=raw
+#
+# and, in the guest, with cgroup2 mounted on /sys/fs/cgroup:
+#
+#   mkfs.ext4 /dev/vdb && mount /dev/vdb /mnt
+#   ./zswap_writeback.sh /mnt
+#
+# Usage: zswap_writeback.sh <swap file dir> [test size in MiB]
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+
+SWAP_DIR=${1:-/mnt}
+SIZE_MB=${2:-128}
+SWAP_FILE=$SWAP_DIR/zswap_writeback.swap
+CGROUP=/sys/fs/cgroup/zswap_writeback
+ZSWAP=/sys/module/zswap/parameters
+
+if [ $UID != 0 ]; then
+	echo "Please run this test as root"
+	exit $ksft_skip
+fi
+
+if [ ! -d $ZSWAP ] || [ ! -f $ZSWAP/shrinker_enabled ]; then
+	echo "zswap with writeback shrinker is not available"
+	exit $ksft_skip
+fi
+
+if ! grep -qw memory /sys/fs/cgroup/cgroup.controllers 2>/dev/null; then
+	echo "cgroup2 with the memory controller is not mounted"
+	exit $ksft_skip
+fi
+
+old_enabled=$(cat $ZSWAP/enabled)
+old_shrinker=$(cat $ZSWAP/shrinker_enabled)
+
+cleanup() {
+	rmdir $CGROUP 2>/dev/null
+	swapoff $SWAP_FILE 2>/dev/null
+	rm -f $SWAP_FILE
+	echo $old_shrinker > $ZSWAP/shrinker_enabled
+	echo $old_enabled > $ZSWAP/enabled
+}
+trap cleanup EXIT
+
+# twice the test size, so that writeback never runs out of slots
+dd if=/dev/zero of=$SWAP_FILE bs=1M count=$((SIZE_MB * 2)) status=none || exit 1
+chmod 600 $SWAP_FILE
+mkswap $SWAP_FILE > /dev/null || exit 1
+if ! swapon $SWAP_FILE; then
+	echo "swapon failed, is $SWAP_DIR on a block device?"
+	exit $ksft_skip
+fi
+
+echo Y > $ZSWAP/enabled
+echo Y > $ZSWAP/shrinker_enabled
+
+echo +memory > /sys/fs/cgroup/cgroup.subtree_control
+mkdir $CGROUP || exit 1
+
+# run in a subshell so that the cgroup is empty again on exit
+(./zswap_writeback $CGROUP $SIZE_MB)
+ret=$?
+
+if [ -f /sys/kernel/debug/zswap/written_back_pages ]; then
+	echo "written_back_pages $(cat /sys/kernel/debug/zswap/written_back_pages)"
+fi
+
+if [ $ret -eq 0 ]; then
+	echo "[PASS]"
+elif [ $ret -eq $ksft_skip ]; then
+	echo "[SKIP]"
+else
+	echo "[FAIL]"
+fi
+exit $ret
@@ -0,0 +1,188 @@
+#!/bin/bash
+# SPDX-License-Identifier: GPL-2.0
+#
+# Checks the recompression (CONFIG_ZRAM_MULTI_COMP) and the writeback
+# (CONFIG_ZRAM_WRITEBACK) paths of zram on a device of its own: the pages
+# have to be recompressed or written back, as the mm_stat and bd_stat
+# counters show, and read back intact. Either part is skipped when the
+# kernel lacks the matching attributes.
+
+TCID="zram03"
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+
+SIZE_MB=32
+DATA=$(mktemp /tmp/zram03.data.XXXXXX)
+BACKING=""
+LOOP=""
+DEV=""
+ret=0
+
+if [ $UID != 0 ]; then
+	echo "$TCID: Please run this test as root"
+	exit $ksft_skip
+fi
+
+cleanup()
+{
+	[ -n "$DEV" ] && zram_remove
+	[ -n "$LOOP" ] && losetup -d $LOOP
+	rm -f $DATA $BACKING
+}
+trap cleanup EXIT
+
+# adds a new zram device and sets DEV and SYS
+zram_add()
+{
+	local id
+
+	id=$(cat /sys/class/zram-control/hot_add) || return 1
+	DEV=/dev/zram$id
+	SYS=/sys/block/zram$id
+}
+
+zram_remove()
+{
+	echo 1 > $SYS/reset
+	echo ${DEV#/dev/zram} > /sys/class/zram-control/hot_remove
+	DEV=""
+}
+
+# prints column $2 of the stat file $1
+zram_stat()
+{
+	awk -v col=$2 '{ print $col }' $SYS/$1
+}
+
+fill_device()
+{
+	dd if=$DATA of=$DEV bs=1M count=$SIZE_MB oflag=direct status=none
+}
+
+check_device()
+{
+	cmp -s -n $((SIZE_MB << 20)) $DATA \
+		<(dd if=$DEV bs=1M count=$SIZE_MB iflag=direct status=none)
+}
+
+test_recompress()
+{
+	local primary secondary alg pages
+
+	if [ ! -f $SYS/recomp_algorithm ]; then
+		echo "$TCID: recompress: CONFIG_ZRAM_MULTI_COMP is off [SKIP]"
+		return 0
+	fi
+
+	primary=lzo
+	for alg in zstd deflate lz4hc 842; do
+		if grep -qw $alg $SYS/comp_algorithm; then
+			secondary=$alg
+			break
+		fi
+	done
+	if ! grep -qw $primary $SYS/comp_algorithm || [ -z "$secondary" ]; then
+		echo "$TCID: recompress: no secondary algorithm available [SKIP]"
+		return 0
+	fi
+
+	echo $primary > $SYS/comp_algorithm || return 1
+	echo "algo=$secondary priority=1" > $SYS/recomp_algorithm || return 1
+	echo ${SIZE_MB}M > $SYS/disksize || return 1
+	fill_device || return 1
+
+	echo all > $SYS/idle || return 1
+	echo "type=idle" > $SYS/recompress || return 1
+
+	# a second pass must not find anything left to do
+	pages=$(zram_stat mm_stat 9)
+	echo "type=idle algo=$secondary" > $SYS/recompress || return 1
+
+	echo "$TCID: recompress: $primary -> $secondary: $pages pages," \
+	     "$(zram_stat mm_stat 10) bytes saved"
+	if [ "$pages" -eq 0 ]; then
+		echo "$TCID: recompress: no page was recompressed"
+		return 1
+	fi
+	if [ "$(zram_stat mm_stat 9)" -ne "$pages" ]; then
+		echo "$TCID: recompress: pages were recompressed twice"
+		return 1
+	fi
+	if ! check_device; then
+		echo "$TCID: recompress: data mismatch after recompression"
+		return 1
+	fi
+
+	return 0
+}
+
+test_writeback()
+{
+	local writes
+
+	if [ ! -f $SYS/backing_dev ]; then
+		echo "$TCID: writeback: CONFIG_ZRAM_WRITEBACK is off [SKIP]"
+		return 0
+	fi
+
+	BACKING=$(mktemp /tmp/zram03.backing.XXXXXX)
+	dd if=/dev/zero of=$BACKING bs=1M count=$((SIZE_MB * 2)) status=none
+	LOOP=$(losetup -f --show $BACKING) || return 1
+
+	echo $LOOP > $SYS/backing_dev || return 1
+	echo ${SIZE_MB}M > $SYS/disksize || return 1
+	fill_device || return 1
+
+	echo all > $SYS/idle || return 1
+	echo idle > $SYS/writeback || return 1
+	writes=$(zram_stat bd_stat 3)
+	echo "$TCID: writeback: idle: $writes pages written"
+	if [ "$writes" -eq 0 ]; then
+		echo "$TCID: writeback: no page was written back"
+		return 1
+	fi
+	if ! check_device; then
+		echo "$TCID: writeback: data mismatch after idle writeback"
+		return 1
+	fi
+
+	# age= needs CONFIG_ZRAM_MEMORY_TRACKING
+	fill_device || return 1
+	sleep 2
+	if echo age=1 > $SYS/writeback 2>/dev/null; then
+		echo "$TCID: writeback: age=1: $(($(zram_stat bd_stat 3) - writes))" \
+		     "pages written"
+		if [ "$(zram_stat bd_stat 3)" -le "$writes" ]; then
+			echo "$TCID: writeback: no page was written back by age"
+			return 1
+		fi
+		if ! check_device; then
+			echo "$TCID: writeback: data mismatch after age writeback"
+			return 1
+		fi
+	else
+		echo "$TCID: writeback: age=: CONFIG_ZRAM_MEMORY_TRACKING is off [SKIP]"
+	fi
+
+	return 0
+}
+
+if ! modprobe zram num_devices=0 2>/dev/null && [ ! -d /sys/class/zram-control ]; then
+	echo "$TCID: zram is not available [SKIP]"
+	exit $ksft_skip
+fi
+
+# compressible text, but no same-filled pages
+seq -f "zram03 %.0f" 1 $((SIZE_MB << 17)) | head -c $((SIZE_MB << 20)) > $DATA
+
+for t in test_recompress test_writeback; do
+	zram_add || exit 1
+	if ! $t; then
+		echo "$TCID: $t [FAIL]"
+		ret=1
+	fi
+	zram_remove
+done
+
+[ $ret -eq 0 ] && echo "$TCID: [PASS]"
+exit $ret